@@ -0,0 +1,902 @@
+//***************************************************************************************
+// BoundingVolumeHierarchy.cpp
+//***************************************************************************************
+
+#include "BoundingVolumeHierarchy.h"
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t BinCount = 16;
+
+	// Entries Traverse keeps on the stack before it spills to the heap.  Every node
+	// adds at most three entries, so this covers trees about 85 levels deep.
+	const std::uint32_t TraversalStackSize = 256;
+
+	// Half the surface area of a box, proportional to the chance that a random ray
+	// hits it.
+	float HalfArea(FXMVECTOR boxMin, FXMVECTOR boxMax)
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, XMVectorSubtract(boxMax, boxMin));
+		return d.x*d.y + d.y*d.z + d.z*d.x;
+	}
+
+	void GetMinMax(const BoundingBox& box, XMVECTOR& boxMin, XMVECTOR& boxMax)
+	{
+		XMVECTOR center = XMLoadFloat3(&box.Center);
+		XMVECTOR extents = XMLoadFloat3(&box.Extents);
+		boxMin = XMVectorSubtract(center, extents);
+		boxMax = XMVectorAdd(center, extents);
+	}
+
+	int Mask(FXMVECTOR v)
+	{
+		return _mm_movemask_ps(v);
+	}
+
+	// Distances at which a ray enters and leaves the slabs [boxMin, boxMax] of one axis,
+	// four boxes at a time.  When the direction along the axis is zero, or too small to
+	// invert, the ray is inside a slab for every distance or for none.
+	void RaySlab(FXMVECTOR boxMin, FXMVECTOR boxMax, FXMVECTOR origin, GXMVECTOR invDir, bool parallel,
+		XMVECTOR& tNear, XMVECTOR& tFar)
+	{
+		if(parallel)
+		{
+			XMVECTOR inSlab = XMVectorAndInt(XMVectorLessOrEqual(boxMin, origin), XMVectorLessOrEqual(origin, boxMax));
+			tNear = XMVectorSelect(g_XMInfinity, XMVectorNegate(g_XMInfinity), inSlab);
+			tFar = XMVectorSelect(XMVectorNegate(g_XMInfinity), g_XMInfinity, inSlab);
+			return;
+		}
+
+		XMVECTOR t0 = XMVectorMultiply(XMVectorSubtract(boxMin, origin), invDir);
+		XMVECTOR t1 = XMVectorMultiply(XMVectorSubtract(boxMax, origin), invDir);
+		tNear = XMVectorMin(t0, t1);
+		tFar = XMVectorMax(t0, t1);
+	}
+}
+
+void BoundingVolumeHierarchy::Build(const BoundingBox* boxes, std::uint32_t count)
+{
+	assert(count <= MaxItemCount);
+
+	mBuildItems.resize(count);
+	for(std::uint32_t i = 0; i < count; ++i)
+	{
+		XMVECTOR boxMin, boxMax;
+		GetMinMax(boxes[i], boxMin, boxMax);
+		XMStoreFloat3(&mBuildItems[i].Min, boxMin);
+		XMStoreFloat3(&mBuildItems[i].Max, boxMax);
+		mBuildItems[i].Item = i;
+	}
+
+	mItemLocation.assign(count, std::uint32_t(InvalidIndex));
+	BuildTree();
+}
+
+void BoundingVolumeHierarchy::Rebuild()
+{
+	mBuildItems.clear();
+	for(std::uint32_t item = 0; item < mItemLocation.size(); ++item)
+	{
+		std::uint32_t location = mItemLocation[item];
+		if(location == InvalidIndex)
+			continue;
+
+		XMVECTOR boxMin, boxMax;
+		GetSlotBounds(location / 4, location % 4, boxMin, boxMax);
+
+		BuildItem buildItem;
+		XMStoreFloat3(&buildItem.Min, boxMin);
+		XMStoreFloat3(&buildItem.Max, boxMax);
+		buildItem.Item = item;
+		mBuildItems.push_back(buildItem);
+	}
+
+	BuildTree();
+}
+
+void BoundingVolumeHierarchy::BuildTree()
+{
+	std::uint32_t count = (std::uint32_t)mBuildItems.size();
+
+	mNodes.clear();
+	mFreeNodes.clear();
+	mRoot = InvalidIndex;
+	mItemCount = count;
+
+	if(count == 0)
+		return;
+
+	// Every node has at least two children, so n items need at most n - 1 nodes (one
+	// for a single item).  Nodes left with Count == 0 are unused and CompactNodes
+	// removes them.
+	Node unused = {};
+	mNodes.assign(std::max<std::uint32_t>(count - 1, 1), unused);
+
+	BuildTask root = { 0, count, 0, InvalidIndex, 0 };
+	mRoot = 0;
+
+	// Build the top levels here until there are enough large subtrees for every range
+	// of a ParallelFor, then build those in parallel.  Their node blocks and item
+	// ranges are disjoint.
+	ThreadPool& pool = ThreadPool::Default();
+	size_t taskCount = (size_t)pool.ThreadCount()*4;
+
+	std::vector<BuildTask> tasks(1, root);
+	std::vector<BuildTask> deferred;
+	while(!tasks.empty() && tasks.size() < taskCount)
+	{
+		deferred.clear();
+		for(const BuildTask& task : tasks)
+			BuildNode(task, &deferred);
+		tasks.swap(deferred);
+	}
+
+	pool.ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; ++i)
+			BuildNode(tasks[i], nullptr);
+	});
+
+	CompactNodes();
+}
+
+void BoundingVolumeHierarchy::BuildNode(const BuildTask& task, std::vector<BuildTask>* deferred)
+{
+	// Up to four parts: the halves of an SAH split, each split again.
+	std::uint32_t partBegin[4];
+	std::uint32_t partEnd[4];
+	std::uint32_t partCount = 0;
+
+	if(task.End - task.Begin <= 4)
+	{
+		for(std::uint32_t i = task.Begin; i < task.End; ++i)
+		{
+			partBegin[partCount] = i;
+			partEnd[partCount++] = i + 1;
+		}
+	}
+	else
+	{
+		std::uint32_t mid = SplitRange(task.Begin, task.End);
+		std::uint32_t halves[3] = { task.Begin, mid, task.End };
+		for(int h = 0; h < 2; ++h)
+		{
+			std::uint32_t begin = halves[h];
+			std::uint32_t end = halves[h + 1];
+			if(end - begin >= 2)
+			{
+				std::uint32_t quarter = SplitRange(begin, end);
+				partBegin[partCount] = begin;
+				partEnd[partCount++] = quarter;
+				partBegin[partCount] = quarter;
+				partEnd[partCount++] = end;
+			}
+			else
+			{
+				partBegin[partCount] = begin;
+				partEnd[partCount++] = end;
+			}
+		}
+	}
+
+	Node& node = mNodes[task.NodeIndex];
+	node.Parent = task.Parent;
+	node.ParentSlot = task.ParentSlot;
+	node.Count = partCount;
+
+	std::uint32_t nextNode = task.NodeIndex + 1;
+	for(std::uint32_t p = 0; p < partCount; ++p)
+	{
+		XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+		for(std::uint32_t i = partBegin[p]; i < partEnd[p]; ++i)
+		{
+			boxMin = XMVectorMin(boxMin, XMLoadFloat3(&mBuildItems[i].Min));
+			boxMax = XMVectorMax(boxMax, XMLoadFloat3(&mBuildItems[i].Max));
+		}
+
+		XMFLOAT3 minF, maxF;
+		XMStoreFloat3(&minF, boxMin);
+		XMStoreFloat3(&maxF, boxMax);
+		node.MinX[p] = minF.x;
+		node.MinY[p] = minF.y;
+		node.MinZ[p] = minF.z;
+		node.MaxX[p] = maxF.x;
+		node.MaxY[p] = maxF.y;
+		node.MaxZ[p] = maxF.z;
+
+		std::uint32_t partSize = partEnd[p] - partBegin[p];
+		if(partSize == 1)
+		{
+			node.Child[p] = mBuildItems[partBegin[p]].Item | ItemBit;
+			continue;
+		}
+
+		BuildTask child = { partBegin[p], partEnd[p], nextNode, task.NodeIndex, p };
+		node.Child[p] = nextNode;
+		nextNode += partSize - 1;
+
+		if(deferred != nullptr && partSize >= ParallelBuildCount)
+			deferred->push_back(child);
+		else
+			BuildNode(child, deferred);
+	}
+}
+
+std::uint32_t BoundingVolumeHierarchy::SplitRange(std::uint32_t begin, std::uint32_t end)
+{
+	std::uint32_t middle = begin + (end - begin) / 2;
+
+	// Bin the box centers (times two) along the axis where they spread most.
+	XMVECTOR centerMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR centerMax = XMVectorReplicate(-FLT_MAX);
+	for(std::uint32_t i = begin; i < end; ++i)
+	{
+		XMVECTOR center = XMVectorAdd(XMLoadFloat3(&mBuildItems[i].Min), XMLoadFloat3(&mBuildItems[i].Max));
+		centerMin = XMVectorMin(centerMin, center);
+		centerMax = XMVectorMax(centerMax, center);
+	}
+
+	XMFLOAT3 lowF, spreadF;
+	XMStoreFloat3(&lowF, centerMin);
+	XMStoreFloat3(&spreadF, XMVectorSubtract(centerMax, centerMin));
+
+	int axis = 0;
+	if(spreadF.y > spreadF.x)
+		axis = 1;
+	if(spreadF.z > (&spreadF.x)[axis])
+		axis = 2;
+
+	float low = (&lowF.x)[axis];
+	float spread = (&spreadF.x)[axis];
+
+	// All centers coincide; any split is as good as another.
+	if(!(spread > 0.0f))
+		return middle;
+
+	float scale = BinCount / spread;
+	auto binOf = [&](const BuildItem& b)
+	{
+		float center = (&b.Min.x)[axis] + (&b.Max.x)[axis];
+		std::uint32_t bin = (std::uint32_t)((center - low)*scale);
+		return std::min<std::uint32_t>(bin, BinCount - 1);
+	};
+
+	XMVECTOR binMin[BinCount];
+	XMVECTOR binMax[BinCount];
+	std::uint32_t binCount[BinCount] = {};
+	for(std::uint32_t b = 0; b < BinCount; ++b)
+	{
+		binMin[b] = XMVectorReplicate(FLT_MAX);
+		binMax[b] = XMVectorReplicate(-FLT_MAX);
+	}
+
+	for(std::uint32_t i = begin; i < end; ++i)
+	{
+		std::uint32_t bin = binOf(mBuildItems[i]);
+		binMin[bin] = XMVectorMin(binMin[bin], XMLoadFloat3(&mBuildItems[i].Min));
+		binMax[bin] = XMVectorMax(binMax[bin], XMLoadFloat3(&mBuildItems[i].Max));
+		binCount[bin]++;
+	}
+
+	// Splitting after bin s puts bins [0, s] on the left.  Sweep from the right for the
+	// right sides' costs, then from the left to find the cheapest split.
+	float rightCost[BinCount];
+	XMVECTOR sideMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR sideMax = XMVectorReplicate(-FLT_MAX);
+	std::uint32_t sideCount = 0;
+	for(std::uint32_t s = BinCount - 1; s > 0; --s)
+	{
+		sideMin = XMVectorMin(sideMin, binMin[s]);
+		sideMax = XMVectorMax(sideMax, binMax[s]);
+		sideCount += binCount[s];
+		rightCost[s - 1] = sideCount > 0 ? HalfArea(sideMin, sideMax)*sideCount : -1.0f;
+	}
+
+	std::uint32_t bestSplit = BinCount;
+	float bestCost = FLT_MAX;
+	sideMin = XMVectorReplicate(FLT_MAX);
+	sideMax = XMVectorReplicate(-FLT_MAX);
+	sideCount = 0;
+	for(std::uint32_t s = 0; s < BinCount - 1; ++s)
+	{
+		sideMin = XMVectorMin(sideMin, binMin[s]);
+		sideMax = XMVectorMax(sideMax, binMax[s]);
+		sideCount += binCount[s];
+		if(sideCount == 0 || rightCost[s] < 0.0f)
+			continue;
+
+		float cost = HalfArea(sideMin, sideMax)*sideCount + rightCost[s];
+		if(cost < bestCost)
+		{
+			bestCost = cost;
+			bestSplit = s;
+		}
+	}
+
+	if(bestSplit == BinCount)
+		return middle;
+
+	auto first = mBuildItems.begin() + begin;
+	auto split = std::partition(first, mBuildItems.begin() + end,
+		[&](const BuildItem& b) { return binOf(b) <= bestSplit; });
+
+	return begin + (std::uint32_t)(split - first);
+}
+
+void BoundingVolumeHierarchy::CompactNodes()
+{
+	// Moving the used nodes down keeps them in the depth-first order they were built in.
+	std::vector<std::uint32_t> remap(mNodes.size(), std::uint32_t(InvalidIndex));
+	std::uint32_t usedCount = 0;
+	for(std::uint32_t i = 0; i < mNodes.size(); ++i)
+	{
+		if(mNodes[i].Count != 0)
+			remap[i] = usedCount++;
+	}
+
+	for(std::uint32_t i = 0; i < mNodes.size(); ++i)
+	{
+		if(remap[i] == InvalidIndex)
+			continue;
+
+		Node node = mNodes[i];
+		if(node.Parent != InvalidIndex)
+			node.Parent = remap[node.Parent];
+
+		for(std::uint32_t s = 0; s < node.Count; ++s)
+		{
+			if(node.Child[s] & ItemBit)
+				mItemLocation[node.Child[s] & ~ItemBit] = remap[i]*4 + s;
+			else
+				node.Child[s] = remap[node.Child[s]];
+		}
+
+		mNodes[remap[i]] = node;
+	}
+
+	mNodes.resize(usedCount);
+	mRoot = 0;
+}
+
+std::uint32_t BoundingVolumeHierarchy::AllocateNode()
+{
+	std::uint32_t node;
+	if(!mFreeNodes.empty())
+	{
+		node = mFreeNodes.back();
+		mFreeNodes.pop_back();
+	}
+	else
+	{
+		node = (std::uint32_t)mNodes.size();
+		mNodes.push_back(Node());
+	}
+
+	mNodes[node].Parent = InvalidIndex;
+	mNodes[node].ParentSlot = 0;
+	mNodes[node].Count = 0;
+	return node;
+}
+
+void BoundingVolumeHierarchy::FreeNode(std::uint32_t node)
+{
+	mNodes[node].Count = 0;
+	mFreeNodes.push_back(node);
+}
+
+void BoundingVolumeHierarchy::SetSlot(std::uint32_t node, std::uint32_t slot, FXMVECTOR boxMin, FXMVECTOR boxMax,
+	std::uint32_t child)
+{
+	XMFLOAT3 minF, maxF;
+	XMStoreFloat3(&minF, boxMin);
+	XMStoreFloat3(&maxF, boxMax);
+
+	Node& n = mNodes[node];
+	n.MinX[slot] = minF.x;
+	n.MinY[slot] = minF.y;
+	n.MinZ[slot] = minF.z;
+	n.MaxX[slot] = maxF.x;
+	n.MaxY[slot] = maxF.y;
+	n.MaxZ[slot] = maxF.z;
+	n.Child[slot] = child;
+
+	if(child & ItemBit)
+	{
+		mItemLocation[child & ~ItemBit] = node*4 + slot;
+	}
+	else
+	{
+		mNodes[child].Parent = node;
+		mNodes[child].ParentSlot = slot;
+	}
+}
+
+void BoundingVolumeHierarchy::CopySlot(std::uint32_t node, std::uint32_t fromSlot, std::uint32_t toSlot)
+{
+	XMVECTOR boxMin, boxMax;
+	GetSlotBounds(node, fromSlot, boxMin, boxMax);
+	SetSlot(node, toSlot, boxMin, boxMax, mNodes[node].Child[fromSlot]);
+}
+
+void BoundingVolumeHierarchy::GetSlotBounds(std::uint32_t node, std::uint32_t slot, XMVECTOR& boxMin, XMVECTOR& boxMax)const
+{
+	const Node& n = mNodes[node];
+	boxMin = XMVectorSet(n.MinX[slot], n.MinY[slot], n.MinZ[slot], 0.0f);
+	boxMax = XMVectorSet(n.MaxX[slot], n.MaxY[slot], n.MaxZ[slot], 0.0f);
+}
+
+void BoundingVolumeHierarchy::GetNodeBounds(std::uint32_t node, XMVECTOR& boxMin, XMVECTOR& boxMax)const
+{
+	boxMin = XMVectorReplicate(FLT_MAX);
+	boxMax = XMVectorReplicate(-FLT_MAX);
+	for(std::uint32_t s = 0; s < mNodes[node].Count; ++s)
+	{
+		XMVECTOR slotMin, slotMax;
+		GetSlotBounds(node, s, slotMin, slotMax);
+		boxMin = XMVectorMin(boxMin, slotMin);
+		boxMax = XMVectorMax(boxMax, slotMax);
+	}
+}
+
+void BoundingVolumeHierarchy::Refit(std::uint32_t node)
+{
+	while(mNodes[node].Parent != InvalidIndex)
+	{
+		std::uint32_t parent = mNodes[node].Parent;
+		std::uint32_t parentSlot = mNodes[node].ParentSlot;
+
+		XMVECTOR boxMin, boxMax, oldMin, oldMax;
+		GetNodeBounds(node, boxMin, boxMax);
+		GetSlotBounds(parent, parentSlot, oldMin, oldMax);
+		if(XMVector3Equal(boxMin, oldMin) && XMVector3Equal(boxMax, oldMax))
+			return;
+
+		SetSlot(parent, parentSlot, boxMin, boxMax, node);
+		node = parent;
+	}
+}
+
+void BoundingVolumeHierarchy::Insert(std::uint32_t item, const BoundingBox& box)
+{
+	assert(item < MaxItemCount);
+
+	if(Contains(item))
+	{
+		Update(item, box);
+		return;
+	}
+
+	if(item >= mItemLocation.size())
+		mItemLocation.resize(item + 1, std::uint32_t(InvalidIndex));
+
+	XMVECTOR boxMin, boxMax;
+	GetMinMax(box, boxMin, boxMax);
+	mItemCount++;
+
+	if(mRoot == InvalidIndex)
+		mRoot = AllocateNode();
+
+	std::uint32_t node = mRoot;
+	for(;;)
+	{
+		if(mNodes[node].Count < 4)
+		{
+			SetSlot(node, mNodes[node].Count++, boxMin, boxMax, item | ItemBit);
+			Refit(node);
+			return;
+		}
+
+		// Descend into the child whose box grows least.
+		std::uint32_t bestSlot = 0;
+		float bestGrowth = FLT_MAX;
+		XMVECTOR bestMin = boxMin, bestMax = boxMax;
+		for(std::uint32_t s = 0; s < 4; ++s)
+		{
+			XMVECTOR slotMin, slotMax;
+			GetSlotBounds(node, s, slotMin, slotMax);
+
+			XMVECTOR unionMin = XMVectorMin(slotMin, boxMin);
+			XMVECTOR unionMax = XMVectorMax(slotMax, boxMax);
+			float growth = HalfArea(unionMin, unionMax) - HalfArea(slotMin, slotMax);
+			if(growth < bestGrowth)
+			{
+				bestGrowth = growth;
+				bestSlot = s;
+				bestMin = unionMin;
+				bestMax = unionMax;
+			}
+		}
+
+		std::uint32_t child = mNodes[node].Child[bestSlot];
+		if(!(child & ItemBit))
+		{
+			node = child;
+			continue;
+		}
+
+		// The child is an item; put it and the new item under a new node in its slot.
+		XMVECTOR childMin, childMax;
+		GetSlotBounds(node, bestSlot, childMin, childMax);
+
+		std::uint32_t pair = AllocateNode();
+		mNodes[pair].Count = 2;
+		SetSlot(pair, 0, childMin, childMax, child);
+		SetSlot(pair, 1, boxMin, boxMax, item | ItemBit);
+		SetSlot(node, bestSlot, bestMin, bestMax, pair);
+		Refit(node);
+		return;
+	}
+}
+
+bool BoundingVolumeHierarchy::Remove(std::uint32_t item)
+{
+	if(!Contains(item))
+		return false;
+
+	std::uint32_t node = mItemLocation[item] / 4;
+	std::uint32_t slot = mItemLocation[item] % 4;
+	mItemLocation[item] = InvalidIndex;
+	mItemCount--;
+
+	std::uint32_t last = mNodes[node].Count - 1;
+	if(slot != last)
+		CopySlot(node, last, slot);
+	mNodes[node].Count = last;
+
+	if(node == mRoot)
+	{
+		if(last == 0)
+		{
+			FreeNode(node);
+			mRoot = InvalidIndex;
+		}
+		else if(last == 1 && !(mNodes[node].Child[0] & ItemBit))
+		{
+			// Promote the only child.
+			std::uint32_t child = mNodes[node].Child[0];
+			FreeNode(node);
+			mRoot = child;
+			mNodes[child].Parent = InvalidIndex;
+			mNodes[child].ParentSlot = 0;
+		}
+		return true;
+	}
+
+	if(last == 1)
+	{
+		// Replace the node with its only child.
+		std::uint32_t parent = mNodes[node].Parent;
+		XMVECTOR boxMin, boxMax;
+		GetSlotBounds(node, 0, boxMin, boxMax);
+		SetSlot(parent, mNodes[node].ParentSlot, boxMin, boxMax, mNodes[node].Child[0]);
+		FreeNode(node);
+		Refit(parent);
+	}
+	else
+	{
+		Refit(node);
+	}
+
+	return true;
+}
+
+void BoundingVolumeHierarchy::Update(std::uint32_t item, const BoundingBox& box)
+{
+	assert(Contains(item));
+
+	XMVECTOR boxMin, boxMax;
+	GetMinMax(box, boxMin, boxMax);
+
+	std::uint32_t node = mItemLocation[item] / 4;
+	SetSlot(node, mItemLocation[item] % 4, boxMin, boxMax, item | ItemBit);
+	Refit(node);
+}
+
+bool BoundingVolumeHierarchy::Contains(std::uint32_t item)const
+{
+	return item < mItemLocation.size() && mItemLocation[item] != InvalidIndex;
+}
+
+template<typename Test>
+void BoundingVolumeHierarchy::Traverse(const Test& test, std::vector<std::uint32_t>& items)const
+{
+	items.clear();
+	if(mRoot == InvalidIndex)
+		return;
+
+	// Entries with ItemBit set are nodes whose whole subtree passes.  Entries go to
+	// overflow only while stack is full, so popping overflow first keeps the order.
+	std::uint32_t stack[TraversalStackSize];
+	std::uint32_t stackSize = 0;
+	std::vector<std::uint32_t> overflow;
+	stack[stackSize++] = mRoot;
+
+	while(stackSize > 0)
+	{
+		std::uint32_t entry;
+		if(!overflow.empty())
+		{
+			entry = overflow.back();
+			overflow.pop_back();
+		}
+		else
+		{
+			entry = stack[--stackSize];
+		}
+
+		const Node& node = mNodes[entry & ~ItemBit];
+		int used = (1 << node.Count) - 1;
+
+		int visit = used;
+		int inside = used;
+		if(!(entry & ItemBit))
+		{
+			visit = test(node, inside) & used;
+			inside &= visit;
+		}
+
+		for(std::uint32_t s = 0; s < node.Count; ++s)
+		{
+			if(!(visit & (1 << s)))
+				continue;
+
+			std::uint32_t child = node.Child[s];
+			if(child & ItemBit)
+			{
+				items.push_back(child & ~ItemBit);
+				continue;
+			}
+
+			std::uint32_t push = (inside & (1 << s)) ? child | ItemBit : child;
+			if(stackSize < TraversalStackSize)
+				stack[stackSize++] = push;
+			else
+				overflow.push_back(push);
+		}
+	}
+}
+
+namespace
+{
+	//
+	// The query tests.  Each checks the four child boxes of a node at once, returns the
+	// mask of children that pass and sets inside to the mask of children whose whole
+	// subtrees pass.
+	//
+
+	class FrustumTest
+	{
+	public:
+		explicit FrustumTest(FXMMATRIX viewProj)
+		{
+			XMFLOAT4 planes[6];
+			FrustumCuller::ExtractPlanes(viewProj, planes);
+
+			for(int p = 0; p < 6; ++p)
+			{
+				XMVECTOR plane = XMLoadFloat4(&planes[p]);
+				mPlaneX[p] = XMVectorSplatX(plane);
+				mPlaneY[p] = XMVectorSplatY(plane);
+				mPlaneZ[p] = XMVectorSplatZ(plane);
+				mPlaneW[p] = XMVectorSplatW(plane);
+				mAbsPlaneX[p] = XMVectorAbs(mPlaneX[p]);
+				mAbsPlaneY[p] = XMVectorAbs(mPlaneY[p]);
+				mAbsPlaneZ[p] = XMVectorAbs(mPlaneZ[p]);
+			}
+		}
+
+		template<typename Node>
+		int operator()(const Node& node, int& inside)const
+		{
+			XMVECTOR half = XMVectorReplicate(0.5f);
+			XMVECTOR zero = XMVectorZero();
+
+			XMVECTOR minX = XMLoadFloat4((const XMFLOAT4*)node.MinX);
+			XMVECTOR minY = XMLoadFloat4((const XMFLOAT4*)node.MinY);
+			XMVECTOR minZ = XMLoadFloat4((const XMFLOAT4*)node.MinZ);
+			XMVECTOR maxX = XMLoadFloat4((const XMFLOAT4*)node.MaxX);
+			XMVECTOR maxY = XMLoadFloat4((const XMFLOAT4*)node.MaxY);
+			XMVECTOR maxZ = XMLoadFloat4((const XMFLOAT4*)node.MaxZ);
+
+			XMVECTOR cx = XMVectorMultiply(XMVectorAdd(minX, maxX), half);
+			XMVECTOR cy = XMVectorMultiply(XMVectorAdd(minY, maxY), half);
+			XMVECTOR cz = XMVectorMultiply(XMVectorAdd(minZ, maxZ), half);
+			XMVECTOR ex = XMVectorMultiply(XMVectorSubtract(maxX, minX), half);
+			XMVECTOR ey = XMVectorMultiply(XMVectorSubtract(maxY, minY), half);
+			XMVECTOR ez = XMVectorMultiply(XMVectorSubtract(maxZ, minZ), half);
+
+			// A box is outside when center distance plus radius is negative for some
+			// plane, and inside when center distance minus radius is not for any.
+			XMVECTOR outside = XMVectorFalseInt();
+			XMVECTOR straddles = XMVectorFalseInt();
+			for(int p = 0; p < 6; ++p)
+			{
+				XMVECTOR d = XMVectorMultiplyAdd(cx, mPlaneX[p], mPlaneW[p]);
+				d = XMVectorMultiplyAdd(cy, mPlaneY[p], d);
+				d = XMVectorMultiplyAdd(cz, mPlaneZ[p], d);
+
+				XMVECTOR r = XMVectorMultiply(ex, mAbsPlaneX[p]);
+				r = XMVectorMultiplyAdd(ey, mAbsPlaneY[p], r);
+				r = XMVectorMultiplyAdd(ez, mAbsPlaneZ[p], r);
+
+				outside = XMVectorOrInt(outside, XMVectorLess(XMVectorAdd(d, r), zero));
+				straddles = XMVectorOrInt(straddles, XMVectorLess(XMVectorSubtract(d, r), zero));
+			}
+
+			inside = ~Mask(straddles) & 0xf;
+			return ~Mask(outside) & 0xf;
+		}
+
+	private:
+		XMVECTOR mPlaneX[6], mPlaneY[6], mPlaneZ[6], mPlaneW[6];
+		XMVECTOR mAbsPlaneX[6], mAbsPlaneY[6], mAbsPlaneZ[6];
+	};
+
+	class RayTest
+	{
+	public:
+		RayTest(FXMVECTOR origin, FXMVECTOR direction, float maxDistance)
+		{
+			// 1/0 would turn the slab distances of boxes touching the origin into NaNs,
+			// so axes the ray does not move along are handled by RaySlab without dividing.
+			XMVECTOR invDir = XMVectorReciprocal(direction);
+			XMVECTOR parallel = XMVectorIsInfinite(invDir);
+			mParallelX = XMVectorGetIntX(parallel) != 0;
+			mParallelY = XMVectorGetIntY(parallel) != 0;
+			mParallelZ = XMVectorGetIntZ(parallel) != 0;
+
+			mOriginX = XMVectorSplatX(origin);
+			mOriginY = XMVectorSplatY(origin);
+			mOriginZ = XMVectorSplatZ(origin);
+			mInvDirX = XMVectorSplatX(invDir);
+			mInvDirY = XMVectorSplatY(invDir);
+			mInvDirZ = XMVectorSplatZ(invDir);
+			mLimit = XMVectorReplicate(maxDistance);
+		}
+
+		template<typename Node>
+		int operator()(const Node& node, int& inside)const
+		{
+			// Slab test: the ray is inside the box between the largest entry and the
+			// smallest exit distance over the three axes.
+			XMVECTOR t0x, t1x, t0y, t1y, t0z, t1z;
+			RaySlab(XMLoadFloat4((const XMFLOAT4*)node.MinX), XMLoadFloat4((const XMFLOAT4*)node.MaxX),
+				mOriginX, mInvDirX, mParallelX, t0x, t1x);
+			RaySlab(XMLoadFloat4((const XMFLOAT4*)node.MinY), XMLoadFloat4((const XMFLOAT4*)node.MaxY),
+				mOriginY, mInvDirY, mParallelY, t0y, t1y);
+			RaySlab(XMLoadFloat4((const XMFLOAT4*)node.MinZ), XMLoadFloat4((const XMFLOAT4*)node.MaxZ),
+				mOriginZ, mInvDirZ, mParallelZ, t0z, t1z);
+
+			XMVECTOR tEnter = XMVectorMax(XMVectorMax(t0x, t0y), XMVectorMax(t0z, XMVectorZero()));
+			XMVECTOR tExit = XMVectorMin(XMVectorMin(t1x, t1y), XMVectorMin(t1z, mLimit));
+
+			inside = 0;
+			return Mask(XMVectorLessOrEqual(tEnter, tExit));
+		}
+
+	private:
+		XMVECTOR mOriginX, mOriginY, mOriginZ;
+		XMVECTOR mInvDirX, mInvDirY, mInvDirZ;
+		XMVECTOR mLimit;
+		bool mParallelX, mParallelY, mParallelZ;
+	};
+
+	class SphereTest
+	{
+	public:
+		explicit SphereTest(const BoundingSphere& sphere)
+		{
+			mCenterX = XMVectorReplicate(sphere.Center.x);
+			mCenterY = XMVectorReplicate(sphere.Center.y);
+			mCenterZ = XMVectorReplicate(sphere.Center.z);
+			mRadiusSq = XMVectorReplicate(sphere.Radius*sphere.Radius);
+		}
+
+		template<typename Node>
+		int operator()(const Node& node, int& inside)const
+		{
+			XMVECTOR zero = XMVectorZero();
+
+			// Distance from the center to the nearest point of each box; at most one of
+			// the two terms per axis is positive.
+			XMVECTOR dx = XMVectorAdd(
+				XMVectorMax(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.MinX), mCenterX), zero),
+				XMVectorMax(XMVectorSubtract(mCenterX, XMLoadFloat4((const XMFLOAT4*)node.MaxX)), zero));
+			XMVECTOR dy = XMVectorAdd(
+				XMVectorMax(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.MinY), mCenterY), zero),
+				XMVectorMax(XMVectorSubtract(mCenterY, XMLoadFloat4((const XMFLOAT4*)node.MaxY)), zero));
+			XMVECTOR dz = XMVectorAdd(
+				XMVectorMax(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.MinZ), mCenterZ), zero),
+				XMVectorMax(XMVectorSubtract(mCenterZ, XMLoadFloat4((const XMFLOAT4*)node.MaxZ)), zero));
+
+			XMVECTOR distSq = XMVectorMultiply(dx, dx);
+			distSq = XMVectorMultiplyAdd(dy, dy, distSq);
+			distSq = XMVectorMultiplyAdd(dz, dz, distSq);
+
+			inside = 0;
+			return Mask(XMVectorLessOrEqual(distSq, mRadiusSq));
+		}
+
+	private:
+		XMVECTOR mCenterX, mCenterY, mCenterZ;
+		XMVECTOR mRadiusSq;
+	};
+
+	class BoxTest
+	{
+	public:
+		explicit BoxTest(const BoundingBox& box)
+		{
+			XMVECTOR boxMin, boxMax;
+			GetMinMax(box, boxMin, boxMax);
+
+			mMinX = XMVectorSplatX(boxMin);
+			mMinY = XMVectorSplatY(boxMin);
+			mMinZ = XMVectorSplatZ(boxMin);
+			mMaxX = XMVectorSplatX(boxMax);
+			mMaxY = XMVectorSplatY(boxMax);
+			mMaxZ = XMVectorSplatZ(boxMax);
+		}
+
+		template<typename Node>
+		int operator()(const Node& node, int& inside)const
+		{
+			XMVECTOR minX = XMLoadFloat4((const XMFLOAT4*)node.MinX);
+			XMVECTOR minY = XMLoadFloat4((const XMFLOAT4*)node.MinY);
+			XMVECTOR minZ = XMLoadFloat4((const XMFLOAT4*)node.MinZ);
+			XMVECTOR maxX = XMLoadFloat4((const XMFLOAT4*)node.MaxX);
+			XMVECTOR maxY = XMLoadFloat4((const XMFLOAT4*)node.MaxY);
+			XMVECTOR maxZ = XMLoadFloat4((const XMFLOAT4*)node.MaxZ);
+
+			XMVECTOR overlaps = XMVectorAndInt(
+				XMVectorAndInt(XMVectorLessOrEqual(minX, mMaxX), XMVectorGreaterOrEqual(maxX, mMinX)),
+				XMVectorAndInt(XMVectorLessOrEqual(minY, mMaxY), XMVectorGreaterOrEqual(maxY, mMinY)));
+			overlaps = XMVectorAndInt(overlaps,
+				XMVectorAndInt(XMVectorLessOrEqual(minZ, mMaxZ), XMVectorGreaterOrEqual(maxZ, mMinZ)));
+
+			XMVECTOR contained = XMVectorAndInt(
+				XMVectorAndInt(XMVectorGreaterOrEqual(minX, mMinX), XMVectorLessOrEqual(maxX, mMaxX)),
+				XMVectorAndInt(XMVectorGreaterOrEqual(minY, mMinY), XMVectorLessOrEqual(maxY, mMaxY)));
+			contained = XMVectorAndInt(contained,
+				XMVectorAndInt(XMVectorGreaterOrEqual(minZ, mMinZ), XMVectorLessOrEqual(maxZ, mMaxZ)));
+
+			inside = Mask(contained);
+			return Mask(overlaps);
+		}
+
+	private:
+		XMVECTOR mMinX, mMinY, mMinZ;
+		XMVECTOR mMaxX, mMaxY, mMaxZ;
+	};
+}
+
+void BoundingVolumeHierarchy::QueryFrustum(FXMMATRIX viewProj, std::vector<std::uint32_t>& items)const
+{
+	Traverse(FrustumTest(viewProj), items);
+}
+
+void BoundingVolumeHierarchy::QueryRay(FXMVECTOR origin, FXMVECTOR direction, float maxDistance,
+	std::vector<std::uint32_t>& items)const
+{
+	Traverse(RayTest(origin, direction, maxDistance), items);
+}
+
+void BoundingVolumeHierarchy::QuerySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& items)const
+{
+	Traverse(SphereTest(sphere), items);
+}
+
+void BoundingVolumeHierarchy::QueryBox(const BoundingBox& box, std::vector<std::uint32_t>& items)const
+{
+	Traverse(BoxTest(box), items);
+}
@@ -0,0 +1,153 @@
+//***************************************************************************************
+// BoundingVolumeHierarchy.h
+//
+// A dynamic bounding volume hierarchy over axis aligned item boxes, for culling,
+// picking and proximity queries that should not test every item.
+//
+// Nodes are four wide: each holds the boxes of up to four children in structure of
+// arrays form, so one SSE test checks all four, and a child is either another node
+// or a single item.  Every node except the root has at least two children.
+//
+// Build sorts the items into a tree with the surface area heuristic, evaluated over a
+// fixed number of bins along the widest axis of the box centers.  The top levels are
+// split on the calling thread and the subtrees below them are built in parallel on
+// ThreadPool::Default(), after which the nodes are compacted in depth-first order, so
+// a subtree is mostly contiguous in memory.
+//
+// Between builds the tree is kept up to date incrementally.  Update refits the
+// ancestors of a moved item, Insert descends to the children whose boxes grow least,
+// and Remove collapses nodes left with one child.  These keep the tree correct but
+// not as tight as a build, so call Rebuild when many items have moved far.
+//
+// Items are caller chosen indices, e.g. render item indices.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+
+class BoundingVolumeHierarchy
+{
+public:
+	// Items are in [0, MaxItemCount).
+	static const std::uint32_t MaxItemCount = 0x7fffffff;
+
+	// Items per subtree below which Build stops splitting the work.
+	static const std::uint32_t ParallelBuildCount = 4096;
+
+	// Replaces the tree with one over items [0, count), item i with boxes[i].
+	void Build(const DirectX::BoundingBox* boxes, std::uint32_t count);
+
+	// Builds a new tree over the items in the tree, with their current boxes.
+	void Rebuild();
+
+	// Adds item, or updates it if it is in the tree.
+	void Insert(std::uint32_t item, const DirectX::BoundingBox& box);
+
+	// Returns false if item is not in the tree.
+	bool Remove(std::uint32_t item);
+
+	// Sets the box of an item in the tree and refits its ancestors.
+	void Update(std::uint32_t item, const DirectX::BoundingBox& box);
+
+	bool Contains(std::uint32_t item)const;
+	std::uint32_t ItemCount()const { return mItemCount; }
+	std::uint32_t NodeCount()const { return (std::uint32_t)mNodes.size() - (std::uint32_t)mFreeNodes.size(); }
+
+	// The queries replace items with the items whose boxes pass the test, in no
+	// particular order.  Keep items around to avoid allocating every query.
+
+	// Boxes not entirely outside one of the planes of viewProj (see
+	// FrustumCuller::SetViewProj).
+	void QueryFrustum(DirectX::FXMMATRIX viewProj, std::vector<std::uint32_t>& items)const;
+
+	// Boxes hit by the ray within maxDistance lengths of direction from origin.
+	void QueryRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance,
+		std::vector<std::uint32_t>& items)const;
+
+	// Boxes that intersect sphere.
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<std::uint32_t>& items)const;
+
+	// Boxes that intersect box.
+	void QueryBox(const DirectX::BoundingBox& box, std::vector<std::uint32_t>& items)const;
+
+private:
+	static const std::uint32_t InvalidIndex = 0xffffffff;
+
+	// Set in Node::Child for items.
+	static const std::uint32_t ItemBit = 0x80000000;
+
+	struct Node
+	{
+		// Child boxes; only the first Count are used.
+		float MinX[4];
+		float MinY[4];
+		float MinZ[4];
+		float MaxX[4];
+		float MaxY[4];
+		float MaxZ[4];
+
+		// A node index, or an item with ItemBit set.
+		std::uint32_t Child[4];
+
+		// InvalidIndex for the root.
+		std::uint32_t Parent;
+		std::uint32_t ParentSlot;
+
+		std::uint32_t Count;
+		std::uint32_t Pad;
+	};
+
+	struct BuildItem
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+		std::uint32_t Item;
+	};
+
+	// Builds the subtree over mBuildItems[Begin, End) into the nodes starting at
+	// NodeIndex.  A subtree of n items uses at most n - 1 nodes.
+	struct BuildTask
+	{
+		std::uint32_t Begin;
+		std::uint32_t End;
+		std::uint32_t NodeIndex;
+		std::uint32_t Parent;
+		std::uint32_t ParentSlot;
+	};
+
+	void BuildTree();
+	void BuildNode(const BuildTask& task, std::vector<BuildTask>* deferred);
+	std::uint32_t SplitRange(std::uint32_t begin, std::uint32_t end);
+	void CompactNodes();
+
+	std::uint32_t AllocateNode();
+	void FreeNode(std::uint32_t node);
+
+	void SetSlot(std::uint32_t node, std::uint32_t slot, DirectX::FXMVECTOR boxMin, DirectX::FXMVECTOR boxMax,
+		std::uint32_t child);
+	void CopySlot(std::uint32_t node, std::uint32_t fromSlot, std::uint32_t toSlot);
+	void GetSlotBounds(std::uint32_t node, std::uint32_t slot, DirectX::XMVECTOR& boxMin, DirectX::XMVECTOR& boxMax)const;
+	void GetNodeBounds(std::uint32_t node, DirectX::XMVECTOR& boxMin, DirectX::XMVECTOR& boxMax)const;
+
+	// Recomputes the boxes of node's ancestors, stopping where a box does not change.
+	void Refit(std::uint32_t node);
+
+	// test(node, inside) returns the mask of node's children to visit and sets inside
+	// to the mask of children whose whole subtrees pass.
+	template<typename Test>
+	void Traverse(const Test& test, std::vector<std::uint32_t>& items)const;
+
+	std::vector<Node> mNodes;
+	std::vector<std::uint32_t> mFreeNodes;
+	std::uint32_t mRoot = InvalidIndex;
+
+	// node*4 + slot of every item in the tree, InvalidIndex for the others.
+	std::vector<std::uint32_t> mItemLocation;
+	std::uint32_t mItemCount = 0;
+
+	std::vector<BuildItem> mBuildItems;
+};
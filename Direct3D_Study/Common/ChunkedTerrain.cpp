@@ -0,0 +1,353 @@
+//***************************************************************************************
+// ChunkedTerrain.cpp
+//***************************************************************************************
+
+#include "ChunkedTerrain.h"
+#include "GridIndexGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
+
+using namespace DirectX;
+
+ChunkedTerrain::ChunkedTerrain(float size, std::uint32_t levelCount, std::uint32_t patchQuads)
+	: mSize(size), mLevelCount(levelCount), mPatchQuads(patchQuads)
+{
+	if(patchQuads < 2 || patchQuads > 128 || (patchQuads & (patchQuads - 1)) != 0)
+		throw std::invalid_argument("ChunkedTerrain: patchQuads must be a power of two in [2, 128]");
+
+	// 4^levelCount/3 nodes must fit the 32-bit node indices.
+	if(levelCount == 0 || levelCount > 16)
+		throw std::invalid_argument("ChunkedTerrain: levelCount must be in [1, 16]");
+
+	mLevelOffsets.resize(levelCount + 1);
+	mLevelOffsets[0] = 0;
+	for(std::uint32_t level = 0; level < levelCount; ++level)
+		mLevelOffsets[level + 1] = mLevelOffsets[level] + (1u << level)*(1u << level);
+
+	mMinHeights.assign(NodeCount(), 0.0f);
+	mMaxHeights.assign(NodeCount(), 0.0f);
+	mSplitFrame.assign(NodeCount(), 0);
+
+	BuildStitchIndices();
+}
+
+std::uint32_t ChunkedTerrain::LevelCount()const
+{
+	return mLevelCount;
+}
+
+std::uint32_t ChunkedTerrain::NodeCount()const
+{
+	return mLevelOffsets[mLevelCount];
+}
+
+std::uint32_t ChunkedTerrain::PatchVertexCount()const
+{
+	return (mPatchQuads + 1)*(mPatchQuads + 1);
+}
+
+std::uint32_t ChunkedTerrain::VertexCount()const
+{
+	return NodeCount()*PatchVertexCount();
+}
+
+float ChunkedTerrain::NodeSize(std::uint32_t level)const
+{
+	return mSize / (float)(1u << level);
+}
+
+XMFLOAT2 ChunkedTerrain::NodeCenter(std::uint32_t node)const
+{
+	std::uint32_t level, x, y;
+	NodeCoordinates(node, level, x, y);
+
+	float size = NodeSize(level);
+	return XMFLOAT2(-0.5f*mSize + (x + 0.5f)*size, -0.5f*mSize + (y + 0.5f)*size);
+}
+
+BoundingBox ChunkedTerrain::NodeBounds(std::uint32_t node)const
+{
+	std::uint32_t level, x, y;
+	NodeCoordinates(node, level, x, y);
+
+	float halfSize = 0.5f*NodeSize(level);
+	XMFLOAT2 center = NodeCenter(node);
+	float minY = mMinHeights[node];
+	float maxY = mMaxHeights[node];
+
+	return BoundingBox(XMFLOAT3(center.x, 0.5f*(minY + maxY), center.y),
+		XMFLOAT3(halfSize, 0.5f*(maxY - minY), halfSize));
+}
+
+void ChunkedTerrain::BuildVertices(void* vertices, const TerrainBuilder::VertexLayout& layout,
+	const std::function<void(TerrainBuilder&)>& configure)
+{
+	std::uint8_t* base = (std::uint8_t*)vertices;
+	std::uint32_t gridSize = mPatchQuads + 1;
+	size_t patchByteSize = (size_t)PatchVertexCount()*layout.Stride;
+
+	// Patches are small, so hand out whole patches; the rows of each are then
+	// built on the thread that owns the patch.
+	ThreadPool::Default().ParallelFor(NodeCount(), 1, [&](size_t begin, size_t end)
+	{
+		for(size_t node = begin; node < end; ++node)
+		{
+			std::uint32_t level, x, y;
+			NodeCoordinates((std::uint32_t)node, level, x, y);
+
+			float size = NodeSize(level);
+			XMFLOAT2 center = NodeCenter((std::uint32_t)node);
+
+			TerrainBuilder builder(size, size, gridSize, gridSize);
+			builder.SetCenter(center.x, center.y);
+			configure(builder);
+
+			BoundingBox bounds = builder.BuildVertices(base + node*patchByteSize, layout);
+			mMinHeights[node] = bounds.Center.y - bounds.Extents.y;
+			mMaxHeights[node] = bounds.Center.y + bounds.Extents.y;
+		}
+	});
+
+	UpdateTreeBounds();
+}
+
+void ChunkedTerrain::ComputeBounds(const void* vertices, const TerrainBuilder::VertexLayout& layout)
+{
+	const std::uint8_t* base = (const std::uint8_t*)vertices;
+	std::uint32_t patchVertexCount = PatchVertexCount();
+
+	ThreadPool::Default().ParallelFor(NodeCount(), 1, [&](size_t begin, size_t end)
+	{
+		for(size_t node = begin; node < end; ++node)
+		{
+			const std::uint8_t* vertex = base + node*patchVertexCount*layout.Stride + layout.PositionOffset;
+
+			float minY = +FLT_MAX;
+			float maxY = -FLT_MAX;
+			for(std::uint32_t i = 0; i < patchVertexCount; ++i, vertex += layout.Stride)
+			{
+				XMFLOAT3 position;
+				memcpy(&position, vertex, sizeof(position));
+				minY = std::min<float>(minY, position.y);
+				maxY = std::max<float>(maxY, position.y);
+			}
+
+			mMinHeights[node] = minY;
+			mMaxHeights[node] = maxY;
+		}
+	});
+
+	UpdateTreeBounds();
+}
+
+void ChunkedTerrain::UpdateTreeBounds()
+{
+	// A coarse patch only samples every other point of its children, so widen each
+	// node to cover its children and culling never rejects a visible descendant.
+	for(std::uint32_t level = mLevelCount - 1; level-- > 0; )
+	{
+		std::uint32_t dim = 1u << level;
+		for(std::uint32_t y = 0; y < dim; ++y)
+		{
+			for(std::uint32_t x = 0; x < dim; ++x)
+			{
+				std::uint32_t node = NodeIndex(level, x, y);
+				for(std::uint32_t child = 0; child < 4; ++child)
+				{
+					std::uint32_t childNode = NodeIndex(level + 1, 2*x + (child & 1), 2*y + (child >> 1));
+					mMinHeights[node] = std::min<float>(mMinHeights[node], mMinHeights[childNode]);
+					mMaxHeights[node] = std::max<float>(mMaxHeights[node], mMaxHeights[childNode]);
+				}
+			}
+		}
+	}
+
+	mTerrainMinHeight = mMinHeights[0];
+	mTerrainMaxHeight = mMaxHeights[0];
+}
+
+const std::vector<std::uint16_t>& ChunkedTerrain::Indices()const
+{
+	return mIndices;
+}
+
+std::uint32_t ChunkedTerrain::StitchIndexCount(std::uint32_t stitchMask)const
+{
+	return mStitchCount[stitchMask];
+}
+
+std::uint32_t ChunkedTerrain::StitchStartIndex(std::uint32_t stitchMask)const
+{
+	return mStitchStart[stitchMask];
+}
+
+void ChunkedTerrain::SetLodDistanceRatio(float ratio)
+{
+	mLodDistanceRatio = std::max<float>(ratio, 1.0f);
+}
+
+void ChunkedTerrain::BuildStitchIndices()
+{
+	std::uint32_t n = mPatchQuads + 1;
+	std::uint32_t last = mPatchQuads;
+
+	mIndices.clear();
+	mIndices.reserve((size_t)StitchVariantCount*mPatchQuads*mPatchQuads*6);
+
+	for(std::uint32_t mask = 0; mask < StitchVariantCount; ++mask)
+	{
+		// Row 0 is the north (+z) edge and column 0 the west (-x) edge, as in CreateGrid.
+		// Odd vertices on a stitched edge are folded onto the previous even vertex.
+		auto vertex = [&](std::uint32_t i, std::uint32_t j) -> std::uint16_t
+		{
+			if((j & 1) != 0 && ((i == 0 && (mask & StitchNorth)) || (i == last && (mask & StitchSouth))))
+				--j;
+			if((i & 1) != 0 && ((j == 0 && (mask & StitchWest)) || (j == last && (mask & StitchEast))))
+				--i;
+			return (std::uint16_t)(i*n + j);
+		};
+
+		// Folding collapses some triangles to a line or a point; those are dropped.
+		auto triangle = [&](std::uint16_t a, std::uint16_t b, std::uint16_t c)
+		{
+			int ai = a / n, aj = a % n;
+			int bi = b / n, bj = b % n;
+			int ci = c / n, cj = c % n;
+			if((bi - ai)*(cj - aj) != (ci - ai)*(bj - aj))
+			{
+				mIndices.push_back(a);
+				mIndices.push_back(b);
+				mIndices.push_back(c);
+			}
+		};
+
+		mStitchStart[mask] = (std::uint32_t)mIndices.size();
+
+		// Every patch drawn reuses these indices, so visit the quads in Morton tiles
+		// for better post-transform cache reuse.
+		ForEachGridQuad(n, n, GridTraversal::MortonTiles, 0, last, [&](std::uint32_t i, std::uint32_t j)
+		{
+			triangle(vertex(i, j), vertex(i, j + 1), vertex(i + 1, j));
+			triangle(vertex(i + 1, j), vertex(i, j + 1), vertex(i + 1, j + 1));
+		});
+
+		mStitchCount[mask] = (std::uint32_t)mIndices.size() - mStitchStart[mask];
+	}
+}
+
+void ChunkedTerrain::Select(const XMFLOAT3& eyePos, const BoundingFrustum* frustum,
+	std::vector<Patch>& patches)
+{
+	patches.clear();
+
+	if(++mFrame == 0)
+	{
+		std::fill(mSplitFrame.begin(), mSplitFrame.end(), 0u);
+		mFrame = 1;
+	}
+
+	SelectNode(0, 0, 0, frustum == nullptr, XMLoadFloat3(&eyePos), frustum, patches);
+
+	// Every split node has been recorded, so a neighbor is coarser exactly when the
+	// node that would be its parent was not split.
+	for(Patch& patch : patches)
+	{
+		if(patch.Level == 0)
+			continue;
+
+		std::uint32_t level, x, y;
+		NodeCoordinates(patch.Node, level, x, y);
+
+		std::uint32_t mask = 0;
+		if(IsCoarserNeighbor(level, (std::int64_t)x, (std::int64_t)y + 1))
+			mask |= StitchNorth;
+		if(IsCoarserNeighbor(level, (std::int64_t)x + 1, (std::int64_t)y))
+			mask |= StitchEast;
+		if(IsCoarserNeighbor(level, (std::int64_t)x, (std::int64_t)y - 1))
+			mask |= StitchSouth;
+		if(IsCoarserNeighbor(level, (std::int64_t)x - 1, (std::int64_t)y))
+			mask |= StitchWest;
+
+		patch.StitchMask = mask;
+	}
+}
+
+void ChunkedTerrain::SelectNode(std::uint32_t level, std::uint32_t x, std::uint32_t y, bool insideFrustum,
+	FXMVECTOR eyePos, const BoundingFrustum* frustum, std::vector<Patch>& patches)
+{
+	std::uint32_t node = NodeIndex(level, x, y);
+
+	// Once a node is known to be inside the frustum, so are all of its children.
+	if(!insideFrustum)
+	{
+		ContainmentType containment = frustum->Contains(NodeBounds(node));
+		if(containment == DISJOINT)
+			return;
+		insideFrustum = containment == CONTAINS;
+	}
+
+	if(level + 1 < mLevelCount)
+	{
+		// Distance from the eye to the node's square, extruded over the height range of
+		// the whole terrain.  Two adjacent squares differ in that distance by at most
+		// their size, which with a ratio of at least 1 keeps neighbors within one level.
+		float size = NodeSize(level);
+		float halfSize = 0.5f*size;
+		float minX = -0.5f*mSize + x*size;
+		float minZ = -0.5f*mSize + y*size;
+
+		XMVECTOR boxCenter = XMVectorSet(minX + halfSize,
+			0.5f*(mTerrainMinHeight + mTerrainMaxHeight), minZ + halfSize, 0.0f);
+		XMVECTOR boxExtents = XMVectorSet(halfSize, 0.5f*(mTerrainMaxHeight - mTerrainMinHeight), halfSize, 0.0f);
+
+		XMVECTOR outside = XMVectorMax(XMVectorSubtract(XMVectorAbs(XMVectorSubtract(eyePos, boxCenter)), boxExtents),
+			XMVectorZero());
+		float distanceSq = XMVectorGetX(XMVector3LengthSq(outside));
+		float splitDistance = mLodDistanceRatio*size;
+
+		if(distanceSq < splitDistance*splitDistance)
+		{
+			mSplitFrame[node] = mFrame;
+
+			SelectNode(level + 1, 2*x,     2*y,     insideFrustum, eyePos, frustum, patches);
+			SelectNode(level + 1, 2*x + 1, 2*y,     insideFrustum, eyePos, frustum, patches);
+			SelectNode(level + 1, 2*x,     2*y + 1, insideFrustum, eyePos, frustum, patches);
+			SelectNode(level + 1, 2*x + 1, 2*y + 1, insideFrustum, eyePos, frustum, patches);
+			return;
+		}
+	}
+
+	Patch patch;
+	patch.Node = node;
+	patch.Level = level;
+	patch.StitchMask = 0;
+	patches.push_back(patch);
+}
+
+bool ChunkedTerrain::IsCoarserNeighbor(std::uint32_t level, std::int64_t x, std::int64_t y)const
+{
+	// The terrain border has no neighbor to match.
+	std::int64_t dim = (std::int64_t)1 << level;
+	if(x < 0 || y < 0 || x >= dim || y >= dim)
+		return false;
+
+	std::uint32_t parent = NodeIndex(level - 1, (std::uint32_t)x >> 1, (std::uint32_t)y >> 1);
+	return mSplitFrame[parent] != mFrame;
+}
+
+std::uint32_t ChunkedTerrain::NodeIndex(std::uint32_t level, std::uint32_t x, std::uint32_t y)const
+{
+	return mLevelOffsets[level] + (y << level) + x;
+}
+
+void ChunkedTerrain::NodeCoordinates(std::uint32_t node, std::uint32_t& level, std::uint32_t& x, std::uint32_t& y)const
+{
+	level = (std::uint32_t)(std::upper_bound(mLevelOffsets.begin(), mLevelOffsets.end(), node) - mLevelOffsets.begin()) - 1;
+
+	std::uint32_t local = node - mLevelOffsets[level];
+	x = local & ((1u << level) - 1);
+	y = local >> level;
+}
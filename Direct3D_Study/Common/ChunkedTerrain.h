@@ -0,0 +1,122 @@
+//***************************************************************************************
+// ChunkedTerrain.h
+//
+// Chunked LOD terrain over a quadtree.  Every node covers a square of the terrain with
+// the same (PatchQuads+1)x(PatchQuads+1) vertex grid, laid out like
+// GeometryGenerator::CreateGrid, so each level halves the vertex spacing of the level
+// above it.  The vertices of all nodes live in one buffer, PatchVertexCount() per node,
+// and every node is drawn with the same shared indices, selected by BaseVertexLocation.
+//
+// The indices come in 16 variants, one per subset of the four patch edges that meet a
+// neighbor one level coarser.  On those edges every odd vertex is folded onto its even
+// neighbor so the edge matches the coarser patch exactly and no cracks open.
+//
+// Select() walks the tree from the root every frame and splits the nodes closer to the
+// eye than LodDistanceRatio times their size.  Only the children of split nodes are
+// visited, so the cost follows the number of patches drawn, not the size of the tree.
+//***************************************************************************************
+
+#pragma once
+
+#include "TerrainBuilder.h"
+
+class ChunkedTerrain
+{
+public:
+	// Patch edges that meet a coarser neighbor.  North is +z and east is +x.
+	enum StitchEdge : std::uint32_t
+	{
+		StitchNorth = 1,
+		StitchEast  = 2,
+		StitchSouth = 4,
+		StitchWest  = 8,
+		StitchVariantCount = 16
+	};
+
+	// A node selected for drawing.
+	struct Patch
+	{
+		std::uint32_t Node;
+		std::uint32_t Level;
+		std::uint32_t StitchMask;
+	};
+
+	// A size x size terrain centered at the origin, split levelCount-1 times.  patchQuads
+	// is the number of quads along a patch edge; it must be a power of two so every
+	// other edge vertex lines up with a coarser neighbor, and at most 128 so the patches
+	// can use 16-bit indices.
+	ChunkedTerrain(float size, std::uint32_t levelCount, std::uint32_t patchQuads);
+
+	std::uint32_t LevelCount()const;
+	std::uint32_t NodeCount()const;
+
+	// Vertices of one patch, and of all of them.
+	std::uint32_t PatchVertexCount()const;
+	std::uint32_t VertexCount()const;
+
+	// Side length and center (x, z) of the square covered by a node.
+	float NodeSize(std::uint32_t level)const;
+	DirectX::XMFLOAT2 NodeCenter(std::uint32_t node)const;
+	DirectX::BoundingBox NodeBounds(std::uint32_t node)const;
+
+	// Writes the vertices of every node in node order, so node i is drawn with
+	// BaseVertexLocation = i*PatchVertexCount().  configure sets the height function,
+	// slopes and color bands of each node's builder, and may be called from several
+	// threads at once.  Records the node bounds that Select() tests against.
+	void BuildVertices(void* vertices, const TerrainBuilder::VertexLayout& layout,
+		const std::function<void(TerrainBuilder&)>& configure);
+
+	// Recovers the node bounds from vertices that were written by BuildVertices,
+	// e.g. after loading them from a file.
+	void ComputeBounds(const void* vertices, const TerrainBuilder::VertexLayout& layout);
+
+	// All 16 stitch variants back to back, indexing a single patch.
+	const std::vector<std::uint16_t>& Indices()const;
+	std::uint32_t StitchIndexCount(std::uint32_t stitchMask)const;
+	std::uint32_t StitchStartIndex(std::uint32_t stitchMask)const;
+
+	// A node is split when the eye is closer to it than ratio times its size.  Ratios
+	// below 1 could put a patch next to one two levels coarser, so they are raised to 1.
+	void SetLodDistanceRatio(float ratio);
+
+	// Replaces patches with the nodes to draw from eyePos.  Nodes entirely outside
+	// frustum (in world space) are skipped when it is not null.
+	void Select(const DirectX::XMFLOAT3& eyePos, const DirectX::BoundingFrustum* frustum,
+		std::vector<Patch>& patches);
+
+private:
+	std::uint32_t NodeIndex(std::uint32_t level, std::uint32_t x, std::uint32_t y)const;
+	void NodeCoordinates(std::uint32_t node, std::uint32_t& level, std::uint32_t& x, std::uint32_t& y)const;
+
+	void BuildStitchIndices();
+	void UpdateTreeBounds();
+
+	void SelectNode(std::uint32_t level, std::uint32_t x, std::uint32_t y, bool insideFrustum,
+		DirectX::FXMVECTOR eyePos, const DirectX::BoundingFrustum* frustum, std::vector<Patch>& patches);
+
+	bool IsCoarserNeighbor(std::uint32_t level, std::int64_t x, std::int64_t y)const;
+
+private:
+	float mSize;
+	std::uint32_t mLevelCount;
+	std::uint32_t mPatchQuads;
+	float mLodDistanceRatio = 2.0f;
+
+	// First node of each level; nodes are stored level by level, row by row.
+	std::vector<std::uint32_t> mLevelOffsets;
+
+	// Height range of every node, and of the whole terrain.
+	std::vector<float> mMinHeights;
+	std::vector<float> mMaxHeights;
+	float mTerrainMinHeight = 0.0f;
+	float mTerrainMaxHeight = 0.0f;
+
+	std::vector<std::uint16_t> mIndices;
+	std::uint32_t mStitchStart[StitchVariantCount];
+	std::uint32_t mStitchCount[StitchVariantCount];
+
+	// A node was split in the current Select() if its entry equals mFrame, which
+	// saves clearing the array every frame.
+	std::vector<std::uint32_t> mSplitFrame;
+	std::uint32_t mFrame = 0;
+};
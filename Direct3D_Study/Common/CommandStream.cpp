@@ -0,0 +1,256 @@
+//***************************************************************************************
+// CommandStream.cpp
+//***************************************************************************************
+
+#include "CommandStream.h"
+
+CommandStream::CommandStream()
+{
+	mBlocks.emplace_back();
+	mBlocks.back().Bytes.reset(new std::uint8_t[BlockByteSize]);
+
+	ForgetState();
+}
+
+void CommandStream::Reset()
+{
+	mCurrentBlock = 0;
+	mBlocks[0].Used = 0;
+
+	mCommandCount = 0;
+	mDrawCount = 0;
+	mStateCount = 0;
+	mSkippedCount = 0;
+	mByteSize = 0;
+
+	ForgetState();
+}
+
+void CommandStream::ForgetState()
+{
+	mPsoKnown = false;
+	mRootSignatureKnown = false;
+	mTopologyKnown = false;
+	mIndexBufferKnown = false;
+
+	for(std::uint32_t i = 0; i < TrackedVertexBuffers; ++i)
+		mVertexBufferKnown[i] = false;
+
+	for(std::uint32_t i = 0; i < TrackedRootParameters; ++i)
+		mRootArguments[i].Known = false;
+}
+
+void CommandStream::ResourceBarrier(ID3D12Resource* resource, std::uint32_t stateBefore, std::uint32_t stateAfter)
+{
+	ResourceBarrierCommand& command = Allocate<ResourceBarrierCommand>(CommandType::ResourceBarrier);
+	command.Resource = resource;
+	command.StateBefore = stateBefore;
+	command.StateAfter = stateAfter;
+}
+
+void CommandStream::SetViewport(float topLeftX, float topLeftY, float width, float height, float minDepth, float maxDepth)
+{
+	SetViewportCommand& command = Allocate<SetViewportCommand>(CommandType::SetViewport);
+	command.TopLeftX = topLeftX;
+	command.TopLeftY = topLeftY;
+	command.Width = width;
+	command.Height = height;
+	command.MinDepth = minDepth;
+	command.MaxDepth = maxDepth;
+}
+
+void CommandStream::SetScissorRect(std::int32_t left, std::int32_t top, std::int32_t right, std::int32_t bottom)
+{
+	SetScissorRectCommand& command = Allocate<SetScissorRectCommand>(CommandType::SetScissorRect);
+	command.Left = left;
+	command.Top = top;
+	command.Right = right;
+	command.Bottom = bottom;
+}
+
+void CommandStream::ClearRenderTarget(std::uint64_t rtv, const float color[4])
+{
+	ClearRenderTargetCommand& command = Allocate<ClearRenderTargetCommand>(CommandType::ClearRenderTarget);
+	command.Rtv = rtv;
+	for(int i = 0; i < 4; ++i)
+		command.Color[i] = color[i];
+}
+
+void CommandStream::ClearDepthStencil(std::uint64_t dsv, std::uint32_t flags, float depth, std::uint32_t stencil)
+{
+	ClearDepthStencilCommand& command = Allocate<ClearDepthStencilCommand>(CommandType::ClearDepthStencil);
+	command.Dsv = dsv;
+	command.Flags = flags;
+	command.Depth = depth;
+	command.Stencil = stencil;
+}
+
+void CommandStream::SetRenderTarget(std::uint64_t rtv, std::uint64_t dsv)
+{
+	SetRenderTargetCommand& command = Allocate<SetRenderTargetCommand>(CommandType::SetRenderTarget);
+	command.Rtv = rtv;
+	command.Dsv = dsv;
+}
+
+void CommandStream::SetDescriptorHeap(ID3D12DescriptorHeap* heap)
+{
+	SetDescriptorHeapCommand& command = Allocate<SetDescriptorHeapCommand>(CommandType::SetDescriptorHeap);
+	command.Heap = heap;
+}
+
+void CommandStream::SetRootSignature(ID3D12RootSignature* rootSignature)
+{
+	if(mRootSignatureKnown && mRootSignature == rootSignature)
+	{
+		mSkippedCount++;
+		return;
+	}
+
+	SetRootSignatureCommand& command = Allocate<SetRootSignatureCommand>(CommandType::SetRootSignature);
+	command.RootSignature = rootSignature;
+	mStateCount++;
+
+	mRootSignatureKnown = true;
+	mRootSignature = rootSignature;
+	for(std::uint32_t i = 0; i < TrackedRootParameters; ++i)
+		mRootArguments[i].Known = false;
+}
+
+void CommandStream::SetPipelineState(ID3D12PipelineState* pso)
+{
+	if(mPsoKnown && mPso == pso)
+	{
+		mSkippedCount++;
+		return;
+	}
+
+	SetPipelineStateCommand& command = Allocate<SetPipelineStateCommand>(CommandType::SetPipelineState);
+	command.Pso = pso;
+	mStateCount++;
+
+	mPsoKnown = true;
+	mPso = pso;
+}
+
+void CommandStream::SetRootArgument(CommandType type, std::uint32_t rootParameterIndex, std::uint64_t value,
+	std::uint32_t offset)
+{
+	if(rootParameterIndex < TrackedRootParameters)
+	{
+		RootArgument& bound = mRootArguments[rootParameterIndex];
+
+		// Root constants are only tracked at one offset per parameter.
+		if(bound.Known && bound.Type == type && bound.Value == value && bound.Offset == offset)
+		{
+			mSkippedCount++;
+			return;
+		}
+
+		bound.Known = true;
+		bound.Type = type;
+		bound.Value = value;
+		bound.Offset = offset;
+	}
+
+	SetRootArgumentCommand& command = Allocate<SetRootArgumentCommand>(type);
+	command.RootParameterIndex = rootParameterIndex;
+	command.Value = value;
+	command.Offset = offset;
+	mStateCount++;
+}
+
+void CommandStream::SetRootDescriptorTable(std::uint32_t rootParameterIndex, std::uint64_t baseDescriptor)
+{
+	SetRootArgument(CommandType::SetRootDescriptorTable, rootParameterIndex, baseDescriptor, 0);
+}
+
+void CommandStream::SetRootConstantBufferView(std::uint32_t rootParameterIndex, std::uint64_t bufferLocation)
+{
+	SetRootArgument(CommandType::SetRootConstantBufferView, rootParameterIndex, bufferLocation, 0);
+}
+
+void CommandStream::SetRootShaderResourceView(std::uint32_t rootParameterIndex, std::uint64_t bufferLocation)
+{
+	SetRootArgument(CommandType::SetRootShaderResourceView, rootParameterIndex, bufferLocation, 0);
+}
+
+void CommandStream::SetRoot32BitConstant(std::uint32_t rootParameterIndex, std::uint32_t value, std::uint32_t offset)
+{
+	SetRootArgument(CommandType::SetRoot32BitConstant, rootParameterIndex, value, offset);
+}
+
+void CommandStream::SetVertexBuffer(std::uint32_t slot, std::uint64_t bufferLocation, std::uint32_t sizeInBytes,
+	std::uint32_t strideInBytes)
+{
+	if(slot < TrackedVertexBuffers)
+	{
+		const SetVertexBufferCommand& bound = mVertexBuffers[slot];
+		if(mVertexBufferKnown[slot] && bound.BufferLocation == bufferLocation &&
+			bound.SizeInBytes == sizeInBytes && bound.StrideInBytes == strideInBytes)
+		{
+			mSkippedCount++;
+			return;
+		}
+	}
+
+	SetVertexBufferCommand& command = Allocate<SetVertexBufferCommand>(CommandType::SetVertexBuffer);
+	command.Slot = slot;
+	command.BufferLocation = bufferLocation;
+	command.SizeInBytes = sizeInBytes;
+	command.StrideInBytes = strideInBytes;
+	mStateCount++;
+
+	if(slot < TrackedVertexBuffers)
+	{
+		mVertexBufferKnown[slot] = true;
+		mVertexBuffers[slot] = command;
+	}
+}
+
+void CommandStream::SetIndexBuffer(std::uint64_t bufferLocation, std::uint32_t sizeInBytes, std::uint32_t format)
+{
+	if(mIndexBufferKnown && mIndexBuffer.BufferLocation == bufferLocation &&
+		mIndexBuffer.SizeInBytes == sizeInBytes && mIndexBuffer.Format == format)
+	{
+		mSkippedCount++;
+		return;
+	}
+
+	SetIndexBufferCommand& command = Allocate<SetIndexBufferCommand>(CommandType::SetIndexBuffer);
+	command.BufferLocation = bufferLocation;
+	command.SizeInBytes = sizeInBytes;
+	command.Format = format;
+	mStateCount++;
+
+	mIndexBufferKnown = true;
+	mIndexBuffer = command;
+}
+
+void CommandStream::SetPrimitiveTopology(std::uint32_t topology)
+{
+	if(mTopologyKnown && mTopology == topology)
+	{
+		mSkippedCount++;
+		return;
+	}
+
+	SetPrimitiveTopologyCommand& command = Allocate<SetPrimitiveTopologyCommand>(CommandType::SetPrimitiveTopology);
+	command.Topology = topology;
+	mStateCount++;
+
+	mTopologyKnown = true;
+	mTopology = topology;
+}
+
+void CommandStream::DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+	std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+{
+	DrawIndexedInstancedCommand& command = Allocate<DrawIndexedInstancedCommand>(CommandType::DrawIndexedInstanced);
+	command.IndexCountPerInstance = indexCountPerInstance;
+	command.InstanceCount = instanceCount;
+	command.StartIndexLocation = startIndexLocation;
+	command.BaseVertexLocation = baseVertexLocation;
+	command.StartInstanceLocation = startInstanceLocation;
+
+	mDrawCount++;
+}
@@ -0,0 +1,34 @@
+//***************************************************************************************
+// ConstantUpload.h
+//
+// Batched writes of world matrices into mapped constant buffers.
+//
+// Shaders take matrices column major, so every matrix is transposed on the way.  Four
+// matrices are loaded at a time and transposed with SSE shuffles, and the results are
+// written with non-temporal stores: upload heap memory is write-combined, and the CPU
+// never reads it back, so there is no point in pulling it into the cache.
+//
+// Large updates are split across ThreadPool::Default() by contiguous ranges of CB
+// indices rather than by ranges of the item list, so each thread fills its own part of
+// the buffer and no two threads write to the same cache lines.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+
+class ConstantUpload
+{
+public:
+	// Fewer items than this are written on the calling thread.
+	static const std::uint32_t ParallelItemCount = 4096;
+
+	// For every item in items[0, itemCount), writes the transpose of matrices[item] to
+	// mappedData + cbIndices[item]*elementByteSize, where a constant buffer that
+	// starts with the matrix expects it.  Every CB index must be below cbCount, and
+	// mappedData and elementByteSize must keep each destination 16-byte aligned.
+	static void WriteTransposed(const DirectX::XMFLOAT4X4* matrices, const std::uint32_t* cbIndices,
+		const std::uint32_t* items, std::uint32_t itemCount, std::uint32_t cbCount,
+		void* mappedData, std::uint32_t elementByteSize);
+};
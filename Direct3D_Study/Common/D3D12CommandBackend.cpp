@@ -0,0 +1,128 @@
+//***************************************************************************************
+// D3D12CommandBackend.cpp
+//***************************************************************************************
+
+#include "D3D12CommandBackend.h"
+
+D3D12CommandBackend::D3D12CommandBackend(ID3D12GraphicsCommandList* cmdList)
+	: mCmdList(cmdList)
+{
+}
+
+void D3D12CommandBackend::operator()(const ResourceBarrierCommand& command)
+{
+	mCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(command.Resource,
+		(D3D12_RESOURCE_STATES)command.StateBefore, (D3D12_RESOURCE_STATES)command.StateAfter));
+}
+
+void D3D12CommandBackend::operator()(const SetViewportCommand& command)
+{
+	D3D12_VIEWPORT viewport;
+	viewport.TopLeftX = command.TopLeftX;
+	viewport.TopLeftY = command.TopLeftY;
+	viewport.Width = command.Width;
+	viewport.Height = command.Height;
+	viewport.MinDepth = command.MinDepth;
+	viewport.MaxDepth = command.MaxDepth;
+	mCmdList->RSSetViewports(1, &viewport);
+}
+
+void D3D12CommandBackend::operator()(const SetScissorRectCommand& command)
+{
+	D3D12_RECT rect = { command.Left, command.Top, command.Right, command.Bottom };
+	mCmdList->RSSetScissorRects(1, &rect);
+}
+
+void D3D12CommandBackend::operator()(const ClearRenderTargetCommand& command)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE rtv;
+	rtv.ptr = (SIZE_T)command.Rtv;
+	mCmdList->ClearRenderTargetView(rtv, command.Color, 0, nullptr);
+}
+
+void D3D12CommandBackend::operator()(const ClearDepthStencilCommand& command)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE dsv;
+	dsv.ptr = (SIZE_T)command.Dsv;
+	mCmdList->ClearDepthStencilView(dsv, (D3D12_CLEAR_FLAGS)command.Flags, command.Depth, (UINT8)command.Stencil,
+		0, nullptr);
+}
+
+void D3D12CommandBackend::operator()(const SetRenderTargetCommand& command)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE rtv;
+	rtv.ptr = (SIZE_T)command.Rtv;
+	D3D12_CPU_DESCRIPTOR_HANDLE dsv;
+	dsv.ptr = (SIZE_T)command.Dsv;
+	mCmdList->OMSetRenderTargets(1, &rtv, true, command.Dsv != 0 ? &dsv : nullptr);
+}
+
+void D3D12CommandBackend::operator()(const SetDescriptorHeapCommand& command)
+{
+	ID3D12DescriptorHeap* heaps[] = { command.Heap };
+	mCmdList->SetDescriptorHeaps(_countof(heaps), heaps);
+}
+
+void D3D12CommandBackend::operator()(const SetRootSignatureCommand& command)
+{
+	mCmdList->SetGraphicsRootSignature(command.RootSignature);
+}
+
+void D3D12CommandBackend::operator()(const SetPipelineStateCommand& command)
+{
+	mCmdList->SetPipelineState(command.Pso);
+}
+
+void D3D12CommandBackend::operator()(const SetRootArgumentCommand& command)
+{
+	switch(command.Type)
+	{
+	case CommandType::SetRootDescriptorTable:
+	{
+		D3D12_GPU_DESCRIPTOR_HANDLE table;
+		table.ptr = command.Value;
+		mCmdList->SetGraphicsRootDescriptorTable(command.RootParameterIndex, table);
+		break;
+	}
+	case CommandType::SetRootConstantBufferView:
+		mCmdList->SetGraphicsRootConstantBufferView(command.RootParameterIndex, command.Value);
+		break;
+	case CommandType::SetRootShaderResourceView:
+		mCmdList->SetGraphicsRootShaderResourceView(command.RootParameterIndex, command.Value);
+		break;
+	case CommandType::SetRoot32BitConstant:
+		mCmdList->SetGraphicsRoot32BitConstant(command.RootParameterIndex, (UINT)command.Value, command.Offset);
+		break;
+	default:
+		break;
+	}
+}
+
+void D3D12CommandBackend::operator()(const SetVertexBufferCommand& command)
+{
+	D3D12_VERTEX_BUFFER_VIEW vbv;
+	vbv.BufferLocation = command.BufferLocation;
+	vbv.SizeInBytes = command.SizeInBytes;
+	vbv.StrideInBytes = command.StrideInBytes;
+	mCmdList->IASetVertexBuffers(command.Slot, 1, &vbv);
+}
+
+void D3D12CommandBackend::operator()(const SetIndexBufferCommand& command)
+{
+	D3D12_INDEX_BUFFER_VIEW ibv;
+	ibv.BufferLocation = command.BufferLocation;
+	ibv.SizeInBytes = command.SizeInBytes;
+	ibv.Format = (DXGI_FORMAT)command.Format;
+	mCmdList->IASetIndexBuffer(&ibv);
+}
+
+void D3D12CommandBackend::operator()(const SetPrimitiveTopologyCommand& command)
+{
+	mCmdList->IASetPrimitiveTopology((D3D12_PRIMITIVE_TOPOLOGY)command.Topology);
+}
+
+void D3D12CommandBackend::operator()(const DrawIndexedInstancedCommand& command)
+{
+	mCmdList->DrawIndexedInstanced(command.IndexCountPerInstance, command.InstanceCount,
+		command.StartIndexLocation, command.BaseVertexLocation, command.StartInstanceLocation);
+}
@@ -0,0 +1,73 @@
+//***************************************************************************************
+// FrustumCuller.h
+//
+// Culls world space bounding boxes against the camera frustum in bulk.
+//
+// The boxes are kept in structure of arrays form, one array per center and extent
+// component, so each SSE step tests the same plane against four boxes, and every loop
+// iteration tests two such groups (eight boxes).  A box is culled when it lies entirely
+// on the outside of any of the six planes; boxes that straddle a plane are kept.  The
+// planes are taken straight from the view-projection matrix, so no BoundingFrustum has
+// to be transformed to world space first.
+//
+// Boxes are split into fixed chunks that are culled in parallel on ThreadPool::Default().
+// Each chunk writes its visible indices into its own part of the output, and the parts
+// are then moved together, so the visible list comes out in increasing index order
+// regardless of how the chunks were scheduled.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+
+class FrustumCuller
+{
+public:
+	// Boxes culled per task.  A multiple of the eight boxes tested per iteration.
+	static const std::uint32_t ChunkSize = 4096;
+
+	// Grows or shrinks the box arrays.  New boxes are empty boxes at the origin and
+	// should be set before the next Cull.
+	void Resize(std::uint32_t count);
+	std::uint32_t Count()const;
+
+	void SetBounds(std::uint32_t index, const DirectX::BoundingBox& worldBounds);
+
+	// Transforms localBounds by world and stores the axis aligned box around the result.
+	void SetBounds(std::uint32_t index, const DirectX::BoundingBox& localBounds, DirectX::FXMMATRIX world);
+
+	// Extracts the frustum planes of viewProj, which maps world space to clip space
+	// (row vectors, D3D depth range [0, 1]).
+	void SetViewProj(DirectX::FXMMATRIX viewProj);
+
+	// The planes SetViewProj uses: left, right, bottom, top, near, far, normalized,
+	// with normals pointing into the frustum.
+	static void ExtractPlanes(DirectX::FXMMATRIX viewProj, DirectX::XMFLOAT4 planes[6]);
+
+	// Replaces visible with the indices of the boxes that intersect the frustum, in
+	// increasing order.  Keep visible around to avoid allocating every frame.
+	void Cull(std::vector<std::uint32_t>& visible);
+
+private:
+	std::uint32_t CullRange(std::uint32_t begin, std::uint32_t end, std::uint32_t* visible)const;
+
+private:
+	std::uint32_t mCount = 0;
+
+	// Padded to a multiple of eight so the last iteration can load whole groups.
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+
+	// Left, right, bottom, top, near, far; normals point into the frustum.  All zero
+	// until SetViewProj, which culls nothing.
+	DirectX::XMFLOAT4 mPlanes[6] = {};
+
+	std::vector<std::uint32_t> mChunkCounts;
+};
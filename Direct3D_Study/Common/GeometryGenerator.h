@@ -16,6 +16,9 @@
 
 #include <cstdint>
 #include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <DirectXCollision.h>
+#include <stdexcept>
 #include <vector>
 
 class GeometryGenerator
@@ -25,6 +28,10 @@ public:
     using uint16 = std::uint16_t;
     using uint32 = std::uint32_t;
 
+	// Bumped whenever a generator returns different vertices or indices for the same
+	// arguments, so that meshes saved to disk by an older version are not reused.
+	static const uint32 Version = 1;
+
 	struct Vertex
 	{
 		Vertex(){}
@@ -56,22 +63,123 @@ public:
 	struct MeshData
 	{
 		std::vector<Vertex> Vertices;
+
+		// Only one of the index arrays is populated at a time.  Generators pick
+		// 16-bit indices whenever the vertex count allows it, so check
+		// Uses16BitIndices() (or use IndexCount()/GetIndex()) instead of
+		// assuming Indices32 is filled.
         std::vector<uint32> Indices32;
+        std::vector<uint16> Indices16;
+
+		// Bounding volumes of the vertices, filled in by every generator.
+		DirectX::BoundingBox Bounds;
+		DirectX::BoundingSphere SphereBounds;
+
+		bool Uses16BitIndices()const
+		{
+			return mUse16BitIndices;
+		}
+
+		size_t IndexCount()const
+		{
+			return mUse16BitIndices ? Indices16.size() : Indices32.size();
+		}
+
+		uint32 GetIndex(size_t i)const
+		{
+			return mUse16BitIndices ? Indices16[i] : Indices32[i];
+		}
+
+		// Clears the indices and selects the narrowest index width able to
+		// address vertexCount vertices.
+		void ResetIndices(size_t vertexCount, size_t indexCapacity = 0)
+		{
+			std::vector<uint16>().swap(Indices16);
+			std::vector<uint32>().swap(Indices32);
+
+			mUse16BitIndices = vertexCount <= 0x10000;
+			if(mUse16BitIndices)
+				Indices16.reserve(indexCapacity);
+			else
+				Indices32.reserve(indexCapacity);
+		}
+
+		// Widens to 32-bit indices the first time an index does not fit in 16 bits.
+		void AddIndex(uint32 i)
+		{
+			if(mUse16BitIndices && i > 0xffff)
+			{
+				size_t capacity = Indices16.capacity();
+				GetIndices32().reserve(capacity);
+			}
 
+			if(mUse16BitIndices)
+				Indices16.push_back(static_cast<uint16>(i));
+			else
+				Indices32.push_back(i);
+		}
+
+		// Converts to 16-bit indices if needed and releases the 32-bit copy.
+		// Throws std::overflow_error if an index does not fit in 16 bits.
         std::vector<uint16>& GetIndices16()
         {
-			if(mIndices16.empty())
+			if(!mUse16BitIndices)
 			{
-				mIndices16.resize(Indices32.size());
-				for(size_t i = 0; i < Indices32.size(); ++i)
-					mIndices16[i] = static_cast<uint16>(Indices32[i]);
+				for(uint32 i : Indices32)
+				{
+					if(i > 0xffff)
+						throw std::overflow_error("MeshData::GetIndices16: index does not fit in 16 bits.");
+				}
+
+				Indices16.assign(Indices32.begin(), Indices32.end());
+				std::vector<uint32>().swap(Indices32);
+				mUse16BitIndices = true;
 			}
 
-			return mIndices16;
+			return Indices16;
+        }
+
+		// Converts to 32-bit indices if needed and releases the 16-bit copy.
+        std::vector<uint32>& GetIndices32()
+        {
+			if(mUse16BitIndices)
+			{
+				Indices32.assign(Indices16.begin(), Indices16.end());
+				std::vector<uint16>().swap(Indices16);
+				mUse16BitIndices = false;
+			}
+
+			return Indices32;
         }
 
 	private:
-		std::vector<uint16> mIndices16;
+		bool mUse16BitIndices = false;
+	};
+
+	// Compact 20 byte alternative to Vertex (44 bytes).  Positions are 16-bit
+	// UNORM relative to the mesh AABB, normals and tangents are octahedral
+	// 16-bit SNORM and texture coordinates are half floats.  Matching input
+	// layout formats:
+	//   Position: DXGI_FORMAT_R16G16B16A16_UNORM (w is unused)
+	//   Normal:   DXGI_FORMAT_R16G16_SNORM
+	//   TangentU: DXGI_FORMAT_R16G16_SNORM
+	//   TexC:     DXGI_FORMAT_R16G16_FLOAT
+	// The shader recovers the position with PosL = Position*PositionScale + PositionBias.
+	struct PackedVertex
+	{
+		DirectX::PackedVector::XMUSHORTN4 Position;
+		DirectX::PackedVector::XMSHORTN2 Normal;
+		DirectX::PackedVector::XMSHORTN2 TangentU;
+		DirectX::PackedVector::XMHALF2 TexC;
+	};
+
+	struct PackedMeshData
+	{
+		std::vector<PackedVertex> Vertices;
+
+		// Decode metadata; copy into SubmeshGeometry::PositionScale/PositionBias.
+		DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+		DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
 	};
 
 	///<summary>
@@ -88,7 +196,8 @@ public:
 
 	///<summary>
 	/// Creates a geosphere centered at the origin with the given radius.  The
-	/// depth controls the level of tessellation.
+	/// depth controls the level of tessellation: each level splits every triangle
+	/// into four, up to level 14.
 	///</summary>
     MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
 
@@ -110,10 +219,60 @@ public:
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 
+	///<summary>
+	/// Quantizes the vertices of meshData into the PackedVertex format.  The
+	/// position scale/bias needed to decode is returned with the vertices.
+	///</summary>
+    PackedMeshData PackMesh(const MeshData& meshData);
+
+	///<summary>
+	/// Recomputes meshData.Bounds and meshData.SphereBounds from the vertex positions.
+	/// Use after modifying the vertices of a generated mesh.
+	///</summary>
+    void ComputeBounds(MeshData& meshData);
+
+	///<summary>
+	/// Computes the AABB and a bounding sphere (centered on the AABB) of count
+	/// XMFLOAT3 positions spaced stride bytes apart, e.g., the Pos member of an
+	/// application defined vertex.
+	///</summary>
+    void ComputeBounds(const void* positions, size_t count, size_t stride,
+        DirectX::BoundingBox& box, DirectX::BoundingSphere& sphere);
+
+	///<summary>
+	/// Meshes with at least this many vertices are generated on ThreadPool::Default().
+	/// The output does not depend on the number of threads used; pass SIZE_MAX to
+	/// always generate on the calling thread.
+	///</summary>
+    void SetParallelThreshold(size_t minVertexCount);
+
 private:
+	// sin/cos of every slice angle and the matching u texture coordinate.  Every
+	// ring of a sphere or cylinder reuses them, and the arrays are padded to a
+	// multiple of four so rings can be evaluated four slices at a time.
+	struct SliceTable
+	{
+		std::vector<float> Cos;
+		std::vector<float> Sin;
+		std::vector<float> U;
+	};
+
 	void Subdivide(MeshData& meshData);
+    DirectX::XMVECTOR OctahedralEncode(DirectX::FXMVECTOR n);
+    void SetBounds(MeshData& meshData, const DirectX::XMFLOAT3& extents, float radius);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+    Vertex GeosphereVertex(float radius, DirectX::FXMVECTOR direction);
+    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const SliceTable& slices, MeshData& meshData);
+    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const SliceTable& slices, MeshData& meshData);
+    void BuildSliceTable(uint32 sliceCount, SliceTable& slices);
+    void BuildSphereRing(float radius, float phi, uint32 sliceCount, const SliceTable& slices, Vertex* ring);
+    void BuildCylinderRing(float radius, float y, float v, float normalXZ, float normalY, uint32 sliceCount, const SliceTable& slices, Vertex* ring);
+    void BuildCapRing(float radius, float y, float normalY, float height, uint32 sliceCount, const SliceTable& slices, Vertex* ring);
+
+    template<typename Body>
+    void ForEachRow(size_t rowCount, size_t rowVertexCount, Body&& body);
+
+private:
+    size_t mParallelVertexThreshold = 32768;
 };
 
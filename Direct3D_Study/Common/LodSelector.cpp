@@ -0,0 +1,183 @@
+//***************************************************************************************
+// LodSelector.cpp
+//***************************************************************************************
+
+#include "LodSelector.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <stdexcept>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// Items selected per task.
+	const std::uint32_t SelectGrainSize = 4096;
+}
+
+LodSelector::LodSelector(float hysteresis)
+	: mHysteresis(hysteresis)
+{
+	if(!(hysteresis >= 0.0f && hysteresis < 1.0f))
+		throw std::invalid_argument("LodSelector: hysteresis must be in [0, 1).");
+
+	// The row of NoTable: always the finest level.
+	mCoarser.push_back(XMFLOAT4(-1.0f, -1.0f, -1.0f, -1.0f));
+	mFiner.push_back(XMFLOAT4(-1.0f, -1.0f, -1.0f, -1.0f));
+}
+
+std::uint32_t LodSelector::AddTable(const LodLevel* levels, std::uint32_t count)
+{
+	if(count < 1 || count > MaxLevels)
+		throw std::invalid_argument("LodSelector: a table must have 1 to 4 levels.");
+
+	float switchSizes[MaxLevels - 1] = { -1.0f, -1.0f, -1.0f };
+	float coarser[MaxLevels - 1] = { -1.0f, -1.0f, -1.0f };
+	float finer[MaxLevels - 1] = { -1.0f, -1.0f, -1.0f };
+	for(std::uint32_t i = 1; i < count; ++i)
+	{
+		// The switch size to level i is where level i - 1 stops.
+		float size = levels[i - 1].MinScreenSize;
+		if(!(size > 0.0f) || (i > 1 && !(size < switchSizes[i - 2])))
+			throw std::invalid_argument("LodSelector: MinScreenSize must be positive and decrease with the level.");
+
+		switchSizes[i - 1] = size;
+		coarser[i - 1] = size*size*(1.0f - mHysteresis)*(1.0f - mHysteresis);
+		finer[i - 1] = size*size*(1.0f + mHysteresis)*(1.0f + mHysteresis);
+	}
+
+	mCoarser.push_back(XMFLOAT4(coarser[0], coarser[1], coarser[2], -1.0f));
+	mFiner.push_back(XMFLOAT4(finer[0], finer[1], finer[2], -1.0f));
+
+	for(std::uint32_t i = 0; i < MaxLevels; ++i)
+		mLevels.push_back(levels[std::min(i, count - 1)]);
+	mLevelCounts.push_back(count);
+
+	return (std::uint32_t)mLevelCounts.size() - 1;
+}
+
+const LodLevel& LodSelector::GetLevel(std::uint32_t table, std::uint32_t level)const
+{
+	return mLevels[table*MaxLevels + level];
+}
+
+float LodSelector::ScreenSize(const BoundingBox& worldBounds, FXMVECTOR eyePos, float projScale)
+{
+	float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBounds.Extents)));
+	float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&worldBounds.Center), eyePos)));
+	return radius*projScale / distance;
+}
+
+void LodSelector::Select(RenderItemStore& store, const std::vector<std::uint32_t>& items,
+	const BoundingBox* worldBounds, FXMVECTOR eyePos, float projScale)const
+{
+	std::uint32_t count = (std::uint32_t)items.size();
+	if(count < ParallelItemCount)
+	{
+		SelectRange(store, items.data(), count, worldBounds, eyePos, projScale);
+		return;
+	}
+
+	// Every item is written by one task, so SetLod calls never overlap.
+	XMVECTOR eye = eyePos;
+	ThreadPool::Default().ParallelFor(count, SelectGrainSize, [&](size_t begin, size_t end)
+	{
+		SelectRange(store, items.data() + begin, (std::uint32_t)(end - begin), worldBounds, eye, projScale);
+	});
+}
+
+void LodSelector::SelectRange(RenderItemStore& store, const std::uint32_t* items, std::uint32_t count,
+	const BoundingBox* worldBounds, FXMVECTOR eyePos, float projScale)const
+{
+	const std::vector<std::uint32_t>& lodTable = store.LodTable();
+	const std::vector<std::uint8_t>& lodLevel = store.LodLevel();
+
+	XMVECTOR eyeX = XMVectorSplatX(eyePos);
+	XMVECTOR eyeY = XMVectorSplatY(eyePos);
+	XMVECTOR eyeZ = XMVectorSplatZ(eyePos);
+	XMVECTOR projScaleSq = XMVectorReplicate(projScale*projScale);
+	XMVECTOR one = XMVectorReplicate(1.0f);
+
+	for(std::uint32_t i = 0; i < count; i += 4)
+	{
+		// A short last group repeats its last item in the unused lanes.
+		std::uint32_t lanes = std::min<std::uint32_t>(count - i, 4);
+		std::uint32_t ri[4];
+		std::uint32_t row[4];
+		for(std::uint32_t j = 0; j < 4; ++j)
+		{
+			ri[j] = items[i + std::min(j, lanes - 1)];
+
+			// NoTable + 1 wraps to row 0.
+			row[j] = lodTable[ri[j]] + 1;
+		}
+
+		XMVECTOR centerX = XMLoadFloat3(&worldBounds[ri[0]].Center);
+		XMVECTOR centerY = XMLoadFloat3(&worldBounds[ri[1]].Center);
+		XMVECTOR centerZ = XMLoadFloat3(&worldBounds[ri[2]].Center);
+		XMVECTOR centerW = XMLoadFloat3(&worldBounds[ri[3]].Center);
+		_MM_TRANSPOSE4_PS(centerX, centerY, centerZ, centerW);
+
+		XMVECTOR extentX = XMLoadFloat3(&worldBounds[ri[0]].Extents);
+		XMVECTOR extentY = XMLoadFloat3(&worldBounds[ri[1]].Extents);
+		XMVECTOR extentZ = XMLoadFloat3(&worldBounds[ri[2]].Extents);
+		XMVECTOR extentW = XMLoadFloat3(&worldBounds[ri[3]].Extents);
+		_MM_TRANSPOSE4_PS(extentX, extentY, extentZ, extentW);
+
+		XMVECTOR dx = XMVectorSubtract(centerX, eyeX);
+		XMVECTOR dy = XMVectorSubtract(centerY, eyeY);
+		XMVECTOR dz = XMVectorSubtract(centerZ, eyeZ);
+		XMVECTOR distanceSq = XMVectorMultiplyAdd(dz, dz, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dx, dx)));
+		XMVECTOR radiusSq = XMVectorMultiplyAdd(extentZ, extentZ,
+			XMVectorMultiplyAdd(extentY, extentY, XMVectorMultiply(extentX, extentX)));
+
+		// size^2 < s^2 is radius^2*projScale^2 < s^2*distance^2.
+		XMVECTOR scaledSizeSq = XMVectorMultiply(radiusSq, projScaleSq);
+
+		XMVECTOR coarser0 = XMLoadFloat4(&mCoarser[row[0]]);
+		XMVECTOR coarser1 = XMLoadFloat4(&mCoarser[row[1]]);
+		XMVECTOR coarser2 = XMLoadFloat4(&mCoarser[row[2]]);
+		XMVECTOR coarser3 = XMLoadFloat4(&mCoarser[row[3]]);
+		_MM_TRANSPOSE4_PS(coarser0, coarser1, coarser2, coarser3);
+
+		XMVECTOR finer0 = XMLoadFloat4(&mFiner[row[0]]);
+		XMVECTOR finer1 = XMLoadFloat4(&mFiner[row[1]]);
+		XMVECTOR finer2 = XMLoadFloat4(&mFiner[row[2]]);
+		XMVECTOR finer3 = XMLoadFloat4(&mFiner[row[3]]);
+		_MM_TRANSPOSE4_PS(finer0, finer1, finer2, finer3);
+
+		// The levels the item is certainly at least as coarse as, and at most as coarse
+		// as: the number of switch sizes it is below with and without the hysteresis.
+		auto countBelow = [&](FXMVECTOR s0, FXMVECTOR s1, FXMVECTOR s2)
+		{
+			XMVECTOR below0 = XMVectorLess(scaledSizeSq, XMVectorMultiply(s0, distanceSq));
+			XMVECTOR below1 = XMVectorLess(scaledSizeSq, XMVectorMultiply(s1, distanceSq));
+			XMVECTOR below2 = XMVectorLess(scaledSizeSq, XMVectorMultiply(s2, distanceSq));
+			return XMVectorAdd(XMVectorAdd(XMVectorAndInt(below0, one), XMVectorAndInt(below1, one)),
+				XMVectorAndInt(below2, one));
+		};
+		XMVECTOR minLevel = countBelow(coarser0, coarser1, coarser2);
+		XMVECTOR maxLevel = countBelow(finer0, finer1, finer2);
+
+		XMVECTOR previous = XMVectorSet(lodLevel[ri[0]], lodLevel[ri[1]], lodLevel[ri[2]], lodLevel[ri[3]]);
+		XMVECTOR level = XMVectorMin(XMVectorMax(previous, minLevel), maxLevel);
+
+		// Most items keep their level from one frame to the next.
+		int changed = _mm_movemask_ps(XMVectorNotEqual(level, previous)) & ((1 << lanes) - 1);
+		if(changed == 0)
+			continue;
+
+		XMFLOAT4 levels;
+		XMStoreFloat4(&levels, level);
+		for(std::uint32_t j = 0; j < lanes; ++j)
+		{
+			if(!(changed & (1 << j)))
+				continue;
+
+			std::uint8_t newLevel = (std::uint8_t)(&levels.x)[j];
+			const LodLevel& lod = mLevels[(row[j] - 1)*MaxLevels + newLevel];
+			store.SetLod(ri[j], newLevel, lod.DrawArgs, lod.SubmeshId);
+		}
+	}
+}
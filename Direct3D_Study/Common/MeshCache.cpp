@@ -0,0 +1,253 @@
+//***************************************************************************************
+// MeshCache.cpp
+//***************************************************************************************
+
+#include "MeshCache.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// FNV-1a over the raw bytes of a key.
+	size_t HashBytes(const void* data, size_t byteSize, size_t hash = 14695981039346656037ull)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for(size_t i = 0; i < byteSize; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	size_t MeshByteSize(const GeometryGenerator::MeshData& mesh)
+	{
+		return mesh.Vertices.size()*sizeof(GeometryGenerator::Vertex) +
+			mesh.Indices32.size()*sizeof(std::uint32_t) +
+			mesh.Indices16.size()*sizeof(std::uint16_t);
+	}
+}
+
+MeshKey MeshKey::Box(float width, float height, float depth, std::uint32_t numSubdivisions)
+{
+	MeshKey key;
+	key.Shape = MeshShape::Box;
+	key.Params[0] = width;
+	key.Params[1] = height;
+	key.Params[2] = depth;
+	key.Counts[0] = numSubdivisions;
+	return key;
+}
+
+MeshKey MeshKey::Sphere(float radius, std::uint32_t sliceCount, std::uint32_t stackCount)
+{
+	MeshKey key;
+	key.Shape = MeshShape::Sphere;
+	key.Params[0] = radius;
+	key.Counts[0] = sliceCount;
+	key.Counts[1] = stackCount;
+	return key;
+}
+
+MeshKey MeshKey::Geosphere(float radius, std::uint32_t numSubdivisions)
+{
+	MeshKey key;
+	key.Shape = MeshShape::Geosphere;
+	key.Params[0] = radius;
+	key.Counts[0] = numSubdivisions;
+	return key;
+}
+
+MeshKey MeshKey::Cylinder(float bottomRadius, float topRadius, float height, std::uint32_t sliceCount, std::uint32_t stackCount)
+{
+	MeshKey key;
+	key.Shape = MeshShape::Cylinder;
+	key.Params[0] = bottomRadius;
+	key.Params[1] = topRadius;
+	key.Params[2] = height;
+	key.Counts[0] = sliceCount;
+	key.Counts[1] = stackCount;
+	return key;
+}
+
+MeshKey MeshKey::Grid(float width, float depth, std::uint32_t m, std::uint32_t n)
+{
+	MeshKey key;
+	key.Shape = MeshShape::Grid;
+	key.Params[0] = width;
+	key.Params[1] = depth;
+	key.Counts[0] = m;
+	key.Counts[1] = n;
+	return key;
+}
+
+MeshKey MeshKey::Quad(float x, float y, float w, float h, float depth)
+{
+	MeshKey key;
+	key.Shape = MeshShape::Quad;
+	key.Params[0] = x;
+	key.Params[1] = y;
+	key.Params[2] = w;
+	key.Params[3] = h;
+	key.Params[4] = depth;
+	return key;
+}
+
+bool MeshKey::operator==(const MeshKey& rhs)const
+{
+	return memcmp(this, &rhs, sizeof(MeshKey)) == 0;
+}
+
+size_t MeshKeyHash::operator()(const MeshKey& key)const
+{
+	return HashBytes(&key, sizeof(MeshKey));
+}
+
+MeshCache::MeshCache(size_t memoryBudget)
+	: mMemoryBudget(memoryBudget)
+{
+}
+
+std::shared_ptr<const MeshCache::MeshData> MeshCache::GetMesh(const MeshKey& key)
+{
+	std::promise<std::shared_ptr<const MeshData>> promise;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+
+		auto it = mMeshes.find(key);
+		if(it != mMeshes.end())
+		{
+			mStats.MeshHits++;
+			if(it->second.Ready)
+			{
+				Touch(it->second.Lru);
+				return it->second.Mesh.get();
+			}
+
+			// Another request is generating the mesh.
+			std::shared_future<std::shared_ptr<const MeshData>> pending = it->second.Mesh;
+			lock.unlock();
+			return pending.get();
+		}
+
+		mStats.MeshMisses++;
+
+		MeshEntry entry;
+		entry.Mesh = promise.get_future().share();
+		mMeshes.emplace(key, std::move(entry));
+	}
+
+	std::shared_ptr<const MeshData> mesh;
+	try
+	{
+		mesh = std::make_shared<const MeshData>(Generate(key));
+	}
+	catch(...)
+	{
+		promise.set_exception(std::current_exception());
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mMeshes.erase(key);
+		throw;
+	}
+
+	promise.set_value(mesh);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Entries being generated are never evicted, so it is still there.
+	MeshEntry& entry = mMeshes.at(key);
+	entry.Ready = true;
+	entry.Bytes = MeshByteSize(*mesh);
+	entry.Lru = mLru.insert(mLru.begin(), key);
+
+	mStats.MeshBytes += entry.Bytes;
+
+	EnforceBudget();
+
+	return mesh;
+}
+
+void MeshCache::SetMemoryBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMemoryBudget = bytes;
+	EnforceBudget();
+}
+
+size_t MeshCache::GetMemoryBudget()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMemoryBudget;
+}
+
+void MeshCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	size_t budget = mMemoryBudget;
+	mMemoryBudget = 0;
+	EnforceBudget();
+	mMemoryBudget = budget;
+}
+
+MeshCache::Stats MeshCache::GetStats()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void MeshCache::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// The byte count describes the current contents, not history.
+	Stats stats;
+	stats.MeshBytes = mStats.MeshBytes;
+	mStats = stats;
+}
+
+MeshCache::MeshData MeshCache::Generate(const MeshKey& key)
+{
+	const float* p = key.Params;
+	const std::uint32_t* n = key.Counts;
+
+	switch(key.Shape)
+	{
+	case MeshShape::Box:       return mGeoGen.CreateBox(p[0], p[1], p[2], n[0]);
+	case MeshShape::Sphere:    return mGeoGen.CreateSphere(p[0], n[0], n[1]);
+	case MeshShape::Geosphere: return mGeoGen.CreateGeosphere(p[0], n[0]);
+	case MeshShape::Cylinder:  return mGeoGen.CreateCylinder(p[0], p[1], p[2], n[0], n[1]);
+	case MeshShape::Grid:      return mGeoGen.CreateGrid(p[0], p[1], n[0], n[1]);
+	case MeshShape::Quad:      return mGeoGen.CreateQuad(p[0], p[1], p[2], p[3], p[4]);
+	}
+
+	throw std::invalid_argument("MeshCache: unknown MeshShape");
+}
+
+void MeshCache::Touch(LruIterator node)
+{
+	mLru.splice(mLru.begin(), mLru, node);
+}
+
+void MeshCache::EnforceBudget()
+{
+	// Walk from the least recently used entry and release the ones the application
+	// no longer holds.  Releasing the others would not free memory, only lose the
+	// sharing.
+	auto it = mLru.end();
+	while(it != mLru.begin() && mStats.MeshBytes > mMemoryBudget)
+	{
+		--it;
+
+		auto mesh = mMeshes.find(*it);
+		if(mesh->second.Mesh.get().use_count() > 1)
+			continue;
+
+		mStats.MeshBytes -= mesh->second.Bytes;
+		mMeshes.erase(mesh);
+
+		it = mLru.erase(it);
+		mStats.Evictions++;
+	}
+}
@@ -0,0 +1,550 @@
+//***************************************************************************************
+// MeshCodec.cpp
+//***************************************************************************************
+
+#include "MeshCodec.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <emmintrin.h>
+#include <xmmintrin.h>
+
+namespace
+{
+	const std::uint32_t MeshCodecMagic = 0x4344434d; // "MCDC"
+
+	const std::uint32_t GroupSize = 16;
+	const std::uint32_t GroupsPerBlock = MeshCodec::BlockSize / GroupSize;
+	static_assert(GroupsPerBlock*2 <= 32, "The bit widths of a byte plane must fit in 32 bits.");
+
+	// Bytes per element in each bit width code.
+	const std::uint32_t GroupBytes[4] = { 0, 4, 8, 16 };
+
+	struct MeshCodecHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+		std::uint32_t VertexCount;
+		std::uint32_t VertexByteStride;
+		std::uint32_t IndexCount;
+		std::uint32_t IndexByteSize;
+		std::uint32_t VertexBlockCount;
+		std::uint32_t IndexBlockCount;
+
+		// Followed by VertexBlockCount + IndexBlockCount + 1 block offsets, relative to
+		// the end of the offset table, then by the blocks.
+	};
+
+	std::uint32_t BlockCount(std::uint32_t count)
+	{
+		return (count + MeshCodec::BlockSize - 1) / MeshCodec::BlockSize;
+	}
+
+	// Largest encoding of a block: the bit widths and 8 bits per byte for every plane.
+	size_t MaxBlockBytes(std::uint32_t laneCount, std::uint32_t planeCount)
+	{
+		return (size_t)laneCount*planeCount*(sizeof(std::uint32_t) + MeshCodec::BlockSize);
+	}
+
+	std::uint32_t Zigzag32(std::uint32_t delta)
+	{
+		return (delta << 1) ^ (std::uint32_t)((std::int32_t)delta >> 31);
+	}
+
+	std::uint32_t Zigzag16(std::uint32_t delta)
+	{
+		std::uint16_t d = (std::uint16_t)delta;
+		return (std::uint16_t)((d << 1) ^ (std::uint16_t)((std::int16_t)d >> 15));
+	}
+
+	// Writes planeCount byte planes of count values: per plane, 2 bits of width code per
+	// group of 16 bytes, then the groups packed at that width.  Returns the bytes written.
+	size_t EncodePlanes(const std::uint32_t* values, std::uint32_t count, std::uint32_t planeCount, std::uint8_t* out)
+	{
+		std::uint8_t* start = out;
+		std::uint32_t groupCount = (count + GroupSize - 1) / GroupSize;
+
+		for(std::uint32_t plane = 0; plane < planeCount; ++plane)
+		{
+			std::uint8_t* widthsOut = out;
+			out += sizeof(std::uint32_t);
+			std::uint32_t widths = 0;
+
+			for(std::uint32_t group = 0; group < groupCount; ++group)
+			{
+				std::uint8_t bytes[GroupSize] = {};
+				std::uint8_t maxByte = 0;
+				for(std::uint32_t i = 0; i < GroupSize && group*GroupSize + i < count; ++i)
+				{
+					bytes[i] = (std::uint8_t)(values[group*GroupSize + i] >> (8*plane));
+					maxByte = std::max<std::uint8_t>(maxByte, bytes[i]);
+				}
+
+				std::uint32_t code = maxByte == 0 ? 0 : maxByte < 4 ? 1 : maxByte < 16 ? 2 : 3;
+				widths |= code << (2*group);
+
+				// Element 4k+j sits in bits 2j of byte k, and element 2k+j in bits 4j of byte k.
+				if(code == 1)
+				{
+					for(std::uint32_t k = 0; k < 4; ++k)
+						out[k] = (std::uint8_t)(bytes[4*k] | (bytes[4*k + 1] << 2) | (bytes[4*k + 2] << 4) | (bytes[4*k + 3] << 6));
+				}
+				else if(code == 2)
+				{
+					for(std::uint32_t k = 0; k < 8; ++k)
+						out[k] = (std::uint8_t)(bytes[2*k] | (bytes[2*k + 1] << 4));
+				}
+				else if(code == 3)
+				{
+					memcpy(out, bytes, GroupSize);
+				}
+				out += GroupBytes[code];
+			}
+
+			memcpy(widthsOut, &widths, sizeof(widths));
+		}
+
+		return out - start;
+	}
+
+	// Unpacks one byte plane of groupCount groups into bytes.  Returns false if the
+	// plane runs past end.
+	bool DecodePlane(const std::uint8_t*& in, const std::uint8_t* end, std::uint32_t groupCount, std::uint8_t* bytes)
+	{
+		if(end - in < (std::ptrdiff_t)sizeof(std::uint32_t))
+			return false;
+
+		std::uint32_t widths;
+		memcpy(&widths, in, sizeof(widths));
+		in += sizeof(widths);
+
+		const __m128i mask2 = _mm_set1_epi8(0x03);
+		const __m128i mask4 = _mm_set1_epi8(0x0f);
+
+		for(std::uint32_t group = 0; group < groupCount; ++group)
+		{
+			std::uint32_t code = (widths >> (2*group)) & 3;
+			if(end - in < (std::ptrdiff_t)GroupBytes[code])
+				return false;
+
+			__m128i result;
+			if(code == 0)
+			{
+				result = _mm_setzero_si128();
+			}
+			else if(code == 1)
+			{
+				int packed;
+				memcpy(&packed, in, sizeof(packed));
+				__m128i v = _mm_cvtsi32_si128(packed);
+
+				__m128i e0 = _mm_and_si128(v, mask2);
+				__m128i e1 = _mm_and_si128(_mm_srli_epi16(v, 2), mask2);
+				__m128i e2 = _mm_and_si128(_mm_srli_epi16(v, 4), mask2);
+				__m128i e3 = _mm_and_si128(_mm_srli_epi16(v, 6), mask2);
+				result = _mm_unpacklo_epi16(_mm_unpacklo_epi8(e0, e1), _mm_unpacklo_epi8(e2, e3));
+			}
+			else if(code == 2)
+			{
+				__m128i v = _mm_loadl_epi64((const __m128i*)in);
+				__m128i lo = _mm_and_si128(v, mask4);
+				__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask4);
+				result = _mm_unpacklo_epi8(lo, hi);
+			}
+			else
+			{
+				result = _mm_loadu_si128((const __m128i*)in);
+			}
+
+			_mm_store_si128((__m128i*)(bytes + group*GroupSize), result);
+			in += GroupBytes[code];
+		}
+
+		return true;
+	}
+
+	// Undoes the zigzag of four deltas and adds them up on top of the last value of
+	// previous.
+	__m128i AccumulateDeltas(__m128i zigzag, __m128i previous)
+	{
+		__m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zigzag, _mm_set1_epi32(1)));
+		__m128i delta = _mm_xor_si128(_mm_srli_epi32(zigzag, 1), sign);
+
+		delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+		delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+		return _mm_add_epi32(delta, _mm_shuffle_epi32(previous, _MM_SHUFFLE(3, 3, 3, 3)));
+	}
+
+	// Decodes the planeCount byte planes of count values into groupCount*16 values.
+	bool DecodeValues(const std::uint8_t*& in, const std::uint8_t* end, std::uint32_t count,
+		std::uint32_t planeCount, std::uint32_t* values)
+	{
+		alignas(16) std::uint8_t planes[4][MeshCodec::BlockSize];
+		std::uint32_t groupCount = (count + GroupSize - 1) / GroupSize;
+
+		for(std::uint32_t plane = 0; plane < 4; ++plane)
+		{
+			if(plane >= planeCount)
+				memset(planes[plane], 0, groupCount*GroupSize);
+			else if(!DecodePlane(in, end, groupCount, planes[plane]))
+				return false;
+		}
+
+		// Interleave the planes back into 32-bit values, 16 at a time.
+		__m128i previous = _mm_setzero_si128();
+		for(std::uint32_t group = 0; group < groupCount; ++group)
+		{
+			size_t offset = group*GroupSize;
+			__m128i p0 = _mm_load_si128((const __m128i*)(planes[0] + offset));
+			__m128i p1 = _mm_load_si128((const __m128i*)(planes[1] + offset));
+			__m128i p2 = _mm_load_si128((const __m128i*)(planes[2] + offset));
+			__m128i p3 = _mm_load_si128((const __m128i*)(planes[3] + offset));
+
+			__m128i low01 = _mm_unpacklo_epi8(p0, p1);
+			__m128i high01 = _mm_unpackhi_epi8(p0, p1);
+			__m128i low23 = _mm_unpacklo_epi8(p2, p3);
+			__m128i high23 = _mm_unpackhi_epi8(p2, p3);
+
+			__m128i v0 = AccumulateDeltas(_mm_unpacklo_epi16(low01, low23), previous);
+			__m128i v1 = AccumulateDeltas(_mm_unpackhi_epi16(low01, low23), v0);
+			__m128i v2 = AccumulateDeltas(_mm_unpacklo_epi16(high01, high23), v1);
+			__m128i v3 = AccumulateDeltas(_mm_unpackhi_epi16(high01, high23), v2);
+			previous = v3;
+
+			_mm_storeu_si128((__m128i*)(values + offset), v0);
+			_mm_storeu_si128((__m128i*)(values + offset + 4), v1);
+			_mm_storeu_si128((__m128i*)(values + offset + 8), v2);
+			_mm_storeu_si128((__m128i*)(values + offset + 12), v3);
+		}
+
+		return true;
+	}
+
+	size_t EncodeVertexBlock(const std::uint8_t* vertices, std::uint32_t count, std::uint32_t stride, std::uint8_t* out)
+	{
+		std::uint32_t values[MeshCodec::BlockSize];
+		size_t size = 0;
+
+		for(std::uint32_t lane = 0; lane < stride / 4; ++lane)
+		{
+			std::uint32_t previous = 0;
+			for(std::uint32_t v = 0; v < count; ++v)
+			{
+				std::uint32_t value;
+				memcpy(&value, vertices + (size_t)v*stride + 4*lane, sizeof(value));
+				values[v] = Zigzag32(value - previous);
+				previous = value;
+			}
+
+			size += EncodePlanes(values, count, 4, out + size);
+		}
+
+		return size;
+	}
+
+	size_t EncodeIndexBlock(const std::uint8_t* indices, std::uint32_t count, std::uint32_t indexByteSize, std::uint8_t* out)
+	{
+		std::uint32_t values[MeshCodec::BlockSize];
+		std::uint32_t previous = 0;
+
+		for(std::uint32_t i = 0; i < count; ++i)
+		{
+			std::uint32_t value;
+			if(indexByteSize == 2)
+			{
+				std::uint16_t index;
+				memcpy(&index, indices + 2*i, sizeof(index));
+				value = index;
+				values[i] = Zigzag16(value - previous);
+			}
+			else
+			{
+				memcpy(&value, indices + 4*i, sizeof(value));
+				values[i] = Zigzag32(value - previous);
+			}
+			previous = value;
+		}
+
+		return EncodePlanes(values, count, indexByteSize, out);
+	}
+
+	// lanes holds BlockSize values per lane.
+	bool DecodeVertexBlock(const std::uint8_t* in, const std::uint8_t* end, std::uint32_t count,
+		std::uint32_t stride, std::uint32_t* lanes, std::uint8_t* vertices)
+	{
+		std::uint32_t laneCount = stride / 4;
+		for(std::uint32_t lane = 0; lane < laneCount; ++lane)
+		{
+			if(!DecodeValues(in, end, count, 4, lanes + lane*MeshCodec::BlockSize))
+				return false;
+		}
+
+		// Transpose the lanes back into vertices, 4 lanes of 4 vertices at a time.
+		std::uint32_t v = 0;
+		for(; v + 4 <= count; v += 4)
+		{
+			std::uint32_t lane = 0;
+			for(; lane + 4 <= laneCount; lane += 4)
+			{
+				__m128 r0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(lanes + (lane + 0)*MeshCodec::BlockSize + v)));
+				__m128 r1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(lanes + (lane + 1)*MeshCodec::BlockSize + v)));
+				__m128 r2 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(lanes + (lane + 2)*MeshCodec::BlockSize + v)));
+				__m128 r3 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(lanes + (lane + 3)*MeshCodec::BlockSize + v)));
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+				std::uint8_t* out = vertices + (size_t)v*stride + 4*lane;
+				_mm_storeu_ps((float*)out, r0);
+				_mm_storeu_ps((float*)(out + stride), r1);
+				_mm_storeu_ps((float*)(out + 2*stride), r2);
+				_mm_storeu_ps((float*)(out + 3*stride), r3);
+			}
+
+			for(; lane < laneCount; ++lane)
+			{
+				for(std::uint32_t k = 0; k < 4; ++k)
+					memcpy(vertices + (size_t)(v + k)*stride + 4*lane, lanes + lane*MeshCodec::BlockSize + v + k, 4);
+			}
+		}
+
+		for(; v < count; ++v)
+		{
+			for(std::uint32_t lane = 0; lane < laneCount; ++lane)
+				memcpy(vertices + (size_t)v*stride + 4*lane, lanes + lane*MeshCodec::BlockSize + v, 4);
+		}
+
+		return true;
+	}
+
+	bool DecodeIndexBlock(const std::uint8_t* in, const std::uint8_t* end, std::uint32_t count,
+		std::uint32_t indexByteSize, std::uint8_t* indices)
+	{
+		alignas(16) std::uint32_t values[MeshCodec::BlockSize];
+		if(!DecodeValues(in, end, count, indexByteSize, values))
+			return false;
+
+		if(indexByteSize == 4)
+		{
+			memcpy(indices, values, (size_t)count*4);
+			return true;
+		}
+
+		// Keep the low 16 bits: sign extending them first makes the signed pack exact.
+		std::uint32_t i = 0;
+		for(; i + 8 <= count; i += 8)
+		{
+			__m128i a = _mm_load_si128((const __m128i*)(values + i));
+			__m128i b = _mm_load_si128((const __m128i*)(values + i + 4));
+			a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+			b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+			_mm_storeu_si128((__m128i*)(indices + 2*i), _mm_packs_epi32(a, b));
+		}
+
+		for(; i < count; ++i)
+		{
+			std::uint16_t index = (std::uint16_t)values[i];
+			memcpy(indices + 2*i, &index, sizeof(index));
+		}
+
+		return true;
+	}
+}
+
+std::vector<std::uint8_t> MeshCodec::Encode(const void* vertices, std::uint32_t vertexCount,
+	std::uint32_t vertexByteStride, const void* indices, std::uint32_t indexCount,
+	std::uint32_t indexByteSize)
+{
+	if(vertexByteStride == 0 || vertexByteStride % 4 != 0)
+		throw std::invalid_argument("MeshCodec::Encode: vertex stride must be a nonzero multiple of 4 bytes");
+
+	if(indexByteSize != 2 && indexByteSize != 4)
+		throw std::invalid_argument("MeshCodec::Encode: index size must be 2 or 4 bytes");
+
+	MeshCodecHeader header;
+	header.Magic = MeshCodecMagic;
+	header.Version = Version;
+	header.VertexCount = vertexCount;
+	header.VertexByteStride = vertexByteStride;
+	header.IndexCount = indexCount;
+	header.IndexByteSize = indexByteSize;
+	header.VertexBlockCount = BlockCount(vertexCount);
+	header.IndexBlockCount = BlockCount(indexCount);
+
+	// Every block is encoded into its own worst case sized slot, then the slots are
+	// packed behind the offset table.
+	std::uint32_t blockCount = header.VertexBlockCount + header.IndexBlockCount;
+	size_t vertexSlotBytes = MaxBlockBytes(vertexByteStride / 4, 4);
+	size_t indexSlotBytes = MaxBlockBytes(1, indexByteSize);
+
+	std::vector<std::uint8_t> slots(header.VertexBlockCount*vertexSlotBytes + header.IndexBlockCount*indexSlotBytes);
+	std::vector<size_t> blockBytes(blockCount);
+
+	auto slotOffset = [&](std::uint32_t block)
+	{
+		return block < header.VertexBlockCount ? block*vertexSlotBytes :
+			header.VertexBlockCount*vertexSlotBytes + (block - header.VertexBlockCount)*indexSlotBytes;
+	};
+
+	ThreadPool::Default().ParallelFor(blockCount, 1, [&](size_t begin, size_t end)
+	{
+		for(std::uint32_t block = (std::uint32_t)begin; block < (std::uint32_t)end; ++block)
+		{
+			std::uint8_t* out = slots.data() + slotOffset(block);
+			if(block < header.VertexBlockCount)
+			{
+				std::uint32_t first = block*BlockSize;
+				std::uint32_t count = std::min<std::uint32_t>(BlockSize, vertexCount - first);
+				blockBytes[block] = EncodeVertexBlock((const std::uint8_t*)vertices + (size_t)first*vertexByteStride,
+					count, vertexByteStride, out);
+			}
+			else
+			{
+				std::uint32_t first = (block - header.VertexBlockCount)*BlockSize;
+				std::uint32_t count = std::min<std::uint32_t>(BlockSize, indexCount - first);
+				blockBytes[block] = EncodeIndexBlock((const std::uint8_t*)indices + (size_t)first*indexByteSize,
+					count, indexByteSize, out);
+			}
+		}
+	});
+
+	std::vector<std::uint32_t> offsets(blockCount + 1);
+	offsets[0] = 0;
+	for(std::uint32_t block = 0; block < blockCount; ++block)
+		offsets[block + 1] = offsets[block] + (std::uint32_t)blockBytes[block];
+
+	size_t tableBytes = offsets.size()*sizeof(std::uint32_t);
+	std::vector<std::uint8_t> data(sizeof(header) + tableBytes + offsets[blockCount]);
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(header), offsets.data(), tableBytes);
+
+	std::uint8_t* blocks = data.data() + sizeof(header) + tableBytes;
+	for(std::uint32_t block = 0; block < blockCount; ++block)
+		memcpy(blocks + offsets[block], slots.data() + slotOffset(block), blockBytes[block]);
+
+	return data;
+}
+
+std::vector<std::uint8_t> MeshCodec::Encode(const MeshGeometry& geo)
+{
+	std::uint32_t indexByteSize = geo.IndexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+
+	return Encode(geo.VertexBufferCPU->GetBufferPointer(), geo.VertexBufferByteSize / geo.VertexByteStride,
+		geo.VertexByteStride, geo.IndexBufferCPU->GetBufferPointer(), geo.IndexBufferByteSize / indexByteSize,
+		indexByteSize);
+}
+
+bool MeshCodec::GetInfo(const void* data, size_t byteSize, Info& info)
+{
+	if(byteSize < sizeof(MeshCodecHeader))
+		return false;
+
+	MeshCodecHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if(header.Magic != MeshCodecMagic ||
+	   header.Version != Version ||
+	   header.VertexByteStride == 0 || header.VertexByteStride % 4 != 0 ||
+	   (header.IndexByteSize != 2 && header.IndexByteSize != 4) ||
+	   header.VertexBlockCount != BlockCount(header.VertexCount) ||
+	   header.IndexBlockCount != BlockCount(header.IndexCount))
+		return false;
+
+	// The decoded buffers must be addressable by the UINT sizes of a MeshGeometry.
+	if((std::uint64_t)header.VertexCount*header.VertexByteStride > 0xffffffff ||
+	   (std::uint64_t)header.IndexCount*header.IndexByteSize > 0xffffffff)
+		return false;
+
+	std::uint64_t tableBytes = ((std::uint64_t)header.VertexBlockCount + header.IndexBlockCount + 1)*sizeof(std::uint32_t);
+	if(byteSize - sizeof(header) < tableBytes)
+		return false;
+
+	info.VertexCount = header.VertexCount;
+	info.VertexByteStride = header.VertexByteStride;
+	info.IndexCount = header.IndexCount;
+	info.IndexByteSize = header.IndexByteSize;
+	return true;
+}
+
+bool MeshCodec::Decode(const void* data, size_t byteSize, void* vertices, void* indices)
+{
+	Info info;
+	if(!GetInfo(data, byteSize, info))
+		return false;
+
+	//
+	// Validate the offset table before trusting any block in it.
+	//
+
+	std::uint32_t vertexBlockCount = BlockCount(info.VertexCount);
+	std::uint32_t blockCount = vertexBlockCount + BlockCount(info.IndexCount);
+
+	std::vector<std::uint32_t> offsets(blockCount + 1);
+	size_t tableBytes = offsets.size()*sizeof(std::uint32_t);
+	memcpy(offsets.data(), (const std::uint8_t*)data + sizeof(MeshCodecHeader), tableBytes);
+
+	const std::uint8_t* blocks = (const std::uint8_t*)data + sizeof(MeshCodecHeader) + tableBytes;
+	size_t blockBytes = byteSize - sizeof(MeshCodecHeader) - tableBytes;
+
+	if(offsets[0] != 0 || offsets[blockCount] > blockBytes)
+		return false;
+
+	for(std::uint32_t block = 0; block < blockCount; ++block)
+	{
+		if(offsets[block] > offsets[block + 1])
+			return false;
+	}
+
+	std::atomic<bool> malformed(false);
+	ThreadPool::Default().ParallelFor(blockCount, 1, [&](size_t begin, size_t end)
+	{
+		std::vector<std::uint32_t> lanes((size_t)info.VertexByteStride / 4 * BlockSize);
+
+		for(std::uint32_t block = (std::uint32_t)begin; block < (std::uint32_t)end; ++block)
+		{
+			const std::uint8_t* in = blocks + offsets[block];
+			const std::uint8_t* inEnd = blocks + offsets[block + 1];
+
+			bool decoded;
+			if(block < vertexBlockCount)
+			{
+				std::uint32_t first = block*BlockSize;
+				std::uint32_t count = std::min<std::uint32_t>(BlockSize, info.VertexCount - first);
+				decoded = DecodeVertexBlock(in, inEnd, count, info.VertexByteStride, lanes.data(),
+					(std::uint8_t*)vertices + (size_t)first*info.VertexByteStride);
+			}
+			else
+			{
+				std::uint32_t first = (block - vertexBlockCount)*BlockSize;
+				std::uint32_t count = std::min<std::uint32_t>(BlockSize, info.IndexCount - first);
+				decoded = DecodeIndexBlock(in, inEnd, count, info.IndexByteSize,
+					(std::uint8_t*)indices + (size_t)first*info.IndexByteSize);
+			}
+
+			if(!decoded)
+				malformed = true;
+		}
+	});
+
+	return !malformed;
+}
+
+std::unique_ptr<MeshGeometry> MeshCodec::DecodeGeometry(const void* data, size_t byteSize)
+{
+	Info info;
+	if(!GetInfo(data, byteSize, info))
+		return nullptr;
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->VertexByteStride = info.VertexByteStride;
+	geo->VertexBufferByteSize = info.VertexCount*info.VertexByteStride;
+	geo->IndexFormat = info.IndexByteSize == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	geo->IndexBufferByteSize = info.IndexCount*info.IndexByteSize;
+
+	ThrowIfFailed(D3DCreateBlob(geo->VertexBufferByteSize, &geo->VertexBufferCPU));
+	ThrowIfFailed(D3DCreateBlob(geo->IndexBufferByteSize, &geo->IndexBufferCPU));
+
+	if(!Decode(data, byteSize, geo->VertexBufferCPU->GetBufferPointer(), geo->IndexBufferCPU->GetBufferPointer()))
+		return nullptr;
+
+	return geo;
+}
@@ -0,0 +1,65 @@
+//***************************************************************************************
+// MeshCodec.h
+//
+// Lossless compression of the vertex and index blobs of a MeshGeometry, for content
+// stored on disk.
+//
+// Vertices are split into 32-bit attribute lanes (the vertex stride must be a multiple
+// of four bytes).  Each lane is delta coded from one vertex to the next and zigzag
+// encoded, so small differences in either direction become small integers.  Indices
+// are coded the same way as a single lane of 16- or 32-bit values.  Meshes whose
+// triangles were ordered for the post-transform cache, like the Morton ordered grids,
+// reuse recent vertices and give small index deltas.  Quantized vertices such as
+// GeometryGenerator::PackedVertex give small vertex deltas.
+//
+// The deltas are then split into byte planes, and every group of 16 bytes of a plane
+// is bit packed with 0, 2, 4 or 8 bits per byte.  Both streams are cut into blocks of
+// BlockSize elements that are coded independently, so blocks are encoded and decoded
+// in parallel on ThreadPool::Default(), and the decoder unpacks, unzigzags and prefix
+// sums 16 elements at a time with SSE2.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class MeshCodec
+{
+public:
+	// Bumped whenever the encoding changes; data of other versions fails to decode.
+	static const std::uint32_t Version = 1;
+
+	// Vertices or indices coded together.  At most 256 so that the bit widths of a
+	// byte plane of a block fit in one 32-bit word.
+	static const std::uint32_t BlockSize = 256;
+
+	struct Info
+	{
+		std::uint32_t VertexCount = 0;
+		std::uint32_t VertexByteStride = 0;
+		std::uint32_t IndexCount = 0;
+		std::uint32_t IndexByteSize = 0;
+	};
+
+	// Encodes vertexCount vertices of vertexByteStride bytes and indexCount indices of
+	// indexByteSize (2 or 4) bytes.  Throws std::invalid_argument for a stride that is
+	// not a multiple of four or an unsupported index size.
+	static std::vector<std::uint8_t> Encode(const void* vertices, std::uint32_t vertexCount,
+		std::uint32_t vertexByteStride, const void* indices, std::uint32_t indexCount,
+		std::uint32_t indexByteSize);
+
+	// Encodes the CPU blobs of geo.  DrawArgs are not included.
+	static std::vector<std::uint8_t> Encode(const MeshGeometry& geo);
+
+	// Reads the sizes needed to decode data.  Returns false if data is not an encoded
+	// mesh of this version.
+	static bool GetInfo(const void* data, size_t byteSize, Info& info);
+
+	// Decodes into VertexCount*VertexByteStride and IndexCount*IndexByteSize byte
+	// buffers.  Returns false if data is malformed.
+	static bool Decode(const void* data, size_t byteSize, void* vertices, void* indices);
+
+	// Returns a MeshGeometry with its CPU blobs, stride, sizes and index format filled
+	// in, or nullptr if data is malformed.
+	static std::unique_ptr<MeshGeometry> DecodeGeometry(const void* data, size_t byteSize);
+};
@@ -0,0 +1,401 @@
+//***************************************************************************************
+// MeshTopology.cpp
+//***************************************************************************************
+
+#include "MeshTopology.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+namespace
+{
+	// Smallest number of corners worth handing to another thread.
+	const size_t MinCornersPerTask = 16384;
+
+	const std::uint32_t RadixBits = 11;
+	const std::uint32_t RadixSize = 1u << RadixBits;
+}
+
+const std::uint32_t MeshTopology::Invalid;
+
+MeshTopology::MeshTopology(const GeometryGenerator::MeshData& meshData)
+{
+	if(meshData.Vertices.size() > 0xffffffff)
+		throw std::invalid_argument("MeshTopology: too many vertices");
+
+	std::uint32_t vertexCount = (std::uint32_t)meshData.Vertices.size();
+	if(meshData.Uses16BitIndices())
+		Build(meshData.Indices16.data(), meshData.Indices16.size(), vertexCount);
+	else
+		Build(meshData.Indices32.data(), meshData.Indices32.size(), vertexCount);
+}
+
+MeshTopology::MeshTopology(const std::uint16_t* indices, size_t indexCount, std::uint32_t vertexCount)
+{
+	Build(indices, indexCount, vertexCount);
+}
+
+MeshTopology::MeshTopology(const std::uint32_t* indices, size_t indexCount, std::uint32_t vertexCount)
+{
+	Build(indices, indexCount, vertexCount);
+}
+
+template<typename Index>
+void MeshTopology::Build(const Index* indices, size_t indexCount, std::uint32_t vertexCount)
+{
+	if(indexCount % 3 != 0)
+		throw std::invalid_argument("MeshTopology: index count is not a multiple of three");
+
+	// Invalid must never be a real corner.
+	if(indexCount >= Invalid)
+		throw std::invalid_argument("MeshTopology: too many triangles");
+
+	mCornerCount = (std::uint32_t)indexCount;
+	mVertexCount = vertexCount;
+
+	mPool.reset(new std::uint32_t[2*(size_t)mCornerCount + mVertexCount]);
+	mCornerVertices = mPool.get();
+	mOpposites = mCornerVertices + mCornerCount;
+	mVertexCorners = mOpposites + mCornerCount;
+
+	std::atomic<bool> outOfRange(false);
+	ThreadPool::Default().ParallelFor(mCornerCount, MinCornersPerTask, [&](size_t begin, size_t end)
+	{
+		bool bad = false;
+		for(size_t c = begin; c < end; ++c)
+		{
+			mCornerVertices[c] = indices[c];
+			bad |= indices[c] >= vertexCount;
+		}
+
+		if(bad)
+			outOfRange = true;
+	});
+
+	if(outOfRange)
+		throw std::invalid_argument("MeshTopology: index out of range");
+
+	MatchEdges();
+	FindVertexCorners();
+}
+
+void MeshTopology::MatchEdges()
+{
+	size_t cornerCount = mCornerCount;
+	if(cornerCount == 0)
+		return;
+
+	// Corner c faces the edge from CornerVertex(Next(c)) to CornerVertex(Prev(c)).
+	// The corners are radix sorted on the lower vertex of that edge, which leaves only
+	// a handful of corners per key to match on the upper vertex.  Corners of
+	// degenerate triangles get a key past every vertex so they sort last.
+	std::uint32_t degenerateKey = mVertexCount;
+
+	std::uint32_t keyBits = 0;
+	while(keyBits < 32 && (degenerateKey >> keyBits) != 0)
+		++keyBits;
+
+	// The radix sort below cuts the corners into a fixed number of blocks, each with
+	// its own digit counts.
+	ThreadPool& pool = ThreadPool::Default();
+	size_t blockCount = std::min<size_t>((cornerCount + MinCornersPerTask - 1) / MinCornersPerTask, (size_t)pool.ThreadCount()*4);
+	blockCount = std::max<size_t>(blockCount, 1);
+	size_t blockSize = (cornerCount + blockCount - 1) / blockCount;
+
+	// Keys and corners, each with a second array to sort into, and the digit offsets
+	// of every block, all in one scratch allocation.  Offsets are below cornerCount,
+	// which fits in 32 bits.
+	std::unique_ptr<std::uint32_t[]> scratch(new std::uint32_t[4*cornerCount + blockCount*RadixSize]);
+	std::uint32_t* keys = scratch.get();
+	std::uint32_t* sortedKeys = keys + cornerCount;
+	std::uint32_t* corners = sortedKeys + cornerCount;
+	std::uint32_t* sortedCorners = corners + cornerCount;
+	std::uint32_t* offsets = sortedCorners + cornerCount;
+
+	pool.ParallelFor(cornerCount / 3, MinCornersPerTask / 3, [&](size_t begin, size_t end)
+	{
+		for(size_t t = begin; t < end; ++t)
+		{
+			const std::uint32_t* v = mCornerVertices + 3*t;
+			bool degenerate = v[0] == v[1] || v[1] == v[2] || v[2] == v[0];
+
+			for(size_t k = 0; k < 3; ++k)
+			{
+				keys[3*t + k] = degenerate ? degenerateKey : std::min<std::uint32_t>(v[(k + 1) % 3], v[(k + 2) % 3]);
+				corners[3*t + k] = (std::uint32_t)(3*t + k);
+			}
+		}
+	});
+
+	// Least significant digit first radix sort.  Each block counts its digits, then
+	// scatters its corners to the offsets the counts give it.  Stability keeps corners
+	// with equal keys in corner order, so the result does not depend on the number of
+	// threads.
+	for(std::uint32_t shift = 0; shift < keyBits; shift += RadixBits)
+	{
+		std::fill(offsets, offsets + blockCount*RadixSize, 0);
+
+		pool.ParallelFor(blockCount, 1, [&](size_t beginBlock, size_t endBlock)
+		{
+			for(size_t block = beginBlock; block < endBlock; ++block)
+			{
+				std::uint32_t* counts = offsets + block*RadixSize;
+				size_t end = std::min<size_t>((block + 1)*blockSize, cornerCount);
+				for(size_t i = block*blockSize; i < end; ++i)
+					++counts[(keys[i] >> shift) & (RadixSize - 1)];
+			}
+		});
+
+		std::uint32_t start = 0;
+		for(std::uint32_t digit = 0; digit < RadixSize; ++digit)
+		{
+			for(size_t block = 0; block < blockCount; ++block)
+			{
+				std::uint32_t count = offsets[block*RadixSize + digit];
+				offsets[block*RadixSize + digit] = start;
+				start += count;
+			}
+		}
+
+		pool.ParallelFor(blockCount, 1, [&](size_t beginBlock, size_t endBlock)
+		{
+			for(size_t block = beginBlock; block < endBlock; ++block)
+			{
+				std::uint32_t* next = offsets + block*RadixSize;
+				size_t end = std::min<size_t>((block + 1)*blockSize, cornerCount);
+				for(size_t i = block*blockSize; i < end; ++i)
+				{
+					size_t dst = next[(keys[i] >> shift) & (RadixSize - 1)]++;
+					sortedKeys[dst] = keys[i];
+					sortedCorners[dst] = corners[i];
+				}
+			}
+		});
+
+		std::swap(keys, sortedKeys);
+		std::swap(corners, sortedCorners);
+	}
+
+	// Each range handles the runs of equal keys that start inside it.  A run is sorted
+	// on the upper vertex, then every group with the same upper vertex is one edge.
+	std::atomic<std::uint32_t> edgeCount(0);
+	std::atomic<std::uint32_t> boundaryEdgeCount(0);
+	std::atomic<std::uint32_t> nonManifoldEdgeCount(0);
+
+	pool.ParallelFor(cornerCount, MinCornersPerTask, [&](size_t begin, size_t end)
+	{
+		std::uint32_t edges = 0;
+		std::uint32_t boundaryEdges = 0;
+		std::uint32_t nonManifoldEdges = 0;
+
+		auto upperVertex = [&](std::uint32_t c)
+		{
+			return std::max<std::uint32_t>(mCornerVertices[Next(c)], mCornerVertices[Prev(c)]);
+		};
+
+		for(size_t i = begin; i < end; ++i)
+		{
+			if(i > 0 && keys[i - 1] == keys[i])
+				continue;
+
+			size_t runEnd = i + 1;
+			while(runEnd < cornerCount && keys[runEnd] == keys[i])
+				++runEnd;
+
+			if(keys[i] == degenerateKey)
+			{
+				for(size_t j = i; j < runEnd; ++j)
+					mOpposites[corners[j]] = Invalid;
+				continue;
+			}
+
+			std::sort(corners + i, corners + runEnd, [&](std::uint32_t a, std::uint32_t b)
+			{
+				std::uint32_t upperA = upperVertex(a);
+				std::uint32_t upperB = upperVertex(b);
+				return upperA < upperB || (upperA == upperB && a < b);
+			});
+
+			for(size_t edgeBegin = i; edgeBegin < runEnd; )
+			{
+				std::uint32_t upper = upperVertex(corners[edgeBegin]);
+				size_t edgeEnd = edgeBegin + 1;
+				while(edgeEnd < runEnd && upperVertex(corners[edgeEnd]) == upper)
+					++edgeEnd;
+
+				++edges;
+
+				std::uint32_t c0 = corners[edgeBegin];
+				std::uint32_t c1 = corners[edgeEnd - 1];
+
+				// Two triangles that wind the same way go through their shared edge in
+				// opposite directions.
+				if(edgeEnd - edgeBegin == 2 && mCornerVertices[Next(c0)] == mCornerVertices[Prev(c1)])
+				{
+					mOpposites[c0] = c1;
+					mOpposites[c1] = c0;
+				}
+				else
+				{
+					if(edgeEnd - edgeBegin == 1)
+						++boundaryEdges;
+					else
+						++nonManifoldEdges;
+
+					for(size_t j = edgeBegin; j < edgeEnd; ++j)
+						mOpposites[corners[j]] = Invalid;
+				}
+
+				edgeBegin = edgeEnd;
+			}
+		}
+
+		edgeCount += edges;
+		boundaryEdgeCount += boundaryEdges;
+		nonManifoldEdgeCount += nonManifoldEdges;
+	});
+
+	mEdgeCount = edgeCount;
+	mBoundaryEdgeCount = boundaryEdgeCount;
+	mNonManifoldEdgeCount = nonManifoldEdgeCount;
+}
+
+void MeshTopology::FindVertexCorners()
+{
+	std::fill(mVertexCorners, mVertexCorners + mVertexCount, Invalid);
+
+	// A single pass in corner order keeps the choice deterministic: the first corner
+	// of each vertex, unless a later one starts a boundary fan.
+	for(std::uint32_t c = 0; c < mCornerCount; ++c)
+	{
+		if(IsDegenerateTriangle(Triangle(c)))
+			continue;
+
+		std::uint32_t& vertexCorner = mVertexCorners[mCornerVertices[c]];
+		if(vertexCorner == Invalid ||
+			(mOpposites[Prev(c)] == Invalid && mOpposites[Prev(vertexCorner)] != Invalid))
+		{
+			vertexCorner = c;
+		}
+	}
+}
+
+std::uint32_t MeshTopology::TriangleCount()const
+{
+	return mCornerCount / 3;
+}
+
+std::uint32_t MeshTopology::CornerCount()const
+{
+	return mCornerCount;
+}
+
+std::uint32_t MeshTopology::VertexCount()const
+{
+	return mVertexCount;
+}
+
+std::uint32_t MeshTopology::EdgeCount()const
+{
+	return mEdgeCount;
+}
+
+std::uint32_t MeshTopology::BoundaryEdgeCount()const
+{
+	return mBoundaryEdgeCount;
+}
+
+std::uint32_t MeshTopology::NonManifoldEdgeCount()const
+{
+	return mNonManifoldEdgeCount;
+}
+
+bool MeshTopology::IsClosedManifold()const
+{
+	return mBoundaryEdgeCount == 0 && mNonManifoldEdgeCount == 0;
+}
+
+std::uint32_t MeshTopology::TriangleNeighbor(std::uint32_t triangle, std::uint32_t k)const
+{
+	std::uint32_t opposite = mOpposites[3*triangle + k];
+	return opposite == Invalid ? Invalid : Triangle(opposite);
+}
+
+bool MeshTopology::IsBoundaryEdge(std::uint32_t corner)const
+{
+	return mOpposites[corner] == Invalid && !IsDegenerateTriangle(Triangle(corner));
+}
+
+bool MeshTopology::IsDegenerateTriangle(std::uint32_t triangle)const
+{
+	const std::uint32_t* v = mCornerVertices + 3*triangle;
+	return v[0] == v[1] || v[1] == v[2] || v[2] == v[0];
+}
+
+bool MeshTopology::IsBoundaryVertex(std::uint32_t vertex)const
+{
+	std::uint32_t corner = mVertexCorners[vertex];
+	return corner != Invalid && mOpposites[Prev(corner)] == Invalid;
+}
+
+std::uint32_t MeshTopology::NextAroundVertex(std::uint32_t corner)const
+{
+	std::uint32_t opposite = mOpposites[Next(corner)];
+	return opposite == Invalid ? Invalid : Next(opposite);
+}
+
+std::uint32_t MeshTopology::PrevAroundVertex(std::uint32_t corner)const
+{
+	std::uint32_t opposite = mOpposites[Prev(corner)];
+	return opposite == Invalid ? Invalid : Prev(opposite);
+}
+
+void MeshTopology::GetOneRing(std::uint32_t vertex, std::vector<std::uint32_t>& ring)const
+{
+	ring.clear();
+
+	std::uint32_t last = Invalid;
+	ForEachCornerAroundVertex(vertex, [&](std::uint32_t corner)
+	{
+		ring.push_back(mCornerVertices[Next(corner)]);
+		last = corner;
+	});
+
+	// An open fan ends with the far side of its last triangle.
+	if(last != Invalid && NextAroundVertex(last) == Invalid)
+		ring.push_back(mCornerVertices[Prev(last)]);
+}
+
+void MeshTopology::GetBoundaryLoops(std::vector<std::uint32_t>& corners, std::vector<std::uint32_t>& loopOffsets)const
+{
+	corners.clear();
+	loopOffsets.assign(1, 0);
+
+	std::vector<bool> visited(mCornerCount, false);
+
+	for(std::uint32_t first = 0; first < mCornerCount; ++first)
+	{
+		if(visited[first] || !IsBoundaryEdge(first))
+			continue;
+
+		std::uint32_t corner = first;
+		do
+		{
+			visited[corner] = true;
+			corners.push_back(corner);
+
+			// The edge faced by corner ends on the vertex of Prev(corner).  Swing
+			// around that vertex, away from this edge, to the next edge without a
+			// neighbor; it leaves the vertex and continues the loop.
+			std::uint32_t pivot = Prev(corner);
+			for(std::uint32_t next = PrevAroundVertex(pivot); next != Invalid && next != Prev(corner); next = PrevAroundVertex(pivot))
+				pivot = next;
+
+			corner = Prev(pivot);
+		}
+		while(corner != first && !visited[corner] && IsBoundaryEdge(corner));
+
+		loopOffsets.push_back((std::uint32_t)corners.size());
+	}
+}
@@ -0,0 +1,124 @@
+//***************************************************************************************
+// MeshTopology.h
+//
+// Triangle adjacency of an indexed triangle list, stored as a corner table.  Corner c
+// is the c-th index of the list: it belongs to triangle c/3, sits on vertex
+// CornerVertex(c) and faces the edge between the triangle's other two corners.
+// Opposite(c) is the corner facing the same edge in the neighboring triangle, so
+// neighbors, edge loops and vertex one-rings are a few array lookups away.
+//
+// Edges are matched by radix sorting the corners on the key of the edge they face,
+// in parallel on ThreadPool::Default().  The table takes 8 bytes per corner plus 4 per
+// vertex, in a single allocation; the sort borrows one more block of 16 bytes per
+// corner and frees it before the constructor returns.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryGenerator.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class MeshTopology
+{
+public:
+	// Returned for corners and triangles that do not exist.
+	static const std::uint32_t Invalid = 0xffffffff;
+
+	// Throws std::invalid_argument if the index count is not a multiple of three, an
+	// index is out of range, or the mesh has 2^32 - 1 corners or more.
+	explicit MeshTopology(const GeometryGenerator::MeshData& meshData);
+	MeshTopology(const std::uint16_t* indices, size_t indexCount, std::uint32_t vertexCount);
+	MeshTopology(const std::uint32_t* indices, size_t indexCount, std::uint32_t vertexCount);
+	MeshTopology(const MeshTopology& rhs) = delete;
+	MeshTopology& operator=(const MeshTopology& rhs) = delete;
+	MeshTopology(MeshTopology&& rhs) = default;
+	MeshTopology& operator=(MeshTopology&& rhs) = default;
+
+	std::uint32_t TriangleCount()const;
+	std::uint32_t CornerCount()const;
+	std::uint32_t VertexCount()const;
+
+	// Distinct edges of the non-degenerate triangles.  Boundary edges have one
+	// triangle; non-manifold edges have more than two, or two that disagree on the
+	// winding.  Neither kind links its triangles.
+	std::uint32_t EdgeCount()const;
+	std::uint32_t BoundaryEdgeCount()const;
+	std::uint32_t NonManifoldEdgeCount()const;
+
+	// True if every edge is shared by exactly two consistently wound triangles.
+	bool IsClosedManifold()const;
+
+	static std::uint32_t Triangle(std::uint32_t corner) { return corner / 3; }
+	static std::uint32_t Next(std::uint32_t corner) { return corner % 3 == 2 ? corner - 2 : corner + 1; }
+	static std::uint32_t Prev(std::uint32_t corner) { return corner % 3 == 0 ? corner + 2 : corner - 1; }
+
+	std::uint32_t CornerVertex(std::uint32_t corner)const { return mCornerVertices[corner]; }
+	std::uint32_t Opposite(std::uint32_t corner)const { return mOpposites[corner]; }
+
+	// Triangle across the edge facing corner k (0, 1 or 2) of triangle, or Invalid.
+	std::uint32_t TriangleNeighbor(std::uint32_t triangle, std::uint32_t k)const;
+
+	// True if the edge facing corner has no neighbor, because it is on the boundary
+	// or non-manifold.  Degenerate triangles are not part of any boundary.
+	bool IsBoundaryEdge(std::uint32_t corner)const;
+	bool IsDegenerateTriangle(std::uint32_t triangle)const;
+
+	// A corner on vertex, or Invalid if only degenerate triangles use it.  For vertices
+	// on the boundary it is the first corner of the fan, so walking NextAroundVertex()
+	// from it visits every corner of the fan.
+	std::uint32_t VertexCorner(std::uint32_t vertex)const { return mVertexCorners[vertex]; }
+	bool IsBoundaryVertex(std::uint32_t vertex)const;
+
+	// The corner on the same vertex in the next (or previous) triangle of its fan, or
+	// Invalid at a boundary.  Next goes clockwise for clockwise wound triangles.
+	std::uint32_t NextAroundVertex(std::uint32_t corner)const;
+	std::uint32_t PrevAroundVertex(std::uint32_t corner)const;
+
+	// Calls visit(corner) for the corners of vertex's fan, starting at VertexCorner().
+	// A vertex where several fans meet only has the first one visited.
+	template<typename Visit>
+	void ForEachCornerAroundVertex(std::uint32_t vertex, Visit&& visit)const
+	{
+		std::uint32_t start = mVertexCorners[vertex];
+		std::uint32_t corner = start;
+		while(corner != Invalid)
+		{
+			visit(corner);
+			corner = NextAroundVertex(corner);
+			if(corner == start)
+				break;
+		}
+	}
+
+	// Replaces ring with the vertices adjacent to vertex, in fan order.  For a boundary
+	// vertex the first and last entries are its neighbors along the boundary.
+	void GetOneRing(std::uint32_t vertex, std::vector<std::uint32_t>& ring)const;
+
+	// Replaces corners with the corners facing boundary edges, loop after loop, each
+	// loop going the same way as the triangle winding.  Loop i is
+	// corners[loopOffsets[i], loopOffsets[i+1]).  Around non-manifold edges a loop can
+	// stop before it gets back to its first edge.
+	void GetBoundaryLoops(std::vector<std::uint32_t>& corners, std::vector<std::uint32_t>& loopOffsets)const;
+
+private:
+	template<typename Index>
+	void Build(const Index* indices, size_t indexCount, std::uint32_t vertexCount);
+
+	void MatchEdges();
+	void FindVertexCorners();
+
+private:
+	std::uint32_t mCornerCount = 0;
+	std::uint32_t mVertexCount = 0;
+	std::uint32_t mEdgeCount = 0;
+	std::uint32_t mBoundaryEdgeCount = 0;
+	std::uint32_t mNonManifoldEdgeCount = 0;
+
+	// mCornerVertices, mOpposites and mVertexCorners all point into mPool.
+	std::unique_ptr<std::uint32_t[]> mPool;
+	std::uint32_t* mCornerVertices = nullptr;
+	std::uint32_t* mOpposites = nullptr;
+	std::uint32_t* mVertexCorners = nullptr;
+};
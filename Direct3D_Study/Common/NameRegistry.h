@@ -0,0 +1,108 @@
+//***************************************************************************************
+// NameRegistry.h
+//
+// Named resources (geometries, submeshes, shaders, PSOs) stored in a dense array and
+// referred to by integer handles.
+//
+// Names are interned once, when the resources are created and looked up at load time.
+// From then on code keeps handles, and a lookup is an array index with no string
+// hashing or allocation.  Entries are never removed, so handles stay valid for the
+// life of the registry, and handle indices are dense: [0, Size()), usable directly as
+// sort key ids such as RenderItemIds::SubmeshId.
+//***************************************************************************************
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// An entry of a NameRegistry<T>; the type keeps handles of different registries apart.
+template<typename T>
+struct NameHandle
+{
+	std::uint32_t Index = 0xffffffff;
+
+	bool IsValid()const { return Index != 0xffffffff; }
+};
+
+template<typename T>
+class NameRegistry
+{
+public:
+	typedef NameHandle<T> Handle;
+
+	// Returns the handle of name, adding a default constructed entry if there is
+	// none yet.
+	Handle Intern(const std::string& name)
+	{
+		auto it = mIndices.find(name);
+		if(it != mIndices.end())
+			return MakeHandle(it->second);
+
+		std::uint32_t index = (std::uint32_t)mValues.size();
+		mIndices.emplace(name, index);
+		mValues.emplace_back();
+		mNames.push_back(name);
+		return MakeHandle(index);
+	}
+
+	// Interns name and sets its entry to value.
+	Handle Add(const std::string& name, T value)
+	{
+		Handle handle = Intern(name);
+		mValues[handle.Index] = std::move(value);
+		return handle;
+	}
+
+	// Returns an invalid handle if name was never interned.
+	Handle Find(const std::string& name)const
+	{
+		auto it = mIndices.find(name);
+		return it != mIndices.end() ? MakeHandle(it->second) : Handle();
+	}
+
+	// Throws std::out_of_range if name was never interned, e.g. misspelled.
+	Handle Get(const std::string& name)const
+	{
+		Handle handle = Find(name);
+		if(!handle.IsValid())
+			throw std::out_of_range("NameRegistry: no entry named " + name + ".");
+
+		return handle;
+	}
+
+	T& operator[](Handle handle)
+	{
+		assert(handle.Index < mValues.size());
+		return mValues[handle.Index];
+	}
+
+	const T& operator[](Handle handle)const
+	{
+		assert(handle.Index < mValues.size());
+		return mValues[handle.Index];
+	}
+
+	const std::string& Name(Handle handle)const { return mNames[handle.Index]; }
+
+	std::uint32_t Size()const { return (std::uint32_t)mValues.size(); }
+
+private:
+	static Handle MakeHandle(std::uint32_t index)
+	{
+		Handle handle;
+		handle.Index = index;
+		return handle;
+	}
+
+	// Used only to intern and find names.
+	std::unordered_map<std::string, std::uint32_t> mIndices;
+
+	std::vector<T> mValues;
+	std::vector<std::string> mNames;
+};
@@ -0,0 +1,111 @@
+//***************************************************************************************
+// RenderSort.cpp
+//***************************************************************************************
+
+#include "RenderSort.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	const std::uint32_t DepthShift = 0;
+	const std::uint32_t MaterialShift = DepthShift + RenderSort::DepthBits;
+	const std::uint32_t GeometryShift = MaterialShift + RenderSort::MaterialBits;
+	const std::uint32_t PsoShift = GeometryShift + RenderSort::GeometryBits;
+	const std::uint32_t LayerShift = PsoShift + RenderSort::PsoBits;
+	static_assert(LayerShift + RenderSort::LayerBits == 64, "Sort key fields must fill 64 bits.");
+
+	std::uint32_t Field(std::uint64_t key, std::uint32_t shift, std::uint32_t bits)
+	{
+		return (std::uint32_t)((key >> shift) & ((1ull << bits) - 1));
+	}
+}
+
+std::uint64_t RenderSort::MakeKey(std::uint32_t layer, std::uint32_t pso, std::uint32_t geometry,
+	std::uint32_t material, float depth, float farZ)
+{
+	// An id spilling into the next field would corrupt that field, in release builds too.
+	if(layer >= (1u << LayerBits) || pso >= (1u << PsoBits) ||
+		geometry >= (1u << GeometryBits) || material >= (1u << MaterialBits))
+		throw std::out_of_range("RenderSort: a sort key id does not fit its field.");
+
+	float normalizedDepth = farZ > 0.0f ? depth / farZ : 0.0f;
+	normalizedDepth = std::min<float>(std::max<float>(normalizedDepth, 0.0f), 1.0f);
+
+	// In double, since 2^28 - 1 rounds up to 2^28 as a float, and clamped so that a
+	// depth of farZ still fits the field.
+	const std::uint64_t maxDepth = (1ull << DepthBits) - 1;
+	std::uint64_t quantizedDepth = (std::uint64_t)((double)normalizedDepth*(double)maxDepth);
+	quantizedDepth = std::min<std::uint64_t>(quantizedDepth, maxDepth);
+
+	return ((std::uint64_t)layer << LayerShift) |
+		((std::uint64_t)pso << PsoShift) |
+		((std::uint64_t)geometry << GeometryShift) |
+		((std::uint64_t)material << MaterialShift) |
+		(quantizedDepth << DepthShift);
+}
+
+std::uint32_t RenderSort::Layer(std::uint64_t key)
+{
+	return Field(key, LayerShift, LayerBits);
+}
+
+std::uint32_t RenderSort::Pso(std::uint64_t key)
+{
+	return Field(key, PsoShift, PsoBits);
+}
+
+std::uint32_t RenderSort::Geometry(std::uint64_t key)
+{
+	return Field(key, GeometryShift, GeometryBits);
+}
+
+std::uint32_t RenderSort::Material(std::uint64_t key)
+{
+	return Field(key, MaterialShift, MaterialBits);
+}
+
+std::uint64_t RenderSort::ReplaceDepth(std::uint64_t key, std::uint32_t value)
+{
+	if(value >= (1u << DepthBits))
+		throw std::out_of_range("RenderSort: the depth field value does not fit DepthBits.");
+
+	std::uint64_t depthMask = ((1ull << DepthBits) - 1) << DepthShift;
+	return (key & ~depthMask) | ((std::uint64_t)value << DepthShift);
+}
+
+void RenderSort::Sort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+	if(entries.size() < 2)
+		return;
+
+	// Bits that differ between any two keys; the other passes would not move anything.
+	std::uint64_t changedBits = 0;
+	for(const SortEntry& entry : entries)
+		changedBits |= entry.Key ^ entries[0].Key;
+
+	scratch.resize(entries.size());
+
+	for(std::uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		if(((changedBits >> shift) & 0xff) == 0)
+			continue;
+
+		size_t offsets[256] = {};
+		for(const SortEntry& entry : entries)
+			++offsets[(entry.Key >> shift) & 0xff];
+
+		size_t start = 0;
+		for(size_t& offset : offsets)
+		{
+			size_t count = offset;
+			offset = start;
+			start += count;
+		}
+
+		for(const SortEntry& entry : entries)
+			scratch[offsets[(entry.Key >> shift) & 0xff]++] = entry;
+
+		entries.swap(scratch);
+	}
+}
@@ -0,0 +1,299 @@
+//***************************************************************************************
+// TerrainBuilder.cpp
+//***************************************************************************************
+
+#include "TerrainBuilder.h"
+#include "GridIndexGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <mutex>
+
+using namespace DirectX;
+
+namespace
+{
+	// Smallest amount of work, in vertices, worth handing to another thread.
+	const size_t MinElementsPerTask = 4096;
+
+	size_t RowGrainSize(std::uint32_t rowLength)
+	{
+		return std::max<size_t>(1, MinElementsPerTask / std::max<std::uint32_t>(1, rowLength));
+	}
+}
+
+TerrainBuilder::TerrainBuilder(float width, float depth, std::uint32_t m, std::uint32_t n)
+	: mWidth(width), mDepth(depth), mM(m), mN(n)
+{
+}
+
+void TerrainBuilder::SetCenter(float x, float z)
+{
+	mCenterX = x;
+	mCenterZ = z;
+}
+
+void TerrainBuilder::SetHeightFunction(HeightFunction heights)
+{
+	mHeights = std::move(heights);
+}
+
+void TerrainBuilder::SetHeightImage(const float* texels, std::uint32_t imageWidth, std::uint32_t imageHeight,
+	float scale, float offset)
+{
+	float halfWidth = 0.5f*mWidth;
+	float halfDepth = 0.5f*mDepth;
+	float centerX = mCenterX;
+	float centerZ = mCenterZ;
+
+	// Grid space to texel space.
+	float uScale = (imageWidth - 1) / mWidth;
+	float vScale = (imageHeight - 1) / mDepth;
+	float maxU = (float)(imageWidth - 1);
+	float maxV = (float)(imageHeight - 1);
+
+	mHeights = [=](FXMVECTOR x, FXMVECTOR z) -> XMVECTOR
+	{
+		alignas(16) float xs[4], zs[4], heights[4];
+		XMStoreFloat4A((XMFLOAT4A*)xs, x);
+		XMStoreFloat4A((XMFLOAT4A*)zs, z);
+
+		// Bilinear filtering with clamped addressing, one lane at a time since
+		// the four texel fetches are gathers.
+		for(int k = 0; k < 4; ++k)
+		{
+			float u = std::min<float>(std::max<float>((xs[k] - centerX + halfWidth)*uScale, 0.0f), maxU);
+			float v = std::min<float>(std::max<float>((centerZ + halfDepth - zs[k])*vScale, 0.0f), maxV);
+
+			std::uint32_t u0 = (std::uint32_t)u;
+			std::uint32_t v0 = (std::uint32_t)v;
+			std::uint32_t u1 = std::min<std::uint32_t>(u0 + 1, imageWidth - 1);
+			std::uint32_t v1 = std::min<std::uint32_t>(v0 + 1, imageHeight - 1);
+			float s = u - u0;
+			float t = v - v0;
+
+			const float* row0 = texels + (size_t)v0*imageWidth;
+			const float* row1 = texels + (size_t)v1*imageWidth;
+			float top = row0[u0] + (row0[u1] - row0[u0])*s;
+			float bottom = row1[u0] + (row1[u1] - row1[u0])*s;
+
+			heights[k] = scale*(top + (bottom - top)*t) + offset;
+		}
+
+		return XMLoadFloat4A((const XMFLOAT4A*)heights);
+	};
+}
+
+void TerrainBuilder::SetSlopeFunction(SlopeFunction slopes)
+{
+	mSlopes = std::move(slopes);
+}
+
+void TerrainBuilder::SetColorBands(const std::vector<ColorBand>& bands)
+{
+	mColorBands = bands;
+}
+
+void TerrainBuilder::SetParallelThreshold(size_t minVertexCount)
+{
+	mParallelVertexThreshold = minVertexCount;
+}
+
+std::uint32_t TerrainBuilder::VertexCount()const
+{
+	return mM*mN;
+}
+
+std::uint32_t TerrainBuilder::IndexCount()const
+{
+	return (mM-1)*(mN-1)*6;
+}
+
+BoundingBox TerrainBuilder::BuildVertices(void* vertices, const VertexLayout& layout)const
+{
+	std::mutex boundsMutex;
+	XMVECTOR minHeight = XMVectorReplicate(+FLT_MAX);
+	XMVECTOR maxHeight = XMVectorReplicate(-FLT_MAX);
+
+	auto buildRows = [&](size_t begin, size_t end)
+	{
+		XMVECTOR rangeMin = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR rangeMax = XMVectorReplicate(-FLT_MAX);
+
+		for(size_t i = begin; i < end; ++i)
+			BuildRow((std::uint32_t)i, (std::uint8_t*)vertices, layout, rangeMin, rangeMax);
+
+		std::lock_guard<std::mutex> lock(boundsMutex);
+		minHeight = XMVectorMin(minHeight, rangeMin);
+		maxHeight = XMVectorMax(maxHeight, rangeMax);
+	};
+
+	if(VertexCount() < mParallelVertexThreshold)
+		buildRows(0, mM);
+	else
+		ThreadPool::Default().ParallelFor(mM, RowGrainSize(mN), buildRows);
+
+	alignas(16) float lo[4], hi[4];
+	XMStoreFloat4A((XMFLOAT4A*)lo, minHeight);
+	XMStoreFloat4A((XMFLOAT4A*)hi, maxHeight);
+	float minY = std::min<float>(std::min<float>(lo[0], lo[1]), std::min<float>(lo[2], lo[3]));
+	float maxY = std::max<float>(std::max<float>(hi[0], hi[1]), std::max<float>(hi[2], hi[3]));
+
+	float halfWidth = 0.5f*mWidth;
+	float halfDepth = 0.5f*mDepth;
+
+	BoundingBox bounds;
+	BoundingBox::CreateFromPoints(bounds,
+		XMVectorSet(mCenterX - halfWidth, minY, mCenterZ - halfDepth, 0.0f),
+		XMVectorSet(mCenterX + halfWidth, maxY, mCenterZ + halfDepth, 0.0f));
+	return bounds;
+}
+
+void TerrainBuilder::BuildRow(std::uint32_t i, std::uint8_t* vertices, const VertexLayout& layout,
+	XMVECTOR& minHeight, XMVECTOR& maxHeight)const
+{
+	float halfWidth = 0.5f*mWidth;
+	float halfDepth = 0.5f*mDepth;
+
+	float dx = mWidth / (mN-1);
+	float dz = mDepth / (mM-1);
+
+	float du = 1.0f / (mN-1);
+	float dv = 1.0f / (mM-1);
+
+	float z = mCenterZ + halfDepth - i*dz;
+	float v = i*dv;
+
+	XMVECTOR vz = XMVectorReplicate(z);
+	XMVECTOR vdx = XMVectorReplicate(dx);
+	XMVECTOR vdz = XMVectorReplicate(dz);
+	XMVECTOR vdu = XMVectorReplicate(du);
+	XMVECTOR vLeft = XMVectorReplicate(mCenterX - halfWidth);
+	XMVECTOR vColumnCount = XMVectorReplicate((float)mN);
+	const XMVECTORF32 laneOffsets = { 0.0f, 1.0f, 2.0f, 3.0f };
+
+	bool writeNormals = layout.NormalOffset >= 0;
+	bool writeColors = layout.ColorOffset >= 0 && !mColorBands.empty();
+
+	std::uint8_t* row = vertices + (size_t)i*mN*layout.Stride;
+
+	alignas(16) float px[4], py[4], nx[4], ny[4], nz[4], tu[4];
+	alignas(16) float cr[4], cg[4], cb[4], ca[4];
+	for(std::uint32_t j = 0; j < mN; j += 4)
+	{
+		XMVECTOR column = XMVectorAdd(XMVectorReplicate((float)j), laneOffsets);
+		XMVECTOR x = XMVectorMultiplyAdd(column, vdx, vLeft);
+		XMVECTOR h = mHeights ? mHeights(x, vz) : XMVectorZero();
+
+		// Lanes past the end of the row are evaluated but must not affect the bounds.
+		XMVECTOR inRow = XMVectorLess(column, vColumnCount);
+		minHeight = XMVectorMin(minHeight, XMVectorSelect(minHeight, h, inRow));
+		maxHeight = XMVectorMax(maxHeight, XMVectorSelect(maxHeight, h, inRow));
+
+		XMStoreFloat4A((XMFLOAT4A*)px, x);
+		XMStoreFloat4A((XMFLOAT4A*)py, h);
+		XMStoreFloat4A((XMFLOAT4A*)tu, XMVectorMultiply(column, vdu));
+
+		if(writeNormals)
+		{
+			XMVECTOR dhdx;
+			XMVECTOR dhdz;
+			if(mSlopes)
+			{
+				mSlopes(x, vz, dhdx, dhdz);
+			}
+			else if(mHeights)
+			{
+				// Central differences over one grid cell.
+				XMVECTOR left = mHeights(XMVectorSubtract(x, vdx), vz);
+				XMVECTOR right = mHeights(XMVectorAdd(x, vdx), vz);
+				XMVECTOR back = mHeights(x, XMVectorSubtract(vz, vdz));
+				XMVECTOR front = mHeights(x, XMVectorAdd(vz, vdz));
+				dhdx = XMVectorDivide(XMVectorSubtract(right, left), XMVectorAdd(vdx, vdx));
+				dhdz = XMVectorDivide(XMVectorSubtract(front, back), XMVectorAdd(vdz, vdz));
+			}
+			else
+			{
+				dhdx = XMVectorZero();
+				dhdz = XMVectorZero();
+			}
+
+			// n = (-dh/dx, 1, -dh/dz), normalized.
+			XMVECTOR lengthSq = XMVectorMultiplyAdd(dhdx, dhdx, XMVectorMultiplyAdd(dhdz, dhdz, XMVectorSplatOne()));
+			XMVECTOR invLength = XMVectorReciprocalSqrt(lengthSq);
+			XMStoreFloat4A((XMFLOAT4A*)nx, XMVectorNegate(XMVectorMultiply(dhdx, invLength)));
+			XMStoreFloat4A((XMFLOAT4A*)ny, invLength);
+			XMStoreFloat4A((XMFLOAT4A*)nz, XMVectorNegate(XMVectorMultiply(dhdz, invLength)));
+		}
+
+		if(writeColors)
+		{
+			// Start from the top band and let each lower band whose limit is above
+			// the height override it.
+			const XMFLOAT4& top = mColorBands.back().Color;
+			XMVECTOR r = XMVectorReplicate(top.x);
+			XMVECTOR g = XMVectorReplicate(top.y);
+			XMVECTOR b = XMVectorReplicate(top.z);
+			XMVECTOR a = XMVectorReplicate(top.w);
+			for(size_t band = mColorBands.size()-1; band-- > 0; )
+			{
+				const ColorBand& colorBand = mColorBands[band];
+				XMVECTOR below = XMVectorLess(h, XMVectorReplicate(colorBand.MaxHeight));
+				r = XMVectorSelect(r, XMVectorReplicate(colorBand.Color.x), below);
+				g = XMVectorSelect(g, XMVectorReplicate(colorBand.Color.y), below);
+				b = XMVectorSelect(b, XMVectorReplicate(colorBand.Color.z), below);
+				a = XMVectorSelect(a, XMVectorReplicate(colorBand.Color.w), below);
+			}
+			XMStoreFloat4A((XMFLOAT4A*)cr, r);
+			XMStoreFloat4A((XMFLOAT4A*)cg, g);
+			XMStoreFloat4A((XMFLOAT4A*)cb, b);
+			XMStoreFloat4A((XMFLOAT4A*)ca, a);
+		}
+
+		// Scatter the lanes into the destination vertices.
+		std::uint32_t laneCount = std::min<std::uint32_t>(4, mN - j);
+		for(std::uint32_t k = 0; k < laneCount; ++k)
+		{
+			std::uint8_t* vertex = row + (size_t)(j+k)*layout.Stride;
+
+			if(layout.PositionOffset >= 0)
+			{
+				XMFLOAT3 position(px[k], py[k], z);
+				memcpy(vertex + layout.PositionOffset, &position, sizeof(position));
+			}
+
+			if(writeNormals)
+			{
+				XMFLOAT3 normal(nx[k], ny[k], nz[k]);
+				memcpy(vertex + layout.NormalOffset, &normal, sizeof(normal));
+			}
+
+			if(layout.TexCOffset >= 0)
+			{
+				XMFLOAT2 texC(tu[k], v);
+				memcpy(vertex + layout.TexCOffset, &texC, sizeof(texC));
+			}
+
+			if(writeColors)
+			{
+				XMFLOAT4 color(cr[k], cg[k], cb[k], ca[k]);
+				memcpy(vertex + layout.ColorOffset, &color, sizeof(color));
+			}
+		}
+	}
+}
+
+void TerrainBuilder::BuildIndices(std::uint16_t* indices)const
+{
+	GridIndexGenerator<std::uint16_t> generator(mM, mN);
+	generator.SetParallelThreshold(VertexCount() < mParallelVertexThreshold ? SIZE_MAX : 0);
+	generator.Generate(indices);
+}
+
+void TerrainBuilder::BuildIndices(std::uint32_t* indices)const
+{
+	GridIndexGenerator<std::uint32_t> generator(mM, mN);
+	generator.SetParallelThreshold(VertexCount() < mParallelVertexThreshold ? SIZE_MAX : 0);
+	generator.Generate(indices);
+}
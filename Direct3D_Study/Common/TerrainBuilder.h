@@ -0,0 +1,107 @@
+//***************************************************************************************
+// TerrainBuilder.h
+//
+// Builds heightfield terrain over the same mxn grid layout as
+// GeometryGenerator::CreateGrid, but writes straight into an application defined
+// vertex format instead of going through MeshData.
+//
+// Heights come from a function evaluated four points at a time, or from a height
+// image.  Normals are either analytic (from a slope function) or central finite
+// differences of the height function, and colors come from a ramp of height bands.
+// Rows are split across ThreadPool::Default() (see SetParallelThreshold), and each
+// row is evaluated four vertices per XMVECTOR.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class TerrainBuilder
+{
+public:
+	// Returns the heights at four (x, z) points.
+	using HeightFunction = std::function<DirectX::XMVECTOR(DirectX::FXMVECTOR x, DirectX::FXMVECTOR z)>;
+
+	// Returns the partial derivatives of the height at four (x, z) points.
+	using SlopeFunction = std::function<void(DirectX::FXMVECTOR x, DirectX::FXMVECTOR z,
+		DirectX::XMVECTOR& dhdx, DirectX::XMVECTOR& dhdz)>;
+
+	// Vertices with height below MaxHeight (and not below a previous band) get Color.
+	struct ColorBand
+	{
+		float MaxHeight;
+		DirectX::XMFLOAT4 Color;
+	};
+
+	// Where each attribute lives inside the destination vertex, as byte offsets from
+	// the start of the vertex.  Attributes with a negative offset are not written.
+	struct VertexLayout
+	{
+		size_t Stride = 0;
+		int PositionOffset = -1; // XMFLOAT3
+		int NormalOffset = -1;   // XMFLOAT3
+		int TexCOffset = -1;     // XMFLOAT2
+		int ColorOffset = -1;    // XMFLOAT4
+	};
+
+	// An mxn grid of vertices in the xz-plane centered at the origin, laid out like
+	// GeometryGenerator::CreateGrid.
+	TerrainBuilder(float width, float depth, std::uint32_t m, std::uint32_t n);
+
+	// Moves the grid so that it is centered at (x, z).  Height functions are evaluated
+	// at the moved positions.
+	void SetCenter(float x, float z);
+
+	void SetHeightFunction(HeightFunction heights);
+
+	// Samples heights bilinearly from a row-major image that covers the whole grid,
+	// with row 0 at the far (+z) edge: height = scale*texel + offset.  The image is
+	// placed around the center set when this is called.  It is not copied and must
+	// outlive BuildVertices.
+	void SetHeightImage(const float* texels, std::uint32_t imageWidth, std::uint32_t imageHeight,
+		float scale = 1.0f, float offset = 0.0f);
+
+	// Analytic derivatives for the normals.  Without one, normals are estimated
+	// from the heights of the neighboring grid points.
+	void SetSlopeFunction(SlopeFunction slopes);
+
+	// Bands ordered by increasing MaxHeight.  Heights above the last band use its color.
+	void SetColorBands(const std::vector<ColorBand>& bands);
+
+	// Grids with fewer vertices than this are built on the calling thread; pass
+	// SIZE_MAX to never use the thread pool.  By default any grid may be split.
+	// The output does not depend on the number of threads used.
+	void SetParallelThreshold(size_t minVertexCount);
+
+	std::uint32_t VertexCount()const;
+	std::uint32_t IndexCount()const;
+
+	// Writes VertexCount() vertices and returns their bounding box.
+	DirectX::BoundingBox BuildVertices(void* vertices, const VertexLayout& layout)const;
+
+	// Writes IndexCount() triangle list indices in the CreateGrid order.
+	void BuildIndices(std::uint16_t* indices)const;
+	void BuildIndices(std::uint32_t* indices)const;
+
+private:
+	void BuildRow(std::uint32_t i, std::uint8_t* vertices, const VertexLayout& layout,
+		DirectX::XMVECTOR& minHeight, DirectX::XMVECTOR& maxHeight)const;
+
+private:
+	float mWidth;
+	float mDepth;
+	float mCenterX = 0.0f;
+	float mCenterZ = 0.0f;
+	std::uint32_t mM;
+	std::uint32_t mN;
+
+	HeightFunction mHeights;
+	SlopeFunction mSlopes;
+	std::vector<ColorBand> mColorBands;
+
+	size_t mParallelVertexThreshold = 0;
+};
@@ -0,0 +1,130 @@
+//***************************************************************************************
+// ThreadPool.cpp
+//***************************************************************************************
+
+#include "ThreadPool.h"
+
+thread_local bool ThreadPool::sInsideTask = false;
+
+ThreadPool::ThreadPool(std::uint32_t threadCount)
+    : mNextTask(0), mFinishedTasks(0)
+{
+    if(threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if(threadCount == 0)
+        threadCount = 1;
+
+    // The caller is the first thread, so spawn one less.
+    mWorkers.reserve(threadCount - 1);
+    for(std::uint32_t i = 1; i < threadCount; ++i)
+        mWorkers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mShutdown = true;
+    }
+    mWakeCondition.notify_all();
+
+    for(auto& worker : mWorkers)
+        worker.join();
+}
+
+ThreadPool& ThreadPool::Default()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+std::uint32_t ThreadPool::ThreadCount()const
+{
+    return (std::uint32_t)mWorkers.size() + 1;
+}
+
+void ThreadPool::Run(size_t taskCount, const std::function<void(size_t)>& task)
+{
+    std::lock_guard<std::mutex> submitLock(mSubmitMutex);
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTask = &task;
+        mTaskCount = taskCount;
+        mNextTask = 0;
+        mFinishedTasks = 0;
+        ++mJobGeneration;
+    }
+    mWakeCondition.notify_all();
+
+    ExecuteTasks();
+
+    // Wait for the tasks picked up by workers, and for the workers to let go
+    // of the job, before the task object goes out of scope.
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCondition.wait(lock, [this]
+    {
+        return mFinishedTasks.load() == mTaskCount && mBusyWorkers == 0;
+    });
+    mTask = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+    std::uint64_t seenGeneration = 0;
+
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWakeCondition.wait(lock, [&]
+            {
+                return mShutdown || mJobGeneration != seenGeneration;
+            });
+
+            if(mShutdown)
+                return;
+
+            seenGeneration = mJobGeneration;
+
+            // Woke up after the job already completed.
+            if(mTask == nullptr)
+                continue;
+
+            ++mBusyWorkers;
+        }
+
+        ExecuteTasks();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mBusyWorkers;
+        }
+        mDoneCondition.notify_one();
+    }
+}
+
+void ThreadPool::ExecuteTasks()
+{
+    bool wasInsideTask = sInsideTask;
+    sInsideTask = true;
+
+    for(;;)
+    {
+        size_t index = mNextTask.fetch_add(1);
+        if(index >= mTaskCount)
+            break;
+
+        (*mTask)(index);
+
+        if(mFinishedTasks.fetch_add(1) + 1 == mTaskCount)
+        {
+            // Take the lock so the notification cannot slip in between the
+            // waiter's predicate check and its sleep.
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDoneCondition.notify_one();
+        }
+    }
+
+    sInsideTask = wasInsideTask;
+}
@@ -0,0 +1,96 @@
+//***************************************************************************************
+// ThreadPool.h
+//
+// Fixed set of worker threads used for fork-join data parallelism
+// (mesh generation, culling, constant buffer updates, ...).  The calling
+// thread always takes part in the work, and a ParallelFor issued from inside
+// a task runs serially, so nested use cannot deadlock.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // threadCount includes the calling thread; 0 means one per hardware thread.
+    explicit ThreadPool(std::uint32_t threadCount = 0);
+    ThreadPool(const ThreadPool& rhs) = delete;
+    ThreadPool& operator=(const ThreadPool& rhs) = delete;
+    ~ThreadPool();
+
+    // Process wide pool shared by the helpers in Common.
+    static ThreadPool& Default();
+
+    // Number of threads that execute tasks, including the caller.
+    std::uint32_t ThreadCount()const;
+
+    // Splits [0, count) into contiguous ranges of at least grainSize elements
+    // and calls body(begin, end) once per range.  Returns when every range is done.
+    template<typename Body>
+    void ParallelFor(size_t count, size_t grainSize, Body&& body)
+    {
+        if(count == 0)
+            return;
+
+        if(grainSize == 0)
+            grainSize = 1;
+
+        // A few ranges per thread smooths out uneven range costs.
+        size_t maxRanges = (size_t)ThreadCount()*4;
+        size_t rangeCount = (count + grainSize - 1) / grainSize;
+        if(rangeCount > maxRanges)
+            rangeCount = maxRanges;
+
+        if(rangeCount <= 1 || sInsideTask)
+        {
+            body(size_t(0), count);
+            return;
+        }
+
+        size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+        rangeCount = (count + rangeSize - 1) / rangeSize;
+
+        std::function<void(size_t)> task = [&](size_t range)
+        {
+            size_t begin = range*rangeSize;
+            size_t end = begin + rangeSize < count ? begin + rangeSize : count;
+            body(begin, end);
+        };
+
+        Run(rangeCount, task);
+    }
+
+private:
+    void Run(size_t taskCount, const std::function<void(size_t)>& task);
+    void WorkerLoop();
+    void ExecuteTasks();
+
+private:
+    std::vector<std::thread> mWorkers;
+
+    // Only one ParallelFor is in flight at a time.
+    std::mutex mSubmitMutex;
+
+    std::mutex mMutex;
+    std::condition_variable mWakeCondition;
+    std::condition_variable mDoneCondition;
+    std::uint64_t mJobGeneration = 0;
+    size_t mBusyWorkers = 0;
+    bool mShutdown = false;
+
+    // Current job.
+    const std::function<void(size_t)>* mTask = nullptr;
+    size_t mTaskCount = 0;
+    std::atomic<size_t> mNextTask;
+    std::atomic<size_t> mFinishedTasks;
+
+    static thread_local bool sInsideTask;
+};
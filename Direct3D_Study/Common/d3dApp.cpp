@@ -595,7 +595,8 @@ void D3DApp::CalculateFrameStats()
 
         wstring windowText = mMainWndCaption +
             L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+            L"   mspf: " + mspfStr +
+            FrameStatsText();
 
         SetWindowText(mhMainWnd, windowText.c_str());
 		
@@ -605,6 +606,11 @@ void D3DApp::CalculateFrameStats()
 	}
 }
 
+std::wstring D3DApp::FrameStatsText()const
+{
+	return L"";
+}
+
 void D3DApp::LogAdapters()
 {
     UINT i = 0;
@@ -68,6 +68,9 @@ protected:
 
 	void CalculateFrameStats();
 
+	// Appended to the frame stats in the window caption.
+	virtual std::wstring FrameStatsText()const;
+
     void LogAdapters();
     void LogAdapterOutputs(IDXGIAdapter* adapter);
     void LogOutputDisplayModes(IDXGIOutput* output, DXGI_FORMAT format);
@@ -155,6 +155,11 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// Decode metadata for quantized (GeometryGenerator::PackedVertex) positions:
+	// PosL = quantizedPos*PositionScale + PositionBias.  Identity for float vertices.
+	DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
 };
 
 struct MeshGeometry
@@ -8,6 +8,12 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/MeshFile.h"
+#include "../../Common/ChunkedTerrain.h"
+#include "../../Common/GridIndexGenerator.h"
+#include "../../Common/RenderSort.h"
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/NameRegistry.h"
 #include "FrameResource.h"
 #include "Waves.h"
 
@@ -17,6 +23,8 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+typedef NameRegistry<ComPtr<ID3D12PipelineState>>::Handle PsoHandle;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -46,6 +54,18 @@ struct RenderItem
 	UINT IndexCount = 0;
 	UINT StartIndexLocation = 0;
 	int BaseVertexLocation = 0;
+
+	// Sort key fields (see RenderSort).  Items with the same ids share a pipeline
+	// state and buffers; the layer's PSO itself is bound by Draw().
+	UINT PsoId = 0;
+	UINT GeoId = 0;
+	UINT MaterialId = 0;
+
+	// Rebuilt from the ids and the view depth every frame.
+	std::uint64_t SortKey = 0;
+
+	// Bounds of the submesh in local space; culled after transforming by World.
+	BoundingBox Bounds;
 };
 
 enum class RenderLayer : int
@@ -78,17 +98,26 @@ private:
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt);
+	void UpdateTerrain(const GameTimer& gt);
+	void UpdateVisibleRitems(const GameTimer& gt);
 
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
     void BuildLandGeometry();
+    std::unique_ptr<MeshGeometry> GenerateLandGeometry();
+    TerrainBuilder::VertexLayout LandVertexLayout()const;
     void BuildWavesGeometryBuffers();
     void BuildPSOs();
     void BuildFrameResources();
     void BuildRenderItems();
+	void SortRenderItems(const std::vector<RenderItem*>& ritems, RenderLayer layer, std::vector<RenderItem*>& sorted);
 	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void DrawTerrain(ID3D12GraphicsCommandList* cmdList);
+
+	virtual std::wstring FrameStatsText()const override;
 
     float GetHillsHeight(float x, float z)const;
+    XMVECTOR GetHillsHeights(FXMVECTOR x, FXMVECTOR z)const;
     XMFLOAT3 GetHillsNormal(float x, float z)const;
 
 private:
@@ -101,22 +130,51 @@ private:
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	// Looked up by name only while loading; the per-frame code keeps handles.
+	NameRegistry<std::unique_ptr<MeshGeometry>> mGeometries;
+	NameRegistry<SubmeshGeometry> mSubmeshes;
+	NameRegistry<ComPtr<ID3DBlob>> mShaders;
+	NameRegistry<ComPtr<ID3D12PipelineState>> mPSOs;
+
+	PsoHandle mOpaquePso;
+	PsoHandle mOpaqueWireframePso;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
 	RenderItem* mWavesRitem = nullptr;
 
+	// Holds the land's constants and buffers; its patches are drawn by DrawTerrain
+	// rather than through a render layer.
+	RenderItem* mLandRitem = nullptr;
+
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// Culler index i is the opaque layer's item i.
+	FrustumCuller mCuller;
+	std::vector<std::uint32_t> mVisibleIndices;
+
+	// The opaque items inside the camera frustum, rebuilt every frame.
+	std::vector<RenderItem*> mVisibleRitems;
+
+	// mVisibleRitems in submission order, rebuilt every frame.
+	std::vector<RenderItem*> mSortedRitems;
+	std::vector<SortEntry> mSortEntries;
+	std::vector<SortEntry> mSortScratch;
+
+	DrawStats mDrawStats;
+
 	std::unique_ptr<Waves> mWaves;
 
+	std::unique_ptr<ChunkedTerrain> mTerrain;
+	std::vector<ChunkedTerrain::Patch> mTerrainPatches;
+
+	// Camera frustum in view space.
+	BoundingFrustum mCamFrustum;
+
     PassConstants mMainPassCB;
 
     bool mIsWireframe = false;
@@ -156,6 +214,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
         MessageBox(nullptr, e.ToString().c_str(), L"HR Failed", MB_OK);
         return 0;
     }
+    catch(const std::exception& e)
+    {
+        MessageBoxA(nullptr, e.what(), "Exception", MB_OK);
+        return 0;
+    }
 }
 
 LandAndWavesApp::LandAndWavesApp(HINSTANCE hInstance)
@@ -206,12 +269,16 @@ void LandAndWavesApp::OnResize()
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
+
+    BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
 }
 
 void LandAndWavesApp::Update(const GameTimer& gt)
 {
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
+	UpdateTerrain(gt);
+	UpdateVisibleRitems(gt);
 
 	// Cycle through the circular frame resource array.
 	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -244,11 +311,11 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
 	// Reusing the command list reuses memory.
     if(mIsWireframe)
     {
-        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque_wireframe"].Get()));
+        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs[mOpaqueWireframePso].Get()));
     }
     else
     {
-        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs[mOpaquePso].Get()));
     }
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
@@ -271,7 +338,11 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
 	auto passCB = mCurrFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	mDrawStats = DrawStats();
+
+	SortRenderItems(mVisibleRitems, RenderLayer::Opaque, mSortedRitems);
+	DrawRenderItems(mCommandList.Get(), mSortedRitems);
+	DrawTerrain(mCommandList.Get());
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -335,7 +406,7 @@ void LandAndWavesApp::OnMouseMove(WPARAM btnState, int x, int y)
         mRadius += dx - dy;
 
         // Restrict the radius.
-        mRadius = MathHelper::Clamp(mRadius, 5.0f, 150.0f);
+        mRadius = MathHelper::Clamp(mRadius, 5.0f, 500.0f);
     }
 
     mLastMousePos.x = x;
@@ -366,6 +437,33 @@ void LandAndWavesApp::UpdateCamera(const GameTimer& gt)
 	XMStoreFloat4x4(&mView, view);
 }
 
+void LandAndWavesApp::UpdateVisibleRitems(const GameTimer& gt)
+{
+	const std::vector<RenderItem*>& ritems = mRitemLayer[(int)RenderLayer::Opaque];
+
+	// New items and items whose world matrix changed need their world bounds
+	// refreshed.  This runs before UpdateObjectCBs counts NumFramesDirty down.
+	std::uint32_t oldCount = mCuller.Count();
+	if(oldCount != (std::uint32_t)ritems.size())
+		mCuller.Resize((std::uint32_t)ritems.size());
+
+	for(std::uint32_t i = 0; i < (std::uint32_t)ritems.size(); ++i)
+	{
+		RenderItem* ri = ritems[i];
+		if(i >= oldCount || ri->NumFramesDirty > 0)
+			mCuller.SetBounds(i, ri->Bounds, XMLoadFloat4x4(&ri->World));
+	}
+
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX proj = XMLoadFloat4x4(&mProj);
+	mCuller.SetViewProj(XMMatrixMultiply(view, proj));
+	mCuller.Cull(mVisibleIndices);
+
+	mVisibleRitems.resize(mVisibleIndices.size());
+	for(size_t i = 0; i < mVisibleIndices.size(); ++i)
+		mVisibleRitems[i] = ritems[mVisibleIndices[i]];
+}
+
 void LandAndWavesApp::UpdateObjectCBs(const GameTimer& gt)
 {
 	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
@@ -451,6 +549,19 @@ void LandAndWavesApp::UpdateWaves(const GameTimer& gt)
 	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
+void LandAndWavesApp::UpdateTerrain(const GameTimer& gt)
+{
+	// Choose this frame's land patches from the eye position, culled against the
+	// camera frustum in world space.
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+	BoundingFrustum worldFrustum;
+	mCamFrustum.Transform(worldFrustum, invView);
+
+	mTerrain->Select(mEyePos, &worldFrustum, mTerrainPatches);
+}
+
 void LandAndWavesApp::BuildRootSignature()
 {
     // Root parameter can be a table, root descriptor or root constants.
@@ -484,8 +595,8 @@ void LandAndWavesApp::BuildRootSignature()
 
 void LandAndWavesApp::BuildShadersAndInputLayout()
 {
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_0");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_0");
+	mShaders.Add("standardVS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_0"));
+	mShaders.Add("opaquePS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_0"));
 
     mInputLayout =
     {
@@ -496,109 +607,124 @@ void LandAndWavesApp::BuildShadersAndInputLayout()
 
 void LandAndWavesApp::BuildLandGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
+	// Everything the land mesh is generated from.  Bump Version whenever
+	// GenerateLandGeometry or GetHillsHeights changes so that a mesh saved by an
+	// older build is not reused; GeometryGenerator::Version covers the grids
+	// ChunkedTerrain builds the patches from.
+	struct LandParams
+	{
+		std::uint32_t Version;
+		std::uint32_t GeneratorVersion;
+		std::uint32_t VertexByteSize;
+		float Size;
+		std::uint32_t LevelCount;
+		std::uint32_t PatchQuads;
+	};
+	const LandParams params = { 4, GeometryGenerator::Version, sizeof(Vertex), 1024.0f, 5, 32 };
+	const std::uint64_t contentKey = MeshFile::ContentKey(&params, sizeof(params));
+	const std::wstring cacheFilename = L"landGeo.mesh";
 
-	//
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  In addition, color the vertices based on their height so we have
-	// sandy looking beaches, grassy low hills, and snow mountain peaks.
-	//
+	// A 1024x1024 quadtree, five levels deep, of 32x32 quad patches: the leaves have
+	// a vertex every 2 units, the root one every 32.
+	mTerrain = std::make_unique<ChunkedTerrain>(params.Size, params.LevelCount, params.PatchQuads);
 
-	std::vector<Vertex> vertices(grid.Vertices.size());
-	for(size_t i = 0; i < grid.Vertices.size(); ++i)
+	// Warm start: map the mesh saved by a previous run instead of regenerating it.
+	std::unique_ptr<MeshGeometry> geo = MeshFile::Load(cacheFilename, contentKey);
+	if(geo == nullptr)
+	{
+		geo = GenerateLandGeometry();
+
+		// Failing to write the cache only costs the next launch a regeneration.
+		MeshFile::Save(*geo, cacheFilename, contentKey);
+	}
+	else
 	{
-		auto& p = grid.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
-
-        // Color the vertex based on its height.
-        if(vertices[i].Pos.y < -10.0f)
-        {
-            // Sandy beach color.
-            vertices[i].Color = XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f);
-        }
-        else if(vertices[i].Pos.y < 5.0f)
-        {
-            // Light yellow-green.
-            vertices[i].Color = XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f);
-        }
-        else if(vertices[i].Pos.y < 12.0f)
-        {
-            // Dark yellow-green.
-            vertices[i].Color = XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f);
-        }
-        else if(vertices[i].Pos.y < 20.0f)
-        {
-            // Dark brown.
-            vertices[i].Color = XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f);
-        }
-        else
-        {
-            // White snow.
-            vertices[i].Color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-        }
+		// The patch bounds that selection culls against are not saved with the mesh.
+		mTerrain->ComputeBounds(geo->VertexBufferCPU->GetBufferPointer(), LandVertexLayout());
 	}
-    
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 
-	std::vector<std::uint16_t> indices = grid.GetIndices16();
+	geo->Name = "landGeo";
+
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->VertexBufferCPU->GetBufferPointer(), geo->VertexBufferByteSize, geo->VertexBufferUploader);
+
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferByteSize, geo->IndexBufferUploader);
+
+	mSubmeshes.Add("landGrid", geo->DrawArgs["grid"]);
+	mGeometries.Add("landGeo", std::move(geo));
+}
+
+std::unique_ptr<MeshGeometry> LandAndWavesApp::GenerateLandGeometry()
+{
+	// Color the vertices based on their height so we have sandy looking beaches,
+	// grassy low hills, and snow mountain peaks.
+	const std::vector<TerrainBuilder::ColorBand> colorBands = {
+		{ -10.0f, XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f) },            // Sandy beach color.
+		{ 5.0f, XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f) },             // Light yellow-green.
+		{ 12.0f, XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f) },             // Dark yellow-green.
+		{ 20.0f, XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f) },            // Dark brown.
+		{ MathHelper::Infinity, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f) } // White snow.
+	};
+
+	// Every node of the quadtree gets its own block of vertices, while all of them
+	// share the stitch variant indices, which fit in 16 bits.
+	const std::vector<std::uint16_t>& indices = mTerrain->Indices();
+
+	const UINT vbByteSize = mTerrain->VertexCount() * sizeof(Vertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "landGeo";
 
+	// The patches are built straight into the CPU blob.
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	mTerrain->BuildVertices(geo->VertexBufferCPU->GetBufferPointer(), LandVertexLayout(),
+		[this, &colorBands](TerrainBuilder& builder)
+	{
+		builder.SetHeightFunction([this](FXMVECTOR x, FXMVECTOR z) { return GetHillsHeights(x, z); });
+		builder.SetColorBands(colorBands);
+	});
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
+	// The unstitched patch; DrawTerrain offsets it per node and per stitch variant.
 	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
+	submesh.IndexCount = mTerrain->StitchIndexCount(0);
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	submesh.Bounds = mTerrain->NodeBounds(0);
 
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["landGeo"] = std::move(geo);
+	return geo;
 }
 
-void LandAndWavesApp::BuildWavesGeometryBuffers()
+TerrainBuilder::VertexLayout LandAndWavesApp::LandVertexLayout()const
 {
-	std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
-
-	// Iterate over each quad.
-	int m = mWaves->RowCount();
-	int n = mWaves->ColumnCount();
-	int k = 0;
-	for(int i = 0; i < m - 1; ++i)
-	{
-		for(int j = 0; j < n - 1; ++j)
-		{
-			indices[k] = i*n + j;
-			indices[k + 1] = i*n + j + 1;
-			indices[k + 2] = (i + 1)*n + j;
+	// Our vertex has no normal, so only the position and color are written.
+	TerrainBuilder::VertexLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = (int)offsetof(Vertex, Pos);
+	layout.ColorOffset = (int)offsetof(Vertex, Color);
+	return layout;
+}
 
-			indices[k + 3] = (i + 1)*n + j;
-			indices[k + 4] = i*n + j + 1;
-			indices[k + 5] = (i + 1)*n + j + 1;
+void LandAndWavesApp::BuildWavesGeometryBuffers()
+{
+	// One triangle strip per row of quads, separated by the strip cut value: about
+	// a third of the indices of a triangle list.
+	GridIndexGenerator<std::uint16_t, GridTopology::TriangleStrip> gridIndices(
+		mWaves->RowCount(), mWaves->ColumnCount());
 
-			k += 6; // next quad
-		}
-	}
+	std::vector<std::uint16_t> indices(gridIndices.IndexCount());
+	gridIndices.Generate(indices.data());
 
 	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
 	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
@@ -626,13 +752,22 @@ void LandAndWavesApp::BuildWavesGeometryBuffers()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
+	// The surface is animated, so use the rest plane with a conservative height;
+	// the disturbances never move it by more than a fraction of a unit.
+	submesh.Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f),
+		XMFLOAT3(0.5f*mWaves->Width(), 1.0f, 0.5f*mWaves->Depth()));
+
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["waterGeo"] = std::move(geo);
+	mSubmeshes.Add("waterGrid", submesh);
+	mGeometries.Add("waterGeo", std::move(geo));
 }
 
 void LandAndWavesApp::BuildPSOs()
 {
+	ID3DBlob* standardVS = mShaders[mShaders.Get("standardVS")].Get();
+	ID3DBlob* opaquePS = mShaders[mShaders.Get("opaquePS")].Get();
+
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
 	//
@@ -643,25 +778,27 @@ void LandAndWavesApp::BuildPSOs()
 	opaquePsoDesc.pRootSignature = mRootSignature.Get();
 	opaquePsoDesc.VS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()),
-		mShaders["standardVS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(standardVS->GetBufferPointer()),
+		standardVS->GetBufferSize()
 	};
 	opaquePsoDesc.PS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(opaquePS->GetBufferPointer()),
+		opaquePS->GetBufferSize()
 	};
 	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.SampleMask = UINT_MAX;
 	opaquePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	opaquePsoDesc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_0xFFFF; // Restarts the waves' strips.
 	opaquePsoDesc.NumRenderTargets = 1;
 	opaquePsoDesc.RTVFormats[0] = mBackBufferFormat;
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+	mOpaquePso = mPSOs.Intern("opaque");
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs[mOpaquePso])));
 
     //
     // PSO for opaque wireframe objects.
@@ -669,7 +806,8 @@ void LandAndWavesApp::BuildPSOs()
 
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
     opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
+    mOpaqueWireframePso = mPSOs.Intern("opaque_wireframe");
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&mPSOs[mOpaqueWireframePso])));
 }
 
 void LandAndWavesApp::BuildFrameResources()
@@ -683,48 +821,108 @@ void LandAndWavesApp::BuildFrameResources()
 
 void LandAndWavesApp::BuildRenderItems()
 {
+	// Geometry handles double as the sort key geometry ids.
+	auto waterGeo = mGeometries.Get("waterGeo");
+	const SubmeshGeometry& waterGrid = mSubmeshes[mSubmeshes.Get("waterGrid")];
+
 	auto wavesRitem = std::make_unique<RenderItem>();
 	wavesRitem->World = MathHelper::Identity4x4();
 	wavesRitem->ObjCBIndex = 0;
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	wavesRitem->Geo = mGeometries[waterGeo].get();
+	wavesRitem->GeoId = waterGeo.Index;
+	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+	wavesRitem->IndexCount = waterGrid.IndexCount;
+	wavesRitem->StartIndexLocation = waterGrid.StartIndexLocation;
+	wavesRitem->BaseVertexLocation = waterGrid.BaseVertexLocation;
+	wavesRitem->Bounds = waterGrid.Bounds;
 
 	mWavesRitem = wavesRitem.get();
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(wavesRitem.get());
 
+	auto landGeo = mGeometries.Get("landGeo");
+	const SubmeshGeometry& landGrid = mSubmeshes[mSubmeshes.Get("landGrid")];
+
 	auto gridRitem = std::make_unique<RenderItem>();
 	gridRitem->World = MathHelper::Identity4x4();
 	gridRitem->ObjCBIndex = 1;
-	gridRitem->Geo = mGeometries["landGeo"].get();
+	gridRitem->Geo = mGeometries[landGeo].get();
+	gridRitem->GeoId = landGeo.Index;
 	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	gridRitem->IndexCount = landGrid.IndexCount;
+	gridRitem->StartIndexLocation = landGrid.StartIndexLocation;
+	gridRitem->BaseVertexLocation = landGrid.BaseVertexLocation;
+	gridRitem->Bounds = landGrid.Bounds;
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
+	// The land is drawn patch by patch in DrawTerrain.
+	mLandRitem = gridRitem.get();
 
 	mAllRitems.push_back(std::move(wavesRitem));
 	mAllRitems.push_back(std::move(gridRitem));
 }
 
+void LandAndWavesApp::SortRenderItems(const std::vector<RenderItem*>& ritems, RenderLayer layer, std::vector<RenderItem*>& sorted)
+{
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+
+	mSortEntries.resize(ritems.size());
+	for(size_t i = 0; i < ritems.size(); ++i)
+	{
+		RenderItem* ri = ritems[i];
+
+		// View space depth of the item's origin.
+		XMVECTOR origin = XMVectorSet(ri->World._41, ri->World._42, ri->World._43, 1.0f);
+		float depth = XMVectorGetZ(XMVector3TransformCoord(origin, view));
+
+		ri->SortKey = RenderSort::MakeKey((UINT)layer, ri->PsoId, ri->GeoId, ri->MaterialId, depth, mMainPassCB.FarZ);
+		mSortEntries[i] = { ri->SortKey, (std::uint32_t)i };
+	}
+
+	RenderSort::Sort(mSortEntries, mSortScratch);
+
+	sorted.resize(ritems.size());
+	for(size_t i = 0; i < ritems.size(); ++i)
+		sorted[i] = ritems[mSortEntries[i].Index];
+}
+
 void LandAndWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
 	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
 	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
 
+	// Input assembler state of the previous item; ritems is sorted, so most items
+	// find their buffers already bound.
+	MeshGeometry* boundGeo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
 	// For each render item...
 	for(size_t i = 0; i < ritems.size(); ++i)
 	{
 		auto ri = ritems[i];
 
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		if(ri->Geo != boundGeo)
+		{
+			cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+			cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+			boundGeo = ri->Geo;
+			mDrawStats.StateChanges += 2;
+		}
+		else
+		{
+			mDrawStats.StateChangesSaved += 2;
+		}
+
+		if(ri->PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			boundTopology = ri->PrimitiveType;
+			mDrawStats.StateChanges++;
+		}
+		else
+		{
+			mDrawStats.StateChangesSaved++;
+		}
 
         D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress();
         objCBAddress += ri->ObjCBIndex*objCBByteSize;
@@ -732,7 +930,44 @@ void LandAndWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const
 		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
 
 		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		mDrawStats.DrawCalls++;
+	}
+}
+
+void LandAndWavesApp::DrawTerrain(ID3D12GraphicsCommandList* cmdList)
+{
+	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+
+	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+
+	// All patches share the land's buffers and constants, so bind them once.
+	MeshGeometry* geo = mLandRitem->Geo;
+	cmdList->IASetVertexBuffers(0, 1, &geo->VertexBufferView());
+	cmdList->IASetIndexBuffer(&geo->IndexBufferView());
+	cmdList->IASetPrimitiveTopology(mLandRitem->PrimitiveType);
+	mDrawStats.StateChanges += 3;
+
+	D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress();
+	objCBAddress += mLandRitem->ObjCBIndex*objCBByteSize;
+
+	cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+
+	// Each patch picks its node's vertex block and the indices for its stitched edges.
+	UINT patchVertexCount = mTerrain->PatchVertexCount();
+	for(const ChunkedTerrain::Patch& patch : mTerrainPatches)
+	{
+		cmdList->DrawIndexedInstanced(mTerrain->StitchIndexCount(patch.StitchMask), 1,
+			mLandRitem->StartIndexLocation + mTerrain->StitchStartIndex(patch.StitchMask),
+			mLandRitem->BaseVertexLocation + (INT)(patch.Node*patchVertexCount), 0);
 	}
+	mDrawStats.DrawCalls += (std::uint32_t)mTerrainPatches.size();
+}
+
+std::wstring LandAndWavesApp::FrameStatsText()const
+{
+	return L"   draws: " + std::to_wstring(mDrawStats.DrawCalls) +
+		L"   state changes: " + std::to_wstring(mDrawStats.StateChanges) +
+		L" (" + std::to_wstring(mDrawStats.StateChangesSaved) + L" saved)";
 }
 
 float LandAndWavesApp::GetHillsHeight(float x, float z)const
@@ -740,6 +975,16 @@ float LandAndWavesApp::GetHillsHeight(float x, float z)const
     return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
 }
 
+// GetHillsHeight for four points at once.
+XMVECTOR LandAndWavesApp::GetHillsHeights(FXMVECTOR x, FXMVECTOR z)const
+{
+    XMVECTOR tenth = XMVectorReplicate(0.1f);
+    XMVECTOR sinX = XMVectorSin(XMVectorMultiply(tenth, x));
+    XMVECTOR cosZ = XMVectorCos(XMVectorMultiply(tenth, z));
+
+    return XMVectorScale(XMVectorAdd(XMVectorMultiply(z, sinX), XMVectorMultiply(x, cosZ)), 0.3f);
+}
+
 XMFLOAT3 LandAndWavesApp::GetHillsNormal(float x, float z)const
 {
     // n = (-df/dx, 1, -df/dz)
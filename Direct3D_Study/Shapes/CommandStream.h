@@ -0,0 +1,409 @@
+//***************************************************************************************
+// CommandStream.h
+//
+// A frame's graphics commands recorded into plain memory, to be replayed later by a
+// backend: D3D12CommandBackend translates them to an ID3D12GraphicsCommandList, and
+// NullCommandBackend only walks them, so building a frame can be timed without a GPU.
+//
+// Every command is a small POD struct that starts with its CommandType.  They are
+// written back to back into 64 KB blocks; Reset rewinds to the first block and keeps
+// the blocks, so recording a frame allocates nothing once the stream has grown to
+// the size of a frame.  Resources are referred to by pointer and GPU addresses and
+// descriptor handles by value, so this header needs no D3D12 headers.
+//
+// Setting state that is already set (pipeline state, root signature and arguments,
+// buffers, topology) records nothing.  The stream assumes nothing about the state
+// at the start of a replay, so the first set of each always goes in.
+//
+// Streams share nothing, so several threads can each record their own.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct ID3D12DescriptorHeap;
+struct ID3D12PipelineState;
+struct ID3D12Resource;
+struct ID3D12RootSignature;
+
+enum class CommandType : std::uint32_t
+{
+	ResourceBarrier,
+	SetViewport,
+	SetScissorRect,
+	ClearRenderTarget,
+	ClearDepthStencil,
+	SetRenderTarget,
+	SetDescriptorHeap,
+	SetRootSignature,
+	SetPipelineState,
+	SetRootDescriptorTable,
+	SetRootConstantBufferView,
+	SetRootShaderResourceView,
+	SetRoot32BitConstant,
+	SetVertexBuffer,
+	SetIndexBuffer,
+	SetPrimitiveTopology,
+	DrawIndexedInstanced,
+	Count
+};
+
+// The fields mirror the D3D12 calls of the same names; enums (resource states,
+// formats, topologies, clear flags) hold their D3D12 values.
+
+// A transition barrier of all subresources.
+struct ResourceBarrierCommand
+{
+	CommandType Type;
+	std::uint32_t StateBefore;
+	ID3D12Resource* Resource;
+	std::uint32_t StateAfter;
+	std::uint32_t Pad;
+};
+
+struct SetViewportCommand
+{
+	CommandType Type;
+	float TopLeftX;
+	float TopLeftY;
+	float Width;
+	float Height;
+	float MinDepth;
+	float MaxDepth;
+	std::uint32_t Pad;
+};
+
+struct SetScissorRectCommand
+{
+	CommandType Type;
+	std::int32_t Left;
+	std::int32_t Top;
+	std::int32_t Right;
+	std::int32_t Bottom;
+	std::uint32_t Pad;
+};
+
+// Rtv is the ptr of a D3D12_CPU_DESCRIPTOR_HANDLE.
+struct ClearRenderTargetCommand
+{
+	CommandType Type;
+	float Color[4];
+	std::uint32_t Pad;
+	std::uint64_t Rtv;
+};
+
+struct ClearDepthStencilCommand
+{
+	CommandType Type;
+	std::uint32_t Flags;
+	float Depth;
+	std::uint32_t Stencil;
+	std::uint64_t Dsv;
+};
+
+// One render target and a depth stencil view; Dsv is 0 for none.
+struct SetRenderTargetCommand
+{
+	CommandType Type;
+	std::uint32_t Pad;
+	std::uint64_t Rtv;
+	std::uint64_t Dsv;
+};
+
+// A single CBV/SRV/UAV heap.
+struct SetDescriptorHeapCommand
+{
+	CommandType Type;
+	std::uint32_t Pad;
+	ID3D12DescriptorHeap* Heap;
+};
+
+struct SetRootSignatureCommand
+{
+	CommandType Type;
+	std::uint32_t Pad;
+	ID3D12RootSignature* RootSignature;
+};
+
+struct SetPipelineStateCommand
+{
+	CommandType Type;
+	std::uint32_t Pad;
+	ID3D12PipelineState* Pso;
+};
+
+// The root argument commands share this layout.  Value is the ptr of a
+// D3D12_GPU_DESCRIPTOR_HANDLE for a table, a GPU virtual address for a CBV or SRV,
+// and the 32-bit value for a constant, which Offset places.
+struct SetRootArgumentCommand
+{
+	CommandType Type;
+	std::uint32_t RootParameterIndex;
+	std::uint64_t Value;
+	std::uint32_t Offset;
+	std::uint32_t Pad;
+};
+
+struct SetVertexBufferCommand
+{
+	CommandType Type;
+	std::uint32_t Slot;
+	std::uint64_t BufferLocation;
+	std::uint32_t SizeInBytes;
+	std::uint32_t StrideInBytes;
+};
+
+struct SetIndexBufferCommand
+{
+	CommandType Type;
+	std::uint32_t Format;
+	std::uint64_t BufferLocation;
+	std::uint32_t SizeInBytes;
+	std::uint32_t Pad;
+};
+
+struct SetPrimitiveTopologyCommand
+{
+	CommandType Type;
+	std::uint32_t Topology;
+};
+
+struct DrawIndexedInstancedCommand
+{
+	CommandType Type;
+	std::uint32_t IndexCountPerInstance;
+	std::uint32_t InstanceCount;
+	std::uint32_t StartIndexLocation;
+	std::int32_t BaseVertexLocation;
+	std::uint32_t StartInstanceLocation;
+};
+
+class CommandStream
+{
+public:
+	static const std::uint32_t BlockByteSize = 64*1024;
+
+	// Root parameters and vertex buffer slots past these are never skipped as
+	// redundant.
+	static const std::uint32_t TrackedRootParameters = 16;
+	static const std::uint32_t TrackedVertexBuffers = 4;
+
+	CommandStream();
+	CommandStream(const CommandStream& rhs) = delete;
+	CommandStream& operator=(const CommandStream& rhs) = delete;
+
+	// Drops the commands and forgets the state, keeping the memory.
+	void Reset();
+
+	void ResourceBarrier(ID3D12Resource* resource, std::uint32_t stateBefore, std::uint32_t stateAfter);
+	void SetViewport(float topLeftX, float topLeftY, float width, float height, float minDepth, float maxDepth);
+	void SetScissorRect(std::int32_t left, std::int32_t top, std::int32_t right, std::int32_t bottom);
+	void ClearRenderTarget(std::uint64_t rtv, const float color[4]);
+	void ClearDepthStencil(std::uint64_t dsv, std::uint32_t flags, float depth, std::uint32_t stencil);
+	void SetRenderTarget(std::uint64_t rtv, std::uint64_t dsv);
+	void SetDescriptorHeap(ID3D12DescriptorHeap* heap);
+
+	// Also forgets the root arguments, which a new root signature unbinds.
+	void SetRootSignature(ID3D12RootSignature* rootSignature);
+
+	void SetPipelineState(ID3D12PipelineState* pso);
+	void SetRootDescriptorTable(std::uint32_t rootParameterIndex, std::uint64_t baseDescriptor);
+	void SetRootConstantBufferView(std::uint32_t rootParameterIndex, std::uint64_t bufferLocation);
+	void SetRootShaderResourceView(std::uint32_t rootParameterIndex, std::uint64_t bufferLocation);
+	void SetRoot32BitConstant(std::uint32_t rootParameterIndex, std::uint32_t value, std::uint32_t offset);
+	void SetVertexBuffer(std::uint32_t slot, std::uint64_t bufferLocation, std::uint32_t sizeInBytes,
+		std::uint32_t strideInBytes);
+	void SetIndexBuffer(std::uint64_t bufferLocation, std::uint32_t sizeInBytes, std::uint32_t format);
+	void SetPrimitiveTopology(std::uint32_t topology);
+	void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+		std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation);
+
+	// Commands recorded; of the state commands, the ones recorded and the ones
+	// skipped because the state was set.
+	std::uint32_t CommandCount()const { return mCommandCount; }
+	std::uint32_t DrawCount()const { return mDrawCount; }
+	std::uint32_t StateCount()const { return mStateCount; }
+	std::uint32_t SkippedCount()const { return mSkippedCount; }
+
+	// Bytes taken by the commands, not counting the unused ends of blocks.
+	size_t ByteSize()const { return mByteSize; }
+
+	// Calls backend(command) for every command in recording order, with the command
+	// as its own struct type; the root argument commands are SetRootArgumentCommand.
+	template<typename Backend>
+	void Replay(Backend& backend)const;
+
+private:
+	struct Block
+	{
+		std::unique_ptr<std::uint8_t[]> Bytes;
+		std::uint32_t Used = 0;
+	};
+
+	template<typename T>
+	T& Allocate(CommandType type);
+
+	void SetRootArgument(CommandType type, std::uint32_t rootParameterIndex, std::uint64_t value,
+		std::uint32_t offset);
+	void ForgetState();
+
+	std::vector<Block> mBlocks;
+	std::uint32_t mCurrentBlock = 0;
+
+	std::uint32_t mCommandCount = 0;
+	std::uint32_t mDrawCount = 0;
+	std::uint32_t mStateCount = 0;
+	std::uint32_t mSkippedCount = 0;
+	size_t mByteSize = 0;
+
+	// The state set so far; a Known flag is false until the state is first set.
+	struct RootArgument
+	{
+		bool Known;
+		CommandType Type;
+		std::uint64_t Value;
+		std::uint32_t Offset;
+	};
+
+	bool mPsoKnown = false;
+	ID3D12PipelineState* mPso = nullptr;
+	bool mRootSignatureKnown = false;
+	ID3D12RootSignature* mRootSignature = nullptr;
+	bool mTopologyKnown = false;
+	std::uint32_t mTopology = 0;
+	bool mIndexBufferKnown = false;
+	SetIndexBufferCommand mIndexBuffer;
+	bool mVertexBufferKnown[TrackedVertexBuffers];
+	SetVertexBufferCommand mVertexBuffers[TrackedVertexBuffers];
+	RootArgument mRootArguments[TrackedRootParameters];
+};
+
+// Walks the commands and counts them by type, so a frame's recording can be timed
+// and checked without a device.
+class NullCommandBackend
+{
+public:
+	std::uint32_t Count(CommandType type)const { return mCounts[(std::uint32_t)type]; }
+
+	// Indices over all draws.
+	std::uint64_t IndexCount()const { return mIndexCount; }
+
+	template<typename Command>
+	void operator()(const Command& command)
+	{
+		mCounts[(std::uint32_t)command.Type]++;
+	}
+
+	void operator()(const DrawIndexedInstancedCommand& command)
+	{
+		mCounts[(std::uint32_t)command.Type]++;
+		mIndexCount += (std::uint64_t)command.IndexCountPerInstance*command.InstanceCount;
+	}
+
+private:
+	std::uint32_t mCounts[(std::uint32_t)CommandType::Count] = {};
+	std::uint64_t mIndexCount = 0;
+};
+
+template<typename T>
+T& CommandStream::Allocate(CommandType type)
+{
+	// Rounded up so that the next command is 8-byte aligned.
+	const std::uint32_t size = (std::uint32_t)((sizeof(T) + 7) & ~size_t(7));
+
+	if(mBlocks[mCurrentBlock].Used + size > BlockByteSize)
+	{
+		// Later blocks are kept from earlier frames.
+		if(++mCurrentBlock == mBlocks.size())
+		{
+			mBlocks.emplace_back();
+			mBlocks.back().Bytes.reset(new std::uint8_t[BlockByteSize]);
+		}
+		mBlocks[mCurrentBlock].Used = 0;
+	}
+
+	Block& block = mBlocks[mCurrentBlock];
+	T& command = *reinterpret_cast<T*>(block.Bytes.get() + block.Used);
+	command = T();
+	command.Type = type;
+
+	block.Used += size;
+	mByteSize += size;
+	mCommandCount++;
+	return command;
+}
+
+template<typename Backend>
+void CommandStream::Replay(Backend& backend)const
+{
+	for(std::uint32_t b = 0; b <= mCurrentBlock; ++b)
+	{
+		const std::uint8_t* bytes = mBlocks[b].Bytes.get();
+		const std::uint8_t* end = bytes + mBlocks[b].Used;
+		while(bytes < end)
+		{
+			size_t size = 0;
+			auto replay = [&](const auto& command)
+			{
+				backend(command);
+				size = (sizeof(command) + 7) & ~size_t(7);
+			};
+
+			switch(*reinterpret_cast<const CommandType*>(bytes))
+			{
+			case CommandType::ResourceBarrier:
+				replay(*reinterpret_cast<const ResourceBarrierCommand*>(bytes));
+				break;
+			case CommandType::SetViewport:
+				replay(*reinterpret_cast<const SetViewportCommand*>(bytes));
+				break;
+			case CommandType::SetScissorRect:
+				replay(*reinterpret_cast<const SetScissorRectCommand*>(bytes));
+				break;
+			case CommandType::ClearRenderTarget:
+				replay(*reinterpret_cast<const ClearRenderTargetCommand*>(bytes));
+				break;
+			case CommandType::ClearDepthStencil:
+				replay(*reinterpret_cast<const ClearDepthStencilCommand*>(bytes));
+				break;
+			case CommandType::SetRenderTarget:
+				replay(*reinterpret_cast<const SetRenderTargetCommand*>(bytes));
+				break;
+			case CommandType::SetDescriptorHeap:
+				replay(*reinterpret_cast<const SetDescriptorHeapCommand*>(bytes));
+				break;
+			case CommandType::SetRootSignature:
+				replay(*reinterpret_cast<const SetRootSignatureCommand*>(bytes));
+				break;
+			case CommandType::SetPipelineState:
+				replay(*reinterpret_cast<const SetPipelineStateCommand*>(bytes));
+				break;
+			case CommandType::SetRootDescriptorTable:
+			case CommandType::SetRootConstantBufferView:
+			case CommandType::SetRootShaderResourceView:
+			case CommandType::SetRoot32BitConstant:
+				replay(*reinterpret_cast<const SetRootArgumentCommand*>(bytes));
+				break;
+			case CommandType::SetVertexBuffer:
+				replay(*reinterpret_cast<const SetVertexBufferCommand*>(bytes));
+				break;
+			case CommandType::SetIndexBuffer:
+				replay(*reinterpret_cast<const SetIndexBufferCommand*>(bytes));
+				break;
+			case CommandType::SetPrimitiveTopology:
+				replay(*reinterpret_cast<const SetPrimitiveTopologyCommand*>(bytes));
+				break;
+			case CommandType::DrawIndexedInstanced:
+				replay(*reinterpret_cast<const DrawIndexedInstancedCommand*>(bytes));
+				break;
+			default:
+				return;
+			}
+
+			bytes += size;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+//***************************************************************************************
+// ConstantUpload.cpp
+//***************************************************************************************
+
+#include "ConstantUpload.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	void TransposeAndStream(const float* src, float* dest)
+	{
+		__m128 r0 = _mm_loadu_ps(src);
+		__m128 r1 = _mm_loadu_ps(src + 4);
+		__m128 r2 = _mm_loadu_ps(src + 8);
+		__m128 r3 = _mm_loadu_ps(src + 12);
+
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		_mm_stream_ps(dest, r0);
+		_mm_stream_ps(dest + 4, r1);
+		_mm_stream_ps(dest + 8, r2);
+		_mm_stream_ps(dest + 12, r3);
+	}
+
+	// Writes the items whose CB index is in [cbBegin, cbEnd).
+	void WriteRange(const XMFLOAT4X4* matrices, const std::uint32_t* cbIndices,
+		const std::uint32_t* items, std::uint32_t itemCount, std::uint32_t cbBegin, std::uint32_t cbEnd,
+		std::uint8_t* mappedData, std::uint32_t elementByteSize)
+	{
+		const float* src[4];
+		float* dest[4];
+		std::uint32_t pending = 0;
+
+		for(std::uint32_t i = 0; i < itemCount; ++i)
+		{
+			std::uint32_t item = items[i];
+			std::uint32_t cbIndex = cbIndices[item];
+			if(cbIndex < cbBegin || cbIndex >= cbEnd)
+				continue;
+
+			src[pending] = &matrices[item]._11;
+			dest[pending] = (float*)(mappedData + (size_t)cbIndex*elementByteSize);
+			if(++pending < 4)
+				continue;
+
+			// Load all four before storing any, so the loads overlap.
+			__m128 a0 = _mm_loadu_ps(src[0]), a1 = _mm_loadu_ps(src[0] + 4), a2 = _mm_loadu_ps(src[0] + 8), a3 = _mm_loadu_ps(src[0] + 12);
+			__m128 b0 = _mm_loadu_ps(src[1]), b1 = _mm_loadu_ps(src[1] + 4), b2 = _mm_loadu_ps(src[1] + 8), b3 = _mm_loadu_ps(src[1] + 12);
+			__m128 c0 = _mm_loadu_ps(src[2]), c1 = _mm_loadu_ps(src[2] + 4), c2 = _mm_loadu_ps(src[2] + 8), c3 = _mm_loadu_ps(src[2] + 12);
+			__m128 d0 = _mm_loadu_ps(src[3]), d1 = _mm_loadu_ps(src[3] + 4), d2 = _mm_loadu_ps(src[3] + 8), d3 = _mm_loadu_ps(src[3] + 12);
+
+			_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+			_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			_MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+
+			_mm_stream_ps(dest[0], a0); _mm_stream_ps(dest[0] + 4, a1); _mm_stream_ps(dest[0] + 8, a2); _mm_stream_ps(dest[0] + 12, a3);
+			_mm_stream_ps(dest[1], b0); _mm_stream_ps(dest[1] + 4, b1); _mm_stream_ps(dest[1] + 8, b2); _mm_stream_ps(dest[1] + 12, b3);
+			_mm_stream_ps(dest[2], c0); _mm_stream_ps(dest[2] + 4, c1); _mm_stream_ps(dest[2] + 8, c2); _mm_stream_ps(dest[2] + 12, c3);
+			_mm_stream_ps(dest[3], d0); _mm_stream_ps(dest[3] + 4, d1); _mm_stream_ps(dest[3] + 8, d2); _mm_stream_ps(dest[3] + 12, d3);
+
+			pending = 0;
+		}
+
+		for(std::uint32_t i = 0; i < pending; ++i)
+			TransposeAndStream(src[i], dest[i]);
+
+		// Non-temporal stores are weakly ordered; make them visible before the GPU is
+		// told to read the buffer.
+		_mm_sfence();
+	}
+}
+
+void ConstantUpload::WriteTransposed(const XMFLOAT4X4* matrices, const std::uint32_t* cbIndices,
+	const std::uint32_t* items, std::uint32_t itemCount, std::uint32_t cbCount,
+	void* mappedData, std::uint32_t elementByteSize)
+{
+	std::uint8_t* bytes = (std::uint8_t*)mappedData;
+
+	if(itemCount < ParallelItemCount)
+	{
+		WriteRange(matrices, cbIndices, items, itemCount, 0, cbCount, bytes, elementByteSize);
+		return;
+	}
+
+	// Every range looks through the whole item list for its own CB indices.  That is
+	// a cheap read of 4 bytes per item next to the 64 byte matrix writes, but it grows
+	// with the range count, so use one range per thread.
+	ThreadPool& pool = ThreadPool::Default();
+	std::uint32_t rangeCount = std::min<std::uint32_t>(pool.ThreadCount(), cbCount);
+	std::uint32_t rangeSize = (cbCount + rangeCount - 1) / rangeCount;
+
+	pool.ParallelFor(rangeCount, 1, [&](size_t begin, size_t end)
+	{
+		for(size_t range = begin; range < end; ++range)
+		{
+			std::uint32_t cbBegin = (std::uint32_t)range*rangeSize;
+			std::uint32_t cbEnd = std::min<std::uint32_t>(cbBegin + rangeSize, cbCount);
+			WriteRange(matrices, cbIndices, items, itemCount, cbBegin, cbEnd, bytes, elementByteSize);
+		}
+	});
+}
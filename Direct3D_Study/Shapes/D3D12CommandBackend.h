@@ -0,0 +1,37 @@
+//***************************************************************************************
+// D3D12CommandBackend.h
+//
+// Replays a CommandStream into a graphics command list:
+//
+//     D3D12CommandBackend backend(cmdList);
+//     stream.Replay(backend);
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "CommandStream.h"
+
+class D3D12CommandBackend
+{
+public:
+	explicit D3D12CommandBackend(ID3D12GraphicsCommandList* cmdList);
+
+	void operator()(const ResourceBarrierCommand& command);
+	void operator()(const SetViewportCommand& command);
+	void operator()(const SetScissorRectCommand& command);
+	void operator()(const ClearRenderTargetCommand& command);
+	void operator()(const ClearDepthStencilCommand& command);
+	void operator()(const SetRenderTargetCommand& command);
+	void operator()(const SetDescriptorHeapCommand& command);
+	void operator()(const SetRootSignatureCommand& command);
+	void operator()(const SetPipelineStateCommand& command);
+	void operator()(const SetRootArgumentCommand& command);
+	void operator()(const SetVertexBufferCommand& command);
+	void operator()(const SetIndexBufferCommand& command);
+	void operator()(const SetPrimitiveTopologyCommand& command);
+	void operator()(const DrawIndexedInstancedCommand& command);
+
+private:
+	ID3D12GraphicsCommandList* mCmdList = nullptr;
+};
@@ -9,6 +9,13 @@ struct ObjectConstants
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 };
 
+// Per-instance data of an instanced draw, read by the instanced vertex shader from
+// a structured buffer.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+};
+
 struct PassConstants
 {
     //  ġ, þ İ  , ׸ ȭ( ) ũ⿡ 
@@ -43,19 +50,25 @@ struct Vertex
 struct FrameResource
 {
 public:
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT maxInstanceCount,
+        UINT cmdListCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
 
     //  Ҵڴ GPU ɵ  ó  缳ؾ Ѵ.
-    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+    // One per command list the frame is recorded into, so that the lists can be
+    // recorded on different threads.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> CmdListAllocs;
 
     //  ۴ װ ϴ ɵ GPU  ó Ŀ
     // ؾ Ѵ. Ӹ  ۸   Ѵ.
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
+    // Rewritten every frame with the world matrices of the instanced draws.
+    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+
     // Fence  Ÿ  ɵ ǥϴ ̴.
     //   GPU    ڿ ϰ ִ
     // ϴ 뵵 δ.
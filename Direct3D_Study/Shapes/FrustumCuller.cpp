@@ -0,0 +1,198 @@
+//***************************************************************************************
+// FrustumCuller.cpp
+//***************************************************************************************
+
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t GroupSize = 8;
+	static_assert(FrustumCuller::ChunkSize % GroupSize == 0, "Chunks must hold whole groups.");
+}
+
+void FrustumCuller::Resize(std::uint32_t count)
+{
+	std::uint32_t paddedCount = (count + GroupSize - 1) & ~(GroupSize - 1);
+
+	std::vector<float>* arrays[] = { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ };
+	for(std::vector<float>* a : arrays)
+	{
+		a->resize(paddedCount);
+
+		// Clear what a smaller count left behind in the old padding.
+		if(count > mCount)
+			std::fill(a->begin() + mCount, a->end(), 0.0f);
+	}
+
+	mCount = count;
+}
+
+std::uint32_t FrustumCuller::Count()const
+{
+	return mCount;
+}
+
+void FrustumCuller::SetBounds(std::uint32_t index, const BoundingBox& worldBounds)
+{
+	mCenterX[index] = worldBounds.Center.x;
+	mCenterY[index] = worldBounds.Center.y;
+	mCenterZ[index] = worldBounds.Center.z;
+	mExtentX[index] = worldBounds.Extents.x;
+	mExtentY[index] = worldBounds.Extents.y;
+	mExtentZ[index] = worldBounds.Extents.z;
+}
+
+void FrustumCuller::SetBounds(std::uint32_t index, const BoundingBox& localBounds, FXMMATRIX world)
+{
+	BoundingBox worldBounds;
+	localBounds.Transform(worldBounds, world);
+	SetBounds(index, worldBounds);
+}
+
+void FrustumCuller::SetViewProj(FXMMATRIX viewProj)
+{
+	ExtractPlanes(viewProj, mPlanes);
+}
+
+void FrustumCuller::ExtractPlanes(FXMMATRIX viewProj, XMFLOAT4 planes[6])
+{
+	// With row vectors the clip space coordinates are dot products with the columns of
+	// viewProj; after transposing they are the rows.  A point is inside when
+	// -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+	XMMATRIX m = XMMatrixTranspose(viewProj);
+
+	XMVECTOR clipPlanes[6] =
+	{
+		XMVectorAdd(m.r[3], m.r[0]),
+		XMVectorSubtract(m.r[3], m.r[0]),
+		XMVectorAdd(m.r[3], m.r[1]),
+		XMVectorSubtract(m.r[3], m.r[1]),
+		m.r[2],
+		XMVectorSubtract(m.r[3], m.r[2])
+	};
+
+	// Normalized so the plane distances and the box radii below are in world units.
+	for(int i = 0; i < 6; ++i)
+		XMStoreFloat4(&planes[i], XMPlaneNormalize(clipPlanes[i]));
+}
+
+void FrustumCuller::Cull(std::vector<std::uint32_t>& visible)
+{
+	if(mCount == 0)
+	{
+		visible.clear();
+		return;
+	}
+
+	// Every chunk may keep all of its boxes, so it gets room for all of them.
+	visible.resize(mCenterX.size());
+
+	std::uint32_t chunkCount = (mCount + ChunkSize - 1) / ChunkSize;
+	mChunkCounts.resize(chunkCount);
+
+	std::uint32_t* output = visible.data();
+	ThreadPool::Default().ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for(size_t chunk = begin; chunk < end; ++chunk)
+		{
+			std::uint32_t first = (std::uint32_t)chunk*ChunkSize;
+			std::uint32_t last = std::min<std::uint32_t>(first + ChunkSize, mCount);
+			mChunkCounts[chunk] = CullRange(first, last, output + first);
+		}
+	});
+
+	// Close the gaps between the chunks' results.  Few boxes are usually visible, so
+	// this moves little memory.
+	std::uint32_t visibleCount = mChunkCounts[0];
+	for(std::uint32_t chunk = 1; chunk < chunkCount; ++chunk)
+	{
+		std::memmove(output + visibleCount, output + chunk*ChunkSize, mChunkCounts[chunk]*sizeof(std::uint32_t));
+		visibleCount += mChunkCounts[chunk];
+	}
+
+	visible.resize(visibleCount);
+}
+
+std::uint32_t FrustumCuller::CullRange(std::uint32_t begin, std::uint32_t end, std::uint32_t* visible)const
+{
+	XMVECTOR planeX[6], planeY[6], planeZ[6], planeW[6];
+	XMVECTOR absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+	for(int p = 0; p < 6; ++p)
+	{
+		XMVECTOR plane = XMLoadFloat4(&mPlanes[p]);
+		planeX[p] = XMVectorSplatX(plane);
+		planeY[p] = XMVectorSplatY(plane);
+		planeZ[p] = XMVectorSplatZ(plane);
+		planeW[p] = XMVectorSplatW(plane);
+		absPlaneX[p] = XMVectorAbs(planeX[p]);
+		absPlaneY[p] = XMVectorAbs(planeY[p]);
+		absPlaneZ[p] = XMVectorAbs(planeZ[p]);
+	}
+
+	XMVECTOR zero = XMVectorZero();
+
+	std::uint32_t visibleCount = 0;
+	for(std::uint32_t i = begin; i < end; i += GroupSize)
+	{
+		XMVECTOR cx0 = XMLoadFloat4((const XMFLOAT4*)&mCenterX[i]);
+		XMVECTOR cy0 = XMLoadFloat4((const XMFLOAT4*)&mCenterY[i]);
+		XMVECTOR cz0 = XMLoadFloat4((const XMFLOAT4*)&mCenterZ[i]);
+		XMVECTOR ex0 = XMLoadFloat4((const XMFLOAT4*)&mExtentX[i]);
+		XMVECTOR ey0 = XMLoadFloat4((const XMFLOAT4*)&mExtentY[i]);
+		XMVECTOR ez0 = XMLoadFloat4((const XMFLOAT4*)&mExtentZ[i]);
+		XMVECTOR cx1 = XMLoadFloat4((const XMFLOAT4*)&mCenterX[i + 4]);
+		XMVECTOR cy1 = XMLoadFloat4((const XMFLOAT4*)&mCenterY[i + 4]);
+		XMVECTOR cz1 = XMLoadFloat4((const XMFLOAT4*)&mCenterZ[i + 4]);
+		XMVECTOR ex1 = XMLoadFloat4((const XMFLOAT4*)&mExtentX[i + 4]);
+		XMVECTOR ey1 = XMLoadFloat4((const XMFLOAT4*)&mExtentY[i + 4]);
+		XMVECTOR ez1 = XMLoadFloat4((const XMFLOAT4*)&mExtentZ[i + 4]);
+
+		XMVECTOR outside0 = XMVectorFalseInt();
+		XMVECTOR outside1 = XMVectorFalseInt();
+		for(int p = 0; p < 6; ++p)
+		{
+			// Signed distance of the center plus the box's radius along the plane
+			// normal; negative means every corner is outside.
+			XMVECTOR d0 = XMVectorMultiplyAdd(cx0, planeX[p], planeW[p]);
+			XMVECTOR d1 = XMVectorMultiplyAdd(cx1, planeX[p], planeW[p]);
+			d0 = XMVectorMultiplyAdd(cy0, planeY[p], d0);
+			d1 = XMVectorMultiplyAdd(cy1, planeY[p], d1);
+			d0 = XMVectorMultiplyAdd(cz0, planeZ[p], d0);
+			d1 = XMVectorMultiplyAdd(cz1, planeZ[p], d1);
+			d0 = XMVectorMultiplyAdd(ex0, absPlaneX[p], d0);
+			d1 = XMVectorMultiplyAdd(ex1, absPlaneX[p], d1);
+			d0 = XMVectorMultiplyAdd(ey0, absPlaneY[p], d0);
+			d1 = XMVectorMultiplyAdd(ey1, absPlaneY[p], d1);
+			d0 = XMVectorMultiplyAdd(ez0, absPlaneZ[p], d0);
+			d1 = XMVectorMultiplyAdd(ez1, absPlaneZ[p], d1);
+
+			outside0 = XMVectorOrInt(outside0, XMVectorLess(d0, zero));
+			outside1 = XMVectorOrInt(outside1, XMVectorLess(d1, zero));
+		}
+
+		std::uint32_t mask = ~((std::uint32_t)_mm_movemask_ps(outside0) |
+			((std::uint32_t)_mm_movemask_ps(outside1) << 4)) & 0xff;
+
+		// Padding past the last box.
+		if(end - i < GroupSize)
+			mask &= (1u << (end - i)) - 1;
+
+		if(mask == 0)
+			continue;
+
+		// Write every index and advance only past the visible ones.
+		for(std::uint32_t k = 0; k < GroupSize; ++k)
+		{
+			visible[visibleCount] = i + k;
+			visibleCount += (mask >> k) & 1;
+		}
+	}
+
+	return visibleCount;
+}
@@ -3,9 +3,59 @@
 //***************************************************************************************
 
 #include "GeometryGenerator.h"
+#include "GridIndexGenerator.h"
+#include "ThreadPool.h"
 #include <algorithm>
+#include <type_traits>
 
 using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	// Smallest amount of work, in vertices or indices, worth handing to another thread.
+	const size_t MinElementsPerTask = 4096;
+
+	// Sizes the index array selected by MeshData::ResetIndices to indexCount and
+	// calls build(indices) with a pointer to its first element, so one generic
+	// lambda can fill either width in place.
+	template<typename Build>
+	void WriteIndices(GeometryGenerator::MeshData& meshData, size_t indexCount, Build&& build)
+	{
+		if(meshData.Uses16BitIndices())
+		{
+			meshData.Indices16.resize(indexCount);
+			build(meshData.Indices16.data());
+		}
+		else
+		{
+			meshData.Indices32.resize(indexCount);
+			build(meshData.Indices32.data());
+		}
+	}
+}
+
+const GeometryGenerator::uint32 GeometryGenerator::Version;
+
+void GeometryGenerator::SetParallelThreshold(size_t minVertexCount)
+{
+	mParallelVertexThreshold = minVertexCount;
+}
+
+template<typename Body>
+void GeometryGenerator::ForEachRow(size_t rowCount, size_t rowVertexCount, Body&& body)
+{
+	// Rows are always processed by the same code whether or not the work is
+	// split, so the result does not depend on the thread count.
+	if(rowCount*rowVertexCount < mParallelVertexThreshold)
+	{
+		body(size_t(0), rowCount);
+		return;
+	}
+
+	size_t grainSize = std::max<size_t>(1, MinElementsPerTask / std::max<size_t>(1, rowVertexCount));
+	ThreadPool::Default().ParallelFor(rowCount, grainSize, body);
+}
 
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
@@ -89,7 +139,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	i[30] = 20; i[31] = 21; i[32] = 22;
 	i[33] = 20; i[34] = 22; i[35] = 23;
 
-	meshData.Indices32.assign(&i[0], &i[36]);
+	meshData.ResetIndices(meshData.Vertices.size(), 36);
+	for(uint32 j = 0; j < 36; ++j)
+		meshData.AddIndex(i[j]);
 
     // Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
@@ -97,6 +149,8 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
     for(uint32 i = 0; i < numSubdivisions; ++i)
         Subdivide(meshData);
 
+	SetBounds(meshData, XMFLOAT3(w2, h2, d2), sqrtf(w2*w2 + h2*h2 + d2*d2));
+
     return meshData;
 }
 
@@ -114,99 +168,100 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back( topVertex );
+	float phiStep = XM_PI/stackCount;
 
-	float phiStep   = XM_PI/stackCount;
-	float thetaStep = 2.0f*XM_PI/sliceCount;
+	// Do not count the poles as rings.
+	uint32 ringCount = stackCount-1;
+	uint32 ringVertexCount = sliceCount + 1;
 
-	// Compute vertices for each stack ring (do not count the poles as rings).
-	for(uint32 i = 1; i <= stackCount-1; ++i)
-	{
-		float phi = i*phiStep;
-
-		// Vertices of ring.
-        for(uint32 j = 0; j <= sliceCount; ++j)
-		{
-			float theta = j*thetaStep;
+	meshData.Vertices.resize(2 + (size_t)ringCount*ringVertexCount);
+	meshData.Vertices.front() = topVertex;
+	meshData.Vertices.back() = bottomVertex;
 
-			Vertex v;
+	SliceTable slices;
+	BuildSliceTable(sliceCount, slices);
 
-			// spherical to cartesian
-			v.Position.x = radius*sinf(phi)*cosf(theta);
-			v.Position.y = radius*cosf(phi);
-			v.Position.z = radius*sinf(phi)*sinf(theta);
+	// Compute vertices for each stack ring.  Rings are independent, so they are
+	// written in place and may be built by several threads.
+	Vertex* rings = &meshData.Vertices[1];
+	ForEachRow(ringCount, ringVertexCount, [&](size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; ++i)
+		{
+			float phi = (i+1)*phiStep;
+			BuildSphereRing(radius, phi, sliceCount, slices, rings + i*ringVertexCount);
+		}
+	});
 
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
+	// Every index is known to fit once the vertex count is, so pick the index width up front.
+	meshData.ResetIndices(meshData.Vertices.size());
 
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+	// South pole vertex was added last.
+	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
 
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+	size_t indexCount = 6*(size_t)sliceCount*(stackCount-1);
+	WriteIndices(meshData, indexCount, [&](auto* indices)
+	{
+		using Index = std::remove_pointer_t<decltype(indices)>;
 
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
+		//
+		// Compute indices for top stack.  The top stack was written first to the vertex buffer
+		// and connects the top pole to the first ring.
+		//
 
-			meshData.Vertices.push_back( v );
+		for(uint32 i = 1; i <= sliceCount; ++i)
+		{
+			Index* tri = indices + 3*(i-1);
+			tri[0] = 0;
+			tri[1] = (Index)(i+1);
+			tri[2] = (Index)i;
 		}
-	}
-
-	meshData.Vertices.push_back( bottomVertex );
-
-	//
-	// Compute indices for top stack.  The top stack was written first to the vertex buffer
-	// and connects the top pole to the first ring.
-	//
 
-    for(uint32 i = 1; i <= sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
-	}
-	
-	//
-	// Compute indices for inner stacks (not connected to poles).
-	//
+		//
+		// Compute indices for inner stacks (not connected to poles).
+		//
 
-	// Offset the indices to the index of the first vertex in the first ring.
-	// This is just skipping the top pole vertex.
-    uint32 baseIndex = 1;
-    uint32 ringVertexCount = sliceCount + 1;
-	for(uint32 i = 0; i < stackCount-2; ++i)
-	{
-		for(uint32 j = 0; j < sliceCount; ++j)
+		// Offset the indices to the index of the first vertex in the first ring.
+		// This is just skipping the top pole vertex.
+		uint32 baseIndex = 1;
+		Index* inner = indices + 3*sliceCount;
+		ForEachRow(stackCount-2, 6*sliceCount, [&](size_t begin, size_t end)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			for(uint32 i = (uint32)begin; i < (uint32)end; ++i)
+			{
+				Index* quad = inner + 6*(size_t)i*sliceCount;
+				for(uint32 j = 0; j < sliceCount; ++j, quad += 6)
+				{
+					quad[0] = (Index)(baseIndex + i*ringVertexCount + j);
+					quad[1] = (Index)(baseIndex + i*ringVertexCount + j+1);
+					quad[2] = (Index)(baseIndex + (i+1)*ringVertexCount + j);
+
+					quad[3] = (Index)(baseIndex + (i+1)*ringVertexCount + j);
+					quad[4] = (Index)(baseIndex + i*ringVertexCount + j+1);
+					quad[5] = (Index)(baseIndex + (i+1)*ringVertexCount + j+1);
+				}
+			}
+		});
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
-		}
-	}
+		//
+		// Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer
+		// and connects the bottom pole to the bottom ring.
+		//
 
-	//
-	// Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer
-	// and connects the bottom pole to the bottom ring.
-	//
+		// Offset the indices to the index of the first vertex in the last ring.
+		baseIndex = southPoleIndex - ringVertexCount;
 
-	// South pole vertex was added last.
-	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
+		Index* bottom = indices + indexCount - 3*sliceCount;
+		for(uint32 i = 0; i < sliceCount; ++i)
+		{
+			Index* tri = bottom + 3*i;
+			tri[0] = (Index)southPoleIndex;
+			tri[1] = (Index)(baseIndex+i);
+			tri[2] = (Index)(baseIndex+i+1);
+		}
+	});
 
-	// Offset the indices to the index of the first vertex in the last ring.
-	baseIndex = southPoleIndex - ringVertexCount;
-	
-	for(uint32 i = 0; i < sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
-	}
+	SetBounds(meshData, XMFLOAT3(radius, radius, radius), radius);
 
     return meshData;
 }
@@ -217,8 +272,10 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	MeshData inputCopy = meshData;
 
 
+	uint32 numTris = (uint32)inputCopy.IndexCount()/3;
+
 	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+	meshData.ResetIndices(numTris*6, numTris*12);
 
 	//       v1
 	//       *
@@ -230,12 +287,11 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
 	for(uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		Vertex v0 = inputCopy.Vertices[ inputCopy.GetIndex(i*3+0) ];
+		Vertex v1 = inputCopy.Vertices[ inputCopy.GetIndex(i*3+1) ];
+		Vertex v2 = inputCopy.Vertices[ inputCopy.GetIndex(i*3+2) ];
 
 		//
 		// Generate the midpoints.
@@ -256,21 +312,21 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 		meshData.Vertices.push_back(m1); // 4
 		meshData.Vertices.push_back(m2); // 5
  
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		meshData.AddIndex(i*6+0);
+		meshData.AddIndex(i*6+3);
+		meshData.AddIndex(i*6+5);
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+		meshData.AddIndex(i*6+3);
+		meshData.AddIndex(i*6+4);
+		meshData.AddIndex(i*6+5);
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+		meshData.AddIndex(i*6+5);
+		meshData.AddIndex(i*6+4);
+		meshData.AddIndex(i*6+2);
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+		meshData.AddIndex(i*6+3);
+		meshData.AddIndex(i*6+1);
+		meshData.AddIndex(i*6+4);
 	}
 }
 
@@ -308,8 +364,11 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 {
     MeshData meshData;
 
-	// Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+	// Each subdivision splits every triangle into four, so level n cuts the edges of
+	// the icosahedron into 2^n segments and has 10*4^n + 2 distinct vertices.  Level 14
+	// is the last whose vertices can all be addressed by 32-bit indices.
+	if(numSubdivisions > 14)
+		throw std::invalid_argument("GeometryGenerator::CreateGeosphere: numSubdivisions must be at most 14.");
 
 	// Approximate a sphere by tessellating an icosahedron.
 
@@ -334,51 +393,203 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
 	};
 
-    meshData.Vertices.resize(12);
-    meshData.Indices32.assign(&k[0], &k[60]);
+	//
+	// Rather than subdividing n times, fill every face with its level n lattice in
+	// one pass.  Lattice point (a, b) of face (c0, c1, c2) lies at
+	// c0 + (a/s)(c1 - c0) + (b/s)(c2 - c0), where s is the number of segments per
+	// edge.  The 12 corners come first in the vertex buffer, then the interior
+	// vertices of the 30 edges, then those of the 20 faces, so a vertex shared by
+	// several faces is stored once.
+	//
 
-	for(uint32 i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
+	const uint32 s = 1u << numSubdivisions;
+	const uint32 edgeVertexCount = s - 1;           // Inside each edge.
+	const uint32 faceVertexCount = (s - 1)*(s - 2)/2; // Inside each face.
+	const uint32 edgeBase = 12;
+	const uint32 faceBase = edgeBase + 30*edgeVertexCount;
+	const uint32 vertexCount = faceBase + 20*faceVertexCount;
+
+	// Number the edges, each stored from its lower to its higher corner, and record
+	// the edges c0c1, c0c2 and c1c2 of every face.
+	uint32 edges[30][2];
+	uint32 faceEdges[20][3];
+	uint32 edgeCount = 0;
+	auto findEdge = [&](uint32 v0, uint32 v1) -> uint32
+	{
+		uint32 lo = std::min<uint32>(v0, v1);
+		uint32 hi = std::max<uint32>(v0, v1);
+		for(uint32 e = 0; e < edgeCount; ++e)
+		{
+			if(edges[e][0] == lo && edges[e][1] == hi)
+				return e;
+		}
+		edges[edgeCount][0] = lo;
+		edges[edgeCount][1] = hi;
+		return edgeCount++;
+	};
+	for(uint32 face = 0; face < 20; ++face)
+	{
+		faceEdges[face][0] = findEdge(k[3*face], k[3*face+1]);
+		faceEdges[face][1] = findEdge(k[3*face], k[3*face+2]);
+		faceEdges[face][2] = findEdge(k[3*face+1], k[3*face+2]);
+	}
 
-	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	// Vertex t segments away from corner 'from' along an edge.
+	auto edgeVertex = [&](uint32 edge, uint32 from, uint32 t) -> uint32
+	{
+		uint32 step = edges[edge][0] == from ? t : s - t;
+		return edgeBase + edge*edgeVertexCount + step - 1;
+	};
 
-	// Project vertices onto sphere and scale.
-	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
+	auto latticeVertex = [&](uint32 face, uint32 a, uint32 b) -> uint32
 	{
-		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
+		const uint32* c = &k[3*face];
+		if(b == 0)
+		{
+			if(a == 0) return c[0];
+			if(a == s) return c[1];
+			return edgeVertex(faceEdges[face][0], c[0], a);
+		}
+		if(a == 0)
+		{
+			if(b == s) return c[2];
+			return edgeVertex(faceEdges[face][1], c[0], b);
+		}
+		if(a + b == s)
+			return edgeVertex(faceEdges[face][2], c[1], b);
 
-		// Project onto sphere.
-		XMVECTOR p = radius*n;
+		// Interior rows b = 1..s-2 hold a = 1..s-1-b.
+		return faceBase + face*faceVertexCount + (b-1)*(s-1) - (b-1)*b/2 + (a-1);
+	};
 
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
+	//
+	// Create the vertices: the corners, then the edges and the face interiors a row
+	// at a time.
+	//
 
-		// Derive texture coordinates from spherical coordinates.
-        float theta = atan2f(meshData.Vertices[i].Position.z, meshData.Vertices[i].Position.x);
+	meshData.Vertices.resize(vertexCount);
 
-        // Put in [0, 2pi].
-        if(theta < 0.0f)
-            theta += XM_2PI;
+	for(uint32 i = 0; i < 12; ++i)
+		meshData.Vertices[i] = GeosphereVertex(radius, XMLoadFloat3(&pos[i]));
 
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
+	const float invS = 1.0f / s;
 
-		meshData.Vertices[i].TexC.x = theta/XM_2PI;
-		meshData.Vertices[i].TexC.y = phi/XM_PI;
+	ForEachRow(30, edgeVertexCount, [&](size_t begin, size_t end)
+	{
+		for(uint32 e = (uint32)begin; e < (uint32)end; ++e)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&pos[edges[e][0]]);
+			XMVECTOR p1 = XMLoadFloat3(&pos[edges[e][1]]);
+			for(uint32 t = 1; t < s; ++t)
+			{
+				meshData.Vertices[edgeVertex(e, edges[e][0], t)] =
+					GeosphereVertex(radius, XMVectorLerp(p0, p1, t*invS));
+			}
+		}
+	});
 
-		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
+	const uint32 interiorRowCount = s > 2 ? s - 2 : 0;
+	ForEachRow(20*(size_t)interiorRowCount, s, [&](size_t begin, size_t end)
+	{
+		for(size_t row = begin; row < end; ++row)
+		{
+			uint32 face = (uint32)(row / interiorRowCount);
+			uint32 b = (uint32)(row % interiorRowCount) + 1;
+
+			XMVECTOR c0 = XMLoadFloat3(&pos[k[3*face]]);
+			XMVECTOR c1 = XMLoadFloat3(&pos[k[3*face+1]]);
+			XMVECTOR c2 = XMLoadFloat3(&pos[k[3*face+2]]);
+			XMVECTOR rowStart = XMVectorLerp(c0, c2, b*invS);
+			XMVECTOR step = XMVectorScale(XMVectorSubtract(c1, c0), invS);
+
+			for(uint32 a = 1; a + b < s; ++a)
+			{
+				meshData.Vertices[latticeVertex(face, a, b)] =
+					GeosphereVertex(radius, XMVectorMultiplyAdd(XMVectorReplicate((float)a), step, rowStart));
+			}
+		}
+	});
 
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
-	}
+	//
+	// Create the indices.  Row b of a face is a band of 2(s-b)-1 triangles, pointing
+	// alternately up (toward c2) and down, wound like the face itself.
+	//
+
+	meshData.ResetIndices(vertexCount);
+
+	WriteIndices(meshData, 60*(size_t)s*s, [&](auto* indices)
+	{
+		using Index = std::remove_pointer_t<decltype(indices)>;
+
+		ForEachRow(20*(size_t)s, s, [&](size_t begin, size_t end)
+		{
+			for(size_t row = begin; row < end; ++row)
+			{
+				uint32 face = (uint32)(row / s);
+				uint32 b = (uint32)(row % s);
+
+				// Rows before b hold 2bs - b^2 triangles.
+				Index* tri = indices + 3*((size_t)face*s*s + 2*(size_t)b*s - (size_t)b*b);
+				for(uint32 a = 0; a + b < s; ++a)
+				{
+					tri[0] = (Index)latticeVertex(face, a, b);
+					tri[1] = (Index)latticeVertex(face, a+1, b);
+					tri[2] = (Index)latticeVertex(face, a, b+1);
+					tri += 3;
+
+					if(a + b + 1 < s)
+					{
+						tri[0] = (Index)latticeVertex(face, a+1, b);
+						tri[1] = (Index)latticeVertex(face, a+1, b+1);
+						tri[2] = (Index)latticeVertex(face, a, b+1);
+						tri += 3;
+					}
+				}
+			}
+		});
+	});
+
+	SetBounds(meshData, XMFLOAT3(radius, radius, radius), radius);
 
     return meshData;
 }
 
+GeometryGenerator::Vertex GeometryGenerator::GeosphereVertex(float radius, FXMVECTOR direction)
+{
+	Vertex v;
+
+	// Project onto unit sphere.
+	XMVECTOR n = XMVector3Normalize(direction);
+
+	// Project onto sphere.
+	XMVECTOR p = radius*n;
+
+	XMStoreFloat3(&v.Position, p);
+	XMStoreFloat3(&v.Normal, n);
+
+	// Derive texture coordinates from spherical coordinates.
+	float theta = atan2f(v.Position.z, v.Position.x);
+
+	// Put in [0, 2pi].
+	if(theta < 0.0f)
+		theta += XM_2PI;
+
+	float phi = acosf(v.Position.y / radius);
+
+	v.TexC.x = theta/XM_2PI;
+	v.TexC.y = phi/XM_PI;
+
+	// Partial derivative of P with respect to theta
+	v.TangentU.x = -radius*sinf(phi)*sinf(theta);
+	v.TangentU.y = 0.0f;
+	v.TangentU.z = +radius*sinf(phi)*cosf(theta);
+
+	XMVECTOR T = XMLoadFloat3(&v.TangentU);
+	XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+
+	return v;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
@@ -394,111 +605,112 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 
 	uint32 ringCount = stackCount+1;
 
-	// ϴ  ֻ  ö󰡸鼭
-	//    Ѵ.
-	for(uint32 i = 0; i < ringCount; ++i)
-	{
-		float y = -0.5f*height + i*stackHeight;
-		float r = bottomRadius + i*radiusStep;
-
-		//  .
-		float dTheta = 2.0f*XM_PI/sliceCount;
-		for(uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j*dTheta);
-			float s = sinf(j*dTheta);
-
-			vertex.Position = XMFLOAT3(r*c, y, r*s);
-
-			vertex.TexC.x = (float)j/sliceCount;
-			vertex.TexC.y = 1.0f - (float)i/stackCount;
-
-			//     Űȭ  ִ. ̸ 
-			// ؽó ǥ v а   ư Ű v ߴ.
-			// ̷ ϸ (bitangent) ؽó ǥ v
-			// а   ȴ.
-			// ظ  r0,   r1̶  ,
-			// [0,1]  v :
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// TangentU   ̴.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius-topRadius;
-			XMFLOAT3 bitangent(dr*c, -height, dr*s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
-	}
-
 	//   ù    ġ  ؽó ǥ
 	// ٸǷ  ٸ  ؾ Ѵ. ̸   
 	//  1 Ѵ.
 	uint32 ringVertexCount = sliceCount+1;
 
-	//   ε Ѵ.
-	for(uint32 i = 0; i < stackCount; ++i)
+	//     Űȭ  ִ. ̸ 
+	// ؽó ǥ v а   ư Ű v ߴ.
+	// ̷ ϸ (bitangent) ؽó ǥ v
+	// а   ȴ.
+	// ظ  r0,   r1̶  ,
+	// [0,1]  v :
+	//   y(v) = h - hv for v in [0,1].
+	//   r(v) = r1 + (r0-r1)v
+	//
+	//   x(t, v) = r(v)*cos(t)
+	//   y(t, v) = h - hv
+	//   z(t, v) = r(v)*sin(t)
+	// 
+	//  dx/dt = -r(v)*sin(t)
+	//  dy/dt = 0
+	//  dz/dt = +r(v)*cos(t)
+	//
+	//  dx/dv = (r0-r1)*cos(t)
+	//  dy/dv = -h
+	//  dz/dv = (r0-r1)*sin(t)
+	//
+	// The tangent T = (-sin(t), 0, cos(t)) is unit length, and with B = dP/dv
+	// the normal is cross(T, B) = (h*cos(t), r0-r1, h*sin(t)).  Its length does
+	// not depend on t, so the normalized normal is the same on every ring.
+	float dr = bottomRadius-topRadius;
+	float invLength = 1.0f / sqrtf(height*height + dr*dr);
+	float normalXZ = height*invLength;
+	float normalY = dr*invLength;
+
+	// The caps add two rings plus a center vertex each.
+	size_t sideVertexCount = (size_t)ringCount*ringVertexCount;
+	size_t vertexCount = sideVertexCount + 2*(ringVertexCount+1);
+	meshData.Vertices.reserve(vertexCount);
+	meshData.Vertices.resize(sideVertexCount);
+
+	SliceTable slices;
+	BuildSliceTable(sliceCount, slices);
+
+	// ϴ  ֻ  ö󰡸鼭
+	//    Ѵ.
+	Vertex* rings = meshData.Vertices.data();
+	ForEachRow(ringCount, ringVertexCount, [&](size_t begin, size_t end)
 	{
-		for(uint32 j = 0; j < sliceCount; ++j)
+		for(uint32 i = (uint32)begin; i < (uint32)end; ++i)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
+			float y = -0.5f*height + i*stackHeight;
+			float r = bottomRadius + i*radiusStep;
+			float v = 1.0f - (float)i/stackCount;
 
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			BuildCylinderRing(r, y, v, normalXZ, normalY, sliceCount, slices, rings + (size_t)i*ringVertexCount);
 		}
-	}
+	});
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+	size_t sideIndexCount = 6*(size_t)sliceCount*stackCount;
+	meshData.ResetIndices(vertexCount, sideIndexCount + 6*sliceCount);
+
+	//   ε Ѵ.
+	WriteIndices(meshData, sideIndexCount, [&](auto* indices)
+	{
+		using Index = std::remove_pointer_t<decltype(indices)>;
+
+		ForEachRow(stackCount, 6*sliceCount, [&](size_t begin, size_t end)
+		{
+			for(uint32 i = (uint32)begin; i < (uint32)end; ++i)
+			{
+				Index* quad = indices + 6*(size_t)i*sliceCount;
+				for(uint32 j = 0; j < sliceCount; ++j, quad += 6)
+				{
+					quad[0] = (Index)(i*ringVertexCount + j);
+					quad[1] = (Index)((i+1)*ringVertexCount + j);
+					quad[2] = (Index)((i+1)*ringVertexCount + j+1);
+
+					quad[3] = (Index)(i*ringVertexCount + j);
+					quad[4] = (Index)((i+1)*ringVertexCount + j+1);
+					quad[5] = (Index)(i*ringVertexCount + j+1);
+				}
+			}
+		});
+	});
+
+	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, slices, meshData);
+	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, slices, meshData);
+
+	float maxRadius = std::max(bottomRadius, topRadius);
+	float h2 = 0.5f*height;
+	SetBounds(meshData, XMFLOAT3(maxRadius, h2, maxRadius), sqrtf(maxRadius*maxRadius + h2*h2));
 
     return meshData;
 }
 
 void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											uint32 sliceCount, uint32 stackCount, const SliceTable& slices, MeshData& meshData)
 {
 	uint32 baseIndex = (uint32)meshData.Vertices.size();
 
 	float y = 0.5f*height;
-	float dTheta = 2.0f*XM_PI/sliceCount;
 
 	//    ֻ   ġ 
 	// ؽó ǥ  ٸǷ ó  ߰ؾ Ѵ.
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = topRadius*cosf(i*dTheta);
-		float z = topRadius*sinf(i*dTheta);
-
-		//   ؽó ǥ  ظ鿡 ϵ,
-		// ̿   ؽó ǥе Ѵ.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
-
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
-	}
+	meshData.Vertices.resize(baseIndex + sliceCount+1);
+	BuildCapRing(topRadius, y, 1.0f, height, sliceCount, slices, &meshData.Vertices[baseIndex]);
 
 	// Ű ߽ .
 	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
@@ -508,14 +720,14 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
+		meshData.AddIndex(centerIndex);
+		meshData.AddIndex(baseIndex + i+1);
+		meshData.AddIndex(baseIndex + i);
 	}
 }
 
 void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											   uint32 sliceCount, uint32 stackCount, const SliceTable& slices, MeshData& meshData)
 {
 	// 
 	// Build bottom cap.
@@ -525,19 +737,8 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 	float y = -0.5f*height;
 
 	// vertices of ring
-	float dTheta = 2.0f*XM_PI/sliceCount;
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = bottomRadius*cosf(i*dTheta);
-		float z = bottomRadius*sinf(i*dTheta);
-
-		// Scale down by the height to try and make top cap texture coord area
-		// proportional to base.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
-
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
-	}
+	meshData.Vertices.resize(baseIndex + sliceCount+1);
+	BuildCapRing(bottomRadius, y, -1.0f, height, sliceCount, slices, &meshData.Vertices[baseIndex]);
 
 	// Cap center vertex.
 	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
@@ -547,9 +748,9 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
+		meshData.AddIndex(centerIndex);
+		meshData.AddIndex(baseIndex + i);
+		meshData.AddIndex(baseIndex + i+1);
 	}
 }
 
@@ -595,25 +796,17 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	// Create the indices.
 	//
 
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
+	meshData.ResetIndices(vertexCount);
 
-	// Iterate over each quad and compute indices.
-	uint32 k = 0;
-	for(uint32 i = 0; i < m-1; ++i)
+	WriteIndices(meshData, faceCount*3, [&](auto* indices) // 3 indices per face
 	{
-		for(uint32 j = 0; j < n-1; ++j)
-		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
-
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+		using Index = std::remove_pointer_t<decltype(indices)>;
+		GridIndexGenerator<Index> generator(m, n);
+		generator.SetParallelThreshold(vertexCount < mParallelVertexThreshold ? SIZE_MAX : 0);
+		generator.Generate(indices);
+	});
 
-			k += 6; // next quad
-		}
-	}
+	SetBounds(meshData, XMFLOAT3(halfWidth, 0.0f, halfDepth), sqrtf(halfWidth*halfWidth + halfDepth*halfDepth));
 
     return meshData;
 }
@@ -623,7 +816,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
     MeshData meshData;
 
 	meshData.Vertices.resize(4);
-	meshData.Indices32.resize(6);
 
 	// Position coordinates specified in NDC space.
 	meshData.Vertices[0] = Vertex(
@@ -650,13 +842,292 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
 		1.0f, 0.0f, 0.0f,
 		1.0f, 1.0f);
 
-	meshData.Indices32[0] = 0;
-	meshData.Indices32[1] = 1;
-	meshData.Indices32[2] = 2;
+	meshData.ResetIndices(4, 6);
 
-	meshData.Indices32[3] = 0;
-	meshData.Indices32[4] = 2;
-	meshData.Indices32[5] = 3;
+	meshData.AddIndex(0);
+	meshData.AddIndex(1);
+	meshData.AddIndex(2);
+
+	meshData.AddIndex(0);
+	meshData.AddIndex(2);
+	meshData.AddIndex(3);
+
+	ComputeBounds(meshData);
 
     return meshData;
 }
+
+GeometryGenerator::PackedMeshData GeometryGenerator::PackMesh(const MeshData& meshData)
+{
+    PackedMeshData packed;
+
+	packed.Vertices.resize(meshData.Vertices.size());
+	if(meshData.Vertices.empty())
+		return packed;
+
+	//
+	// Find the box the positions are quantized against.
+	//
+
+	XMVECTOR vMin = XMLoadFloat3(&meshData.Vertices[0].Position);
+	XMVECTOR vMax = vMin;
+	for(size_t i = 1; i < meshData.Vertices.size(); ++i)
+	{
+		XMVECTOR p = XMLoadFloat3(&meshData.Vertices[i].Position);
+		vMin = XMVectorMin(vMin, p);
+		vMax = XMVectorMax(vMax, p);
+	}
+
+	// Flat axes (e.g., y for a grid) get a zero scale so they decode to the bias.
+	XMVECTOR scale = XMVectorSubtract(vMax, vMin);
+	XMVECTOR invScale = XMVectorSelect(XMVectorReciprocal(scale), XMVectorZero(), XMVectorEqual(scale, XMVectorZero()));
+
+	XMStoreFloat3(&packed.PositionScale, scale);
+	XMStoreFloat3(&packed.PositionBias, vMin);
+
+	//
+	// Quantize each attribute.
+	//
+
+	for(size_t i = 0; i < meshData.Vertices.size(); ++i)
+	{
+		const Vertex& v = meshData.Vertices[i];
+		PackedVertex& pv = packed.Vertices[i];
+
+		XMVECTOR p = XMLoadFloat3(&v.Position);
+		XMStoreUShortN4(&pv.Position, XMVectorMultiply(XMVectorSubtract(p, vMin), invScale));
+
+		XMStoreShortN2(&pv.Normal, OctahedralEncode(XMLoadFloat3(&v.Normal)));
+		XMStoreShortN2(&pv.TangentU, OctahedralEncode(XMLoadFloat3(&v.TangentU)));
+
+		XMStoreHalf2(&pv.TexC, XMLoadFloat2(&v.TexC));
+	}
+
+    return packed;
+}
+
+XMVECTOR GeometryGenerator::OctahedralEncode(FXMVECTOR n)
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1.
+	XMVECTOR l1 = XMVector3Dot(XMVectorAbs(n), XMVectorSplatOne());
+	XMVECTOR p = XMVectorDivide(n, l1);
+
+	// Fold the lower hemisphere over the diagonals so the whole sphere maps onto [-1,1]^2.
+	XMVECTOR signNotZero = XMVectorSelect(XMVectorReplicate(-1.0f), XMVectorSplatOne(), XMVectorGreaterOrEqual(p, XMVectorZero()));
+	XMVECTOR folded = XMVectorMultiply(XMVectorSubtract(XMVectorSplatOne(), XMVectorAbs(XMVectorSwizzle<1, 0, 2, 3>(p))), signNotZero);
+
+	p = XMVectorSelect(p, folded, XMVectorLess(XMVectorSplatZ(p), XMVectorZero()));
+
+	// Degenerate (zero length) vectors encode to the origin.
+	return XMVectorSelect(p, XMVectorZero(), XMVectorEqual(l1, XMVectorZero()));
+}
+
+void GeometryGenerator::ComputeBounds(MeshData& meshData)
+{
+	ComputeBounds(meshData.Vertices.data(), meshData.Vertices.size(), sizeof(Vertex),
+		meshData.Bounds, meshData.SphereBounds);
+}
+
+void GeometryGenerator::ComputeBounds(const void* positions, size_t count, size_t stride,
+	BoundingBox& box, BoundingSphere& sphere)
+{
+	if(count == 0)
+	{
+		box = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+		sphere = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f);
+		return;
+	}
+
+	const char* base = static_cast<const char*>(positions);
+	auto position = [base, stride](size_t i)
+	{
+		return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(base + i*stride));
+	};
+
+	//
+	// Min/max reduction.  Four independent accumulators keep the
+	// min/max dependency chains from serializing the loop.
+	//
+
+	XMVECTOR vMin[4], vMax[4];
+	for(int k = 0; k < 4; ++k)
+		vMin[k] = vMax[k] = position(0);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		for(int k = 0; k < 4; ++k)
+		{
+			XMVECTOR p = position(i + k);
+			vMin[k] = XMVectorMin(vMin[k], p);
+			vMax[k] = XMVectorMax(vMax[k], p);
+		}
+	}
+	for(; i < count; ++i)
+	{
+		XMVECTOR p = position(i);
+		vMin[0] = XMVectorMin(vMin[0], p);
+		vMax[0] = XMVectorMax(vMax[0], p);
+	}
+
+	XMVECTOR boxMin = XMVectorMin(XMVectorMin(vMin[0], vMin[1]), XMVectorMin(vMin[2], vMin[3]));
+	XMVECTOR boxMax = XMVectorMax(XMVectorMax(vMax[0], vMax[1]), XMVectorMax(vMax[2], vMax[3]));
+
+	BoundingBox::CreateFromPoints(box, boxMin, boxMax);
+
+	//
+	// Sphere around the box center enclosing every point.
+	//
+
+	XMVECTOR center = XMLoadFloat3(&box.Center);
+	XMVECTOR maxDistSq[4] = { XMVectorZero(), XMVectorZero(), XMVectorZero(), XMVectorZero() };
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		for(int k = 0; k < 4; ++k)
+			maxDistSq[k] = XMVectorMax(maxDistSq[k], XMVector3LengthSq(XMVectorSubtract(position(i + k), center)));
+	}
+	for(; i < count; ++i)
+		maxDistSq[0] = XMVectorMax(maxDistSq[0], XMVector3LengthSq(XMVectorSubtract(position(i), center)));
+
+	XMVECTOR radiusSq = XMVectorMax(XMVectorMax(maxDistSq[0], maxDistSq[1]), XMVectorMax(maxDistSq[2], maxDistSq[3]));
+
+	sphere.Center = box.Center;
+	sphere.Radius = XMVectorGetX(XMVectorSqrt(radiusSq));
+}
+
+void GeometryGenerator::SetBounds(MeshData& meshData, const XMFLOAT3& extents, float radius)
+{
+	// Closed form bounds of the analytic shape centered at the origin.
+	meshData.Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), extents);
+	meshData.SphereBounds = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), radius);
+}
+
+void GeometryGenerator::BuildSliceTable(uint32 sliceCount, SliceTable& slices)
+{
+	// Pad to a whole number of 4-wide blocks; the padding lanes are never written out.
+	size_t size = (sliceCount + 1 + 3) & ~size_t(3);
+	slices.Cos.assign(size, 0.0f);
+	slices.Sin.assign(size, 0.0f);
+	slices.U.assign(size, 0.0f);
+
+	float dTheta = 2.0f*XM_PI/sliceCount;
+	for(uint32 j = 0; j <= sliceCount; ++j)
+	{
+		slices.Cos[j] = cosf(j*dTheta);
+		slices.Sin[j] = sinf(j*dTheta);
+		slices.U[j] = (float)j/sliceCount;
+	}
+}
+
+//
+// The ring builders evaluate four slices per iteration in structure of arrays
+// form and then scatter the lanes into the interleaved Vertex layout.
+//
+
+void GeometryGenerator::BuildSphereRing(float radius, float phi, uint32 sliceCount, const SliceTable& slices, Vertex* ring)
+{
+	float sinPhi = sinf(phi);
+	float cosPhi = cosf(phi);
+
+	XMVECTOR vSinPhi = XMVectorReplicate(sinPhi);
+	XMVECTOR vRadius = XMVectorReplicate(radius);
+
+	float y = radius*cosPhi;
+	float v = phi / XM_PI;
+
+	alignas(16) float px[4], pz[4], nx[4], nz[4], c[4], s[4], u[4];
+	for(uint32 j = 0; j <= sliceCount; j += 4)
+	{
+		XMVECTOR cosTheta = XMLoadFloat4((const XMFLOAT4*)&slices.Cos[j]);
+		XMVECTOR sinTheta = XMLoadFloat4((const XMFLOAT4*)&slices.Sin[j]);
+
+		// The normal is the unit sphere point, and the position is the normal scaled by the radius.
+		XMVECTOR normalX = XMVectorMultiply(vSinPhi, cosTheta);
+		XMVECTOR normalZ = XMVectorMultiply(vSinPhi, sinTheta);
+
+		XMStoreFloat4A((XMFLOAT4A*)nx, normalX);
+		XMStoreFloat4A((XMFLOAT4A*)nz, normalZ);
+		XMStoreFloat4A((XMFLOAT4A*)px, XMVectorMultiply(vRadius, normalX));
+		XMStoreFloat4A((XMFLOAT4A*)pz, XMVectorMultiply(vRadius, normalZ));
+		XMStoreFloat4A((XMFLOAT4A*)c, cosTheta);
+		XMStoreFloat4A((XMFLOAT4A*)s, sinTheta);
+		XMStoreFloat4A((XMFLOAT4A*)u, XMLoadFloat4((const XMFLOAT4*)&slices.U[j]));
+
+		// The tangent is dP/dtheta divided by its length radius*sin(phi).
+		uint32 laneCount = std::min<uint32>(4, sliceCount+1 - j);
+		for(uint32 k = 0; k < laneCount; ++k)
+		{
+			ring[j+k] = Vertex(
+				px[k], y, pz[k],
+				nx[k], cosPhi, nz[k],
+				-s[k], 0.0f, c[k],
+				u[k], v);
+		}
+	}
+}
+
+void GeometryGenerator::BuildCylinderRing(float radius, float y, float v, float normalXZ, float normalY,
+										  uint32 sliceCount, const SliceTable& slices, Vertex* ring)
+{
+	XMVECTOR vRadius = XMVectorReplicate(radius);
+	XMVECTOR vNormalXZ = XMVectorReplicate(normalXZ);
+
+	alignas(16) float px[4], pz[4], nx[4], nz[4], c[4], s[4], u[4];
+	for(uint32 j = 0; j <= sliceCount; j += 4)
+	{
+		XMVECTOR cosTheta = XMLoadFloat4((const XMFLOAT4*)&slices.Cos[j]);
+		XMVECTOR sinTheta = XMLoadFloat4((const XMFLOAT4*)&slices.Sin[j]);
+
+		XMStoreFloat4A((XMFLOAT4A*)px, XMVectorMultiply(vRadius, cosTheta));
+		XMStoreFloat4A((XMFLOAT4A*)pz, XMVectorMultiply(vRadius, sinTheta));
+		XMStoreFloat4A((XMFLOAT4A*)nx, XMVectorMultiply(vNormalXZ, cosTheta));
+		XMStoreFloat4A((XMFLOAT4A*)nz, XMVectorMultiply(vNormalXZ, sinTheta));
+		XMStoreFloat4A((XMFLOAT4A*)c, cosTheta);
+		XMStoreFloat4A((XMFLOAT4A*)s, sinTheta);
+		XMStoreFloat4A((XMFLOAT4A*)u, XMLoadFloat4((const XMFLOAT4*)&slices.U[j]));
+
+		uint32 laneCount = std::min<uint32>(4, sliceCount+1 - j);
+		for(uint32 k = 0; k < laneCount; ++k)
+		{
+			ring[j+k] = Vertex(
+				px[k], y, pz[k],
+				nx[k], normalY, nz[k],
+				-s[k], 0.0f, c[k],
+				u[k], v);
+		}
+	}
+}
+
+void GeometryGenerator::BuildCapRing(float radius, float y, float normalY, float height,
+									 uint32 sliceCount, const SliceTable& slices, Vertex* ring)
+{
+	XMVECTOR vRadius = XMVectorReplicate(radius);
+
+	// Scale down by the height to try and make top cap texture coord area
+	// proportional to base.
+	XMVECTOR vInvHeight = XMVectorReplicate(1.0f / height);
+	XMVECTOR vHalf = XMVectorReplicate(0.5f);
+
+	alignas(16) float px[4], pz[4], tu[4], tv[4];
+	for(uint32 j = 0; j <= sliceCount; j += 4)
+	{
+		XMVECTOR x = XMVectorMultiply(vRadius, XMLoadFloat4((const XMFLOAT4*)&slices.Cos[j]));
+		XMVECTOR z = XMVectorMultiply(vRadius, XMLoadFloat4((const XMFLOAT4*)&slices.Sin[j]));
+
+		XMStoreFloat4A((XMFLOAT4A*)px, x);
+		XMStoreFloat4A((XMFLOAT4A*)pz, z);
+		XMStoreFloat4A((XMFLOAT4A*)tu, XMVectorMultiplyAdd(x, vInvHeight, vHalf));
+		XMStoreFloat4A((XMFLOAT4A*)tv, XMVectorMultiplyAdd(z, vInvHeight, vHalf));
+
+		uint32 laneCount = std::min<uint32>(4, sliceCount+1 - j);
+		for(uint32 k = 0; k < laneCount; ++k)
+		{
+			ring[j+k] = Vertex(
+				px[k], y, pz[k],
+				0.0f, normalY, 0.0f,
+				1.0f, 0.0f, 0.0f,
+				tu[k], tv[k]);
+		}
+	}
+}
@@ -0,0 +1,230 @@
+//***************************************************************************************
+// GridIndexGenerator.h
+//
+// Index buffers for an mxn grid of vertices stored row by row, the layout used by
+// GeometryGenerator::CreateGrid, TerrainBuilder and Waves.  The index type, winding
+// and topology are template parameters:
+//
+//   TriangleList   Two triangles per quad.  Quads are visited row by row, or in
+//                  Morton (Z) order inside square tiles, which revisits vertices
+//                  while they are still in the post-transform cache.
+//   TriangleStrip  One strip per row of quads, with a strip cut value between rows;
+//                  about a third of the indices of a list.  The PSO must set
+//                  IBStripCutValue for the index width.
+//
+// Clockwise is the CreateGrid winding: front facing when seen from +y.  Large grids
+// are generated on ThreadPool::Default(), by blocks of rows or of tile rows, unless
+// SetParallelThreshold keeps them on the calling thread.
+//***************************************************************************************
+
+#pragma once
+
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+enum class GridTopology
+{
+	TriangleList,
+	TriangleStrip
+};
+
+enum class GridWinding
+{
+	Clockwise,
+	CounterClockwise
+};
+
+// Order in which a triangle list visits the quads.
+enum class GridTraversal
+{
+	RowMajor,
+	MortonTiles
+};
+
+// Quads per tile edge for GridTraversal::MortonTiles; an 8x8 tile touches 81 vertices.
+const std::uint32_t GridTileSize = 8;
+static_assert(GridTileSize == 8, "ForEachGridQuad decodes 3-bit Morton coordinates");
+
+// Calls visit(i, j) once per quad of an mxn vertex grid, where (i, j) is the row and
+// column of the quad's first vertex, in the order the traversal lists them.  Only
+// visits the quads of rows [beginRow, endRow), which for MortonTiles must be a whole
+// number of tile rows (the last one may be partial).
+template<typename Visit>
+void ForEachGridQuad(std::uint32_t m, std::uint32_t n, GridTraversal traversal,
+	std::uint32_t beginRow, std::uint32_t endRow, Visit&& visit)
+{
+	std::uint32_t columnCount = n - 1;
+
+	if(traversal == GridTraversal::RowMajor)
+	{
+		for(std::uint32_t i = beginRow; i < endRow; ++i)
+		{
+			for(std::uint32_t j = 0; j < columnCount; ++j)
+				visit(i, j);
+		}
+		return;
+	}
+
+	// Tiles go left to right; inside a tile the quads follow the Z curve, with the
+	// even bits of the curve index giving the column and the odd bits the row.
+	for(std::uint32_t tileRow = beginRow; tileRow < endRow; tileRow += GridTileSize)
+	{
+		std::uint32_t tileHeight = std::min<std::uint32_t>(GridTileSize, endRow - tileRow);
+
+		for(std::uint32_t tileColumn = 0; tileColumn < columnCount; tileColumn += GridTileSize)
+		{
+			std::uint32_t tileWidth = std::min<std::uint32_t>(GridTileSize, columnCount - tileColumn);
+
+			for(std::uint32_t k = 0; k < GridTileSize*GridTileSize; ++k)
+			{
+				std::uint32_t x = (k & 1) | ((k >> 1) & 2) | ((k >> 2) & 4);
+				std::uint32_t y = ((k >> 1) & 1) | ((k >> 2) & 2) | ((k >> 3) & 4);
+				if(x < tileWidth && y < tileHeight)
+					visit(tileRow + y, tileColumn + x);
+			}
+		}
+	}
+}
+
+template<typename Index,
+	GridTopology Topology = GridTopology::TriangleList,
+	GridWinding Winding = GridWinding::Clockwise>
+class GridIndexGenerator
+{
+	static_assert(std::is_same<Index, std::uint16_t>::value || std::is_same<Index, std::uint32_t>::value,
+		"GridIndexGenerator: Index must be std::uint16_t or std::uint32_t");
+
+public:
+	// Ends a strip when primitive restart is enabled, so no vertex may use it.
+	static const Index StripCutValue = (Index)~Index(0);
+
+	// traversal only affects triangle lists; strips always run row by row.
+	GridIndexGenerator(std::uint32_t m, std::uint32_t n, GridTraversal traversal = GridTraversal::RowMajor)
+		: mM(m), mN(n), mTraversal(traversal)
+	{
+		std::uint64_t maxVertexCount = (std::uint64_t)std::numeric_limits<Index>::max() +
+			(Topology == GridTopology::TriangleStrip ? 0 : 1);
+
+		if(m < 2 || n < 2 || (std::uint64_t)m*n > maxVertexCount)
+			throw std::invalid_argument("GridIndexGenerator: grid is empty or too large for the index type");
+	}
+
+	size_t IndexCount()const
+	{
+		size_t rowCount = mM - 1;
+		if(Topology == GridTopology::TriangleStrip)
+			return rowCount*2*mN + (rowCount - 1);
+
+		return rowCount*(mN - 1)*6;
+	}
+
+	// Grids with fewer quads than this are generated on the calling thread; pass
+	// SIZE_MAX to never use the thread pool.  By default any grid may be split.
+	void SetParallelThreshold(size_t minQuadCount)
+	{
+		mParallelQuadThreshold = minQuadCount;
+	}
+
+	// Writes IndexCount() indices.
+	void Generate(Index* indices)const
+	{
+		if(Topology == GridTopology::TriangleStrip)
+			GenerateStrips(indices);
+		else
+			GenerateList(indices);
+	}
+
+private:
+	// Smallest amount of work, in quads, worth handing to another thread.
+	static const size_t MinQuadsPerTask = 4096;
+
+	template<typename Body>
+	void ForEachBlock(size_t blockCount, size_t grainSize, Body&& body)const
+	{
+		if((size_t)(mM - 1)*(mN - 1) < mParallelQuadThreshold)
+		{
+			body(size_t(0), blockCount);
+			return;
+		}
+
+		ThreadPool::Default().ParallelFor(blockCount, grainSize, body);
+	}
+
+	void GenerateList(Index* indices)const
+	{
+		std::uint32_t rowCount = mM - 1;
+		std::uint32_t columnCount = mN - 1;
+
+		// Both traversals finish a block of rows before starting the next, so each
+		// block knows where its indices start.  Morton blocks are whole tile rows.
+		std::uint32_t rowsPerBlock = mTraversal == GridTraversal::MortonTiles ? GridTileSize : 1;
+		size_t blockCount = (rowCount + rowsPerBlock - 1) / rowsPerBlock;
+		size_t grainSize = std::max<size_t>(1, MinQuadsPerTask / ((size_t)rowsPerBlock*columnCount));
+
+		ForEachBlock(blockCount, grainSize, [&](size_t begin, size_t end)
+		{
+			std::uint32_t beginRow = (std::uint32_t)begin*rowsPerBlock;
+			std::uint32_t endRow = std::min<std::uint32_t>((std::uint32_t)end*rowsPerBlock, rowCount);
+
+			Index* quad = indices + (size_t)beginRow*columnCount*6;
+			ForEachGridQuad(mM, mN, mTraversal, beginRow, endRow, [&](std::uint32_t i, std::uint32_t j)
+			{
+				Index a = (Index)(i*mN + j);
+				Index b = (Index)(i*mN + j + 1);
+				Index c = (Index)((i+1)*mN + j);
+				Index d = (Index)((i+1)*mN + j + 1);
+
+				if(Winding == GridWinding::Clockwise)
+				{
+					quad[0] = a; quad[1] = b; quad[2] = c;
+					quad[3] = c; quad[4] = b; quad[5] = d;
+				}
+				else
+				{
+					quad[0] = a; quad[1] = c; quad[2] = b;
+					quad[3] = c; quad[4] = d; quad[5] = b;
+				}
+				quad += 6;
+			});
+		});
+	}
+
+	void GenerateStrips(Index* indices)const
+	{
+		std::uint32_t rowCount = mM - 1;
+		size_t stripLength = 2*(size_t)mN + 1;
+		size_t grainSize = std::max<size_t>(1, MinQuadsPerTask / mN);
+
+		// Each row of quads zigzags between its two rows of vertices.  Which row
+		// comes first sets the winding of the strip, and also which diagonal splits
+		// the quads: clockwise strips cut them the other way from clockwise lists.
+		ForEachBlock(rowCount, grainSize, [&](size_t begin, size_t end)
+		{
+			for(std::uint32_t i = (std::uint32_t)begin; i < (std::uint32_t)end; ++i)
+			{
+				Index* strip = indices + i*stripLength;
+				Index first = (Index)((Winding == GridWinding::Clockwise ? i+1 : i)*mN);
+				Index second = (Index)((Winding == GridWinding::Clockwise ? i : i+1)*mN);
+
+				for(std::uint32_t j = 0; j < mN; ++j)
+				{
+					strip[2*j] = (Index)(first + j);
+					strip[2*j + 1] = (Index)(second + j);
+				}
+
+				if(i + 1 < rowCount)
+					strip[2*mN] = StripCutValue;
+			}
+		});
+	}
+
+private:
+	std::uint32_t mM;
+	std::uint32_t mN;
+	GridTraversal mTraversal;
+	size_t mParallelQuadThreshold = 0;
+};
@@ -0,0 +1,90 @@
+//***************************************************************************************
+// LodSelector.h
+//
+// Level of detail selection.  A LOD table lists the draw arguments of up to four
+// versions of a mesh, finest first, and the screen size below which each coarser
+// version takes over.  Every frame Select measures the visible items on screen and
+// switches each to the level of its table that fits.
+//
+// An item's screen size is the diameter of its bounding sphere on screen over the
+// viewport height, roughly r*proj(1,1)/d for a sphere of radius r at distance d from
+// the eye; the sphere is the one around the item's world box.
+//
+// An item moving back and forth across a switch size would change level every frame
+// and pop.  The selector adds hysteresis: an item only switches to a coarser level
+// once it is a fraction smaller than the switch size, and back once it is the same
+// fraction larger.
+//
+// Select works on four items at a time with SSE.  It compares squared sizes, scaled
+// by the squared distances, so it needs no square roots or divisions, and it only
+// writes to the RenderItemStore for the items whose level changed.  Large item lists
+// are split across ThreadPool::Default().
+//***************************************************************************************
+
+#pragma once
+
+#include "RenderItemStore.h"
+
+struct LodLevel
+{
+	RenderItemDrawArgs DrawArgs;
+
+	// Tells the levels apart for instancing (see RenderItemIds::SubmeshId).
+	UINT SubmeshId = 0;
+
+	// The level is used down to this screen size.  Ignored for the coarsest level,
+	// which is used down to nothing.
+	float MinScreenSize = 0.0f;
+};
+
+class LodSelector
+{
+public:
+	static const std::uint32_t MaxLevels = 4;
+	static const std::uint32_t NoTable = 0xffffffff;
+
+	// Fewer items than this are selected on the calling thread.
+	static const std::uint32_t ParallelItemCount = 16384;
+
+	// Items switch levels once their screen size is a fraction hysteresis past the
+	// switch size.  Throws std::invalid_argument unless hysteresis is in [0, 1).
+	explicit LodSelector(float hysteresis = 0.1f);
+	LodSelector(const LodSelector& rhs) = delete;
+	LodSelector& operator=(const LodSelector& rhs) = delete;
+
+	// Adds a table of count levels, finest first, and returns its index for
+	// RenderItemDesc::LodTable.  Throws std::invalid_argument unless count is in
+	// [1, MaxLevels] and the MinScreenSize of every level but the coarsest is positive
+	// and smaller than the one before.
+	std::uint32_t AddTable(const LodLevel* levels, std::uint32_t count);
+
+	std::uint32_t TableCount()const { return (std::uint32_t)mLevelCounts.size(); }
+	std::uint32_t LevelCount(std::uint32_t table)const { return mLevelCounts[table]; }
+	const LodLevel& GetLevel(std::uint32_t table, std::uint32_t level)const;
+
+	// The screen size of a box; projScale is proj(1,1) of the projection matrix.
+	static float ScreenSize(const DirectX::BoundingBox& worldBounds, DirectX::FXMVECTOR eyePos, float projScale);
+
+	// Selects the levels of items, which must not repeat, from the sizes of their
+	// worldBounds (indexed by render item) seen from eyePos, and switches the items
+	// whose level changed with RenderItemStore::SetLod.  Items without a table are
+	// left alone.
+	void Select(RenderItemStore& store, const std::vector<std::uint32_t>& items,
+		const DirectX::BoundingBox* worldBounds, DirectX::FXMVECTOR eyePos, float projScale)const;
+
+private:
+	void SelectRange(RenderItemStore& store, const std::uint32_t* items, std::uint32_t count,
+		const DirectX::BoundingBox* worldBounds, DirectX::FXMVECTOR eyePos, float projScale)const;
+
+	float mHysteresis = 0.1f;
+
+	// Per table, offset by one: row 0 is for NoTable, which wraps to it.  The squared
+	// switch sizes to the next three levels, lowered for mCoarser and raised for mFiner
+	// by the hysteresis, and -1 past the coarsest level, which no squared size is below.
+	std::vector<DirectX::XMFLOAT4> mCoarser;
+	std::vector<DirectX::XMFLOAT4> mFiner;
+
+	// MaxLevels per table.
+	std::vector<LodLevel> mLevels;
+	std::vector<std::uint32_t> mLevelCounts;
+};
@@ -0,0 +1,124 @@
+//***************************************************************************************
+// MeshCache.h
+//
+// Memoizes GeometryGenerator output.  Requests with identical generator type and
+// parameters share one immutable MeshData, so a scene that asks for the same
+// cylinder for every column generates it once.
+//
+// Meshes are generated without holding the cache's lock, so other requests go on
+// while one is generated.  A request for a mesh that is still being generated waits
+// for it rather than generating it again.
+//
+// Entries still referenced by the application are never evicted.  When the bytes
+// held by the cache exceed the memory budget, the others go in least recently used
+// order.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryGenerator.h"
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+enum class MeshShape : std::uint32_t
+{
+	Box = 0,
+	Sphere,
+	Geosphere,
+	Cylinder,
+	Grid,
+	Quad
+};
+
+// Generator type plus the exact arguments passed to it.  Keys compare bitwise.
+struct MeshKey
+{
+	MeshShape Shape = MeshShape::Box;
+	float Params[5] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	std::uint32_t Counts[2] = { 0, 0 };
+
+	static MeshKey Box(float width, float height, float depth, std::uint32_t numSubdivisions);
+	static MeshKey Sphere(float radius, std::uint32_t sliceCount, std::uint32_t stackCount);
+	static MeshKey Geosphere(float radius, std::uint32_t numSubdivisions);
+	static MeshKey Cylinder(float bottomRadius, float topRadius, float height, std::uint32_t sliceCount, std::uint32_t stackCount);
+	static MeshKey Grid(float width, float depth, std::uint32_t m, std::uint32_t n);
+	static MeshKey Quad(float x, float y, float w, float h, float depth);
+
+	bool operator==(const MeshKey& rhs)const;
+};
+
+struct MeshKeyHash
+{
+	size_t operator()(const MeshKey& key)const;
+};
+
+class MeshCache
+{
+public:
+	using MeshData = GeometryGenerator::MeshData;
+
+	struct Stats
+	{
+		std::uint64_t MeshHits = 0;
+		std::uint64_t MeshMisses = 0;
+		std::uint64_t Evictions = 0;
+
+		// Vertex and index bytes of the cached meshes.
+		size_t MeshBytes = 0;
+	};
+
+	explicit MeshCache(size_t memoryBudget = 64*1024*1024);
+	MeshCache(const MeshCache& rhs) = delete;
+	MeshCache& operator=(const MeshCache& rhs) = delete;
+
+	// Returns the mesh for key, generating it on the first request.  If generating
+	// throws, the exception reaches every request waiting for the mesh, and the next
+	// request tries again.
+	std::shared_ptr<const MeshData> GetMesh(const MeshKey& key);
+
+	// Releases releasable entries, oldest first, until the budget is met.
+	void SetMemoryBudget(size_t bytes);
+	size_t GetMemoryBudget()const;
+
+	// Drops every entry the application no longer uses.
+	void Clear();
+
+	Stats GetStats()const;
+	void ResetStats();
+
+private:
+	typedef std::list<MeshKey>::iterator LruIterator;
+
+	struct MeshEntry
+	{
+		// Requests that find the entry before it is Ready wait on Mesh.  Entries
+		// join mLru once ready, so ones being generated are never evicted.
+		std::shared_future<std::shared_ptr<const MeshData>> Mesh;
+		bool Ready = false;
+		size_t Bytes = 0;
+		LruIterator Lru;
+	};
+
+	MeshData Generate(const MeshKey& key);
+
+	// Must be called with mMutex held.
+	void Touch(LruIterator node);
+	void EnforceBudget();
+
+private:
+	mutable std::mutex mMutex;
+
+	GeometryGenerator mGeoGen;
+
+	std::unordered_map<MeshKey, MeshEntry, MeshKeyHash> mMeshes;
+
+	// Most recently used first.
+	std::list<MeshKey> mLru;
+
+	size_t mMemoryBudget = 0;
+	Stats mStats;
+};
@@ -0,0 +1,296 @@
+//***************************************************************************************
+// MeshFile.cpp
+//***************************************************************************************
+
+#include "MeshFile.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const std::uint32_t MeshFileMagic = 0x4853454d; // "MESH"
+
+	const std::uint64_t TableAlignment = 16;
+	const std::uint64_t PageAlignment = 4096;
+
+	struct MeshFileHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+		std::uint64_t ContentKey;
+		std::uint64_t FileSize;
+
+		std::uint32_t VertexByteStride;
+		std::uint32_t VertexBufferByteSize;
+		std::uint32_t IndexFormat;
+		std::uint32_t IndexBufferByteSize;
+
+		std::uint32_t DrawArgCount;
+		std::uint32_t NameBytes;
+		std::uint64_t DrawArgOffset;
+		std::uint64_t NameOffset;
+		std::uint64_t VertexOffset;
+		std::uint64_t IndexOffset;
+	};
+
+	struct MeshFileDrawArg
+	{
+		std::uint32_t NameOffset;   // Relative to MeshFileHeader::NameOffset.
+		std::uint32_t NameLength;
+		std::uint32_t IndexCount;
+		std::uint32_t StartIndexLocation;
+		std::int32_t BaseVertexLocation;
+		DirectX::XMFLOAT3 BoundsCenter;
+		DirectX::XMFLOAT3 BoundsExtents;
+		DirectX::XMFLOAT3 PositionScale;
+		DirectX::XMFLOAT3 PositionBias;
+		std::uint32_t Pad[3];
+	};
+
+	static_assert(sizeof(MeshFileHeader) % TableAlignment == 0, "MeshFileHeader must keep the tables aligned.");
+	static_assert(sizeof(MeshFileDrawArg) % TableAlignment == 0, "MeshFileDrawArg must keep the table aligned.");
+
+	std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Owns a read-only view of a whole file.  Shared by the blobs that point into it,
+	// so the view stays mapped until the last of them is released.
+	struct MappedFile
+	{
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+		const std::uint8_t* View = nullptr;
+		std::uint64_t Size = 0;
+
+		~MappedFile()
+		{
+			if(View != nullptr)
+				UnmapViewOfFile(View);
+			if(Mapping != nullptr)
+				CloseHandle(Mapping);
+			if(File != INVALID_HANDLE_VALUE)
+				CloseHandle(File);
+		}
+	};
+
+	// ID3DBlob over a range of a MappedFile.
+	class MappedBlob : public Microsoft::WRL::RuntimeClass<
+		Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::ClassicCom>, ID3DBlob>
+	{
+	public:
+		MappedBlob(std::shared_ptr<MappedFile> file, const void* data, SIZE_T size) :
+			mFile(std::move(file)), mData(data), mSize(size)
+		{
+		}
+
+		LPVOID STDMETHODCALLTYPE GetBufferPointer()override
+		{
+			return const_cast<void*>(mData);
+		}
+
+		SIZE_T STDMETHODCALLTYPE GetBufferSize()override
+		{
+			return mSize;
+		}
+
+	private:
+		std::shared_ptr<MappedFile> mFile;
+		const void* mData;
+		SIZE_T mSize;
+	};
+
+	std::shared_ptr<MappedFile> MapFile(const std::wstring& filename)
+	{
+		auto file = std::make_shared<MappedFile>();
+
+		file->File = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(file->File == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(file->File, &size) || size.QuadPart < (LONGLONG)sizeof(MeshFileHeader))
+			return nullptr;
+		file->Size = (std::uint64_t)size.QuadPart;
+
+		file->Mapping = CreateFileMappingW(file->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(file->Mapping == nullptr)
+			return nullptr;
+
+		file->View = (const std::uint8_t*)MapViewOfFile(file->Mapping, FILE_MAP_READ, 0, 0, 0);
+		if(file->View == nullptr)
+			return nullptr;
+
+		return file;
+	}
+
+	bool InFile(std::uint64_t offset, std::uint64_t byteSize, std::uint64_t fileSize)
+	{
+		return offset <= fileSize && byteSize <= fileSize - offset;
+	}
+}
+
+bool MeshFile::Save(const MeshGeometry& geo, const std::wstring& filename, std::uint64_t contentKey)
+{
+	if(geo.VertexBufferCPU == nullptr || geo.IndexBufferCPU == nullptr)
+		return false;
+
+	//
+	// Lay out the sections.
+	//
+
+	std::vector<MeshFileDrawArg> drawArgs;
+	std::string names;
+	drawArgs.reserve(geo.DrawArgs.size());
+	for(const auto& arg : geo.DrawArgs)
+	{
+		const SubmeshGeometry& submesh = arg.second;
+
+		MeshFileDrawArg record = {};
+		record.NameOffset = (std::uint32_t)names.size();
+		record.NameLength = (std::uint32_t)arg.first.size();
+		record.IndexCount = submesh.IndexCount;
+		record.StartIndexLocation = submesh.StartIndexLocation;
+		record.BaseVertexLocation = submesh.BaseVertexLocation;
+		record.BoundsCenter = submesh.Bounds.Center;
+		record.BoundsExtents = submesh.Bounds.Extents;
+		record.PositionScale = submesh.PositionScale;
+		record.PositionBias = submesh.PositionBias;
+		drawArgs.push_back(record);
+
+		names += arg.first;
+	}
+
+	MeshFileHeader header = {};
+	header.Magic = MeshFileMagic;
+	header.Version = Version;
+	header.ContentKey = contentKey;
+	header.VertexByteStride = geo.VertexByteStride;
+	header.VertexBufferByteSize = geo.VertexBufferByteSize;
+	header.IndexFormat = (std::uint32_t)geo.IndexFormat;
+	header.IndexBufferByteSize = geo.IndexBufferByteSize;
+	header.DrawArgCount = (std::uint32_t)drawArgs.size();
+	header.NameBytes = (std::uint32_t)names.size();
+	header.DrawArgOffset = AlignUp(sizeof(MeshFileHeader), TableAlignment);
+	header.NameOffset = AlignUp(header.DrawArgOffset + drawArgs.size()*sizeof(MeshFileDrawArg), TableAlignment);
+	header.VertexOffset = AlignUp(header.NameOffset + names.size(), PageAlignment);
+	header.IndexOffset = AlignUp(header.VertexOffset + header.VertexBufferByteSize, PageAlignment);
+	header.FileSize = header.IndexOffset + header.IndexBufferByteSize;
+
+	//
+	// Assemble the file in memory, then write it under a temporary name and move it
+	// over the old file, so a crash mid-write never leaves a truncated file behind.
+	//
+
+	std::vector<std::uint8_t> bytes((size_t)header.FileSize, 0);
+	memcpy(&bytes[0], &header, sizeof(header));
+	if(!drawArgs.empty())
+		memcpy(&bytes[(size_t)header.DrawArgOffset], drawArgs.data(), drawArgs.size()*sizeof(MeshFileDrawArg));
+	if(!names.empty())
+		memcpy(&bytes[(size_t)header.NameOffset], names.data(), names.size());
+	memcpy(&bytes[(size_t)header.VertexOffset], geo.VertexBufferCPU->GetBufferPointer(), header.VertexBufferByteSize);
+	memcpy(&bytes[(size_t)header.IndexOffset], geo.IndexBufferCPU->GetBufferPointer(), header.IndexBufferByteSize);
+
+	std::wstring tempFilename = filename + L".tmp";
+
+	HANDLE file = CreateFileW(tempFilename.c_str(), GENERIC_WRITE, 0, nullptr,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// WriteFile takes a 32-bit count, so write large files in pieces.
+	bool written = true;
+	size_t offset = 0;
+	while(written && offset < bytes.size())
+	{
+		DWORD chunk = (DWORD)std::min<size_t>(bytes.size() - offset, 1u << 30);
+		DWORD chunkWritten = 0;
+		written = WriteFile(file, &bytes[offset], chunk, &chunkWritten, nullptr) && chunkWritten == chunk;
+		offset += chunk;
+	}
+	CloseHandle(file);
+
+	if(!written || !MoveFileExW(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFilename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+std::unique_ptr<MeshGeometry> MeshFile::Load(const std::wstring& filename, std::uint64_t contentKey)
+{
+	auto file = MapFile(filename);
+	if(file == nullptr)
+		return nullptr;
+
+	//
+	// Validate the header before trusting any offset in it.
+	//
+
+	MeshFileHeader header;
+	memcpy(&header, file->View, sizeof(header));
+
+	if(header.Magic != MeshFileMagic ||
+	   header.Version != Version ||
+	   header.ContentKey != contentKey ||
+	   header.FileSize != file->Size)
+		return nullptr;
+
+	if(!InFile(header.DrawArgOffset, (std::uint64_t)header.DrawArgCount*sizeof(MeshFileDrawArg), file->Size) ||
+	   !InFile(header.NameOffset, header.NameBytes, file->Size) ||
+	   !InFile(header.VertexOffset, header.VertexBufferByteSize, file->Size) ||
+	   !InFile(header.IndexOffset, header.IndexBufferByteSize, file->Size))
+		return nullptr;
+
+	auto geo = std::make_unique<MeshGeometry>();
+
+	geo->VertexByteStride = header.VertexByteStride;
+	geo->VertexBufferByteSize = header.VertexBufferByteSize;
+	geo->IndexFormat = (DXGI_FORMAT)header.IndexFormat;
+	geo->IndexBufferByteSize = header.IndexBufferByteSize;
+
+	const MeshFileDrawArg* drawArgs = (const MeshFileDrawArg*)(file->View + header.DrawArgOffset);
+	const char* names = (const char*)(file->View + header.NameOffset);
+	for(std::uint32_t i = 0; i < header.DrawArgCount; ++i)
+	{
+		const MeshFileDrawArg& record = drawArgs[i];
+		if(!InFile(record.NameOffset, record.NameLength, header.NameBytes))
+			return nullptr;
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = record.IndexCount;
+		submesh.StartIndexLocation = record.StartIndexLocation;
+		submesh.BaseVertexLocation = record.BaseVertexLocation;
+		submesh.Bounds.Center = record.BoundsCenter;
+		submesh.Bounds.Extents = record.BoundsExtents;
+		submesh.PositionScale = record.PositionScale;
+		submesh.PositionBias = record.PositionBias;
+
+		geo->DrawArgs[std::string(names + record.NameOffset, record.NameLength)] = submesh;
+	}
+
+	// The blobs reference the mapping; it is unmapped when the last of them is released.
+	geo->VertexBufferCPU = Microsoft::WRL::Make<MappedBlob>(file,
+		file->View + header.VertexOffset, (SIZE_T)header.VertexBufferByteSize);
+	geo->IndexBufferCPU = Microsoft::WRL::Make<MappedBlob>(file,
+		file->View + header.IndexOffset, (SIZE_T)header.IndexBufferByteSize);
+
+	return geo;
+}
+
+std::uint64_t MeshFile::ContentKey(const void* data, size_t byteSize)
+{
+	// FNV-1a, seeded with the format version so a layout change also changes the key.
+	std::uint64_t hash = 14695981039346656037ull ^ Version;
+	const std::uint8_t* bytes = (const std::uint8_t*)data;
+	for(size_t i = 0; i < byteSize; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
@@ -0,0 +1,45 @@
+//***************************************************************************************
+// MeshFile.h
+//
+// Versioned binary container for the CPU side of a MeshGeometry: vertex and index
+// data, vertex stride, index format, the DrawArgs table and the submesh bounds.
+//
+// Load() memory maps the file instead of reading it.  The vertex and index sections
+// start on page boundaries, and the VertexBufferCPU/IndexBufferCPU blobs of the
+// returned geometry point straight into the mapped view, so only the pages that are
+// actually touched (e.g., by the GPU upload) are read from disk.  These blobs are
+// read-only.
+//
+// Layout (all offsets from the start of the file):
+//   Header
+//   DrawArg records, 16-byte aligned
+//   Submesh names, 16-byte aligned
+//   Vertex data, page aligned
+//   Index data, page aligned
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class MeshFile
+{
+public:
+	// Bumped whenever the layout below changes; older files are ignored by Load().
+	static const std::uint32_t Version = 1;
+
+	// Writes the CPU blobs, layout and DrawArgs of geo.  contentKey identifies the
+	// inputs the geometry was built from (see ContentKey).  Returns false if the
+	// file could not be written.
+	static bool Save(const MeshGeometry& geo, const std::wstring& filename, std::uint64_t contentKey);
+
+	// Maps filename and returns a MeshGeometry with its CPU blobs, layout and DrawArgs
+	// filled in; the name and GPU buffers are left for the caller to set.  Returns nullptr
+	// when the file is missing, malformed, of another version, or was saved with a
+	// different contentKey.
+	static std::unique_ptr<MeshGeometry> Load(const std::wstring& filename, std::uint64_t contentKey);
+
+	// Hash of the parameters that produce a geometry, used as the contentKey so that
+	// a change to them invalidates the saved file.
+	static std::uint64_t ContentKey(const void* data, size_t byteSize);
+};
@@ -0,0 +1,408 @@
+//***************************************************************************************
+// OcclusionCuller.cpp
+//***************************************************************************************
+
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t FullMask = 0xffffffff;
+	static_assert(OcclusionCuller::TileWidth*OcclusionCuller::TileHeight == 32, "A tile's mask is 32 bits.");
+	static_assert(OcclusionCuller::BinWidth % OcclusionCuller::TileWidth == 0 &&
+		OcclusionCuller::BinHeight % OcclusionCuller::TileHeight == 0, "Bins must hold whole tiles.");
+
+	// Triangles set up per task.
+	const std::uint32_t SetupGrainSize = 256;
+}
+
+OcclusionCuller::OcclusionCuller(std::uint32_t width, std::uint32_t height)
+{
+	if(width == 0 || height == 0 || width % TileWidth != 0 || height % TileHeight != 0)
+		throw std::invalid_argument("OcclusionCuller: width and height must be nonzero multiples of the tile size.");
+
+	mWidth = width;
+	mHeight = height;
+	mTilesX = width / TileWidth;
+	mTilesY = height / TileHeight;
+	mBinsX = (width + BinWidth - 1) / BinWidth;
+	mBinsY = (height + BinHeight - 1) / BinHeight;
+
+	std::uint32_t tileCount = mTilesX*mTilesY;
+	mReferenceDepth.assign(tileCount + 3, 1.0f);
+	mWorkingDepth.assign(tileCount, 0.0f);
+	mWorkingMask.assign(tileCount, 0);
+
+	mBinDepth.assign(mBinsX*mBinsY, 1.0f);
+	mBinTriangles.resize(mBinsX*mBinsY);
+
+	XMStoreFloat4x4(&mViewProj, XMMatrixIdentity());
+}
+
+void OcclusionCuller::Begin(FXMMATRIX viewProj)
+{
+	XMStoreFloat4x4(&mViewProj, viewProj);
+
+	std::fill(mReferenceDepth.begin(), mReferenceDepth.end(), 1.0f);
+	std::fill(mWorkingDepth.begin(), mWorkingDepth.end(), 0.0f);
+	std::fill(mWorkingMask.begin(), mWorkingMask.end(), 0);
+	std::fill(mBinDepth.begin(), mBinDepth.end(), 1.0f);
+
+	mOccluders.clear();
+}
+
+void OcclusionCuller::AddOccluder(const void* vertices, std::uint32_t vertexStride,
+	const std::uint16_t* indices, std::uint32_t indexCount, FXMMATRIX world)
+{
+	Occluder occluder;
+	occluder.Vertices = (const std::uint8_t*)vertices;
+	occluder.VertexStride = vertexStride;
+	occluder.Indices16 = indices;
+	occluder.Indices32 = nullptr;
+	occluder.TriangleCount = indexCount / 3;
+	occluder.FirstTriangle = 0;
+	XMStoreFloat4x4(&occluder.WorldViewProj, XMMatrixMultiply(world, XMLoadFloat4x4(&mViewProj)));
+	mOccluders.push_back(occluder);
+}
+
+void OcclusionCuller::AddOccluder(const void* vertices, std::uint32_t vertexStride,
+	const std::uint32_t* indices, std::uint32_t indexCount, FXMMATRIX world)
+{
+	AddOccluder(vertices, vertexStride, (const std::uint16_t*)nullptr, indexCount, world);
+	mOccluders.back().Indices16 = nullptr;
+	mOccluders.back().Indices32 = indices;
+}
+
+void OcclusionCuller::Rasterize()
+{
+	std::uint32_t triangleCount = 0;
+	for(Occluder& occluder : mOccluders)
+	{
+		occluder.FirstTriangle = triangleCount;
+		triangleCount += occluder.TriangleCount;
+	}
+
+	mTriangles.resize(triangleCount);
+
+	ThreadPool& pool = ThreadPool::Default();
+	pool.ParallelFor(triangleCount, SetupGrainSize, [&](size_t begin, size_t end)
+	{
+		// The occluder holding triangle begin.
+		auto occluder = std::upper_bound(mOccluders.begin(), mOccluders.end(), (std::uint32_t)begin,
+			[](std::uint32_t t, const Occluder& o) { return t < o.FirstTriangle; }) - 1;
+
+		for(std::uint32_t t = (std::uint32_t)begin; t < end; ++t)
+		{
+			while(t >= occluder->FirstTriangle + occluder->TriangleCount)
+				++occluder;
+
+			std::uint32_t first = (t - occluder->FirstTriangle)*3;
+			if(occluder->Indices32 != nullptr)
+			{
+				const std::uint32_t* indices = occluder->Indices32 + first;
+				SetupTriangle(*occluder, indices[0], indices[1], indices[2], mTriangles[t]);
+			}
+			else
+			{
+				const std::uint16_t* indices = occluder->Indices16 + first;
+				SetupTriangle(*occluder, indices[0], indices[1], indices[2], mTriangles[t]);
+			}
+		}
+	});
+
+	// Binned in submission order, so every bin rasterizes its triangles in the same
+	// order however the work is scheduled.
+	for(std::vector<std::uint32_t>& binTriangles : mBinTriangles)
+		binTriangles.clear();
+
+	for(std::uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const Triangle& tri = mTriangles[t];
+		if(tri.MinX >= tri.MaxX)
+			continue;
+
+		std::uint32_t binX0 = tri.MinX / BinWidth;
+		std::uint32_t binX1 = (tri.MaxX - 1) / BinWidth;
+		std::uint32_t binY0 = tri.MinY / BinHeight;
+		std::uint32_t binY1 = (tri.MaxY - 1) / BinHeight;
+		for(std::uint32_t y = binY0; y <= binY1; ++y)
+		{
+			for(std::uint32_t x = binX0; x <= binX1; ++x)
+				mBinTriangles[y*mBinsX + x].push_back(t);
+		}
+	}
+
+	pool.ParallelFor(mBinTriangles.size(), 1, [&](size_t begin, size_t end)
+	{
+		for(size_t bin = begin; bin < end; ++bin)
+			RasterizeBin((std::uint32_t)bin);
+	});
+}
+
+void OcclusionCuller::SetupTriangle(const Occluder& occluder, std::uint32_t i0, std::uint32_t i1, std::uint32_t i2,
+	Triangle& tri)const
+{
+	// Skipped until proven otherwise.
+	tri.MinX = tri.MaxX = 0;
+
+	XMMATRIX worldViewProj = XMLoadFloat4x4(&occluder.WorldViewProj);
+	std::uint32_t indices[3] = { i0, i1, i2 };
+
+	float x[3], y[3], z[3];
+	for(int k = 0; k < 3; ++k)
+	{
+		const XMFLOAT3* position = (const XMFLOAT3*)(occluder.Vertices + (size_t)indices[k]*occluder.VertexStride);
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(position), worldViewProj));
+
+		// In front of the near plane; clipping would be exact but skipping is enough.
+		if(clip.z < 0.0f || clip.w <= 0.0f)
+			return;
+
+		float invW = 1.0f / clip.w;
+		x[k] = (clip.x*invW*0.5f + 0.5f)*mWidth;
+		y[k] = (0.5f - clip.y*invW*0.5f)*mHeight;
+		z[k] = clip.z*invW;
+	}
+
+	// Twice the signed area, positive for triangles that are clockwise on screen (y
+	// points down).  Back facing and degenerate triangles are skipped.
+	float area = (x[1] - x[0])*(y[2] - y[0]) - (x[2] - x[0])*(y[1] - y[0]);
+	if(!(area > 0.0f))
+		return;
+
+	float minX = std::min(std::min(x[0], x[1]), x[2]);
+	float maxX = std::max(std::max(x[0], x[1]), x[2]);
+	float minY = std::min(std::min(y[0], y[1]), y[2]);
+	float maxY = std::max(std::max(y[0], y[1]), y[2]);
+	if(maxX <= 0.0f || maxY <= 0.0f || minX >= (float)mWidth || minY >= (float)mHeight)
+		return;
+
+	for(int k = 0; k < 3; ++k)
+	{
+		int j = (k + 1) % 3;
+		tri.EdgeA[k] = y[k] - y[j];
+		tri.EdgeB[k] = x[j] - x[k];
+		tri.EdgeC[k] = x[k]*y[j] - x[j]*y[k];
+	}
+
+	float invArea = 1.0f / area;
+	tri.DepthA = ((z[1] - z[0])*(y[2] - y[0]) - (z[2] - z[0])*(y[1] - y[0]))*invArea;
+	tri.DepthB = ((x[1] - x[0])*(z[2] - z[0]) - (x[2] - x[0])*(z[1] - z[0]))*invArea;
+	tri.DepthC = z[0] - tri.DepthA*x[0] - tri.DepthB*y[0];
+	tri.MaxDepth = std::max(std::max(z[0], z[1]), z[2]);
+
+	tri.MinX = (std::int32_t)std::floor(std::max(minX, 0.0f));
+	tri.MinY = (std::int32_t)std::floor(std::max(minY, 0.0f));
+	tri.MaxX = (std::int32_t)std::ceil(std::min(maxX, (float)mWidth));
+	tri.MaxY = (std::int32_t)std::ceil(std::min(maxY, (float)mHeight));
+
+	if(tri.MinY >= tri.MaxY)
+		tri.MaxX = tri.MinX;
+}
+
+void OcclusionCuller::RasterizeBin(std::uint32_t bin)
+{
+	std::uint32_t binX = bin % mBinsX;
+	std::uint32_t binY = bin / mBinsX;
+
+	// Tiles of the bin, [tileX0, tileX1) x [tileY0, tileY1).
+	std::uint32_t tileX0 = binX*(BinWidth / TileWidth);
+	std::uint32_t tileY0 = binY*(BinHeight / TileHeight);
+	std::uint32_t tileX1 = std::min<std::uint32_t>(tileX0 + BinWidth / TileWidth, mTilesX);
+	std::uint32_t tileY1 = std::min<std::uint32_t>(tileY0 + BinHeight / TileHeight, mTilesY);
+
+	for(std::uint32_t t : mBinTriangles[bin])
+	{
+		const Triangle& tri = mTriangles[t];
+
+		std::uint32_t x0 = std::max<std::uint32_t>(tri.MinX / TileWidth, tileX0);
+		std::uint32_t x1 = std::min<std::uint32_t>((tri.MaxX - 1) / TileWidth + 1, tileX1);
+		std::uint32_t y0 = std::max<std::uint32_t>(tri.MinY / TileHeight, tileY0);
+		std::uint32_t y1 = std::min<std::uint32_t>((tri.MaxY - 1) / TileHeight + 1, tileY1);
+
+		for(std::uint32_t tileY = y0; tileY < y1; ++tileY)
+		{
+			for(std::uint32_t tileX = x0; tileX < x1; ++tileX)
+			{
+				std::uint32_t tile = tileY*mTilesX + tileX;
+
+				// The farthest point of the depth plane over the tile, which is at one
+				// of its corners, but no farther than the triangle's farthest vertex.
+				float left = (float)(tileX*TileWidth);
+				float top = (float)(tileY*TileHeight);
+				float depth = tri.DepthC +
+					tri.DepthA*(tri.DepthA > 0.0f ? left + TileWidth : left) +
+					tri.DepthB*(tri.DepthB > 0.0f ? top + TileHeight : top);
+				depth = std::min(depth, tri.MaxDepth);
+
+				// Nothing to gain behind what the tile already hides.
+				if(depth >= mReferenceDepth[tile])
+					continue;
+
+				std::uint32_t coverage = TileCoverage(tri, tileX, tileY);
+				if(coverage != 0)
+					UpdateTile(tile, coverage, depth);
+			}
+		}
+	}
+
+	float binDepth = 0.0f;
+	for(std::uint32_t tileY = tileY0; tileY < tileY1; ++tileY)
+	{
+		for(std::uint32_t tileX = tileX0; tileX < tileX1; ++tileX)
+			binDepth = std::max(binDepth, mReferenceDepth[tileY*mTilesX + tileX]);
+	}
+	mBinDepth[bin] = binDepth;
+}
+
+std::uint32_t OcclusionCuller::TileCoverage(const Triangle& tri, std::uint32_t tileX, std::uint32_t tileY)const
+{
+	// Pixel centers of the tile's first four columns.
+	float left = tileX*TileWidth + 0.5f;
+	float top = tileY*TileHeight + 0.5f;
+	XMVECTOR columns = XMVectorAdd(XMVectorReplicate(left), XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f));
+
+	// The edge functions at the first pixel row, for the left and right four columns.
+	XMVECTOR edgeLeft[3], edgeRight[3], edgeStepY[3];
+	for(int k = 0; k < 3; ++k)
+	{
+		XMVECTOR a = XMVectorReplicate(tri.EdgeA[k]);
+		XMVECTOR rowStart = XMVectorReplicate(tri.EdgeB[k]*top + tri.EdgeC[k]);
+		edgeLeft[k] = XMVectorMultiplyAdd(a, columns, rowStart);
+		edgeRight[k] = XMVectorAdd(edgeLeft[k], XMVectorReplicate(tri.EdgeA[k]*4.0f));
+		edgeStepY[k] = XMVectorReplicate(tri.EdgeB[k]);
+	}
+
+	XMVECTOR zero = XMVectorZero();
+	std::uint32_t coverage = 0;
+	for(std::uint32_t row = 0; row < TileHeight; ++row)
+	{
+		XMVECTOR insideLeft = XMVectorAndInt(
+			XMVectorAndInt(XMVectorGreaterOrEqual(edgeLeft[0], zero), XMVectorGreaterOrEqual(edgeLeft[1], zero)),
+			XMVectorGreaterOrEqual(edgeLeft[2], zero));
+		XMVECTOR insideRight = XMVectorAndInt(
+			XMVectorAndInt(XMVectorGreaterOrEqual(edgeRight[0], zero), XMVectorGreaterOrEqual(edgeRight[1], zero)),
+			XMVectorGreaterOrEqual(edgeRight[2], zero));
+
+		std::uint32_t rowBits = (std::uint32_t)_mm_movemask_ps(insideLeft) |
+			((std::uint32_t)_mm_movemask_ps(insideRight) << 4);
+		coverage |= rowBits << (row*TileWidth);
+
+		for(int k = 0; k < 3; ++k)
+		{
+			edgeLeft[k] = XMVectorAdd(edgeLeft[k], edgeStepY[k]);
+			edgeRight[k] = XMVectorAdd(edgeRight[k], edgeStepY[k]);
+		}
+	}
+
+	return coverage;
+}
+
+void OcclusionCuller::UpdateTile(std::uint32_t tile, std::uint32_t coverage, float depth)
+{
+	float& reference = mReferenceDepth[tile];
+	float& working = mWorkingDepth[tile];
+	std::uint32_t& mask = mWorkingMask[tile];
+
+	// A triangle much nearer than the working layer would only loosen it; start a new
+	// working layer from the triangle instead.
+	if(depth - working > reference - depth)
+	{
+		working = 0.0f;
+		mask = 0;
+	}
+
+	working = std::max(working, depth);
+	mask |= coverage;
+
+	if(mask == FullMask)
+	{
+		reference = std::min(reference, working);
+		working = 0.0f;
+		mask = 0;
+	}
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox& worldBounds)const
+{
+	XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+
+	float minX = FLT_MAX, minY = FLT_MAX, minDepth = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for(int corner = 0; corner < 8; ++corner)
+	{
+		XMFLOAT3 p = worldBounds.Center;
+		p.x += (corner & 1) ? worldBounds.Extents.x : -worldBounds.Extents.x;
+		p.y += (corner & 2) ? worldBounds.Extents.y : -worldBounds.Extents.y;
+		p.z += (corner & 4) ? worldBounds.Extents.z : -worldBounds.Extents.z;
+
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&p), viewProj));
+
+		// Crossing the near plane; it may cover the whole screen.
+		if(clip.z < 0.0f || clip.w <= 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		float x = (clip.x*invW*0.5f + 0.5f)*mWidth;
+		float y = (0.5f - clip.y*invW*0.5f)*mHeight;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minDepth = std::min(minDepth, clip.z*invW);
+	}
+
+	if(maxX <= 0.0f || maxY <= 0.0f || minX >= (float)mWidth || minY >= (float)mHeight)
+		return false;
+
+	// Tiles overlapped by the screen rectangle, [tileX0, tileX1] x [tileY0, tileY1].
+	std::uint32_t tileX0 = (std::uint32_t)std::max(minX, 0.0f) / TileWidth;
+	std::uint32_t tileY0 = (std::uint32_t)std::max(minY, 0.0f) / TileHeight;
+	std::uint32_t tileX1 = (std::uint32_t)std::min(maxX, (float)(mWidth - 1)) / TileWidth;
+	std::uint32_t tileY1 = (std::uint32_t)std::min(maxY, (float)(mHeight - 1)) / TileHeight;
+
+	const std::uint32_t binTilesX = BinWidth / TileWidth;
+	const std::uint32_t binTilesY = BinHeight / TileHeight;
+
+	XMVECTOR depth = XMVectorReplicate(minDepth);
+	for(std::uint32_t binY = tileY0 / binTilesY; binY <= tileY1 / binTilesY; ++binY)
+	{
+		for(std::uint32_t binX = tileX0 / binTilesX; binX <= tileX1 / binTilesX; ++binX)
+		{
+			// Behind every tile of the bin.
+			if(minDepth >= mBinDepth[binY*mBinsX + binX])
+				continue;
+
+			std::uint32_t x0 = std::max(tileX0, binX*binTilesX);
+			std::uint32_t x1 = std::min(tileX1 + 1, (binX + 1)*binTilesX);
+			std::uint32_t y0 = std::max(tileY0, binY*binTilesY);
+			std::uint32_t y1 = std::min(tileY1 + 1, (binY + 1)*binTilesY);
+
+			// Four tiles of a row at a time; the padding makes the last load safe.
+			for(std::uint32_t tileY = y0; tileY < y1; ++tileY)
+			{
+				for(std::uint32_t tileX = x0; tileX < x1; tileX += 4)
+				{
+					XMVECTOR reference = XMLoadFloat4((const XMFLOAT4*)&mReferenceDepth[tileY*mTilesX + tileX]);
+					int nearer = _mm_movemask_ps(XMVectorLess(depth, reference));
+					if(x1 - tileX < 4)
+						nearer &= (1 << (x1 - tileX)) - 1;
+
+					if(nearer != 0)
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,136 @@
+//***************************************************************************************
+// OcclusionCuller.h
+//
+// Software occlusion culling.  A few large occluder meshes are rasterized on the CPU
+// into a small depth buffer, and the bounding boxes of the other items are tested
+// against it, so that items hidden behind the occluders are not drawn.
+//
+// The buffer is masked occlusion style: the screen is divided into 8x4 pixel tiles,
+// and instead of a depth per pixel every tile keeps two conservative layers.  The
+// reference layer is one depth that no occluder pixel of the tile lies behind.  The
+// working layer is a mask of the pixels covered since, with the farthest depth among
+// them; when the mask fills the tile, the working layer becomes the reference.
+// Coverage is computed four pixels at a time with SSE, and each triangle updates a
+// tile with the farthest depth of its plane over the tile.
+//
+// Depths are D3D's z/w, 0 at the near plane and 1 at the far plane.  Occluder
+// triangles that face away or cross the near plane are skipped, which can only hide
+// fewer items.
+//
+// Rasterize sets up the occluder triangles in parallel, bins them into 64x32 pixel
+// bins, and rasterizes the bins in parallel on ThreadPool::Default(), so every tile is
+// written by one task.  Each bin also keeps the farthest reference depth of its tiles,
+// which IsVisible tests before it looks at the tiles.
+//
+// Nothing here touches D3D, so the culler can be tested and timed without a device.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+
+class OcclusionCuller
+{
+public:
+	static const std::uint32_t TileWidth = 8;
+	static const std::uint32_t TileHeight = 4;
+	static const std::uint32_t BinWidth = 64;
+	static const std::uint32_t BinHeight = 32;
+
+	// Throws std::invalid_argument unless width and height are nonzero multiples of
+	// the tile size.
+	OcclusionCuller(std::uint32_t width, std::uint32_t height);
+	OcclusionCuller(const OcclusionCuller& rhs) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller& rhs) = delete;
+
+	std::uint32_t Width()const { return mWidth; }
+	std::uint32_t Height()const { return mHeight; }
+
+	// Clears the buffer and the queued occluders.  viewProj maps world space to clip
+	// space (row vectors) for the occluders and the tests that follow.
+	void Begin(DirectX::FXMMATRIX viewProj);
+
+	// Queues a triangle list for Rasterize.  Vertex i's position is the XMFLOAT3 at
+	// vertices + i*vertexStride, and the vertices and indices must stay alive until
+	// Rasterize returns.  Triangles are front facing when clockwise on screen.
+	void AddOccluder(const void* vertices, std::uint32_t vertexStride,
+		const std::uint16_t* indices, std::uint32_t indexCount, DirectX::FXMMATRIX world);
+	void AddOccluder(const void* vertices, std::uint32_t vertexStride,
+		const std::uint32_t* indices, std::uint32_t indexCount, DirectX::FXMMATRIX world);
+
+	// Rasterizes the queued occluders.
+	void Rasterize();
+
+	// Returns false if worldBounds is off screen or entirely behind the rasterized
+	// occluders.  Safe to call from several threads at once.
+	bool IsVisible(const DirectX::BoundingBox& worldBounds)const;
+
+private:
+	struct Occluder
+	{
+		const std::uint8_t* Vertices;
+		std::uint32_t VertexStride;
+
+		// One of the two is set.
+		const std::uint16_t* Indices16;
+		const std::uint32_t* Indices32;
+
+		std::uint32_t TriangleCount;
+
+		// Index of the occluder's first triangle in mTriangles.
+		std::uint32_t FirstTriangle;
+
+		DirectX::XMFLOAT4X4 WorldViewProj;
+	};
+
+	struct Triangle
+	{
+		// Edge functions a*x + b*y + c in pixels, not negative inside.
+		float EdgeA[3];
+		float EdgeB[3];
+		float EdgeC[3];
+
+		// Depth plane a*x + b*y + c, and the farthest vertex depth.
+		float DepthA;
+		float DepthB;
+		float DepthC;
+		float MaxDepth;
+
+		// Pixel bounds [MinX, MaxX) x [MinY, MaxY); empty for skipped triangles.
+		std::int32_t MinX;
+		std::int32_t MinY;
+		std::int32_t MaxX;
+		std::int32_t MaxY;
+	};
+
+	void SetupTriangle(const Occluder& occluder, std::uint32_t i0, std::uint32_t i1, std::uint32_t i2,
+		Triangle& tri)const;
+	void RasterizeBin(std::uint32_t bin);
+	std::uint32_t TileCoverage(const Triangle& tri, std::uint32_t tileX, std::uint32_t tileY)const;
+	void UpdateTile(std::uint32_t tile, std::uint32_t coverage, float depth);
+
+	std::uint32_t mWidth = 0;
+	std::uint32_t mHeight = 0;
+	std::uint32_t mTilesX = 0;
+	std::uint32_t mTilesY = 0;
+	std::uint32_t mBinsX = 0;
+	std::uint32_t mBinsY = 0;
+
+	DirectX::XMFLOAT4X4 mViewProj;
+
+	// Per tile.  mReferenceDepth has three floats of padding so four tiles can
+	// always be loaded at once.
+	std::vector<float> mReferenceDepth;
+	std::vector<float> mWorkingDepth;
+	std::vector<std::uint32_t> mWorkingMask;
+
+	// Per bin: the farthest reference depth of its tiles, and its triangles.
+	std::vector<float> mBinDepth;
+	std::vector<std::vector<std::uint32_t>> mBinTriangles;
+
+	std::vector<Occluder> mOccluders;
+	std::vector<Triangle> mTriangles;
+};
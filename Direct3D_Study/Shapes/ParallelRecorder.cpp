@@ -0,0 +1,68 @@
+//***************************************************************************************
+// ParallelRecorder.cpp
+//***************************************************************************************
+
+#include "ParallelRecorder.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+ParallelRecorder::ParallelRecorder(std::uint32_t maxChunks, std::uint32_t minChunkItems)
+	: mMaxChunks(maxChunks),
+	mMinChunkItems(std::max<std::uint32_t>(minChunkItems, 1))
+{
+	if(maxChunks == 0)
+		throw std::invalid_argument("ParallelRecorder: maxChunks must be at least 1.");
+}
+
+std::uint32_t ParallelRecorder::ChunkCount(std::uint32_t itemCount)const
+{
+	std::uint32_t count = itemCount / mMinChunkItems;
+	return std::min<std::uint32_t>(std::max<std::uint32_t>(count, 1), mMaxChunks);
+}
+
+void ParallelRecorder::ChunkRange(std::uint32_t itemCount, std::uint32_t chunkCount, std::uint32_t chunk,
+	std::uint32_t& begin, std::uint32_t& end)
+{
+	begin = (std::uint32_t)((std::uint64_t)itemCount*chunk / chunkCount);
+	end = (std::uint32_t)((std::uint64_t)itemCount*(chunk + 1) / chunkCount);
+}
+
+std::uint32_t ParallelRecorder::Record(ChunkRecorder& recorder, std::uint32_t itemCount)const
+{
+	std::uint32_t chunkCount = ChunkCount(itemCount);
+
+	// Pool threads must not throw, so the exceptions are carried back to this thread.
+	std::vector<std::exception_ptr> errors(chunkCount);
+
+	// One chunk per task: the chunks are the same size, and each is much more work than
+	// handing out a task.
+	ThreadPool::Default().ParallelFor(chunkCount, 1, [&](size_t first, size_t last)
+	{
+		for(size_t chunk = first; chunk < last; ++chunk)
+		{
+			std::uint32_t begin = 0;
+			std::uint32_t end = 0;
+			ChunkRange(itemCount, chunkCount, (std::uint32_t)chunk, begin, end);
+
+			try
+			{
+				recorder.RecordChunk((std::uint32_t)chunk, chunkCount, begin, end);
+			}
+			catch(...)
+			{
+				errors[chunk] = std::current_exception();
+			}
+		}
+	});
+
+	for(const std::exception_ptr& error : errors)
+	{
+		if(error)
+			std::rethrow_exception(error);
+	}
+
+	return chunkCount;
+}
@@ -0,0 +1,56 @@
+//***************************************************************************************
+// ParallelRecorder.h
+//
+// Records a pass over a list of items into several command lists at once.  The items
+// are split into contiguous chunks, one per command list, and the chunks are recorded
+// concurrently on ThreadPool::Default().  Chunk i covers items before those of chunk
+// i + 1, so submitting the lists in chunk order with one ExecuteCommandLists draws
+// the items in list order.
+//
+// What a chunk records, and into what, is up to a ChunkRecorder.  ShapesApp records
+// each chunk into its own CommandStream and replays it into the chunk's command list;
+// Tests/ParallelRecorderTests.cpp checks the splitting and scheduling without a
+// device, with a recorder that only fills CommandStreams.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+
+class ChunkRecorder
+{
+public:
+	virtual ~ChunkRecorder() = default;
+
+	// Records items [begin, end) as chunk of chunkCount.  Called once per chunk, on
+	// any thread, concurrently with the other chunks.
+	virtual void RecordChunk(std::uint32_t chunk, std::uint32_t chunkCount, std::uint32_t begin,
+		std::uint32_t end) = 0;
+};
+
+class ParallelRecorder
+{
+public:
+	// Splits passes into at most maxChunks chunks of at least minChunkItems items.
+	// Throws std::invalid_argument if maxChunks is 0.
+	explicit ParallelRecorder(std::uint32_t maxChunks, std::uint32_t minChunkItems = 256);
+
+	std::uint32_t MaxChunks()const { return mMaxChunks; }
+
+	// The number of chunks itemCount items are split into; at least one, so a pass with
+	// no items still records its first and last chunk.
+	std::uint32_t ChunkCount(std::uint32_t itemCount)const;
+
+	// The items [begin, end) of chunk; the chunks differ in size by one item at most.
+	static void ChunkRange(std::uint32_t itemCount, std::uint32_t chunkCount, std::uint32_t chunk,
+		std::uint32_t& begin, std::uint32_t& end);
+
+	// Records every chunk of itemCount items with recorder and returns the number of
+	// chunks once all are recorded.  If recording throws, the exception of the
+	// lowest chunk is rethrown here after the other chunks finish.
+	std::uint32_t Record(ChunkRecorder& recorder, std::uint32_t itemCount)const;
+
+private:
+	std::uint32_t mMaxChunks = 1;
+	std::uint32_t mMinChunkItems = 256;
+};
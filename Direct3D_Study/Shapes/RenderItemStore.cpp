@@ -0,0 +1,188 @@
+//***************************************************************************************
+// RenderItemStore.cpp
+//***************************************************************************************
+
+#include "RenderItemStore.h"
+#include <cassert>
+#include <stdexcept>
+
+using namespace DirectX;
+
+namespace
+{
+	template<typename T>
+	void RemoveAt(std::vector<T>& items, std::uint32_t index)
+	{
+		items[index] = items.back();
+		items.pop_back();
+	}
+}
+
+RenderItemStore::RenderItemStore(int frameResourceCount)
+	: mFrameResourceCount(frameResourceCount)
+{
+	if(frameResourceCount < 1 || frameResourceCount > MaxFrameResources)
+		throw std::invalid_argument("RenderItemStore: frameResourceCount must be in [1, 32].");
+
+	mDirtyLists.resize(frameResourceCount);
+}
+
+void RenderItemStore::Reserve(std::uint32_t capacity)
+{
+	mWorld.reserve(capacity);
+	mObjCBIndex.reserve(capacity);
+	mGeo.reserve(capacity);
+	mPrimitiveType.reserve(capacity);
+	mDrawArgs.reserve(capacity);
+	mBounds.reserve(capacity);
+	mIds.reserve(capacity);
+	mOccluder.reserve(capacity);
+	mLodTable.reserve(capacity);
+	mLodLevel.reserve(capacity);
+	mSortKey.reserve(capacity);
+	mItemSlots.reserve(capacity);
+	mDirtyMasks.reserve(capacity);
+}
+
+RenderItemHandle RenderItemStore::Add(const RenderItemDesc& desc)
+{
+	std::uint32_t slot;
+	if(!mFreeSlots.empty())
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (std::uint32_t)mSlots.size();
+		mSlots.push_back(Slot());
+	}
+
+	std::uint32_t index = Size();
+	mSlots[slot].Index = index;
+
+	mWorld.push_back(desc.World);
+	mObjCBIndex.push_back(desc.ObjCBIndex);
+	mGeo.push_back(desc.Geo);
+	mPrimitiveType.push_back(desc.PrimitiveType);
+	mDrawArgs.push_back(desc.DrawArgs);
+	mBounds.push_back(desc.Bounds);
+	mIds.push_back(desc.Ids);
+	mOccluder.push_back(desc.Occluder ? 1 : 0);
+	mLodTable.push_back(desc.LodTable);
+	mLodLevel.push_back(0);
+	mSortKey.push_back(0);
+	mItemSlots.push_back(slot);
+	mDirtyMasks.push_back(0);
+
+	MarkDirty(index);
+
+	return HandleAt(index);
+}
+
+bool RenderItemStore::Remove(RenderItemHandle handle)
+{
+	if(!IsValid(handle))
+		return false;
+
+	std::uint32_t index = mSlots[handle.Slot].Index;
+	std::uint32_t last = Size() - 1;
+
+	RemoveAt(mWorld, index);
+	RemoveAt(mObjCBIndex, index);
+	RemoveAt(mGeo, index);
+	RemoveAt(mPrimitiveType, index);
+	RemoveAt(mDrawArgs, index);
+	RemoveAt(mBounds, index);
+	RemoveAt(mIds, index);
+	RemoveAt(mOccluder, index);
+	RemoveAt(mLodTable, index);
+	RemoveAt(mLodLevel, index);
+	RemoveAt(mSortKey, index);
+	RemoveAt(mItemSlots, index);
+	RemoveAt(mDirtyMasks, index);
+
+	if(index != last)
+	{
+		mSlots[mItemSlots[index]].Index = index;
+		MarkDirty(index);
+	}
+
+	// Bumping the generation makes every copy of handle stale, including the ones
+	// on the dirty lists.
+	mSlots[handle.Slot].Index = InvalidIndex;
+	mSlots[handle.Slot].Generation++;
+	mFreeSlots.push_back(handle.Slot);
+
+	return true;
+}
+
+bool RenderItemStore::IsValid(RenderItemHandle handle)const
+{
+	return handle.Slot < mSlots.size() &&
+		mSlots[handle.Slot].Generation == handle.Generation &&
+		mSlots[handle.Slot].Index != InvalidIndex;
+}
+
+std::uint32_t RenderItemStore::IndexOf(RenderItemHandle handle)const
+{
+	assert(IsValid(handle));
+	return mSlots[handle.Slot].Index;
+}
+
+RenderItemHandle RenderItemStore::HandleAt(std::uint32_t index)const
+{
+	RenderItemHandle handle;
+	handle.Slot = mItemSlots[index];
+	handle.Generation = mSlots[handle.Slot].Generation;
+	return handle;
+}
+
+void RenderItemStore::SetWorld(std::uint32_t index, const XMFLOAT4X4& world)
+{
+	mWorld[index] = world;
+	MarkDirty(index);
+}
+
+void RenderItemStore::MarkDirty(std::uint32_t index)
+{
+	std::uint32_t allLists = (std::uint32_t)((1ull << mFrameResourceCount) - 1);
+	std::uint32_t missing = allLists & ~mDirtyMasks[index];
+	if(missing == 0)
+		return;
+
+	RenderItemHandle handle = HandleAt(index);
+	for(int i = 0; i < mFrameResourceCount; ++i)
+	{
+		if(missing & (1u << i))
+			mDirtyLists[i].push_back(handle);
+	}
+
+	mDirtyMasks[index] = allLists;
+}
+
+void RenderItemStore::SetLod(std::uint32_t index, std::uint8_t level, const RenderItemDrawArgs& drawArgs, UINT submeshId)
+{
+	mLodLevel[index] = level;
+	mDrawArgs[index] = drawArgs;
+	mIds[index].SubmeshId = submeshId;
+}
+
+void RenderItemStore::TakeDirtyItems(int frameResource, std::vector<std::uint32_t>& indices)
+{
+	std::vector<RenderItemHandle>& dirtyList = mDirtyLists[frameResource];
+	std::uint32_t bit = 1u << frameResource;
+
+	indices.clear();
+	for(const RenderItemHandle& handle : dirtyList)
+	{
+		if(!IsValid(handle))
+			continue;
+
+		std::uint32_t index = mSlots[handle.Slot].Index;
+		mDirtyMasks[index] &= ~bit;
+		indices.push_back(index);
+	}
+
+	dirtyList.clear();
+}
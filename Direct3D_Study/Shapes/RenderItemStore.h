@@ -0,0 +1,173 @@
+//***************************************************************************************
+// RenderItemStore.h
+//
+// Render items stored as parallel arrays, one per field, instead of one heap object
+// per item.  The per-frame passes each read only the fields they need from contiguous
+// memory: constant buffer updates read the world matrices and CB indices, culling
+// reads the bounds, and drawing reads the draw arguments.
+//
+// Every frame resource has its own list of dirty items.  Marking an item dirty queues
+// it once on each list that does not hold it yet, and a frame resource takes its list
+// when it updates its constant buffers, so that update costs as much as the number of
+// changed items rather than the number of items.
+//
+// Items are packed at indices [0, Size()).  Removing an item moves the last item into
+// its place, so indices change; handles carry a slot and a generation count and keep
+// referring to the same item until it is removed, after which they are stale.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "MathHelper.h"
+
+struct RenderItemHandle
+{
+	std::uint32_t Slot = 0xffffffff;
+	std::uint32_t Generation = 0;
+};
+
+// DrawIndexedInstanced parameters.
+struct RenderItemDrawArgs
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	INT BaseVertexLocation = 0;
+};
+
+// Sort key fields (see RenderSort).  Items with the same ids share a pipeline state
+// and buffers.
+struct RenderItemIds
+{
+	UINT PsoId = 0;
+	UINT GeoId = 0;
+	UINT MaterialId = 0;
+
+	// Items with the same GeoId and SubmeshId draw the same indices.
+	UINT SubmeshId = 0;
+};
+
+// The fields of a new item.
+struct RenderItemDesc
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+
+	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	UINT ObjCBIndex = 0;
+
+	MeshGeometry* Geo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	RenderItemDrawArgs DrawArgs;
+
+	// Bounds of the submesh in local space.
+	DirectX::BoundingBox Bounds;
+
+	RenderItemIds Ids;
+
+	// Rasterized into the OcclusionCuller to hide the items behind it.  Best for a few
+	// large items with simple meshes.
+	bool Occluder = false;
+
+	// The item's table in a LodSelector, or 0xffffffff (LodSelector::NoTable) for an
+	// item drawn with DrawArgs at every size.  DrawArgs and Ids.SubmeshId start out as
+	// those of the table's finest level.
+	std::uint32_t LodTable = 0xffffffff;
+};
+
+class RenderItemStore
+{
+public:
+	static const int MaxFrameResources = 32;
+
+	// Keeps one dirty list per frame resource.  Throws std::invalid_argument if
+	// frameResourceCount is not in [1, MaxFrameResources].
+	explicit RenderItemStore(int frameResourceCount);
+	RenderItemStore(const RenderItemStore& rhs) = delete;
+	RenderItemStore& operator=(const RenderItemStore& rhs) = delete;
+
+	void Reserve(std::uint32_t capacity);
+
+	// Appends an item at index Size() and marks it dirty.
+	RenderItemHandle Add(const RenderItemDesc& desc);
+
+	// Moves the last item into the removed item's index.  The moved item keeps its
+	// handle and its CB index but is marked dirty, so that data kept per index
+	// elsewhere (e.g. by a FrustumCuller) is refreshed.  Returns false if handle is
+	// stale.
+	bool Remove(RenderItemHandle handle);
+
+	bool IsValid(RenderItemHandle handle)const;
+
+	// Current index of a valid handle's item; valid until the next Remove.
+	std::uint32_t IndexOf(RenderItemHandle handle)const;
+	RenderItemHandle HandleAt(std::uint32_t index)const;
+
+	std::uint32_t Size()const { return (std::uint32_t)mWorld.size(); }
+
+	// Sets the item's world matrix and marks it dirty.
+	void SetWorld(std::uint32_t index, const DirectX::XMFLOAT4X4& world);
+
+	// Queues the item on the dirty list of every frame resource.
+	void MarkDirty(std::uint32_t index);
+
+	// Switches the item to another level of its LOD table.  The world matrix is not
+	// changed, so the item is not marked dirty, and calls for different items may run
+	// at the same time.
+	void SetLod(std::uint32_t index, std::uint8_t level, const RenderItemDrawArgs& drawArgs, UINT submeshId);
+
+	// Replaces indices with the current indices of the items marked dirty since
+	// frameResource last took its list, each item once, and empties the list.
+	// Removed items are left out.
+	void TakeDirtyItems(int frameResource, std::vector<std::uint32_t>& indices);
+
+	// Per item arrays, Size() elements each.
+	const std::vector<DirectX::XMFLOAT4X4>& World()const { return mWorld; }
+	const std::vector<UINT>& ObjCBIndex()const { return mObjCBIndex; }
+	const std::vector<MeshGeometry*>& Geo()const { return mGeo; }
+	const std::vector<D3D12_PRIMITIVE_TOPOLOGY>& PrimitiveType()const { return mPrimitiveType; }
+	const std::vector<RenderItemDrawArgs>& DrawArgs()const { return mDrawArgs; }
+	const std::vector<DirectX::BoundingBox>& Bounds()const { return mBounds; }
+	const std::vector<RenderItemIds>& Ids()const { return mIds; }
+	const std::vector<std::uint8_t>& Occluder()const { return mOccluder; }
+	const std::vector<std::uint32_t>& LodTable()const { return mLodTable; }
+	const std::vector<std::uint8_t>& LodLevel()const { return mLodLevel; }
+
+	// Rebuilt from the ids and the view depth every frame.
+	std::vector<std::uint64_t>& SortKey() { return mSortKey; }
+	const std::vector<std::uint64_t>& SortKey()const { return mSortKey; }
+
+private:
+	static const std::uint32_t InvalidIndex = 0xffffffff;
+
+	struct Slot
+	{
+		std::uint32_t Index = InvalidIndex;
+		std::uint32_t Generation = 0;
+	};
+
+	int mFrameResourceCount = 0;
+
+	std::vector<DirectX::XMFLOAT4X4> mWorld;
+	std::vector<UINT> mObjCBIndex;
+	std::vector<MeshGeometry*> mGeo;
+	std::vector<D3D12_PRIMITIVE_TOPOLOGY> mPrimitiveType;
+	std::vector<RenderItemDrawArgs> mDrawArgs;
+	std::vector<DirectX::BoundingBox> mBounds;
+	std::vector<RenderItemIds> mIds;
+	std::vector<std::uint8_t> mOccluder;
+	std::vector<std::uint32_t> mLodTable;
+	std::vector<std::uint8_t> mLodLevel;
+	std::vector<std::uint64_t> mSortKey;
+
+	// The slot of each item, to fix up the moved item's slot on Remove.
+	std::vector<std::uint32_t> mItemSlots;
+
+	// Bit i is set while the item is queued on mDirtyLists[i].
+	std::vector<std::uint32_t> mDirtyMasks;
+
+	// Handles rather than indices, which Remove would invalidate.
+	std::vector<std::vector<RenderItemHandle>> mDirtyLists;
+
+	std::vector<Slot> mSlots;
+	std::vector<std::uint32_t> mFreeSlots;
+};
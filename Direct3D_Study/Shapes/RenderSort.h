@@ -0,0 +1,67 @@
+//***************************************************************************************
+// RenderSort.h
+//
+// 64-bit sort keys for draw submission and a radix sort to order draws by them.  Key
+// fields, from the most significant:
+//
+//   Layer     4 bits   render layers are drawn in order
+//   PSO       8 bits
+//   Geometry 12 bits   vertex and index buffers
+//   Material 12 bits
+//   Depth    28 bits   view space depth over [0, farZ], front to back
+//
+// Sorting puts the draws that share a pipeline state and buffers next to each other,
+// so submission can skip the state that did not change, and orders each such run
+// front to back so the depth test rejects more pixels early.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A draw to sort: its key and whatever index the caller uses to find it again.
+struct SortEntry
+{
+	std::uint64_t Key;
+	std::uint32_t Index;
+};
+
+// State changes of one frame's submission.  A change is counted as saved when the
+// state it would have set was already bound.
+struct DrawStats
+{
+	std::uint32_t DrawCalls = 0;
+	std::uint32_t StateChanges = 0;
+	std::uint32_t StateChangesSaved = 0;
+};
+
+class RenderSort
+{
+public:
+	static const std::uint32_t LayerBits = 4;
+	static const std::uint32_t PsoBits = 8;
+	static const std::uint32_t GeometryBits = 12;
+	static const std::uint32_t MaterialBits = 12;
+	static const std::uint32_t DepthBits = 28;
+
+	// Every id must fit its field; throws std::out_of_range otherwise.  Depths outside
+	// [0, farZ] are clamped.
+	static std::uint64_t MakeKey(std::uint32_t layer, std::uint32_t pso, std::uint32_t geometry,
+		std::uint32_t material, float depth, float farZ);
+
+	static std::uint32_t Layer(std::uint64_t key);
+	static std::uint32_t Pso(std::uint64_t key);
+	static std::uint32_t Geometry(std::uint64_t key);
+	static std::uint32_t Material(std::uint64_t key);
+
+	// key with its depth field replaced by value, which must fit DepthBits (throws
+	// std::out_of_range otherwise).  Sorting by such keys groups draws of the same state
+	// by something other than depth.
+	static std::uint64_t ReplaceDepth(std::uint64_t key, std::uint32_t value);
+
+	// Stable radix sort of entries by key, 8 bits per pass.  Passes over bits that are
+	// the same in every key (e.g. the layer of a single layer list) are skipped.  scratch
+	// is resized as needed; keep it around to avoid allocating every frame.
+	static void Sort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+};
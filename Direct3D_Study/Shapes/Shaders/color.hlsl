@@ -9,6 +9,21 @@ cbuffer cbPerObject : register(b0)
 	float4x4 gWorld; 
 };
 
+// Instanced draws read the world matrix of each instance from gInstanceData.
+// SV_InstanceID starts at zero for every draw, so the draw's first instance in
+// the buffer comes in as a root constant.
+struct InstanceData
+{
+	float4x4 World;
+};
+
+StructuredBuffer<InstanceData> gInstanceData : register(t0);
+
+cbuffer cbInstance : register(b2)
+{
+	uint gBaseInstance;
+};
+
 cbuffer cbPass : register(b1)
 {
     float4x4 gView;
@@ -53,6 +68,20 @@ VertexOut VS(VertexIn vin)
     return vout;
 }
 
+VertexOut VSInstanced(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	VertexOut vout;
+
+	float4x4 world = gInstanceData[gBaseInstance + instanceID].World;
+
+	float4 posW = mul(float4(vin.PosL, 1.0f), world);
+	vout.PosH = mul(posW, gViewProj);
+
+	vout.Color = vin.Color;
+
+	return vout;
+}
+
 float4 PS(VertexOut pin) : SV_Target
 {
     return pin.Color;
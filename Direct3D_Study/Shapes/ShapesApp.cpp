@@ -2,12 +2,31 @@
 // ShapesApp.cpp by Frank Luna (C) 2015 All Rights Reserved.
 //
 // Hold down '1' key to view scene in wireframe mode.
+// Hold down '2' key to draw every render item separately instead of instanced.
+// Hold down '3' key to draw the items hidden behind the occluders too.
+//
+// The draws are recorded into several command lists at once, one chunk of the sorted
+// items each (see ParallelRecorder).
 //***************************************************************************************
 
 #include "d3dApp.h"
 #include "MathHelper.h"
 #include "UploadBuffer.h"
 #include "GeometryGenerator.h"
+#include "MeshFile.h"
+#include "MeshCache.h"
+#include "RenderSort.h"
+#include "RenderItemStore.h"
+#include "TransformHierarchy.h"
+#include "BoundingVolumeHierarchy.h"
+#include "OcclusionCuller.h"
+#include "LodSelector.h"
+#include "NameRegistry.h"
+#include "CommandStream.h"
+#include "D3D12CommandBackend.h"
+#include "ParallelRecorder.h"
+#include "ThreadPool.h"
+#include "ConstantUpload.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -16,38 +35,42 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
-// ϳ ü ׸  ʿ Ű   ü.
-// ̷ ü ü   α׷ ٸ  ִ.
-struct RenderItem
+// The submeshes of shapeGeo.  The spheres and cylinders come in two coarser versions
+// for distant items (see BuildRenderItems).
+struct ShapeDesc
 {
-	RenderItem() = default;
-
-    //    ü   ϴ  .
-    //     ȿ ü ġ , ũ⸦ Ѵ.
-    XMFLOAT4X4 World = MathHelper::Identity4x4();
-
-	// ü ڷᰡ ؼ  ۸ ؾ ϴ θ ϴ '' ÷.
-    // FrameResource ü cbuffer Ƿ, FrameResource  ؾ Ѵ.
-    // , ü ڷḦ   ݵ
-    // NumFramesDirty = gNumFrameResources ؾ Ѵ. ׷   ڿ ŵȴ.
-	int NumFramesDirty = gNumFrameResources;
+	const char* Name;
+	MeshKey Key;
+	XMFLOAT4 Color;
+};
 
-	//   ׸ ü  ۿ شϴ GPU   .
-	UINT ObjCBIndex = -1;
+const ShapeDesc gShapes[] =
+{
+	{ "box", MeshKey::Box(1.5f, 0.5f, 1.5f, 3), XMFLOAT4(DirectX::Colors::DarkGreen) },
+	{ "grid", MeshKey::Grid(20.0f, 30.0f, 60, 40), XMFLOAT4(DirectX::Colors::ForestGreen) },
+	{ "sphere", MeshKey::Sphere(0.5f, 20, 20), XMFLOAT4(DirectX::Colors::Crimson) },
+	{ "sphere_lod1", MeshKey::Sphere(0.5f, 10, 10), XMFLOAT4(DirectX::Colors::Crimson) },
+	{ "sphere_lod2", MeshKey::Sphere(0.5f, 6, 4), XMFLOAT4(DirectX::Colors::Crimson) },
+	{ "cylinder", MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 20), XMFLOAT4(DirectX::Colors::SteelBlue) },
+	{ "cylinder_lod1", MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 10, 2), XMFLOAT4(DirectX::Colors::SteelBlue) },
+	{ "cylinder_lod2", MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 6, 1), XMFLOAT4(DirectX::Colors::SteelBlue) },
+};
 
-	MeshGeometry* Geo = nullptr;
+typedef NameRegistry<ComPtr<ID3D12PipelineState>>::Handle PsoHandle;
+typedef NameRegistry<SubmeshGeometry>::Handle SubmeshHandle;
 
-    //   ׸  ϱ.   ׸ 
-    // ϱ    ϱ ٶ.
-    D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+// Render items drawn by one instanced draw.  Instance i reads the world matrix at
+// BaseInstance + i of the frame's instance buffer.
+struct InstanceBatch
+{
+	// Index of the first item of the batch; supplies the buffers and draw arguments.
+	std::uint32_t First = 0;
 
-    // DrawIndexedInstanced Ű.
-    UINT IndexCount = 0;
-    UINT StartIndexLocation = 0;
-    int BaseVertexLocation = 0;
+	UINT BaseInstance = 0;
+	UINT InstanceCount = 0;
 };
 
-class ShapesApp : public D3DApp
+class ShapesApp : public D3DApp, private ChunkRecorder
 {
 public:
     ShapesApp(HINSTANCE hInstance);
@@ -61,6 +84,8 @@ private:
     virtual void OnResize()override;
     virtual void Update(const GameTimer& gt)override;
     virtual void Draw(const GameTimer& gt)override;
+    virtual void RecordChunk(std::uint32_t chunk, std::uint32_t chunkCount, std::uint32_t begin,
+        std::uint32_t end)override;
 
     virtual void OnMouseDown(WPARAM btnState, int x, int y)override;
     virtual void OnMouseUp(WPARAM btnState, int x, int y)override;
@@ -68,6 +93,8 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
+	void UpdateVisibleRitems(const GameTimer& gt);
+	void CullOccludedRitems(FXMMATRIX viewProj);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 
@@ -76,10 +103,18 @@ private:
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
     void BuildShapeGeometry();
+    std::unique_ptr<MeshGeometry> GenerateShapeGeometry();
     void BuildPSOs();
     void BuildFrameResources();
     void BuildRenderItems();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+    void SortRenderItems(const std::vector<std::uint32_t>& ritems, std::vector<std::uint32_t>& sorted);
+    void BuildInstanceBatches(const std::vector<std::uint32_t>& sorted);
+    void BindInputAssembler(CommandStream& stream, std::uint32_t ritem);
+    void RecordPassState(CommandStream& stream, ID3D12PipelineState* pso);
+    void DrawRenderItems(CommandStream& stream, const std::uint32_t* ritems, std::uint32_t count);
+    void DrawInstanceBatches(CommandStream& stream, std::uint32_t begin, std::uint32_t end);
+
+    virtual std::wstring FrameStatsText()const override;
  
 private:
 
@@ -92,23 +127,75 @@ private:
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-    std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	// Shares the generated meshes between the submeshes built from the same shape.
+	MeshCache mMeshCache;
+
+	// Looked up by name only while loading; the per-frame code keeps handles.
+	NameRegistry<std::unique_ptr<MeshGeometry>> mGeometries;
+	NameRegistry<SubmeshGeometry> mSubmeshes;
+	NameRegistry<ComPtr<ID3DBlob>> mShaders;
+	NameRegistry<ComPtr<ID3D12PipelineState>> mPSOs;
+
+	PsoHandle mOpaquePso;
+	PsoHandle mOpaqueWireframePso;
+	PsoHandle mInstancedPso;
+	PsoHandle mInstancedWireframePso;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
 	//   ׸ .
-	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+	//     ׸ ϴ.
+	RenderItemStore mRitems;
+
+	// Sets the world matrices of mRitems.
+	TransformHierarchy mTransforms;
+
+	// This frame's dirty list of mRitems.
+	std::vector<std::uint32_t> mDirtyRitems;
+
+	// World bounds of the render items; BVH item i is render item i.
+	BoundingVolumeHierarchy mBvh;
+	std::vector<BoundingBox> mWorldBounds;
+
+	// Hides the items behind the occluder items.
+	OcclusionCuller mOcclusion;
+
+	// Switches the spheres and cylinders to coarser meshes when they are small on
+	// screen.
+	LodSelector mLods;
+
+	// The items inside the camera frustum and not occluded, rebuilt every frame.
+	std::vector<std::uint32_t> mVisibleRitems;
 
-	// PSO  ׸.
-	std::vector<RenderItem*> mOpaqueRitems;
+	// mVisibleRitems in submission order, rebuilt every frame.
+	std::vector<std::uint32_t> mSortedRitems;
+	std::vector<SortEntry> mSortEntries;
+	std::vector<SortEntry> mSortScratch;
+
+	// mSortedRitems grouped into instanced draws, rebuilt every frame.
+	std::vector<InstanceBatch> mInstanceBatches;
+
+	// Splits the frame's draws into chunks, one per thread of the thread pool at most.
+	// Chunk i is recorded into mChunkStreams[i], replayed into mChunkCmdLists[i] with
+	// allocator i of the frame resource, and the lists are submitted in chunk order.
+	ParallelRecorder mRecorder;
+	std::vector<std::unique_ptr<CommandStream>> mChunkStreams;
+	std::vector<ComPtr<ID3D12GraphicsCommandList>> mChunkCmdLists;
+	std::vector<ID3D12CommandList*> mChunkSubmitLists;
+
+	DrawStats mDrawStats;
 
     PassConstants mMainPassCB;
 
     UINT mPassCbvOffset = 0;
 
+    // Object constant buffers per frame resource.  Every render item has its own and
+    // keeps it for as long as it exists.
+    UINT mObjCBCount = 0;
+
     bool mIsWireframe = false;
+    bool mIsInstanced = true;
+    bool mIsOcclusionCulled = true;
 
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
@@ -142,10 +229,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
         MessageBox(nullptr, e.ToString().c_str(), L"HR Failed", MB_OK);
         return 0;
     }
+    catch(const std::exception& e)
+    {
+        MessageBoxA(nullptr, e.what(), "Exception", MB_OK);
+        return 0;
+    }
 }
 
 ShapesApp::ShapesApp(HINSTANCE hInstance)
-    : D3DApp(hInstance)
+    : D3DApp(hInstance), mRitems(gNumFrameResources), mOcclusion(256, 128),
+    mRecorder(ThreadPool::Default().ThreadCount())
 {
 }
 
@@ -211,6 +304,13 @@ void ShapesApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	// Moved transforms mark their render items dirty.
+	mTransforms.Update(mRitems);
+
+	// The items changed since this frame resource was last updated.
+	mRitems.TakeDirtyItems(mCurrFrameResourceIndex, mDirtyRitems);
+
+	UpdateVisibleRitems(gt);
 	UpdateObjectCBs(gt);
 	UpdateMainPassCB(gt);
 
@@ -219,61 +319,29 @@ void ShapesApp::Update(const GameTimer& gt)
 
 void ShapesApp::Draw(const GameTimer& gt)
 {
-    auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
+    SortRenderItems(mVisibleRitems, mSortedRitems);
 
-    //  Ͽ õ ޸ Ȱ   Ҵڸ
-    // 缳Ѵ. 缳 GPU   ϵ
-    //  ó Ŀ Ͼ.
-    ThrowIfFailed(cmdListAlloc->Reset());
-
-    //   ExecuteCommandList ؼ  ⿭ 
-    // ߰ߴٸ   缳  ִ.  
-    // 缳ϸ ޸𸮰 Ȱȴ.
-    if(mIsWireframe)
-    {
-        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque_wireframe"].Get()));
-    }
-    else
+    // The chunks split the instanced draws, or the items when each is drawn by itself.
+    std::uint32_t itemCount = (std::uint32_t)mSortedRitems.size();
+    if(mIsInstanced)
     {
-        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+        BuildInstanceBatches(mSortedRitems);
+        itemCount = (std::uint32_t)mInstanceBatches.size();
     }
 
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
-
-    // ڿ 뵵 õ  ̸ Direct3D Ѵ.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
-    // ĸ ۿ  ۸ .
-    mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
-    mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-
-    //   ϵ   ۵ Ѵ.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-
-    ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvHeap.Get() };
-    mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-
-    int passCbvIndex = mPassCbvOffset + mCurrFrameResourceIndex;
-    auto passCbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
-    passCbvHandle.Offset(passCbvIndex, mCbvSrvUavDescriptorSize);
-    mCommandList->SetGraphicsRootDescriptorTable(1, passCbvHandle);
-
-    DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
-
-    // ڿ 뵵 õ  ̸ Direct3D Ѵ.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+    std::uint32_t chunkCount = mRecorder.Record(*this, itemCount);
 
-    // ɵ  ģ.
-    ThrowIfFailed(mCommandList->Close());
+    mDrawStats = DrawStats();
+    for(std::uint32_t i = 0; i < chunkCount; ++i)
+    {
+        mDrawStats.DrawCalls += mChunkStreams[i]->DrawCount();
+        mDrawStats.StateChanges += mChunkStreams[i]->StateCount();
+        mDrawStats.StateChangesSaved += mChunkStreams[i]->SkippedCount();
+    }
 
     //       ⿭ ߰Ѵ.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+    // All the chunks go in one submission, in order.
+    mCommandQueue->ExecuteCommandLists(chunkCount, mChunkSubmitLists.data());
 
     // ĸ ۿ  ۸ ȯѴ.
     ThrowIfFailed(mSwapChain->Present(0, 0));
@@ -296,6 +364,86 @@ void ShapesApp::Draw(const GameTimer& gt)
     // Ƿ   ʴ´.
 }
 
+void ShapesApp::RecordChunk(std::uint32_t chunk, std::uint32_t chunkCount, std::uint32_t begin,
+    std::uint32_t end)
+{
+    auto cmdListAlloc = mCurrFrameResource->CmdListAllocs[chunk];
+    ID3D12GraphicsCommandList* cmdList = mChunkCmdLists[chunk].Get();
+
+    //  Ͽ õ ޸ Ȱ   Ҵڸ
+    // 缳Ѵ. 缳 GPU   ϵ
+    //  ó Ŀ Ͼ.
+    ThrowIfFailed(cmdListAlloc->Reset());
+
+    //   ExecuteCommandList ؼ  ⿭ 
+    // ߰ߴٸ   缳  ִ.  
+    // 缳ϸ ޸𸮰 Ȱȴ.
+    ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), nullptr));
+
+    // The chunk is recorded into its stream first, which drops redundant state
+    // changes, and then replayed into its command list.
+    CommandStream& stream = *mChunkStreams[chunk];
+    stream.Reset();
+
+    // The first chunk opens the frame.
+    if(chunk == 0)
+    {
+        // ڿ 뵵 õ  ̸ Direct3D Ѵ.
+        stream.ResourceBarrier(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+        // ĸ ۿ  ۸ .
+        stream.ClearRenderTarget(CurrentBackBufferView().ptr, Colors::LightSteelBlue);
+        stream.ClearDepthStencil(DepthStencilView().ptr, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0);
+    }
+
+    // Instanced draws read their world matrices from the instance buffer, so they need
+    // the instanced PSO instead of the opaque one.
+    PsoHandle pso = mIsWireframe ? mOpaqueWireframePso : mOpaquePso;
+    if(mIsInstanced)
+        pso = mIsWireframe ? mInstancedWireframePso : mInstancedPso;
+
+    RecordPassState(stream, mPSOs[pso].Get());
+
+    if(mIsInstanced)
+        DrawInstanceBatches(stream, begin, end);
+    else
+        DrawRenderItems(stream, mSortedRitems.data() + begin, end - begin);
+
+    // The last chunk closes it.
+    if(chunk == chunkCount - 1)
+    {
+        // ڿ 뵵 õ  ̸ Direct3D Ѵ.
+        stream.ResourceBarrier(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+    }
+
+    D3D12CommandBackend backend(cmdList);
+    stream.Replay(backend);
+
+    // ɵ  ģ.
+    ThrowIfFailed(cmdList->Close());
+}
+
+void ShapesApp::RecordPassState(CommandStream& stream, ID3D12PipelineState* pso)
+{
+    // A command list starts with no state, so every chunk sets all of it.
+    stream.SetViewport(mScreenViewport.TopLeftX, mScreenViewport.TopLeftY, mScreenViewport.Width,
+        mScreenViewport.Height, mScreenViewport.MinDepth, mScreenViewport.MaxDepth);
+    stream.SetScissorRect(mScissorRect.left, mScissorRect.top, mScissorRect.right, mScissorRect.bottom);
+
+    //   ϵ   ۵ Ѵ.
+    stream.SetRenderTarget(CurrentBackBufferView().ptr, DepthStencilView().ptr);
+
+    stream.SetDescriptorHeap(mCbvHeap.Get());
+
+	stream.SetRootSignature(mRootSignature.Get());
+    stream.SetPipelineState(pso);
+
+    int passCbvIndex = mPassCbvOffset + mCurrFrameResourceIndex;
+    auto passCbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+    passCbvHandle.Offset(passCbvIndex, mCbvSrvUavDescriptorSize);
+    stream.SetRootDescriptorTable(1, passCbvHandle.ptr);
+}
+
 void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
     mLastMousePos.x = x;
@@ -347,6 +495,16 @@ void ShapesApp::OnKeyboardInput(const GameTimer& gt)
         mIsWireframe = true;
     else
         mIsWireframe = false;
+
+    if(GetAsyncKeyState('2') & 0x8000)
+        mIsInstanced = false;
+    else
+        mIsInstanced = true;
+
+    if(GetAsyncKeyState('3') & 0x8000)
+        mIsOcclusionCulled = false;
+    else
+        mIsOcclusionCulled = true;
 }
  
 void ShapesApp::UpdateCamera(const GameTimer& gt)
@@ -365,25 +523,104 @@ void ShapesApp::UpdateCamera(const GameTimer& gt)
 	XMStoreFloat4x4(&mView, view);
 }
 
-void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+void ShapesApp::UpdateVisibleRitems(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
+	const std::vector<XMFLOAT4X4>& world = mRitems.World();
+	const std::vector<BoundingBox>& bounds = mRitems.Bounds();
+
+	// Removing a render item moves the last one into its index, so removed items
+	// leave BVH items past the end.
+	for(std::uint32_t ri = mRitems.Size(); mBvh.Contains(ri); ++ri)
+		mBvh.Remove(ri);
+
+	// New items and items whose world matrix changed are all on the dirty list.  A
+	// few are refit into the tree; when most have changed, as on the first frames,
+	// building a new tree is faster and gives a better one.
+	mWorldBounds.resize(mRitems.Size());
+	if(mDirtyRitems.size()*2 > mRitems.Size())
 	{
-		//  ٲ  cbuffer ڷḦ Ѵ.
-		if(e->NumFramesDirty > 0)
+		for(std::uint32_t ri = 0; ri < mRitems.Size(); ++ri)
+			bounds[ri].Transform(mWorldBounds[ri], XMLoadFloat4x4(&world[ri]));
+
+		mBvh.Build(mWorldBounds.data(), mRitems.Size());
+	}
+	else
+	{
+		for(std::uint32_t ri : mDirtyRitems)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
+			bounds[ri].Transform(mWorldBounds[ri], XMLoadFloat4x4(&world[ri]));
+			mBvh.Insert(ri, mWorldBounds[ri]);
+		}
+	}
+
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX proj = XMLoadFloat4x4(&mProj);
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	mBvh.QueryFrustum(viewProj, mVisibleRitems);
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+	if(mIsOcclusionCulled)
+		CullOccludedRitems(viewProj);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	// Only the items that will be drawn need a level.
+	mLods.Select(mRitems, mVisibleRitems, mWorldBounds.data(), XMLoadFloat3(&mEyePos), mProj._22);
+}
+
+void ShapesApp::CullOccludedRitems(FXMMATRIX viewProj)
+{
+	const std::vector<XMFLOAT4X4>& world = mRitems.World();
+
+	// Rasterize the visible occluders from their CPU copies of the mesh.
+	const std::vector<MeshGeometry*>& geos = mRitems.Geo();
+	const std::vector<RenderItemDrawArgs>& drawArgs = mRitems.DrawArgs();
+	const std::vector<std::uint8_t>& occluder = mRitems.Occluder();
 
-			//   ڿ Ѿ.
-			e->NumFramesDirty--;
+	mOcclusion.Begin(viewProj);
+	for(std::uint32_t ri : mVisibleRitems)
+	{
+		if(!occluder[ri])
+			continue;
+
+		const MeshGeometry* geo = geos[ri];
+		const RenderItemDrawArgs& args = drawArgs[ri];
+		const BYTE* vertices = (const BYTE*)geo->VertexBufferCPU->GetBufferPointer() +
+			(size_t)args.BaseVertexLocation*geo->VertexByteStride;
+		const BYTE* indices = (const BYTE*)geo->IndexBufferCPU->GetBufferPointer();
+
+		if(geo->IndexFormat == DXGI_FORMAT_R32_UINT)
+		{
+			mOcclusion.AddOccluder(vertices, geo->VertexByteStride,
+				(const std::uint32_t*)indices + args.StartIndexLocation, args.IndexCount, XMLoadFloat4x4(&world[ri]));
+		}
+		else
+		{
+			mOcclusion.AddOccluder(vertices, geo->VertexByteStride,
+				(const std::uint16_t*)indices + args.StartIndexLocation, args.IndexCount, XMLoadFloat4x4(&world[ri]));
 		}
 	}
+	mOcclusion.Rasterize();
+
+	// An occluder is behind its own triangles, so occluders are always kept.
+	size_t visibleCount = 0;
+	for(std::uint32_t ri : mVisibleRitems)
+	{
+		if(occluder[ri] || mOcclusion.IsVisible(mWorldBounds[ri]))
+			mVisibleRitems[visibleCount++] = ri;
+	}
+	mVisibleRitems.resize(visibleCount);
+}
+
+void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+{
+	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+
+	// ObjectConstants holds only the world matrix, so the transposed matrices can be
+	// written straight into the mapped buffer.
+	static_assert(sizeof(ObjectConstants) == sizeof(XMFLOAT4X4), "ObjectConstants is more than World.");
+
+	//  ٲ  cbuffer ڷḦ Ѵ.
+	ConstantUpload::WriteTransposed(mRitems.World().data(), mRitems.ObjCBIndex().data(),
+		mDirtyRitems.data(), (std::uint32_t)mDirtyRitems.size(), mObjCBCount,
+		currObjectCB->MappedData(), currObjectCB->ElementByteSize());
 }
 
 void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
@@ -416,7 +653,7 @@ void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
 
 void ShapesApp::BuildDescriptorHeaps()
 {
-    UINT objCount = (UINT)mOpaqueRitems.size();
+    UINT objCount = mObjCBCount;
 
     //   ڿ ü ϳ CBV ڰ ʿϴ.
     // +1   ڿ ʿ н CBV  ̴.
@@ -439,7 +676,7 @@ void ShapesApp::BuildConstantBufferViews()
 {
     UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
-    UINT objCount = (UINT)mOpaqueRitems.size();
+    UINT objCount = mObjCBCount;
 
     //   ڿ ü ϳ CBV ڰ ʿϴ.
     for(int frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
@@ -497,14 +734,18 @@ void ShapesApp::BuildRootSignature()
     cbvTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1);
 
 	// Ʈ Ű  ̺̰ų Ʈ  Ǵ Ʈ ̴.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
 	// Ʈ CBV Ѵ.
     slotRootParameter[0].InitAsDescriptorTable(1, &cbvTable0);
     slotRootParameter[1].InitAsDescriptorTable(1, &cbvTable1);
 
+    // The instance buffer and the first instance of the current instanced draw.
+    slotRootParameter[2].InitAsShaderResourceView(0);
+    slotRootParameter[3].InitAsConstants(1, 2);
+
 	// Ʈ ñ״ó Ʈ Ű 迭̴.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter, 0, nullptr, 
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter, 0, nullptr, 
         D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 	// create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
@@ -528,8 +769,9 @@ void ShapesApp::BuildRootSignature()
 
 void ShapesApp::BuildShadersAndInputLayout()
 {
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders.Add("standardVS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1"));
+	mShaders.Add("instancedVS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VSInstanced", "vs_5_1"));
+	mShaders.Add("opaquePS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_1"));
 	
     mInputLayout =
     {
@@ -540,104 +782,103 @@ void ShapesApp::BuildShadersAndInputLayout()
 
 void ShapesApp::BuildShapeGeometry()
 {
-    GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+	// The key covers everything the saved mesh is built from: the generator version,
+	// the vertex size and the name, generator arguments and color of every shape.
+	// MeshKeys have no padding, so their bytes can be hashed directly.
+	std::vector<std::uint8_t> params;
+	auto appendParams = [&](const void* data, size_t byteSize)
+	{
+		const std::uint8_t* bytes = (const std::uint8_t*)data;
+		params.insert(params.end(), bytes, bytes + byteSize);
+	};
 
-	//
-	//    ϱ ϳ Ŀٶ /ε ۿ ´.
-    //  ۿ  κ ޽ð ϴ   ʿ䰡 ִ.
-	//
+	const std::uint32_t format[] = { GeometryGenerator::Version, sizeof(Vertex) };
+	appendParams(format, sizeof(format));
+	for(const ShapeDesc& shape : gShapes)
+	{
+		appendParams(shape.Name, strlen(shape.Name) + 1);
+		appendParams(&shape.Key, sizeof(shape.Key));
+		appendParams(&shape.Color, sizeof(shape.Color));
+	}
 
-	//   ۿ  ü  
-    //  鿡  д.
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-	UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-
-	//  ε ۿ  ü  ε
-    //  鿡  д.
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-
-    // /ε ۿ  ü ϴ  Ÿ
-    // SubmeshGeometry ü Ѵ.
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
+	const std::uint64_t contentKey = MeshFile::ContentKey(params.data(), params.size());
+	const std::wstring cacheFilename = L"shapeGeo.mesh";
 
-	//
-	// ʿ  е ϰ,  ޽ 
-    // ϳ  ۿ ִ´.
-	//
+	// Warm start: map the mesh saved by a previous run instead of regenerating it.
+	std::unique_ptr<MeshGeometry> geo = MeshFile::Load(cacheFilename, contentKey);
+	if(geo == nullptr)
+	{
+		geo = GenerateShapeGeometry();
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size();
+		// Failing to write the cache only costs the next launch a regeneration.
+		MeshFile::Save(*geo, cacheFilename, contentKey);
+	}
 
-	std::vector<Vertex> vertices(totalVertexCount);
+	geo->Name = "shapeGeo";
 
-	UINT k = 0;
-	for(size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::DarkGreen);
-	}
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->VertexBufferCPU->GetBufferPointer(), geo->VertexBufferByteSize, geo->VertexBufferUploader);
 
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
-	}
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferByteSize, geo->IndexBufferUploader);
 
-	for(size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
-	}
+	// Registered in name order, so that their ids do not depend on the hash map.
+	std::vector<std::string> submeshNames;
+	for(const auto& drawArgs : geo->DrawArgs)
+		submeshNames.push_back(drawArgs.first);
+	std::sort(submeshNames.begin(), submeshNames.end());
+	for(const std::string& name : submeshNames)
+		mSubmeshes.Add(name, geo->DrawArgs[name]);
 
-	for(size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
-	}
+	mGeometries.Add("shapeGeo", std::move(geo));
+}
 
+std::unique_ptr<MeshGeometry> ShapesApp::GenerateShapeGeometry()
+{
+	//
+	//    ϱ ϳ Ŀٶ /ε ۿ ´.
+    //  ۿ  κ ޽ð ϴ   ʿ䰡 ִ.
+	//
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "shapeGeo";
+
+	std::vector<Vertex> vertices;
 	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
+	for(const ShapeDesc& shape : gShapes)
+	{
+		std::shared_ptr<const GeometryGenerator::MeshData> cached = mMeshCache.GetMesh(shape.Key);
+		const GeometryGenerator::MeshData& mesh = *cached;
+
+		// /ε ۿ  ü ϴ  Ÿ
+		// SubmeshGeometry ü Ѵ.
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)mesh.IndexCount();
+		submesh.StartIndexLocation = (UINT)indices.size();
+		submesh.BaseVertexLocation = (INT)vertices.size();
+		submesh.Bounds = mesh.Bounds;
+		geo->DrawArgs[shape.Name] = submesh;
+
+		// ʿ  е ϰ,  ޽ 
+		// ϳ  ۿ ִ´.
+		for(const GeometryGenerator::Vertex& v : mesh.Vertices)
+		{
+			Vertex vertex;
+			vertex.Pos = v.Position;
+			vertex.Color = shape.Color;
+			vertices.push_back(vertex);
+		}
+
+		// The cached meshes are shared and immutable, so they are not converted with
+		// GetIndices16; meshes this small always get 16-bit indices.
+		if(!mesh.Uses16BitIndices())
+			throw std::overflow_error("ShapesApp: a shape has too many vertices for 16-bit indices.");
+		indices.insert(indices.end(), mesh.Indices16.begin(), mesh.Indices16.end());
+	}
 
     const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
     const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
-
     //   
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
@@ -645,23 +886,12 @@ void ShapesApp::BuildShapeGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["grid"] = gridSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-
-	mGeometries[geo->Name] = std::move(geo);
+	return geo;
 }
 
 void ShapesApp::BuildPSOs()
@@ -674,15 +904,17 @@ void ShapesApp::BuildPSOs()
     ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
 	opaquePsoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
 	opaquePsoDesc.pRootSignature = mRootSignature.Get();
+	ID3DBlob* standardVS = mShaders[mShaders.Get("standardVS")].Get();
+	ID3DBlob* opaquePS = mShaders[mShaders.Get("opaquePS")].Get();
 	opaquePsoDesc.VS = 
 	{ 
-		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()), 
-		mShaders["standardVS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(standardVS->GetBufferPointer()), 
+		standardVS->GetBufferSize()
 	};
 	opaquePsoDesc.PS = 
 	{ 
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(opaquePS->GetBufferPointer()),
+		opaquePS->GetBufferSize()
 	};
 	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
     opaquePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID; //D3D12_FILL_MODE_WIREFRAME
@@ -695,7 +927,8 @@ void ShapesApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+    mOpaquePso = mPSOs.Intern("opaque");
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs[mOpaquePso])));
 
 
     //
@@ -704,7 +937,27 @@ void ShapesApp::BuildPSOs()
 
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
     opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
+    mOpaqueWireframePso = mPSOs.Intern("opaque_wireframe");
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&mPSOs[mOpaqueWireframePso])));
+
+    //
+    // PSOs for instanced draws.
+    //
+
+    ID3DBlob* instancedVS = mShaders[mShaders.Get("instancedVS")].Get();
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedPsoDesc = opaquePsoDesc;
+    instancedPsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(instancedVS->GetBufferPointer()),
+        instancedVS->GetBufferSize()
+    };
+    mInstancedPso = mPSOs.Intern("opaque_instanced");
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&instancedPsoDesc, IID_PPV_ARGS(&mPSOs[mInstancedPso])));
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedWireframePsoDesc = instancedPsoDesc;
+    instancedWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+    mInstancedWireframePso = mPSOs.Intern("opaque_instanced_wireframe");
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&instancedWireframePsoDesc, IID_PPV_ARGS(&mPSOs[mInstancedWireframePso])));
 }
 
 
@@ -715,113 +968,243 @@ void ShapesApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size()));
+            1, mObjCBCount, mObjCBCount, mRecorder.MaxChunks()));
+    }
+
+    // The frame resources share the chunk command lists; each list is reset with the
+    // allocator of the current frame resource.
+    for(std::uint32_t i = 0; i < mRecorder.MaxChunks(); ++i)
+    {
+        ComPtr<ID3D12GraphicsCommandList> cmdList;
+        ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+            mFrameResources[0]->CmdListAllocs[i].Get(), nullptr, IID_PPV_ARGS(cmdList.GetAddressOf())));
+        ThrowIfFailed(cmdList->Close());
+
+        mChunkSubmitLists.push_back(cmdList.Get());
+        mChunkCmdLists.push_back(cmdList);
+        mChunkStreams.push_back(std::make_unique<CommandStream>());
     }
 }
 
 void ShapesApp::BuildRenderItems()
 {
-	auto boxRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
-	boxRitem->ObjCBIndex = 0;
-	boxRitem->Geo = mGeometries["shapeGeo"].get();
-	boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(boxRitem));
-
-    auto gridRitem = std::make_unique<RenderItem>();
-    gridRitem->World = MathHelper::Identity4x4();
-	gridRitem->ObjCBIndex = 1;
-	gridRitem->Geo = mGeometries["shapeGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(gridRitem));
+	auto geoHandle = mGeometries.Get("shapeGeo");
+	MeshGeometry* geo = mGeometries[geoHandle].get();
+
+	// Submesh handles double as the submesh ids that instancing groups items by.
+	UINT objCBIndex = 0;
+	auto lodLevel = [&](const char* submeshName, float minScreenSize)
+	{
+		SubmeshHandle handle = mSubmeshes.Get(submeshName);
+		const SubmeshGeometry& submesh = mSubmeshes[handle];
+
+		LodLevel level;
+		level.DrawArgs.IndexCount = submesh.IndexCount;
+		level.DrawArgs.StartIndexLocation = submesh.StartIndexLocation;
+		level.DrawArgs.BaseVertexLocation = submesh.BaseVertexLocation;
+		level.SubmeshId = handle.Index;
+		level.MinScreenSize = minScreenSize;
+		return level;
+	};
+
+	const LodLevel cylinderLevels[] =
+	{
+		lodLevel("cylinder", 0.15f),
+		lodLevel("cylinder_lod1", 0.06f),
+		lodLevel("cylinder_lod2", 0.0f),
+	};
+	const LodLevel sphereLevels[] =
+	{
+		lodLevel("sphere", 0.1f),
+		lodLevel("sphere_lod1", 0.04f),
+		lodLevel("sphere_lod2", 0.0f),
+	};
+	std::uint32_t cylinderLod = mLods.AddTable(cylinderLevels, _countof(cylinderLevels));
+	std::uint32_t sphereLod = mLods.AddTable(sphereLevels, _countof(sphereLevels));
+
+	auto addRitem = [&](TransformHandle parent, const LocalTransform& local, const char* submeshName,
+		bool occluder, std::uint32_t lodTable)
+	{
+		SubmeshHandle handle = mSubmeshes.Get(submeshName);
+		const SubmeshGeometry& submesh = mSubmeshes[handle];
+
+		// The world matrix is set by mTransforms.
+		RenderItemDesc desc;
+		desc.ObjCBIndex = objCBIndex++;
+		desc.Geo = geo;
+		desc.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		desc.DrawArgs.IndexCount = submesh.IndexCount;
+		desc.DrawArgs.StartIndexLocation = submesh.StartIndexLocation;
+		desc.DrawArgs.BaseVertexLocation = submesh.BaseVertexLocation;
+		desc.Bounds = submesh.Bounds;
+		desc.Ids.GeoId = geoHandle.Index;
+		desc.Ids.SubmeshId = handle.Index;
+		desc.Occluder = occluder;
+		desc.LodTable = lodTable;
+
+		return mTransforms.Add(parent, local, mRitems.Add(desc));
+	};
+
+	auto translation = [](float x, float y, float z)
+	{
+		LocalTransform local;
+		local.Translation = XMFLOAT3(x, y, z);
+		return local;
+	};
+
+	// Groups that do not move together are separate roots, so TransformHierarchy can
+	// update them in parallel.
+	TransformHandle root;
+
+	LocalTransform boxLocal = translation(0.0f, 0.5f, 0.0f);
+	boxLocal.Scale = XMFLOAT3(2.0f, 2.0f, 2.0f);
+	// The box and the cylinders hide what is behind them; the grid is seen edge on
+	// and the spheres are small.
+	addRitem(root, boxLocal, "box", true, LodSelector::NoTable);
+	addRitem(root, LocalTransform(), "grid", false, LodSelector::NoTable);
 
     //յ   ٷ ġѴ.
-	UINT objCBIndex = 2;
+	// Each sphere is a child of the cylinder it rests on.
 	for(int i = 0; i < 5; ++i)
 	{
-		auto leftCylRitem = std::make_unique<RenderItem>();
-		auto rightCylRitem = std::make_unique<RenderItem>();
-		auto leftSphereRitem = std::make_unique<RenderItem>();
-		auto rightSphereRitem = std::make_unique<RenderItem>();
-
-		XMMATRIX leftCylWorld = XMMatrixTranslation(-5.0f, 1.5f, -10.0f + i*5.0f);
-		XMMATRIX rightCylWorld = XMMatrixTranslation(+5.0f, 1.5f, -10.0f + i*5.0f);
-
-		XMMATRIX leftSphereWorld = XMMatrixTranslation(-5.0f, 3.5f, -10.0f + i*5.0f);
-		XMMATRIX rightSphereWorld = XMMatrixTranslation(+5.0f, 3.5f, -10.0f + i*5.0f);
-
-		XMStoreFloat4x4(&leftCylRitem->World, rightCylWorld);
-		leftCylRitem->ObjCBIndex = objCBIndex++;
-		leftCylRitem->Geo = mGeometries["shapeGeo"].get();
-		leftCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-
-		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
-		rightCylRitem->ObjCBIndex = objCBIndex++;
-		rightCylRitem->Geo = mGeometries["shapeGeo"].get();
-		rightCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-
-		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
-		leftSphereRitem->ObjCBIndex = objCBIndex++;
-		leftSphereRitem->Geo = mGeometries["shapeGeo"].get();
-		leftSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-
-		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
-		rightSphereRitem->ObjCBIndex = objCBIndex++;
-		rightSphereRitem->Geo = mGeometries["shapeGeo"].get();
-		rightSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-
-		mAllRitems.push_back(std::move(leftCylRitem));
-		mAllRitems.push_back(std::move(rightCylRitem));
-		mAllRitems.push_back(std::move(leftSphereRitem));
-		mAllRitems.push_back(std::move(rightSphereRitem));
+		TransformHandle leftCyl = addRitem(root, translation(-5.0f, 1.5f, -10.0f + i*5.0f), "cylinder", true, cylinderLod);
+		addRitem(leftCyl, translation(0.0f, 2.0f, 0.0f), "sphere", false, sphereLod);
+
+		TransformHandle rightCyl = addRitem(root, translation(+5.0f, 1.5f, -10.0f + i*5.0f), "cylinder", true, cylinderLod);
+		addRitem(rightCyl, translation(0.0f, 2.0f, 0.0f), "sphere", false, sphereLod);
 	}
 
-	//     ׸ ϴ.
-	for(auto& e : mAllRitems)
-		mOpaqueRitems.push_back(e.get());
+	mObjCBCount = objCBIndex;
 }
 
-void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ShapesApp::SortRenderItems(const std::vector<std::uint32_t>& ritems, std::vector<std::uint32_t>& sorted)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
- 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+
+	const std::vector<XMFLOAT4X4>& world = mRitems.World();
+	const std::vector<RenderItemIds>& ids = mRitems.Ids();
+	std::vector<std::uint64_t>& sortKey = mRitems.SortKey();
+
+	mSortEntries.resize(ritems.size());
+	for(size_t i = 0; i < ritems.size(); ++i)
+	{
+		std::uint32_t ri = ritems[i];
+
+		// View space depth of the item's origin.
+		XMVECTOR origin = XMVectorSet(world[ri]._41, world[ri]._42, world[ri]._43, 1.0f);
+		float depth = XMVectorGetZ(XMVector3TransformCoord(origin, view));
+
+		sortKey[ri] = RenderSort::MakeKey(0, ids[ri].PsoId, ids[ri].GeoId, ids[ri].MaterialId, depth, mMainPassCB.FarZ);
+		mSortEntries[i] = { sortKey[ri], ri };
+	}
+
+	RenderSort::Sort(mSortEntries, mSortScratch);
+
+	sorted.resize(ritems.size());
+	for(size_t i = 0; i < ritems.size(); ++i)
+		sorted[i] = mSortEntries[i].Index;
+}
+
+void ShapesApp::BuildInstanceBatches(const std::vector<std::uint32_t>& sorted)
+{
+	const std::vector<XMFLOAT4X4>& world = mRitems.World();
+	const std::vector<RenderItemIds>& ids = mRitems.Ids();
+	const std::vector<std::uint64_t>& sortKey = mRitems.SortKey();
+
+	// Group the sorted items by submesh within each run of equal state.  The sort is
+	// stable, so the instances of a batch stay in front to back order.
+	mSortEntries.resize(sorted.size());
+	for(size_t i = 0; i < sorted.size(); ++i)
+	{
+		std::uint32_t ri = sorted[i];
+		mSortEntries[i] = { RenderSort::ReplaceDepth(sortKey[ri], ids[ri].SubmeshId), ri };
+	}
+
+	RenderSort::Sort(mSortEntries, mSortScratch);
+
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+
+	mInstanceBatches.clear();
+	for(size_t i = 0; i < mSortEntries.size(); ++i)
+	{
+		std::uint32_t ri = mSortEntries[i].Index;
+
+		if(i == 0 || mSortEntries[i].Key != mSortEntries[i - 1].Key)
+		{
+			InstanceBatch batch;
+			batch.First = ri;
+			batch.BaseInstance = (UINT)i;
+			mInstanceBatches.push_back(batch);
+		}
+		mInstanceBatches.back().InstanceCount++;
+
+		InstanceData instanceData;
+		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(XMLoadFloat4x4(&world[ri])));
+		instanceBuffer->CopyData((int)i, instanceData);
+	}
+}
+
+void ShapesApp::BindInputAssembler(CommandStream& stream, std::uint32_t ritem)
+{
+    // The stream drops the buffers and topology that are already bound; the items are
+    // sorted, so most items find them bound.
+    MeshGeometry* geo = mRitems.Geo()[ritem];
+
+    D3D12_VERTEX_BUFFER_VIEW vbv = geo->VertexBufferView();
+    stream.SetVertexBuffer(0, vbv.BufferLocation, vbv.SizeInBytes, vbv.StrideInBytes);
+
+    D3D12_INDEX_BUFFER_VIEW ibv = geo->IndexBufferView();
+    stream.SetIndexBuffer(ibv.BufferLocation, ibv.SizeInBytes, ibv.Format);
+
+    stream.SetPrimitiveTopology(mRitems.PrimitiveType()[ritem]);
+}
+
+void ShapesApp::DrawRenderItems(CommandStream& stream, const std::uint32_t* ritems, std::uint32_t count)
+{
+	const std::vector<UINT>& objCBIndex = mRitems.ObjCBIndex();
+	const std::vector<RenderItemDrawArgs>& drawArgs = mRitems.DrawArgs();
+
+	auto heapStart = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
 
     //   ׸ :
-    for(size_t i = 0; i < ritems.size(); ++i)
+    for(std::uint32_t i = 0; i < count; ++i)
     {
         auto ri = ritems[i];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+        BindInputAssembler(stream, ri);
 
         //   ڿ     ü 
         // CBV  Ѵ.
-        UINT cbvIndex = mCurrFrameResourceIndex*(UINT)mOpaqueRitems.size() + ri->ObjCBIndex;
-        auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+        UINT cbvIndex = mCurrFrameResourceIndex*mObjCBCount + objCBIndex[ri];
+        auto cbvHandle = heapStart;
         cbvHandle.Offset(cbvIndex, mCbvSrvUavDescriptorSize);
 
-        cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
+        stream.SetRootDescriptorTable(0, cbvHandle.ptr);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+        stream.DrawIndexedInstanced(drawArgs[ri].IndexCount, 1, drawArgs[ri].StartIndexLocation, drawArgs[ri].BaseVertexLocation, 0);
     }
 }
+
+void ShapesApp::DrawInstanceBatches(CommandStream& stream, std::uint32_t begin, std::uint32_t end)
+{
+    auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+    stream.SetRootShaderResourceView(2, instanceBuffer->GetGPUVirtualAddress());
+
+    for(std::uint32_t i = begin; i < end; ++i)
+    {
+        const InstanceBatch& batch = mInstanceBatches[i];
+        const RenderItemDrawArgs& drawArgs = mRitems.DrawArgs()[batch.First];
+
+        BindInputAssembler(stream, batch.First);
+
+        stream.SetRoot32BitConstant(3, batch.BaseInstance, 0);
+        stream.DrawIndexedInstanced(drawArgs.IndexCount, batch.InstanceCount, drawArgs.StartIndexLocation, drawArgs.BaseVertexLocation, 0);
+    }
+}
+
+std::wstring ShapesApp::FrameStatsText()const
+{
+	return L"   draws: " + std::to_wstring(mDrawStats.DrawCalls) +
+		L"   state changes: " + std::to_wstring(mDrawStats.StateChanges) +
+		L" (" + std::to_wstring(mDrawStats.StateChangesSaved) + L" saved)";
+}
@@ -0,0 +1,245 @@
+//***************************************************************************************
+// TransformHierarchy.cpp
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+using namespace DirectX;
+
+void TransformHierarchy::Reserve(std::uint32_t capacity)
+{
+	mParent.reserve(capacity);
+	mSubtreeSize.reserve(capacity);
+	mLocal.reserve(capacity);
+	mWorld.reserve(capacity);
+	mItem.reserve(capacity);
+	mNodeSlots.reserve(capacity);
+	mDirtyQueued.reserve(capacity);
+}
+
+TransformHandle TransformHierarchy::Add(TransformHandle parent, const LocalTransform& local, RenderItemHandle item)
+{
+	std::uint32_t parentIndex = InvalidIndex;
+	std::uint32_t index = Size();
+	if(parent.Slot != InvalidIndex)
+	{
+		if(!IsValid(parent))
+			throw std::invalid_argument("TransformHierarchy: parent is stale.");
+
+		parentIndex = mSlots[parent.Slot].Index;
+		index = parentIndex + mSubtreeSize[parentIndex];
+	}
+
+	std::uint32_t slot;
+	if(!mFreeSlots.empty())
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (std::uint32_t)mSlots.size();
+		mSlots.push_back(Slot());
+	}
+
+	mParent.insert(mParent.begin() + index, parentIndex);
+	mSubtreeSize.insert(mSubtreeSize.begin() + index, 1);
+	mLocal.insert(mLocal.begin() + index, local);
+	mWorld.insert(mWorld.begin() + index, MathHelper::Identity4x4());
+	mItem.insert(mItem.begin() + index, item);
+	mNodeSlots.insert(mNodeSlots.begin() + index, slot);
+	mDirtyQueued.insert(mDirtyQueued.begin() + index, 0);
+
+	for(std::uint32_t i = parentIndex; i != InvalidIndex; i = mParent[i])
+		mSubtreeSize[i]++;
+
+	// Fix up the nodes after the new one, none if it was appended.
+	for(std::uint32_t i = index; i < Size(); ++i)
+	{
+		if(i > index && mParent[i] != InvalidIndex && mParent[i] >= index)
+			mParent[i]++;
+
+		mSlots[mNodeSlots[i]].Index = i;
+	}
+
+	TransformHandle handle;
+	handle.Slot = slot;
+	handle.Generation = mSlots[slot].Generation;
+
+	mDirtyQueued[index] = 1;
+	mDirtyNodes.push_back(handle);
+
+	return handle;
+}
+
+bool TransformHierarchy::Remove(TransformHandle node)
+{
+	if(!IsValid(node))
+		return false;
+
+	std::uint32_t begin = mSlots[node.Slot].Index;
+	std::uint32_t count = mSubtreeSize[begin];
+	std::uint32_t end = begin + count;
+
+	for(std::uint32_t i = mParent[begin]; i != InvalidIndex; i = mParent[i])
+		mSubtreeSize[i] -= count;
+
+	// Bumping the generations makes every copy of the removed handles stale, including
+	// the ones on the dirty list.
+	for(std::uint32_t i = begin; i < end; ++i)
+	{
+		Slot& slot = mSlots[mNodeSlots[i]];
+		slot.Index = InvalidIndex;
+		slot.Generation++;
+		mFreeSlots.push_back(mNodeSlots[i]);
+	}
+
+	mParent.erase(mParent.begin() + begin, mParent.begin() + end);
+	mSubtreeSize.erase(mSubtreeSize.begin() + begin, mSubtreeSize.begin() + end);
+	mLocal.erase(mLocal.begin() + begin, mLocal.begin() + end);
+	mWorld.erase(mWorld.begin() + begin, mWorld.begin() + end);
+	mItem.erase(mItem.begin() + begin, mItem.begin() + end);
+	mNodeSlots.erase(mNodeSlots.begin() + begin, mNodeSlots.begin() + end);
+	mDirtyQueued.erase(mDirtyQueued.begin() + begin, mDirtyQueued.begin() + end);
+
+	for(std::uint32_t i = begin; i < Size(); ++i)
+	{
+		if(mParent[i] != InvalidIndex && mParent[i] >= end)
+			mParent[i] -= count;
+
+		mSlots[mNodeSlots[i]].Index = i;
+	}
+
+	return true;
+}
+
+bool TransformHierarchy::IsValid(TransformHandle node)const
+{
+	return node.Slot < mSlots.size() &&
+		mSlots[node.Slot].Generation == node.Generation &&
+		mSlots[node.Slot].Index != InvalidIndex;
+}
+
+std::uint32_t TransformHierarchy::IndexOf(TransformHandle node)const
+{
+	assert(IsValid(node));
+	return mSlots[node.Slot].Index;
+}
+
+const LocalTransform& TransformHierarchy::GetLocal(TransformHandle node)const
+{
+	return mLocal[IndexOf(node)];
+}
+
+void TransformHierarchy::SetLocal(TransformHandle node, const LocalTransform& local)
+{
+	std::uint32_t index = IndexOf(node);
+	mLocal[index] = local;
+
+	if(!mDirtyQueued[index])
+	{
+		mDirtyQueued[index] = 1;
+		mDirtyNodes.push_back(node);
+	}
+}
+
+void TransformHierarchy::SetRenderItem(TransformHandle node, RenderItemHandle item)
+{
+	mItem[IndexOf(node)] = item;
+}
+
+const XMFLOAT4X4& TransformHierarchy::GetWorld(TransformHandle node)const
+{
+	return mWorld[IndexOf(node)];
+}
+
+void TransformHierarchy::UpdateRange(std::uint32_t begin, std::uint32_t end)
+{
+	for(std::uint32_t i = begin; i < end; ++i)
+	{
+		const LocalTransform& local = mLocal[i];
+		XMMATRIX world = XMMatrixAffineTransformation(
+			XMLoadFloat3(&local.Scale),
+			XMVectorZero(),
+			XMLoadFloat4(&local.Rotation),
+			XMLoadFloat3(&local.Translation));
+
+		// The parent is either outside the range and up to date, or earlier in it.
+		if(mParent[i] != InvalidIndex)
+			world = XMMatrixMultiply(world, XMLoadFloat4x4(&mWorld[mParent[i]]));
+
+		XMStoreFloat4x4(&mWorld[i], world);
+	}
+}
+
+void TransformHierarchy::Update(RenderItemStore& items)
+{
+	mDirtyIndices.clear();
+	for(const TransformHandle& node : mDirtyNodes)
+	{
+		if(IsValid(node))
+			mDirtyIndices.push_back(mSlots[node.Slot].Index);
+	}
+	mDirtyNodes.clear();
+
+	// Merge the dirty nodes into the ranges of the outermost dirty subtrees.  Visiting
+	// them in index order, a node inside the previous range is a descendant of its
+	// root.  When many nodes are dirty, scanning the flags is cheaper than sorting.
+	mDirtyRanges.clear();
+	std::uint32_t nodeCount = 0;
+	auto addRange = [&](std::uint32_t index)
+	{
+		Range range;
+		range.Begin = index;
+		range.End = index + mSubtreeSize[index];
+		mDirtyRanges.push_back(range);
+		nodeCount += mSubtreeSize[index];
+		return range.End;
+	};
+
+	if(mDirtyIndices.size()*64 > Size())
+	{
+		for(std::uint32_t i = 0; i < Size(); )
+			i = mDirtyQueued[i] ? addRange(i) : i + 1;
+	}
+	else
+	{
+		std::sort(mDirtyIndices.begin(), mDirtyIndices.end());
+		for(std::uint32_t index : mDirtyIndices)
+		{
+			if(mDirtyRanges.empty() || index >= mDirtyRanges.back().End)
+				addRange(index);
+		}
+	}
+
+	for(std::uint32_t index : mDirtyIndices)
+		mDirtyQueued[index] = 0;
+
+	if(nodeCount < ParallelNodeCount || mDirtyRanges.size() == 1)
+	{
+		for(const Range& range : mDirtyRanges)
+			UpdateRange(range.Begin, range.End);
+	}
+	else
+	{
+		ThreadPool::Default().ParallelFor(mDirtyRanges.size(), 1, [this](size_t begin, size_t end)
+		{
+			for(size_t r = begin; r < end; ++r)
+				UpdateRange(mDirtyRanges[r].Begin, mDirtyRanges[r].End);
+		});
+	}
+
+	// SetWorld queues items on shared dirty lists, so it runs on this thread.
+	for(const Range& range : mDirtyRanges)
+	{
+		for(std::uint32_t i = range.Begin; i < range.End; ++i)
+		{
+			if(items.IsValid(mItem[i]))
+				items.SetWorld(items.IndexOf(mItem[i]), mWorld[i]);
+		}
+	}
+}
@@ -0,0 +1,123 @@
+//***************************************************************************************
+// TransformHierarchy.h
+//
+// A tree of transforms.  Each node has a local scale, rotation and translation
+// relative to its parent and caches its world matrix, local*parentWorld.
+//
+// Nodes are stored in depth-first order, so every subtree occupies a contiguous index
+// range that starts at its root and every parent comes before its children.  Setting
+// a node's local transform queues it as dirty, and Update recomputes only the
+// subtrees of the queued nodes, front to back, in one pass over each subtree's range.
+// Dirty subtrees do not overlap and read nothing the others write, so they are updated
+// in parallel on ThreadPool::Default().
+//
+// A node can drive a render item: Update copies the node's new world matrix into the
+// item with RenderItemStore::SetWorld, which queues the item's constants for upload.
+//
+// Adding a node inserts it after its parent's last descendant and shifts every later
+// node, so build trees in depth-first order, where each insertion is an append.
+//***************************************************************************************
+
+#pragma once
+
+#include "RenderItemStore.h"
+
+struct TransformHandle
+{
+	std::uint32_t Slot = 0xffffffff;
+	std::uint32_t Generation = 0;
+};
+
+struct LocalTransform
+{
+	DirectX::XMFLOAT3 Scale = { 1.0f, 1.0f, 1.0f };
+
+	// Unit quaternion.
+	DirectX::XMFLOAT4 Rotation = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	DirectX::XMFLOAT3 Translation = { 0.0f, 0.0f, 0.0f };
+};
+
+class TransformHierarchy
+{
+public:
+	// Dirty subtrees with fewer nodes than this in total are updated on the calling
+	// thread.
+	static const std::uint32_t ParallelNodeCount = 1024;
+
+	TransformHierarchy() = default;
+	TransformHierarchy(const TransformHierarchy& rhs) = delete;
+	TransformHierarchy& operator=(const TransformHierarchy& rhs) = delete;
+
+	void Reserve(std::uint32_t capacity);
+
+	// Adds a dirty node as the last child of parent, or as a root if parent is a
+	// default constructed handle, that drives item if item is not a default constructed
+	// handle.  Throws std::invalid_argument if parent is stale.
+	TransformHandle Add(TransformHandle parent, const LocalTransform& local,
+		RenderItemHandle item = RenderItemHandle());
+
+	// Removes the node and all its descendants, but not their render items.  Returns
+	// false if node is stale.
+	bool Remove(TransformHandle node);
+
+	bool IsValid(TransformHandle node)const;
+
+	// Current index of a valid handle's node; valid until the next Add or Remove.
+	std::uint32_t IndexOf(TransformHandle node)const;
+
+	std::uint32_t Size()const { return (std::uint32_t)mParent.size(); }
+
+	const LocalTransform& GetLocal(TransformHandle node)const;
+
+	// Sets the node's local transform and queues it as dirty.
+	void SetLocal(TransformHandle node, const LocalTransform& local);
+
+	void SetRenderItem(TransformHandle node, RenderItemHandle item);
+
+	// The world matrix as of the last Update.
+	const DirectX::XMFLOAT4X4& GetWorld(TransformHandle node)const;
+
+	// Recomputes the world matrices of the dirty nodes and their descendants and sets
+	// them on the render items the nodes drive.  Items that are no longer in items are
+	// skipped.
+	void Update(RenderItemStore& items);
+
+private:
+	static const std::uint32_t InvalidIndex = 0xffffffff;
+
+	struct Slot
+	{
+		std::uint32_t Index = InvalidIndex;
+		std::uint32_t Generation = 0;
+	};
+
+	struct Range
+	{
+		std::uint32_t Begin;
+		std::uint32_t End;
+	};
+
+	void UpdateRange(std::uint32_t begin, std::uint32_t end);
+
+	// Per node arrays in depth-first order.  Roots have InvalidIndex parents.
+	std::vector<std::uint32_t> mParent;
+	std::vector<std::uint32_t> mSubtreeSize;
+	std::vector<LocalTransform> mLocal;
+	std::vector<DirectX::XMFLOAT4X4> mWorld;
+	std::vector<RenderItemHandle> mItem;
+	std::vector<std::uint32_t> mNodeSlots;
+
+	// Set while the node is on mDirtyNodes.
+	std::vector<std::uint8_t> mDirtyQueued;
+
+	// Handles rather than indices, which Add and Remove would invalidate.
+	std::vector<TransformHandle> mDirtyNodes;
+
+	// Scratch space of Update.
+	std::vector<std::uint32_t> mDirtyIndices;
+	std::vector<Range> mDirtyRanges;
+
+	std::vector<Slot> mSlots;
+	std::vector<std::uint32_t> mFreeSlots;
+};
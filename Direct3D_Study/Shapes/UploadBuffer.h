@@ -56,6 +56,19 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // The mapped memory, for writers that fill many elements at once.  Element i
+    // starts at MappedData() + i*ElementByteSize().  Upload heaps are write-combined,
+    // so write it sequentially and never read it back.
+    BYTE* MappedData()const
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
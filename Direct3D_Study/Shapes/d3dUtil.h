@@ -157,6 +157,11 @@ struct SubmeshGeometry
     //  κ ޽ð ϴ ϱ  (ٿ ڽ)
     //  ڴ  å  鿡 δ.
 	DirectX::BoundingBox Bounds;
+
+	// Decode metadata for quantized (GeometryGenerator::PackedVertex) positions:
+	// PosL = quantizedPos*PositionScale + PositionBias.  Identity for float vertices.
+	DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
 };
 
 struct MeshGeometry
@@ -0,0 +1,341 @@
+//***************************************************************************************
+// BoundingVolumeHierarchyTests.cpp
+//***************************************************************************************
+
+#include "Tests.h"
+#include "../Common/BoundingVolumeHierarchy.h"
+#include "../Common/FrustumCuller.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// The brute force tests run on every box grown and shrunk by this much.  A box
+	// that passes even when shrunk must be found, and one that fails even when grown
+	// must not be; the boxes in between are too close to call in float.
+	const float Tolerance = 1e-3f;
+
+	struct Box
+	{
+		XMFLOAT3 Min;
+		XMFLOAT3 Max;
+	};
+
+	Box Grow(const BoundingBox& box, float amount)
+	{
+		Box b;
+		b.Min = XMFLOAT3(box.Center.x - box.Extents.x - amount, box.Center.y - box.Extents.y - amount,
+			box.Center.z - box.Extents.z - amount);
+		b.Max = XMFLOAT3(box.Center.x + box.Extents.x + amount, box.Center.y + box.Extents.y + amount,
+			box.Center.z + box.Extents.z + amount);
+		return b;
+	}
+
+	bool Empty(const Box& b)
+	{
+		return b.Min.x > b.Max.x || b.Min.y > b.Max.y || b.Min.z > b.Max.z;
+	}
+
+	bool FrustumPasses(const XMFLOAT4 planes[6], const Box& b)
+	{
+		for(int p = 0; p < 6; ++p)
+		{
+			// The corner farthest along the plane normal.
+			float x = planes[p].x >= 0.0f ? b.Max.x : b.Min.x;
+			float y = planes[p].y >= 0.0f ? b.Max.y : b.Min.y;
+			float z = planes[p].z >= 0.0f ? b.Max.z : b.Min.z;
+			if(planes[p].x*x + planes[p].y*y + planes[p].z*z + planes[p].w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	bool RayPasses(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, const Box& b)
+	{
+		float tEnter = 0.0f;
+		float tExit = maxDistance;
+
+		const float o[3] = { origin.x, origin.y, origin.z };
+		const float d[3] = { direction.x, direction.y, direction.z };
+		const float lo[3] = { b.Min.x, b.Min.y, b.Min.z };
+		const float hi[3] = { b.Max.x, b.Max.y, b.Max.z };
+		for(int a = 0; a < 3; ++a)
+		{
+			if(d[a] == 0.0f)
+			{
+				if(o[a] < lo[a] || o[a] > hi[a])
+					return false;
+				continue;
+			}
+
+			float t0 = (lo[a] - o[a]) / d[a];
+			float t1 = (hi[a] - o[a]) / d[a];
+			tEnter = std::max(tEnter, std::min(t0, t1));
+			tExit = std::min(tExit, std::max(t0, t1));
+		}
+		return tEnter <= tExit;
+	}
+
+	bool SpherePasses(const BoundingSphere& sphere, const Box& b)
+	{
+		float dx = std::max(std::max(b.Min.x - sphere.Center.x, sphere.Center.x - b.Max.x), 0.0f);
+		float dy = std::max(std::max(b.Min.y - sphere.Center.y, sphere.Center.y - b.Max.y), 0.0f);
+		float dz = std::max(std::max(b.Min.z - sphere.Center.z, sphere.Center.z - b.Max.z), 0.0f);
+		return dx*dx + dy*dy + dz*dz <= sphere.Radius*sphere.Radius;
+	}
+
+	bool BoxPasses(const Box& query, const Box& b)
+	{
+		return b.Min.x <= query.Max.x && b.Max.x >= query.Min.x &&
+			b.Min.y <= query.Max.y && b.Max.y >= query.Min.y &&
+			b.Min.z <= query.Max.z && b.Max.z >= query.Min.z;
+	}
+
+	struct Query
+	{
+		XMFLOAT4X4 ViewProj;
+		XMFLOAT3 Origin;
+		XMFLOAT3 Direction;
+		BoundingSphere Sphere;
+		BoundingBox Box;
+	};
+
+	class Scene
+	{
+	public:
+		Scene(std::uint32_t itemCount, std::uint32_t queryCount)
+			: mRng(12345), mBoxes(itemCount), mPresent(itemCount, true), mQueries(queryCount)
+		{
+			for(BoundingBox& box : mBoxes)
+				box = RandomBox();
+
+			// Cameras with a 250 unit far plane, rays of 500 units, a quarter of them
+			// along the x axis, and spheres and boxes 40 units across.
+			std::uniform_int_distribution<int> step(-4, 4);
+			XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f/9.0f, 1.0f, 250.0f);
+			for(std::uint32_t q = 0; q < queryCount; ++q)
+			{
+				Query& query = mQueries[q];
+
+				XMFLOAT3 eye = RandomPoint();
+				XMFLOAT3 target = RandomPoint();
+				if(target.x == eye.x && target.y == eye.y && target.z == eye.z)
+					target.z += 1.0f;
+				XMVECTOR up = std::fabs(target.y - eye.y) > std::fabs(target.x - eye.x) + std::fabs(target.z - eye.z) ?
+					XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+				XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&target), up);
+				XMStoreFloat4x4(&query.ViewProj, XMMatrixMultiply(view, proj));
+
+				query.Origin = RandomPoint();
+				float dx = (float)step(mRng);
+				float dy = (float)step(mRng);
+				float dz = (float)step(mRng);
+				if(q % 4 == 0)
+					dy = dz = 0.0f;
+				if(dx == 0.0f && dy == 0.0f && dz == 0.0f)
+					dx = 1.0f;
+				XMStoreFloat3(&query.Direction, XMVector3Normalize(XMVectorSet(dx, dy, dz, 0.0f)));
+
+				query.Sphere = BoundingSphere(RandomPoint(), 20.0f);
+				query.Box = BoundingBox(RandomPoint(), XMFLOAT3(20.0f, 20.0f, 20.0f));
+			}
+		}
+
+		// Points on a quarter unit grid through a cube a thousand units wide.
+		XMFLOAT3 RandomPoint()
+		{
+			std::uniform_int_distribution<int> coordinate(-2000, 2000);
+			float x = coordinate(mRng)*0.25f;
+			float y = coordinate(mRng)*0.25f;
+			float z = coordinate(mRng)*0.25f;
+			return XMFLOAT3(x, y, z);
+		}
+
+		// Boxes up to four units wide.
+		BoundingBox RandomBox()
+		{
+			std::uniform_int_distribution<int> extent(0, 8);
+			XMFLOAT3 center = RandomPoint();
+			float x = extent(mRng)*0.25f;
+			float y = extent(mRng)*0.25f;
+			float z = extent(mRng)*0.25f;
+			return BoundingBox(center, XMFLOAT3(x, y, z));
+		}
+
+		// Moves, removes and reinserts editCount random items.  Returns false if Remove
+		// disagreed about an item being in the tree.
+		bool Edit(BoundingVolumeHierarchy& bvh, std::uint32_t editCount)
+		{
+			bool agreed = true;
+			std::uniform_int_distribution<std::uint32_t> anyItem(0, (std::uint32_t)mBoxes.size() - 1);
+			for(std::uint32_t e = 0; e < editCount; ++e)
+			{
+				std::uint32_t item = anyItem(mRng);
+				switch(e % 3)
+				{
+				case 0:
+					mBoxes[item] = RandomBox();
+					if(mPresent[item])
+						bvh.Update(item, mBoxes[item]);
+					break;
+				case 1:
+					agreed &= bvh.Remove(item) == (bool)mPresent[item];
+					mPresent[item] = false;
+					break;
+				default:
+					mBoxes[item] = RandomBox();
+					bvh.Insert(item, mBoxes[item]);
+					mPresent[item] = true;
+					break;
+				}
+			}
+			return agreed;
+		}
+
+		// True if items, sorted, holds every present box that passes when shrunk and no
+		// box that fails when grown.
+		template<typename Passes>
+		bool Matches(std::vector<std::uint32_t>& items, const Passes& passes)const
+		{
+			std::sort(items.begin(), items.end());
+			if(std::adjacent_find(items.begin(), items.end()) != items.end())
+				return false;
+
+			size_t next = 0;
+			for(std::uint32_t i = 0; i < (std::uint32_t)mBoxes.size(); ++i)
+			{
+				bool listed = next < items.size() && items[next] == i;
+				if(listed)
+					next++;
+
+				if(!mPresent[i])
+				{
+					if(listed)
+						return false;
+					continue;
+				}
+
+				Box shrunk = Grow(mBoxes[i], -Tolerance);
+				if(!listed && !Empty(shrunk) && passes(shrunk))
+					return false;
+				if(listed && !passes(Grow(mBoxes[i], Tolerance)))
+					return false;
+			}
+			return next == items.size();
+		}
+
+		// Runs every query and checks it by brute force; adds the time of each kind of
+		// query to milliseconds.
+		bool RunQueries(const BoundingVolumeHierarchy& bvh, double milliseconds[4])const
+		{
+			bool matches = true;
+			std::vector<std::uint32_t> items;
+			for(const Query& query : mQueries)
+			{
+				XMMATRIX viewProj = XMLoadFloat4x4(&query.ViewProj);
+				XMVECTOR origin = XMLoadFloat3(&query.Origin);
+				XMVECTOR direction = XMLoadFloat3(&query.Direction);
+
+				auto start = std::chrono::high_resolution_clock::now();
+				bvh.QueryFrustum(viewProj, items);
+				milliseconds[0] += MillisecondsSince(start);
+				XMFLOAT4 planes[6];
+				FrustumCuller::ExtractPlanes(viewProj, planes);
+				matches &= Matches(items, [&](const Box& b) { return FrustumPasses(planes, b); });
+
+				start = std::chrono::high_resolution_clock::now();
+				bvh.QueryRay(origin, direction, 500.0f, items);
+				milliseconds[1] += MillisecondsSince(start);
+				matches &= Matches(items, [&](const Box& b) { return RayPasses(query.Origin, query.Direction, 500.0f, b); });
+
+				start = std::chrono::high_resolution_clock::now();
+				bvh.QuerySphere(query.Sphere, items);
+				milliseconds[2] += MillisecondsSince(start);
+				matches &= Matches(items, [&](const Box& b) { return SpherePasses(query.Sphere, b); });
+
+				start = std::chrono::high_resolution_clock::now();
+				bvh.QueryBox(query.Box, items);
+				milliseconds[3] += MillisecondsSince(start);
+				Box queryBox = Grow(query.Box, 0.0f);
+				matches &= Matches(items, [&](const Box& b) { return BoxPasses(queryBox, b); });
+			}
+			return matches;
+		}
+
+		static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		const std::vector<BoundingBox>& Boxes()const { return mBoxes; }
+
+	private:
+		std::mt19937 mRng;
+		std::vector<BoundingBox> mBoxes;
+		std::vector<std::uint8_t> mPresent;
+		std::vector<Query> mQueries;
+	};
+
+	// Builds a tree over random boxes, checks random queries of each kind against every
+	// box, edits a tenth of the items and checks the queries again.
+	void CheckQueries(std::uint32_t itemCount, std::uint32_t queryCount, bool report)
+	{
+		Scene scene(itemCount, queryCount);
+
+		BoundingVolumeHierarchy bvh;
+		auto start = std::chrono::high_resolution_clock::now();
+		bvh.Build(scene.Boxes().data(), itemCount);
+		double buildMilliseconds = Scene::MillisecondsSince(start);
+		TEST_CHECK(bvh.ItemCount() == itemCount);
+
+		double milliseconds[4] = {};
+		TEST_CHECK(scene.RunQueries(bvh, milliseconds));
+
+		TEST_CHECK(scene.Edit(bvh, itemCount/10));
+		double editedMilliseconds[4] = {};
+		TEST_CHECK(scene.RunQueries(bvh, editedMilliseconds));
+
+		if(report)
+		{
+			std::printf("  %u boxes, built in %.2f ms\n", itemCount, buildMilliseconds);
+			const char* names[4] = { "frustum", "ray", "sphere", "box" };
+			for(int k = 0; k < 4; ++k)
+				std::printf("  %-8s %8.4f ms/query\n", names[k], milliseconds[k]/queryCount);
+		}
+	}
+}
+
+void TestBoundingVolumeHierarchy()
+{
+	CheckQueries(1, 20, false);
+	CheckQueries(5, 20, false);
+	CheckQueries(1000, 50, false);
+	CheckQueries(20000, 50, false);
+
+	// Every item in one spot makes a deep tree.
+	std::vector<BoundingBox> boxes(5000, BoundingBox(XMFLOAT3(1.0f, 2.0f, 3.0f), XMFLOAT3(0.5f, 0.5f, 0.5f)));
+	BoundingVolumeHierarchy bvh;
+	for(std::uint32_t i = 0; i < (std::uint32_t)boxes.size(); ++i)
+		bvh.Insert(i, boxes[i]);
+
+	std::vector<std::uint32_t> items;
+	bvh.QuerySphere(BoundingSphere(XMFLOAT3(1.0f, 2.0f, 3.0f), 0.1f), items);
+	TEST_CHECK(items.size() == boxes.size());
+
+	// A ray with a zero direction is a point.
+	bvh.QueryRay(XMVectorSet(1.0f, 2.0f, 3.0f, 1.0f), XMVectorZero(), 1.0f, items);
+	TEST_CHECK(items.size() == boxes.size());
+	bvh.QueryRay(XMVectorSet(5.0f, 2.0f, 3.0f, 1.0f), XMVectorZero(), 1.0f, items);
+	TEST_CHECK(items.empty());
+}
+
+void BenchBoundingVolumeHierarchy()
+{
+	CheckQueries(1000000, 100, true);
+}
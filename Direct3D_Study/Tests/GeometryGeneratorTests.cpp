@@ -0,0 +1,177 @@
+//***************************************************************************************
+// GeometryGeneratorTests.cpp
+//***************************************************************************************
+
+#include "Tests.h"
+#include "../Common/GeometryGenerator.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+using namespace DirectX;
+
+namespace
+{
+	using Generate = std::function<GeometryGenerator::MeshData(GeometryGenerator&)>;
+
+	bool SameBytes(const GeometryGenerator::MeshData& a, const GeometryGenerator::MeshData& b)
+	{
+		return a.Vertices.size() == b.Vertices.size() &&
+			a.Uses16BitIndices() == b.Uses16BitIndices() &&
+			a.Indices16 == b.Indices16 &&
+			a.Indices32 == b.Indices32 &&
+			std::memcmp(a.Vertices.data(), b.Vertices.data(), a.Vertices.size()*sizeof(GeometryGenerator::Vertex)) == 0;
+	}
+
+	bool Near(float a, float b, float tolerance = 1e-4f)
+	{
+		return std::fabs(a - b) <= tolerance;
+	}
+
+	float Length(const XMFLOAT3& v)
+	{
+		return std::sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
+	}
+
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x*b.x + a.y*b.y + a.z*b.z;
+	}
+
+	bool IndicesInRange(const GeometryGenerator::MeshData& mesh)
+	{
+		for(size_t i = 0; i < mesh.IndexCount(); ++i)
+		{
+			if(mesh.GetIndex(i) >= mesh.Vertices.size())
+				return false;
+		}
+		return mesh.IndexCount() % 3 == 0;
+	}
+
+	// The same mesh generated on the calling thread and split over the thread pool
+	// must be the same bytes.
+	void CheckThreadIndependent(const char* name, const Generate& generate)
+	{
+		GeometryGenerator serial;
+		serial.SetParallelThreshold(SIZE_MAX);
+
+		GeometryGenerator threaded;
+		threaded.SetParallelThreshold(0);
+
+		GeometryGenerator::MeshData expected = generate(serial);
+		GeometryGenerator::MeshData mesh = generate(threaded);
+		if(!SameBytes(expected, mesh))
+			std::printf("  %s: threaded output differs\n", name);
+		TEST_CHECK(SameBytes(expected, mesh));
+		TEST_CHECK(IndicesInRange(mesh));
+	}
+
+	void CheckSphere(float radius, std::uint32_t sliceCount, std::uint32_t stackCount)
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData mesh = geoGen.CreateSphere(radius, sliceCount, stackCount);
+
+		TEST_CHECK(mesh.Vertices.size() == (size_t)(stackCount - 1)*(sliceCount + 1) + 2);
+		TEST_CHECK(IndicesInRange(mesh));
+
+		bool onSphere = true;
+		bool unitFrame = true;
+		bool texCInRange = true;
+		for(const GeometryGenerator::Vertex& v : mesh.Vertices)
+		{
+			onSphere &= Near(Length(v.Position), radius, 1e-4f*radius);
+			onSphere &= Near(v.Normal.x*radius, v.Position.x, 1e-4f*radius) &&
+				Near(v.Normal.y*radius, v.Position.y, 1e-4f*radius) &&
+				Near(v.Normal.z*radius, v.Position.z, 1e-4f*radius);
+			unitFrame &= Near(Length(v.Normal), 1.0f) && Near(Length(v.TangentU), 1.0f) &&
+				Near(Dot(v.Normal, v.TangentU), 0.0f);
+			texCInRange &= v.TexC.x >= 0.0f && v.TexC.x <= 1.0f && v.TexC.y >= 0.0f && v.TexC.y <= 1.0f;
+		}
+		TEST_CHECK(onSphere);
+		TEST_CHECK(unitFrame);
+		TEST_CHECK(texCInRange);
+	}
+
+	void CheckCylinder(float bottomRadius, float topRadius, float height, std::uint32_t sliceCount,
+		std::uint32_t stackCount)
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData mesh = geoGen.CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount);
+
+		size_t sideVertexCount = (size_t)(stackCount + 1)*(sliceCount + 1);
+		TEST_CHECK(mesh.Vertices.size() == sideVertexCount + 2*(sliceCount + 2));
+		TEST_CHECK(IndicesInRange(mesh));
+
+		// The side normal is perpendicular to the slope of the side, (r0 - r1, h) in
+		// the radial plane.
+		float dr = bottomRadius - topRadius;
+		bool onSide = true;
+		bool unitFrame = true;
+		for(size_t i = 0; i < sideVertexCount; ++i)
+		{
+			const GeometryGenerator::Vertex& v = mesh.Vertices[i];
+
+			float y = v.Position.y + 0.5f*height;
+			float r = bottomRadius - dr*y/height;
+			onSide &= Near(std::sqrt(v.Position.x*v.Position.x + v.Position.z*v.Position.z), r, 1e-4f*(1.0f + r));
+
+			float normalXZ = std::sqrt(v.Normal.x*v.Normal.x + v.Normal.z*v.Normal.z);
+			onSide &= Near(v.Normal.y*height, dr*normalXZ, 1e-4f*(height + std::fabs(dr)));
+			onSide &= Near(v.Normal.x*v.Position.z, v.Normal.z*v.Position.x, 1e-4f*(1.0f + r));
+
+			unitFrame &= Near(Length(v.Normal), 1.0f) && Near(Length(v.TangentU), 1.0f) &&
+				Near(Dot(v.Normal, v.TangentU), 0.0f);
+		}
+		TEST_CHECK(onSide);
+		TEST_CHECK(unitFrame);
+
+		// Caps face straight up and down.
+		bool capsFlat = true;
+		for(size_t i = sideVertexCount; i < mesh.Vertices.size(); ++i)
+		{
+			const GeometryGenerator::Vertex& v = mesh.Vertices[i];
+			capsFlat &= Near(std::fabs(v.Position.y), 0.5f*height) && Near(std::fabs(v.Normal.y), 1.0f) &&
+				(v.Normal.y > 0.0f) == (v.Position.y > 0.0f);
+		}
+		TEST_CHECK(capsFlat);
+	}
+}
+
+void TestGeometryGenerator()
+{
+	const std::uint32_t tessellations[][2] =
+	{
+		{ 3, 2 }, { 4, 3 }, { 5, 5 }, { 20, 20 }, { 33, 17 }, { 256, 256 }, { 1023, 64 },
+	};
+
+	for(const auto& t : tessellations)
+	{
+		std::uint32_t slices = t[0];
+		std::uint32_t stacks = t[1];
+
+		CheckSphere(0.5f, slices, stacks);
+		CheckCylinder(0.5f, 0.3f, 3.0f, slices, stacks);
+		CheckCylinder(1.0f, 1.0f, 0.5f, slices, stacks);
+
+		CheckThreadIndependent("sphere", [=](GeometryGenerator& g) { return g.CreateSphere(0.5f, slices, stacks); });
+		CheckThreadIndependent("cylinder", [=](GeometryGenerator& g) { return g.CreateCylinder(0.5f, 0.3f, 3.0f, slices, stacks); });
+		CheckThreadIndependent("grid", [=](GeometryGenerator& g) { return g.CreateGrid(20.0f, 30.0f, slices + 1, stacks + 1); });
+	}
+
+	CheckThreadIndependent("box", [](GeometryGenerator& g) { return g.CreateBox(1.5f, 0.5f, 1.5f, 3); });
+	for(std::uint32_t depth = 0; depth <= 6; ++depth)
+		CheckThreadIndependent("geosphere", [=](GeometryGenerator& g) { return g.CreateGeosphere(1.0f, depth); });
+
+	// An index past 16 bits widens the indices instead of being truncated.
+	GeometryGenerator::MeshData mesh;
+	mesh.ResetIndices(3, 3);
+	mesh.AddIndex(0);
+	mesh.AddIndex(0xffff);
+	TEST_CHECK(mesh.Uses16BitIndices());
+	mesh.AddIndex(0x10000);
+	TEST_CHECK(!mesh.Uses16BitIndices() && mesh.Indices16.empty());
+	TEST_CHECK(mesh.IndexCount() == 3);
+	TEST_CHECK(mesh.GetIndex(0) == 0 && mesh.GetIndex(1) == 0xffff && mesh.GetIndex(2) == 0x10000);
+}
@@ -0,0 +1,163 @@
+//***************************************************************************************
+// MeshCacheTests.cpp
+//***************************************************************************************
+
+#include "Tests.h"
+#include "../Common/MeshCache.h"
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	size_t MeshBytes(const GeometryGenerator::MeshData& mesh)
+	{
+		return mesh.Vertices.size()*sizeof(GeometryGenerator::Vertex) +
+			mesh.Indices32.size()*sizeof(std::uint32_t) +
+			mesh.Indices16.size()*sizeof(std::uint16_t);
+	}
+
+	bool Throws(MeshCache& cache, const MeshKey& key)
+	{
+		try
+		{
+			cache.GetMesh(key);
+		}
+		catch(const std::invalid_argument&)
+		{
+			return true;
+		}
+		return false;
+	}
+
+	void CheckHits()
+	{
+		MeshCache cache;
+
+		auto first = cache.GetMesh(MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 20));
+		auto second = cache.GetMesh(MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 20));
+		auto other = cache.GetMesh(MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 21));
+		TEST_CHECK(first == second);
+		TEST_CHECK(first != other);
+		TEST_CHECK(first->Vertices.size() == GeometryGenerator().CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20).Vertices.size());
+
+		MeshCache::Stats stats = cache.GetStats();
+		TEST_CHECK(stats.MeshHits == 1 && stats.MeshMisses == 2 && stats.Evictions == 0);
+		TEST_CHECK(stats.MeshBytes == MeshBytes(*first) + MeshBytes(*other));
+
+		cache.ResetStats();
+		stats = cache.GetStats();
+		TEST_CHECK(stats.MeshHits == 0 && stats.MeshMisses == 0);
+		TEST_CHECK(stats.MeshBytes == MeshBytes(*first) + MeshBytes(*other));
+
+		// Only the meshes nobody holds go.
+		first.reset();
+		second.reset();
+		cache.Clear();
+		stats = cache.GetStats();
+		TEST_CHECK(stats.Evictions == 1 && stats.MeshBytes == MeshBytes(*other));
+		TEST_CHECK(cache.GetMesh(MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 21)) == other);
+		cache.GetMesh(MeshKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 20));
+		TEST_CHECK(cache.GetStats().MeshMisses == 1);
+	}
+
+	void CheckLeastRecentlyUsed()
+	{
+		// Spheres of different radii and the same tessellation take the same bytes.
+		const MeshKey keys[3] =
+		{
+			MeshKey::Sphere(1.0f, 16, 16),
+			MeshKey::Sphere(2.0f, 16, 16),
+			MeshKey::Sphere(3.0f, 16, 16),
+		};
+
+		MeshCache cache;
+		size_t bytes = MeshBytes(*cache.GetMesh(keys[0]));
+		cache.GetMesh(keys[1]);
+		cache.GetMesh(keys[2]);
+		cache.GetMesh(keys[0]);
+
+		// keys[1] is now the least recently used.
+		cache.SetMemoryBudget(2*bytes);
+		MeshCache::Stats stats = cache.GetStats();
+		TEST_CHECK(stats.Evictions == 1 && stats.MeshBytes == 2*bytes);
+
+		cache.ResetStats();
+		cache.GetMesh(keys[0]);
+		cache.GetMesh(keys[2]);
+		TEST_CHECK(cache.GetStats().MeshHits == 2);
+
+		// Over budget, a new mesh pushes out keys[0], which keys[2] was touched after.
+		cache.GetMesh(keys[1]);
+		stats = cache.GetStats();
+		TEST_CHECK(stats.MeshMisses == 1 && stats.Evictions == 1 && stats.MeshBytes == 2*bytes);
+		cache.GetMesh(keys[2]);
+		TEST_CHECK(cache.GetStats().MeshHits == 3);
+
+		// Held meshes stay even when the budget cannot be met.
+		auto held = cache.GetMesh(keys[1]);
+		cache.SetMemoryBudget(0);
+		stats = cache.GetStats();
+		TEST_CHECK(stats.MeshBytes == bytes);
+		TEST_CHECK(cache.GetMesh(keys[1]) == held);
+	}
+
+	void CheckConcurrentRequests()
+	{
+		MeshCache cache;
+
+		// Every thread asks for the same large sphere, then for one of its own.
+		const std::uint32_t threadCount = 8;
+		std::vector<std::shared_ptr<const GeometryGenerator::MeshData>> shared(threadCount);
+		std::vector<std::shared_ptr<const GeometryGenerator::MeshData>> own(threadCount);
+		std::vector<std::thread> threads;
+		for(std::uint32_t t = 0; t < threadCount; ++t)
+		{
+			threads.emplace_back([&, t]()
+			{
+				shared[t] = cache.GetMesh(MeshKey::Sphere(1.0f, 256, 256));
+				own[t] = cache.GetMesh(MeshKey::Grid(1.0f, 1.0f, 2 + t, 2));
+			});
+		}
+		for(std::thread& thread : threads)
+			thread.join();
+
+		MeshCache::Stats stats = cache.GetStats();
+		TEST_CHECK(stats.MeshMisses == 1 + threadCount);
+		TEST_CHECK(stats.MeshHits == threadCount - 1);
+		for(std::uint32_t t = 0; t < threadCount; ++t)
+		{
+			TEST_CHECK(shared[t] != nullptr && shared[t] == shared[0]);
+			TEST_CHECK(own[t] != nullptr && own[t]->Vertices.size() == 2*(2 + t));
+		}
+	}
+
+	void CheckFailures()
+	{
+		MeshCache cache;
+
+		// A failed request leaves nothing behind, so the next one tries again.
+		MeshKey bad;
+		bad.Shape = (MeshShape)99;
+		TEST_CHECK(Throws(cache, bad));
+		TEST_CHECK(Throws(cache, bad));
+
+		MeshCache::Stats stats = cache.GetStats();
+		TEST_CHECK(stats.MeshMisses == 2 && stats.MeshHits == 0 && stats.MeshBytes == 0);
+	}
+}
+
+void TestMeshCache()
+{
+	MeshKey a = MeshKey::Box(1.0f, 2.0f, 3.0f, 1);
+	MeshKey b = MeshKey::Box(1.0f, 2.0f, 3.0f, 1);
+	MeshKey c = MeshKey::Box(1.0f, 2.0f, 3.0f, 2);
+	TEST_CHECK(a == b && MeshKeyHash()(a) == MeshKeyHash()(b));
+	TEST_CHECK(!(a == c));
+	TEST_CHECK(!(MeshKey::Sphere(1.0f, 4, 4) == MeshKey::Geosphere(1.0f, 4)));
+
+	CheckHits();
+	CheckLeastRecentlyUsed();
+	CheckConcurrentRequests();
+	CheckFailures();
+}
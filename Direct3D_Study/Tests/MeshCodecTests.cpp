@@ -0,0 +1,191 @@
+//***************************************************************************************
+// MeshCodecTests.cpp
+//***************************************************************************************
+
+#include "Tests.h"
+#include "../Common/MeshCodec.h"
+#include "../Common/GeometryGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	struct Shape
+	{
+		const char* Name;
+		GeometryGenerator::MeshData Mesh;
+	};
+
+	// Views the vertices of a shape either as GeometryGenerator::Vertex or as
+	// PackedVertex, with its 16- or 32-bit indices.
+	struct MeshView
+	{
+		const void* Vertices;
+		std::uint32_t VertexCount;
+		std::uint32_t VertexByteStride;
+		const void* Indices;
+		std::uint32_t IndexCount;
+		std::uint32_t IndexByteSize;
+
+		size_t RawBytes()const
+		{
+			return (size_t)VertexCount*VertexByteStride + (size_t)IndexCount*IndexByteSize;
+		}
+	};
+
+	MeshView View(const GeometryGenerator::MeshData& mesh, const GeometryGenerator::PackedMeshData* packed)
+	{
+		MeshView view;
+		view.Vertices = packed != nullptr ? (const void*)packed->Vertices.data() : (const void*)mesh.Vertices.data();
+		view.VertexCount = (std::uint32_t)mesh.Vertices.size();
+		view.VertexByteStride = packed != nullptr ? sizeof(GeometryGenerator::PackedVertex) : sizeof(GeometryGenerator::Vertex);
+		view.Indices = mesh.Uses16BitIndices() ? (const void*)mesh.Indices16.data() : (const void*)mesh.Indices32.data();
+		view.IndexCount = (std::uint32_t)mesh.IndexCount();
+		view.IndexByteSize = mesh.Uses16BitIndices() ? 2 : 4;
+		return view;
+	}
+
+	std::vector<std::uint8_t> Encode(const MeshView& view)
+	{
+		return MeshCodec::Encode(view.Vertices, view.VertexCount, view.VertexByteStride,
+			view.Indices, view.IndexCount, view.IndexByteSize);
+	}
+
+	// memcmp must not be given the null data() of an empty vector.
+	bool SameBytes(const std::vector<std::uint8_t>& bytes, const void* expected)
+	{
+		return bytes.empty() || std::memcmp(bytes.data(), expected, bytes.size()) == 0;
+	}
+
+	// Decodes data and compares it with view byte for byte.
+	bool RoundTrips(const MeshView& view, const std::vector<std::uint8_t>& data)
+	{
+		MeshCodec::Info info;
+		if(!MeshCodec::GetInfo(data.data(), data.size(), info) ||
+		   info.VertexCount != view.VertexCount || info.VertexByteStride != view.VertexByteStride ||
+		   info.IndexCount != view.IndexCount || info.IndexByteSize != view.IndexByteSize)
+			return false;
+
+		std::vector<std::uint8_t> vertices((size_t)view.VertexCount*view.VertexByteStride);
+		std::vector<std::uint8_t> indices((size_t)view.IndexCount*view.IndexByteSize);
+		return MeshCodec::Decode(data.data(), data.size(), vertices.data(), indices.data()) &&
+			SameBytes(vertices, view.Vertices) && SameBytes(indices, view.Indices);
+	}
+
+	bool Rejects(const std::vector<std::uint8_t>& data, const MeshView& view)
+	{
+		std::vector<std::uint8_t> vertices((size_t)view.VertexCount*view.VertexByteStride);
+		std::vector<std::uint8_t> indices((size_t)view.IndexCount*view.IndexByteSize);
+		return !MeshCodec::Decode(data.data(), data.size(), vertices.data(), indices.data());
+	}
+
+	double SecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void TestMeshCodec()
+{
+	GeometryGenerator geoGen;
+
+	// Partial blocks, several blocks and both index sizes.
+	Shape shapes[] =
+	{
+		{ "box",      geoGen.CreateBox(1.0f, 2.0f, 3.0f, 0) },
+		{ "sphere",   geoGen.CreateSphere(1.0f, 20, 20) },
+		{ "cylinder", geoGen.CreateCylinder(1.0f, 0.5f, 3.0f, 37, 11) },
+		{ "grid",     geoGen.CreateGrid(10.0f, 10.0f, 300, 300) },
+	};
+	TEST_CHECK(!shapes[3].Mesh.Uses16BitIndices());
+
+	for(Shape& shape : shapes)
+	{
+		GeometryGenerator::PackedMeshData packed = geoGen.PackMesh(shape.Mesh);
+		for(int pass = 0; pass < 2; ++pass)
+		{
+			MeshView view = View(shape.Mesh, pass == 0 ? nullptr : &packed);
+			std::vector<std::uint8_t> data = Encode(view);
+			TEST_CHECK(RoundTrips(view, data));
+
+			// Cut short anywhere in the header, offset table or blocks.
+			TEST_CHECK(Rejects(std::vector<std::uint8_t>(data.begin(), data.begin() + 16), view));
+			TEST_CHECK(Rejects(std::vector<std::uint8_t>(data.begin(), data.end() - 1), view));
+			TEST_CHECK(Rejects(std::vector<std::uint8_t>(data.begin(), data.begin() + data.size()/2), view));
+
+			std::vector<std::uint8_t> otherVersion = data;
+			otherVersion[4] ^= 0xff;
+			TEST_CHECK(Rejects(otherVersion, view));
+		}
+	}
+
+	// Nothing to code.
+	MeshView empty = {};
+	empty.VertexByteStride = 4;
+	empty.IndexByteSize = 2;
+	TEST_CHECK(RoundTrips(empty, Encode(empty)));
+
+	std::uint32_t vertex = 0;
+	std::uint16_t index = 0;
+	bool threw = false;
+	try { MeshCodec::Encode(&vertex, 1, 6, &index, 1, 2); }
+	catch(const std::invalid_argument&) { threw = true; }
+	TEST_CHECK(threw);
+
+	threw = false;
+	try { MeshCodec::Encode(&vertex, 1, 4, &index, 1, 1); }
+	catch(const std::invalid_argument&) { threw = true; }
+	TEST_CHECK(threw);
+}
+
+void BenchMeshCodec()
+{
+	const std::uint32_t iterations = 10;
+
+	GeometryGenerator geoGen;
+	Shape shapes[] =
+	{
+		{ "box",       geoGen.CreateBox(1.0f, 1.0f, 1.0f, 6) },
+		{ "sphere",    geoGen.CreateSphere(1.0f, 256, 256) },
+		{ "geosphere", geoGen.CreateGeosphere(1.0f, 7) },
+		{ "cylinder",  geoGen.CreateCylinder(1.0f, 0.5f, 3.0f, 256, 128) },
+		{ "grid",      geoGen.CreateGrid(100.0f, 100.0f, 512, 512) },
+	};
+
+	// Throughput is measured on the raw (decoded) byte size.
+	for(Shape& shape : shapes)
+	{
+		GeometryGenerator::PackedMeshData packed = geoGen.PackMesh(shape.Mesh);
+		for(int pass = 0; pass < 2; ++pass)
+		{
+			MeshView view = View(shape.Mesh, pass == 0 ? nullptr : &packed);
+
+			std::vector<std::uint8_t> data;
+			auto start = std::chrono::high_resolution_clock::now();
+			for(std::uint32_t i = 0; i < iterations; ++i)
+				data = Encode(view);
+			double encodeSeconds = SecondsSince(start);
+
+			std::vector<std::uint8_t> vertices((size_t)view.VertexCount*view.VertexByteStride);
+			std::vector<std::uint8_t> indices((size_t)view.IndexCount*view.IndexByteSize);
+			bool decoded = true;
+			start = std::chrono::high_resolution_clock::now();
+			for(std::uint32_t i = 0; i < iterations; ++i)
+				decoded &= MeshCodec::Decode(data.data(), data.size(), vertices.data(), indices.data());
+			double decodeSeconds = SecondsSince(start);
+
+			TEST_CHECK(decoded);
+			TEST_CHECK(SameBytes(vertices, view.Vertices));
+			TEST_CHECK(SameBytes(indices, view.Indices));
+
+			double gigabytes = (double)view.RawBytes()*iterations*1e-9;
+			std::printf("  %-10s %-12s %10zu -> %10zu bytes (%5.1f%%)  encode %6.2f GB/s  decode %6.2f GB/s\n",
+				shape.Name, pass == 0 ? "Vertex" : "PackedVertex", view.RawBytes(), data.size(),
+				100.0*data.size() / std::max<size_t>(view.RawBytes(), 1),
+				gigabytes / std::max(encodeSeconds, 1e-9), gigabytes / std::max(decodeSeconds, 1e-9));
+		}
+	}
+}
@@ -0,0 +1,176 @@
+//***************************************************************************************
+// MeshTopologyTests.cpp
+//***************************************************************************************
+
+#include "Tests.h"
+#include "../Common/MeshTopology.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	std::uint32_t BoundaryLoopCount(const MeshTopology& topology)
+	{
+		std::vector<std::uint32_t> corners;
+		std::vector<std::uint32_t> loopOffsets;
+		topology.GetBoundaryLoops(corners, loopOffsets);
+		return (std::uint32_t)loopOffsets.size() - 1;
+	}
+
+	// Rebuilds the adjacency with a map from directed edges to the corners facing them
+	// and compares every corner with it.
+	bool MatchesBruteForce(const MeshTopology& topology, const std::vector<std::uint32_t>& indices)
+	{
+		std::map<std::pair<std::uint32_t, std::uint32_t>, std::vector<std::uint32_t>> edges;
+		for(std::uint32_t c = 0; c < (std::uint32_t)indices.size(); ++c)
+		{
+			if(topology.IsDegenerateTriangle(MeshTopology::Triangle(c)))
+				continue;
+
+			std::uint32_t from = indices[MeshTopology::Next(c)];
+			std::uint32_t to = indices[MeshTopology::Prev(c)];
+			edges[std::make_pair(std::min(from, to), std::max(from, to))].push_back(c);
+		}
+
+		std::uint32_t boundaryEdges = 0;
+		std::uint32_t nonManifoldEdges = 0;
+		for(const auto& edge : edges)
+		{
+			const std::vector<std::uint32_t>& corners = edge.second;
+			bool linked = corners.size() == 2 &&
+				indices[MeshTopology::Next(corners[0])] == indices[MeshTopology::Prev(corners[1])];
+
+			if(corners.size() == 1)
+				boundaryEdges++;
+			else if(!linked)
+				nonManifoldEdges++;
+
+			for(size_t i = 0; i < corners.size(); ++i)
+			{
+				std::uint32_t expected = linked ? corners[1 - i] : MeshTopology::Invalid;
+				if(topology.Opposite(corners[i]) != expected)
+					return false;
+			}
+		}
+
+		for(std::uint32_t c = 0; c < (std::uint32_t)indices.size(); ++c)
+		{
+			if(topology.CornerVertex(c) != indices[c])
+				return false;
+			if(topology.IsDegenerateTriangle(MeshTopology::Triangle(c)) && topology.Opposite(c) != MeshTopology::Invalid)
+				return false;
+		}
+
+		return topology.EdgeCount() == (std::uint32_t)edges.size() &&
+			topology.BoundaryEdgeCount() == boundaryEdges &&
+			topology.NonManifoldEdgeCount() == nonManifoldEdges;
+	}
+
+	std::vector<std::uint32_t> Indices(const GeometryGenerator::MeshData& mesh)
+	{
+		if(!mesh.Uses16BitIndices())
+			return mesh.Indices32;
+		return std::vector<std::uint32_t>(mesh.Indices16.begin(), mesh.Indices16.end());
+	}
+
+	void CheckShape(const GeometryGenerator::MeshData& mesh, std::uint32_t boundaryLoops)
+	{
+		MeshTopology topology(mesh);
+		TEST_CHECK(topology.VertexCount() == (std::uint32_t)mesh.Vertices.size());
+		TEST_CHECK(topology.CornerCount() == (std::uint32_t)mesh.IndexCount());
+		TEST_CHECK(MatchesBruteForce(topology, Indices(mesh)));
+		TEST_CHECK(topology.NonManifoldEdgeCount() == 0);
+		TEST_CHECK(BoundaryLoopCount(topology) == boundaryLoops);
+		TEST_CHECK(topology.IsClosedManifold() == (boundaryLoops == 0));
+	}
+
+	bool Throws(const std::vector<std::uint32_t>& indices, std::uint32_t vertexCount)
+	{
+		try
+		{
+			MeshTopology topology(indices.data(), indices.size(), vertexCount);
+		}
+		catch(const std::invalid_argument&)
+		{
+			return true;
+		}
+		return false;
+	}
+}
+
+void TestMeshTopology()
+{
+	GeometryGenerator geoGen;
+
+	// The spheres and cylinders are cut open along the texture seam, and every box face
+	// and cylinder cap has its own vertices.  The boundaries must not change between
+	// the tessellations the levels of detail use.  Subdivide gives every triangle its
+	// own midpoints, so each subdivision after the first splits a box into four times
+	// as many patches.
+	CheckShape(geoGen.CreateBox(1.0f, 2.0f, 3.0f, 0), 6);
+	CheckShape(geoGen.CreateBox(1.0f, 2.0f, 3.0f, 1), 12);
+	CheckShape(geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3), 192);
+	CheckShape(geoGen.CreateGrid(20.0f, 30.0f, 60, 40), 1);
+	CheckShape(geoGen.CreateGeosphere(1.0f, 0), 0);
+	CheckShape(geoGen.CreateGeosphere(1.0f, 4), 0);
+
+	const std::uint32_t tessellations[][2] = { { 20, 20 }, { 10, 10 }, { 6, 4 }, { 10, 2 }, { 6, 1 }, { 3, 2 } };
+	for(const auto& t : tessellations)
+	{
+		if(t[1] >= 2)
+			CheckShape(geoGen.CreateSphere(0.5f, t[0], t[1]), 1);
+		CheckShape(geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, t[0], t[1]), 3);
+	}
+
+	// Enough corners for the radix sort to run in several blocks and passes.
+	CheckShape(geoGen.CreateGrid(100.0f, 100.0f, 700, 700), 1);
+
+	// Every interior vertex of a grid has six neighbors, in fan order.
+	MeshTopology grid(geoGen.CreateGrid(4.0f, 4.0f, 5, 5));
+	std::vector<std::uint32_t> ring;
+	grid.GetOneRing(12, ring);
+	TEST_CHECK(ring.size() == 6);
+	TEST_CHECK(!grid.IsBoundaryVertex(12));
+	TEST_CHECK(grid.IsBoundaryVertex(0));
+	for(size_t i = 0; i < ring.size(); ++i)
+	{
+		bool adjacent = false;
+		grid.ForEachCornerAroundVertex(12, [&](std::uint32_t corner)
+		{
+			adjacent |= grid.CornerVertex(MeshTopology::Next(corner)) == ring[i] &&
+				grid.CornerVertex(MeshTopology::Prev(corner)) == ring[(i + 1) % ring.size()];
+		});
+		TEST_CHECK(adjacent);
+	}
+
+	// A tetrahedron, then a third triangle on one of its edges, a flipped triangle
+	// and a degenerate one.
+	std::vector<std::uint32_t> indices = { 0, 1, 2, 0, 3, 1, 1, 3, 2, 2, 3, 0 };
+	MeshTopology tetrahedron(indices.data(), indices.size(), 4);
+	TEST_CHECK(tetrahedron.IsClosedManifold());
+	TEST_CHECK(tetrahedron.EdgeCount() == 6);
+	TEST_CHECK(MatchesBruteForce(tetrahedron, indices));
+
+	indices.insert(indices.end(), { 0, 1, 4, 5, 6, 2, 5, 6, 6 });
+	MeshTopology broken(indices.data(), indices.size(), 7);
+	TEST_CHECK(MatchesBruteForce(broken, indices));
+	TEST_CHECK(broken.NonManifoldEdgeCount() == 1);
+	TEST_CHECK(broken.IsDegenerateTriangle(6));
+	TEST_CHECK(!broken.IsBoundaryEdge(18));
+
+	std::vector<std::uint32_t> flipped = { 0, 1, 2, 0, 1, 3 };
+	MeshTopology inconsistent(flipped.data(), flipped.size(), 4);
+	TEST_CHECK(inconsistent.NonManifoldEdgeCount() == 1);
+	TEST_CHECK(inconsistent.BoundaryEdgeCount() == 4);
+
+	std::vector<std::uint32_t> empty;
+	MeshTopology none(empty.data(), 0, 3);
+	TEST_CHECK(none.EdgeCount() == 0 && BoundaryLoopCount(none) == 0);
+	TEST_CHECK(none.VertexCorner(0) == MeshTopology::Invalid);
+
+	TEST_CHECK(Throws({ 0, 1 }, 3));
+	TEST_CHECK(Throws({ 0, 1, 3 }, 3));
+}
@@ -0,0 +1,241 @@
+//***************************************************************************************
+// ParallelRecorderTests.cpp
+//***************************************************************************************
+
+#include "Tests.h"
+#include "../Common/ParallelRecorder.h"
+#include "../Common/CommandStream.h"
+#include "../Common/ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Records one draw per item into the chunk's own stream, with the item index as
+	// the start instance, and remembers the range each chunk was given.
+	class StreamRecorder : public ChunkRecorder
+	{
+	public:
+		explicit StreamRecorder(std::uint32_t maxChunks)
+		{
+			for(std::uint32_t i = 0; i < maxChunks; ++i)
+				mStreams.push_back(std::make_unique<CommandStream>());
+			mRecordCounts.assign(maxChunks, 0);
+			mBegins.assign(maxChunks, 0);
+			mEnds.assign(maxChunks, 0);
+		}
+
+		void RecordChunk(std::uint32_t chunk, std::uint32_t chunkCount, std::uint32_t begin,
+			std::uint32_t end)override
+		{
+			mRecordCounts[chunk]++;
+			mBegins[chunk] = begin;
+			mEnds[chunk] = end;
+
+			if(mThrowing && chunk % 3 == 2)
+				throw std::runtime_error("chunk " + std::to_string(chunk));
+
+			CommandStream& stream = *mStreams[chunk];
+			stream.Reset();
+			for(std::uint32_t i = begin; i < end; ++i)
+				stream.DrawIndexedInstanced(3, 1, 0, 0, i);
+		}
+
+		std::vector<std::unique_ptr<CommandStream>> mStreams;
+		std::vector<std::uint32_t> mRecordCounts;
+		std::vector<std::uint32_t> mBegins;
+		std::vector<std::uint32_t> mEnds;
+
+		// Chunks 2, 5, ... throw.
+		bool mThrowing = false;
+	};
+
+	// Collects the start instances of the draws in replay order.
+	class OrderBackend
+	{
+	public:
+		template<typename Command>
+		void operator()(const Command&)
+		{
+		}
+
+		void operator()(const DrawIndexedInstancedCommand& command)
+		{
+			Items.push_back(command.StartInstanceLocation);
+		}
+
+		std::vector<std::uint32_t> Items;
+	};
+
+	void CheckRecord(std::uint32_t maxChunks, std::uint32_t minChunkItems, std::uint32_t itemCount)
+	{
+		ParallelRecorder recorder(maxChunks, minChunkItems);
+		StreamRecorder chunks(maxChunks);
+
+		std::uint32_t expectedCount = std::min<std::uint32_t>(std::max<std::uint32_t>(itemCount/minChunkItems, 1), maxChunks);
+		std::uint32_t chunkCount = recorder.Record(chunks, itemCount);
+		TEST_CHECK(chunkCount == expectedCount);
+		TEST_CHECK(chunkCount == recorder.ChunkCount(itemCount));
+
+		// Every chunk is recorded once, the ranges follow each other without gaps, and
+		// their sizes differ by one item at most.
+		std::uint32_t coveredEnd = 0;
+		std::uint32_t minSize = 0xffffffff;
+		std::uint32_t maxSize = 0;
+		for(std::uint32_t i = 0; i < maxChunks; ++i)
+		{
+			TEST_CHECK(chunks.mRecordCounts[i] == (i < chunkCount ? 1u : 0u));
+			if(i >= chunkCount)
+				continue;
+
+			TEST_CHECK(chunks.mBegins[i] == coveredEnd);
+			TEST_CHECK(chunks.mEnds[i] >= chunks.mBegins[i]);
+			coveredEnd = chunks.mEnds[i];
+
+			minSize = std::min(minSize, chunks.mEnds[i] - chunks.mBegins[i]);
+			maxSize = std::max(maxSize, chunks.mEnds[i] - chunks.mBegins[i]);
+		}
+		TEST_CHECK(coveredEnd == itemCount);
+		TEST_CHECK(maxSize - minSize <= 1);
+
+		// Replaying the streams in chunk order draws every item once, in order.
+		OrderBackend backend;
+		for(std::uint32_t i = 0; i < chunkCount; ++i)
+			chunks.mStreams[i]->Replay(backend);
+
+		bool inOrder = backend.Items.size() == itemCount;
+		for(std::uint32_t i = 0; inOrder && i < itemCount; ++i)
+			inOrder = backend.Items[i] == i;
+		TEST_CHECK(inOrder);
+	}
+}
+
+void TestParallelRecorder()
+{
+	const std::uint32_t itemCounts[] = { 0, 1, 22, 255, 256, 257, 511, 512, 2000, 4096, 4099, 100000 };
+	for(std::uint32_t itemCount : itemCounts)
+	{
+		CheckRecord(1, 256, itemCount);
+		CheckRecord(8, 256, itemCount);
+		CheckRecord(16, 1, itemCount);
+		CheckRecord(64, 64, itemCount);
+	}
+
+	// The exception of the lowest throwing chunk is rethrown, after every chunk ran.
+	{
+		ParallelRecorder recorder(8, 16);
+		StreamRecorder chunks(8);
+		chunks.mThrowing = true;
+
+		std::string message;
+		try
+		{
+			recorder.Record(chunks, 1000);
+		}
+		catch(const std::runtime_error& e)
+		{
+			message = e.what();
+		}
+		TEST_CHECK(message == "chunk 2");
+
+		bool allRecorded = true;
+		for(std::uint32_t count : chunks.mRecordCounts)
+			allRecorded &= count == 1;
+		TEST_CHECK(allRecorded);
+	}
+
+	bool threw = false;
+	try
+	{
+		ParallelRecorder recorder(0);
+	}
+	catch(const std::invalid_argument&)
+	{
+		threw = true;
+	}
+	TEST_CHECK(threw);
+}
+
+namespace
+{
+	// Records a pass the way ShapesApp does when it draws every item by itself: the
+	// pass state at the start of each chunk, then the input assembler state, the
+	// object constants and a draw per item.  Each chunk is replayed into its own
+	// NullCommandBackend, where ShapesApp replays into the chunk's command list.
+	class FrameRecorder : public ChunkRecorder
+	{
+	public:
+		explicit FrameRecorder(std::uint32_t maxChunks)
+			: mBackends(maxChunks)
+		{
+			for(std::uint32_t i = 0; i < maxChunks; ++i)
+				mStreams.push_back(std::make_unique<CommandStream>());
+		}
+
+		void RecordChunk(std::uint32_t chunk, std::uint32_t chunkCount, std::uint32_t begin,
+			std::uint32_t end)override
+		{
+			CommandStream& stream = *mStreams[chunk];
+			stream.Reset();
+
+			stream.SetViewport(0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f);
+			stream.SetScissorRect(0, 0, 1280, 720);
+			stream.SetRenderTarget(0x1000, 0x2000);
+			stream.SetDescriptorHeap(nullptr);
+			stream.SetRootSignature(nullptr);
+			stream.SetPipelineState(nullptr);
+			stream.SetRootDescriptorTable(1, 0x3000);
+
+			// Sorted items: runs of 64 share a mesh.
+			for(std::uint32_t i = begin; i < end; ++i)
+			{
+				std::uint64_t mesh = i/64;
+				stream.SetVertexBuffer(0, 0x100000*mesh, 44*482, 44);
+				stream.SetIndexBuffer(0x100000*mesh + 0x80000, 2*2280, 57);
+				stream.SetPrimitiveTopology(4);
+				stream.SetRootDescriptorTable(0, 0x10000 + 32*i);
+				stream.DrawIndexedInstanced(2280, 1, 0, 0, 0);
+			}
+
+			mBackends[chunk] = NullCommandBackend();
+			stream.Replay(mBackends[chunk]);
+		}
+
+		std::vector<std::unique_ptr<CommandStream>> mStreams;
+		std::vector<NullCommandBackend> mBackends;
+	};
+}
+
+void BenchParallelRecorder()
+{
+	// Enough items for 16 chunks of ParallelRecorder's default 256 items.
+	const std::uint32_t itemCount = 4096;
+	const int frameCount = 200;
+
+	std::uint32_t threadCounts[] = { 1, ThreadPool::Default().ThreadCount() };
+	for(std::uint32_t maxChunks : threadCounts)
+	{
+		ParallelRecorder recorder(maxChunks);
+		FrameRecorder frame(maxChunks);
+
+		std::uint32_t chunkCount = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for(int i = 0; i < frameCount; ++i)
+			chunkCount = recorder.Record(frame, itemCount);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+		std::uint32_t drawCount = 0;
+		for(std::uint32_t i = 0; i < chunkCount; ++i)
+			drawCount += frame.mBackends[i].Count(CommandType::DrawIndexedInstanced);
+		TEST_CHECK(drawCount == itemCount);
+
+		std::printf("  %u items in %2u chunks: %7.3f ms per frame\n", itemCount, chunkCount,
+			elapsed.count()/frameCount);
+	}
+}
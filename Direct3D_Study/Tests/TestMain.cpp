@@ -0,0 +1,75 @@
+//***************************************************************************************
+// TestMain.cpp
+//***************************************************************************************
+
+#include "Tests.h"
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace
+{
+	int gFailureCount = 0;
+
+	struct NamedFunction
+	{
+		const char* Name;
+		void (*Function)();
+	};
+
+	const NamedFunction gTests[] =
+	{
+		{ "BoundingVolumeHierarchy", TestBoundingVolumeHierarchy },
+		{ "GeometryGenerator", TestGeometryGenerator },
+		{ "MeshCache", TestMeshCache },
+		{ "MeshCodec", TestMeshCodec },
+		{ "MeshTopology", TestMeshTopology },
+		{ "ParallelRecorder", TestParallelRecorder },
+	};
+
+	const NamedFunction gBenchmarks[] =
+	{
+		{ "BoundingVolumeHierarchy", BenchBoundingVolumeHierarchy },
+		{ "MeshCodec", BenchMeshCodec },
+		{ "ParallelRecorder", BenchParallelRecorder },
+	};
+
+	void Run(const NamedFunction* functions, size_t count)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			int failuresBefore = gFailureCount;
+			std::printf("%s\n", functions[i].Name);
+
+			try
+			{
+				functions[i].Function();
+			}
+			catch(const std::exception& e)
+			{
+				std::printf("  threw: %s\n", e.what());
+				gFailureCount++;
+			}
+
+			if(gFailureCount != failuresBefore)
+				std::printf("  FAILED\n");
+		}
+	}
+}
+
+void ReportFailure(const char* file, int line, const char* expression)
+{
+	std::printf("  %s(%d): check failed: %s\n", file, line, expression);
+	gFailureCount++;
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc > 1 && std::strcmp(argv[1], "-bench") == 0)
+		Run(gBenchmarks, sizeof(gBenchmarks)/sizeof(gBenchmarks[0]));
+	else
+		Run(gTests, sizeof(gTests)/sizeof(gTests[0]));
+
+	std::printf(gFailureCount == 0 ? "All passed.\n" : "%d checks failed.\n", gFailureCount);
+	return gFailureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+//***************************************************************************************
+// Tests.h
+//
+// Headless tests and benchmarks of the Common modules.  Tests.exe runs the tests, and
+// Tests.exe -bench the benchmarks, which also check their results.  Both print to
+// the console and exit with 1 if any check failed.
+//***************************************************************************************
+
+#pragma once
+
+// Prints the failed expression and makes the run fail.
+void ReportFailure(const char* file, int line, const char* expression);
+
+#define TEST_CHECK(expression) \
+	((expression) ? (void)0 : ReportFailure(__FILE__, __LINE__, #expression))
+
+void TestBoundingVolumeHierarchy();
+void TestGeometryGenerator();
+void TestMeshCache();
+void TestMeshCodec();
+void TestMeshTopology();
+void TestParallelRecorder();
+
+void BenchBoundingVolumeHierarchy();
+void BenchMeshCodec();
+void BenchParallelRecorder();